@@ -0,0 +1,103 @@
+// skinning_bench.cpp
+// Standalone timing of the CPU skinning kernels, outside the engine. Each file's first skinned
+// primitive is posed 37% into its first clip, then skinned with the scalar reference
+// (SkinVerticesScalar) and with the SIMD kernel (SkinVertices). Prints the best average of
+// several rounds for each, and the largest position and normal difference between them.
+//   The extension sources are compiled in directly, so this builds against the Defold SDK headers
+//   and libraries (dmsdk, dlib, script and Lua), from the repository root:
+//     g++ -std=c++11 -O2 -I$DEFOLD_SDK/include -Icgltf_lib/include -Icgltf_lib/include/cgltf
+//         -Icgltf_lib/src bench/skinning_bench.cpp cgltf_lib/src/morph.cpp cgltf_lib/src/jobs.cpp
+//         -L$DEFOLD_SDK/lib/<platform> -lscript -ldlib -lluajit-5.1 -lpthread -o skinning_bench
+//     ./skinning_bench test_data/CesiumMan/glTF/CesiumMan.gltf test_data/Fox/glTF/Fox.gltf
+//   example/skinning_bench.collection runs the same comparison in the engine on any target.
+
+#include "cgltf_lib.h"
+
+#define CGLTF_IMPLEMENTATION
+#include "cgltf/cgltf.h"
+
+#include "../cgltf_lib/src/animation.cpp"
+#include "../cgltf_lib/src/animpool.cpp"
+#include "../cgltf_lib/src/skinning.cpp"
+
+#include <chrono>
+
+#define BENCH_ITERATIONS    2000
+#define BENCH_ROUNDS        5
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double Microseconds(BenchClock::time_point a, BenchClock::time_point b, int iterations)
+{
+    return std::chrono::duration<double, std::micro>(b - a).count() / iterations;
+}
+
+static bool BenchFile(const char *path)
+{
+    cgltf_options options = {};
+    cgltf_data *data = nullptr;
+    if(cgltf_parse_file(&options, path, &data) != cgltf_result_success || cgltf_load_buffers(&options, data, path) != cgltf_result_success) {
+        printf("[Error] %s: could not load\n", path);
+        cgltf_free(data);
+        return false;
+    }
+
+    AnimModel *model = GetAnimModel(data);
+    SkinModel *skin_model = GetSkinModel(data);
+    const cgltf_primitive *prim = nullptr;
+    for(cgltf_size n=0; n<data->nodes_count && prim == nullptr; n++) {
+        if(data->nodes[n].skin && data->nodes[n].mesh) prim = &data->nodes[n].mesh->primitives[0];
+    }
+    if(model->clips.empty() || skin_model->skins.empty() || prim == nullptr) {
+        printf("[Error] %s: needs a clip and a skinned mesh\n", path);
+        cgltf_free(data);
+        return false;
+    }
+
+    std::vector<float> trs = model->rest, weights = model->rest_weights;
+    SampleClip(model, model->clips[0], model->clips[0].duration * 0.37f, 1.0f, trs.data(), weights.data());
+    SkinJoints &skin = skin_model->skins[0];
+    std::vector<float> palette(skin.joints.size() * 12);
+    ComputePalette(skin, trs.data(), palette.data());
+
+    SkinMesh *mesh = GetSkinMesh(prim);
+    mesh->source_position = mesh->position.data();
+    mesh->source_normal = mesh->normal.empty() ? nullptr : mesh->normal.data();
+
+    double scalar = 1e30, simd = 1e30;
+    std::vector<float> reference;
+    for(int round=0; round<BENCH_ROUNDS; round++) {
+        BenchClock::time_point a = BenchClock::now();
+        for(int i=0; i<BENCH_ITERATIONS; i++) SkinVerticesScalar(*mesh, palette.data(), 0, mesh->vertices);
+        BenchClock::time_point b = BenchClock::now();
+        reference = mesh->skinned;
+        for(int i=0; i<BENCH_ITERATIONS; i++) SkinVertices(*mesh, palette.data(), 0, mesh->padded);
+        BenchClock::time_point c = BenchClock::now();
+        scalar = std::min(scalar, Microseconds(a, b, BENCH_ITERATIONS));
+        simd = std::min(simd, Microseconds(b, c, BENCH_ITERATIONS));
+    }
+
+    float error = 0.0f, normal_error = 0.0f;
+    for(uint32_t v=0; v<mesh->vertices; v++) {
+        for(int k=0; k<3; k++) {
+            error = std::max(error, fabsf(mesh->skinned[v * 8 + k] - reference[v * 8 + k]));
+            normal_error = std::max(normal_error, fabsf(mesh->skinned[v * 8 + 4 + k] - reference[v * 8 + 4 + k]));
+        }
+    }
+    printf("%s: %u vertices, scalar %.1f us, simd %.1f us, max difference %g (normals %g)\n", path, mesh->vertices, scalar, simd, error, normal_error);
+    SkinFree(data);
+    AnimationFree(data);
+    cgltf_free(data);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        printf("usage: skinning_bench file.gltf ...\n");
+        return 1;
+    }
+    bool ok = true;
+    for(int i=1; i<argc; i++) ok = BenchFile(argv[i]) && ok;
+    return ok ? 0 : 1;
+}
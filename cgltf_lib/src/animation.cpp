@@ -0,0 +1,494 @@
+// animation.cpp
+// glTF animations, evaluated natively.
+//   A model's clips are unpacked from their accessors once (keyframe times and values as plain
+//   floats, whatever the accessor encoding). A pose is the flat local TRS of every node
+//   (POSE_STRIDE floats: translation xyz, rotation xyzw, scale xyz) plus the morph target
+//   weights of every node, starting from the rest pose. animation_sample evaluates every channel
+//   of a clip straight into a pose: keyframes are binary searched, values interpolated 4 floats
+//   at a time (LINEAR, STEP and CUBICSPLINE, rotations slerped).
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <math.h>
+#include <string.h>
+#include <map>
+#include <algorithm>
+
+#define POSE_STREAM     "trs"
+
+static std::map<cgltf_data*, AnimModel*>   anim_models;
+
+static const int path_offset[ANIM_PATH_WEIGHTS] = { 0, 3, 7 };
+
+// Rotation (quaternion xyzw) of a rotation-scale matrix's normalized columns
+static void QuatFromColumns(const float *c0, const float *c1, const float *c2, float *q)
+{
+    float trace = c0[0] + c1[1] + c2[2];
+    if(trace > 0.0f) {
+        float s = sqrtf(trace + 1.0f) * 2.0f;
+        q[3] = 0.25f * s;
+        q[0] = (c1[2] - c2[1]) / s;
+        q[1] = (c2[0] - c0[2]) / s;
+        q[2] = (c0[1] - c1[0]) / s;
+    }
+    else if(c0[0] > c1[1] && c0[0] > c2[2]) {
+        float s = sqrtf(1.0f + c0[0] - c1[1] - c2[2]) * 2.0f;
+        q[3] = (c1[2] - c2[1]) / s;
+        q[0] = 0.25f * s;
+        q[1] = (c1[0] + c0[1]) / s;
+        q[2] = (c2[0] + c0[2]) / s;
+    }
+    else if(c1[1] > c2[2]) {
+        float s = sqrtf(1.0f + c1[1] - c0[0] - c2[2]) * 2.0f;
+        q[3] = (c2[0] - c0[2]) / s;
+        q[0] = (c1[0] + c0[1]) / s;
+        q[1] = 0.25f * s;
+        q[2] = (c2[1] + c1[2]) / s;
+    }
+    else {
+        float s = sqrtf(1.0f + c2[2] - c0[0] - c1[1]) * 2.0f;
+        q[3] = (c0[1] - c1[0]) / s;
+        q[0] = (c2[0] + c0[2]) / s;
+        q[1] = (c2[1] + c1[2]) / s;
+        q[2] = 0.25f * s;
+    }
+}
+
+// Node's local transform as translation, rotation, scale (matrices are decomposed)
+static void NodeRestTRS(const cgltf_node *node, float *trs)
+{
+    if(node->has_matrix) {
+        const float *m = node->matrix;
+        float c[3][3];
+        for(int i=0; i<3; i++) {
+            float len = sqrtf(m[i * 4] * m[i * 4] + m[i * 4 + 1] * m[i * 4 + 1] + m[i * 4 + 2] * m[i * 4 + 2]);
+            trs[7 + i] = len;
+            for(int k=0; k<3; k++) c[i][k] = len > 0.0f ? m[i * 4 + k] / len : 0.0f;
+        }
+        // A mirrored matrix keeps a proper rotation, with x scale negative
+        float det = c[0][0] * (c[1][1] * c[2][2] - c[2][1] * c[1][2]) - c[1][0] * (c[0][1] * c[2][2] - c[2][1] * c[0][2])
+            + c[2][0] * (c[0][1] * c[1][2] - c[1][1] * c[0][2]);
+        if(det < 0.0f) {
+            trs[7] = -trs[7];
+            for(int k=0; k<3; k++) c[0][k] = -c[0][k];
+        }
+        trs[0] = m[12];
+        trs[1] = m[13];
+        trs[2] = m[14];
+        QuatFromColumns(c[0], c[1], c[2], trs + 3);
+        return;
+    }
+    static const float identity[POSE_STRIDE] = { 0, 0, 0, 0, 0, 0, 1, 1, 1, 1 };
+    memcpy(trs, identity, sizeof(identity));
+    if(node->has_translation) memcpy(trs, node->translation, 3 * sizeof(float));
+    if(node->has_rotation) memcpy(trs + 3, node->rotation, 4 * sizeof(float));
+    if(node->has_scale) memcpy(trs + 7, node->scale, 3 * sizeof(float));
+}
+
+// Morph target count of the node's mesh, 0 without one
+static int NodeWeightCount(const cgltf_node *node)
+{
+    if(node->mesh == nullptr || node->mesh->primitives_count == 0) return 0;
+    return (int)node->mesh->primitives[0].targets_count;
+}
+
+static bool LoadSampler(const cgltf_animation_sampler *src, int path, AnimSampler &out)
+{
+    const cgltf_accessor *input = src->input, *output = src->output;
+    if(input == nullptr || output == nullptr || input->count == 0) return false;
+    out.interpolation = src->interpolation;
+    out.times.resize(input->count);
+    if(cgltf_accessor_unpack_floats(input, out.times.data(), input->count) != input->count) return false;
+
+    cgltf_size floats = output->count * cgltf_num_components(output->type);
+    cgltf_size values_per_key = src->interpolation == cgltf_interpolation_type_cubic_spline ? 3 : 1;
+    if(floats == 0 || floats % (input->count * values_per_key) != 0) return false;
+    out.components = (int)(floats / (input->count * values_per_key));
+    if(out.components > ANIM_MAX_COMPONENTS) return false;
+    if(path == ANIM_PATH_ROTATION && out.components != 4) return false;
+    if((path == ANIM_PATH_TRANSLATION || path == ANIM_PATH_SCALE) && out.components != 3) return false;
+
+    // Padded so 4 wide loads of the last value stay inside
+    out.values.assign(floats + 4, 0.0f);
+    return cgltf_accessor_unpack_floats(output, out.values.data(), floats) == floats;
+}
+
+static int ChannelPath(cgltf_animation_path_type path)
+{
+    switch(path) {
+        case cgltf_animation_path_type_translation: return ANIM_PATH_TRANSLATION;
+        case cgltf_animation_path_type_rotation:    return ANIM_PATH_ROTATION;
+        case cgltf_animation_path_type_scale:       return ANIM_PATH_SCALE;
+        case cgltf_animation_path_type_weights:     return ANIM_PATH_WEIGHTS;
+        default:                                    return -1;
+    }
+}
+
+static void LoadClip(AnimModel *model, const cgltf_animation *anim, AnimClip &clip)
+{
+    cgltf_data *data = model->data;
+    clip.name = anim->name ? anim->name : "";
+    clip.duration = 0.0f;
+    std::vector<int> sampler_index(anim->samplers_count, -1);
+    std::vector<const cgltf_accessor*> inputs;
+    for(cgltf_size c=0; c<anim->channels_count; c++) {
+        const cgltf_animation_channel *src = &anim->channels[c];
+        int path = ChannelPath(src->target_path);
+        if(src->target_node == nullptr || src->sampler == nullptr || path < 0) continue;
+        int node = (int)cgltf_node_index(data, src->target_node);
+        if(path == ANIM_PATH_WEIGHTS && model->weight_count[node] == 0) continue;
+
+        cgltf_size s = src->sampler - anim->samplers;
+        if(sampler_index[s] < 0) {
+            AnimSampler sampler;
+            if(!LoadSampler(src->sampler, path, sampler)) {
+                printf("[Error] Animation %s: channel %d has unusable keyframes\n", clip.name.c_str(), (int)c);
+                continue;
+            }
+            clip.duration = std::max(clip.duration, sampler.times.back());
+            sampler.track = (int)(std::find(inputs.begin(), inputs.end(), src->sampler->input) - inputs.begin());
+            if(sampler.track == (int)inputs.size()) {
+                inputs.push_back(src->sampler->input);
+                clip.tracks.push_back((int)clip.samplers.size());
+            }
+            sampler_index[s] = (int)clip.samplers.size();
+            clip.samplers.push_back(sampler);
+        }
+        AnimChannel channel = { node, path, sampler_index[s] };
+        clip.channels.push_back(channel);
+    }
+}
+
+// The model's clips and rest pose, unpacked on first use
+AnimModel *GetAnimModel(cgltf_data *data)
+{
+    std::map<cgltf_data*, AnimModel*>::iterator it = anim_models.find(data);
+    if(it != anim_models.end()) return it->second;
+
+    AnimModel *model = new AnimModel;
+    model->data = data;
+    model->nodes = (int)data->nodes_count;
+    model->rest.resize(data->nodes_count * POSE_STRIDE);
+    model->weight_offset.assign(data->nodes_count, -1);
+    model->weight_count.assign(data->nodes_count, 0);
+    for(cgltf_size n=0; n<data->nodes_count; n++) {
+        const cgltf_node *node = &data->nodes[n];
+        NodeRestTRS(node, &model->rest[n * POSE_STRIDE]);
+        int count = NodeWeightCount(node);
+        if(count == 0) continue;
+        model->weight_offset[n] = (int)model->rest_weights.size();
+        model->weight_count[n] = count;
+        const cgltf_float *defaults = node->weights_count ? node->weights : (node->mesh->weights_count ? node->mesh->weights : nullptr);
+        for(int w=0; w<count; w++) model->rest_weights.push_back(defaults && w < (int)(node->weights_count ? node->weights_count : node->mesh->weights_count) ? defaults[w] : 0.0f);
+    }
+
+    model->clips.resize(data->animations_count);
+    for(cgltf_size a=0; a<data->animations_count; a++) LoadClip(model, &data->animations[a], model->clips[a]);
+    anim_models[data] = model;
+    return model;
+}
+
+void AnimationFree(cgltf_data *data)
+{
+    std::map<cgltf_data*, AnimModel*>::iterator it = anim_models.find(data);
+    if(it == anim_models.end()) return;
+    for(size_t p=0; p<it->second->poses.size(); p++) {
+        AnimPoolRemovePose(it->second->poses[p]);
+        delete it->second->poses[p];
+    }
+    delete it->second;
+    anim_models.erase(it);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Evaluation
+
+// Interval of time: key k and the fraction t to key k + 1. t is 0 before the first key and
+// after the last one (k is then that key).
+int FindKeyframe(const std::vector<float> &times, float time, float *t)
+{
+    *t = 0.0f;
+    size_t count = times.size();
+    if(count < 2 || time <= times[0]) return 0;
+    if(time >= times[count - 1]) return (int)count - 1;
+    int k = (int)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+    float span = times[k + 1] - times[k];
+    *t = span > 0.0f ? (time - times[k]) / span : 0.0f;
+    return k;
+}
+
+// out = a + (b - a) * t, n floats rounded up to 4 (out and the inputs are padded)
+static void LerpValues(const float *a, const float *b, float t, int n, float *out)
+{
+    simd4f vt = simd_splat(t);
+    for(int i=0; i<n; i+=4) {
+        simd4f va = simd_load(a + i);
+        simd_store(out + i, simd_madd(simd_sub(simd_load(b + i), va), vt, va));
+    }
+}
+
+// Cubic Hermite spline between v0 and v1, with v0's out tangent b0 and v1's in tangent a1
+static void HermiteValues(const float *v0, const float *b0, const float *v1, const float *a1, float span, float t, int n, float *out)
+{
+    float t2 = t * t, t3 = t2 * t;
+    simd4f h00 = simd_splat(2.0f * t3 - 3.0f * t2 + 1.0f);
+    simd4f h10 = simd_splat((t3 - 2.0f * t2 + t) * span);
+    simd4f h01 = simd_splat(-2.0f * t3 + 3.0f * t2);
+    simd4f h11 = simd_splat((t3 - t2) * span);
+    for(int i=0; i<n; i+=4) {
+        simd4f r = simd_mul(simd_load(v0 + i), h00);
+        r = simd_madd(simd_load(b0 + i), h10, r);
+        r = simd_madd(simd_load(v1 + i), h01, r);
+        simd_store(out + i, simd_madd(simd_load(a1 + i), h11, r));
+    }
+}
+
+static void NormalizeQuat(float *q)
+{
+    float len = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    if(len <= 0.0f) {
+        q[0] = q[1] = q[2] = 0.0f;
+        q[3] = 1.0f;
+        return;
+    }
+    simd_store(q, simd_mul(simd_load(q), simd_splat(1.0f / len)));
+}
+
+// Slerp as an nlerp with t corrected for the angle between the quaternions (|dot| d): a fitted
+// polynomial, within 4e-4 of slerp (4e-5 for keys under 90 degrees apart) without its trig.
+// animpool.cpp has the same 4 instances at a time.
+float SlerpFactor(float t, float d)
+{
+    float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+    float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+    float k = a * (t - 0.5f) * (t - 0.5f) + b;
+    return t + t * (t - 0.5f) * (t - 1.0f) * k;
+}
+
+// Shortest path slerp
+static void SlerpQuat(const float *a, const float *b, float t, float *out)
+{
+    float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float sign = dot < 0.0f ? -1.0f : 1.0f;
+    float st = SlerpFactor(t, dot * sign);
+    simd_store(out, simd_madd(simd_load(a), simd_splat(1.0f - st), simd_mul(simd_load(b), simd_splat(st * sign))));
+    NormalizeQuat(out);
+}
+
+// The sampler's value at time into out (components floats, padded to a multiple of 4)
+static void EvaluateSampler(const AnimSampler &s, float time, bool rotation, float *out)
+{
+    float t;
+    int k = FindKeyframe(s.times, time, &t);
+    int n = s.components;
+    if(s.interpolation == cgltf_interpolation_type_cubic_spline) {
+        // in tangent, value, out tangent per key
+        const float *key = s.values.data() + (size_t)k * 3 * n;
+        if(t <= 0.0f) {
+            memcpy(out, key + n, n * sizeof(float));
+            return;
+        }
+        const float *next = key + 3 * n;
+        HermiteValues(key + n, key + 2 * n, next + n, next, s.times[k + 1] - s.times[k], t, n, out);
+        if(rotation) NormalizeQuat(out);
+        return;
+    }
+    const float *key = s.values.data() + (size_t)k * n;
+    if(t <= 0.0f || s.interpolation == cgltf_interpolation_type_step) {
+        memcpy(out, key, n * sizeof(float));
+        return;
+    }
+    if(rotation) SlerpQuat(key, key + n, t, out);
+    else LerpValues(key, key + n, t, n, out);
+}
+
+// Blends n floats of value into dst by weight (rotations along the shorter arc, renormalized)
+static void WriteValue(float *dst, const float *value, int n, bool rotation, float weight)
+{
+    if(weight >= 1.0f) {
+        memcpy(dst, value, n * sizeof(float));
+        return;
+    }
+    float sign = 1.0f;
+    if(rotation && dst[0] * value[0] + dst[1] * value[1] + dst[2] * value[2] + dst[3] * value[3] < 0.0f) sign = -1.0f;
+    for(int i=0; i<n; i++) dst[i] += (value[i] * sign - dst[i]) * weight;
+    if(rotation) NormalizeQuat(dst);
+}
+
+// Evaluates one channel of the clip at time into a pose's trs and weights. weight < 1 blends
+// the value over what is there.
+void SampleChannel(const AnimModel *model, const AnimClip &clip, int index, float time, float weight, float *trs, float *weights)
+{
+    float value[ANIM_MAX_COMPONENTS + 4];
+    const AnimChannel &channel = clip.channels[index];
+    const AnimSampler &sampler = clip.samplers[channel.sampler];
+    bool rotation = channel.path == ANIM_PATH_ROTATION;
+    EvaluateSampler(sampler, time, rotation, value);
+    if(channel.path == ANIM_PATH_WEIGHTS) {
+        int n = std::min(sampler.components, model->weight_count[channel.node]);
+        WriteValue(weights + model->weight_offset[channel.node], value, n, false, weight);
+    }
+    else WriteValue(trs + channel.node * POSE_STRIDE + path_offset[channel.path], value, sampler.components, rotation, weight);
+}
+
+// Every channel of the clip
+void SampleClip(const AnimModel *model, const AnimClip &clip, float time, float weight, float *trs, float *weights)
+{
+    for(size_t c=0; c<clip.channels.size(); c++) SampleChannel(model, clip, (int)c, time, weight, trs, weights);
+}
+
+// Wraps (loop) or clamps time to the clip
+float ClipTime(const AnimClip &clip, float time, bool loop)
+{
+    if(clip.duration <= 0.0f) return 0.0f;
+    if(!loop) return std::min(std::max(time, 0.0f), clip.duration);
+    time = fmodf(time, clip.duration);
+    return time < 0.0f ? time + clip.duration : time;
+}
+
+// ---------------------------------------------------------------------------------------------
+
+static Pose *CheckPose(lua_State *L, int index)
+{
+    Pose *pose = (Pose *)lua_touserdata(L, index);
+    if(pose == nullptr) luaL_error(L, "animation: no pose");
+    return pose;
+}
+
+// animation_clips(data)
+//   Returns the model's clips { { name, duration, channels }, .. } (clip indices are 1 based).
+int lib_animation_clips(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    AnimModel *model = GetAnimModel(data);
+    lua_newtable(L);
+    for(size_t c=0; c<model->clips.size(); c++) {
+        lua_newtable(L);
+        lua_pushstring(L, "name");
+        lua_pushstring(L, model->clips[c].name.c_str());
+        lua_settable(L, -3);
+        lua_pushstring(L, "duration");
+        lua_pushnumber(L, model->clips[c].duration);
+        lua_settable(L, -3);
+        lua_pushstring(L, "channels");
+        lua_pushinteger(L, (lua_Integer)model->clips[c].channels.size());
+        lua_settable(L, -3);
+        lua_rawseti(L, -2, (int)c + 1);
+    }
+    return 1;
+}
+
+// pose_new(data)
+//   A pose of the model's nodes in their rest transforms. Poses are freed with the model
+//   (cgltf_free), or earlier with pose_free.
+int lib_pose_new(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    AnimModel *model = GetAnimModel(data);
+    Pose *pose = new Pose;
+    pose->model = model;
+    pose->trs = model->rest;
+    pose->weights = model->rest_weights;
+    model->poses.push_back(pose);
+    lua_pushlightuserdata(L, pose);
+    return 1;
+}
+
+int lib_pose_free(lua_State *L)
+{
+    Pose *pose = (Pose *)lua_touserdata(L, 1);
+    if(pose == nullptr) return 0;
+    std::vector<Pose*> &poses = pose->model->poses;
+    poses.erase(std::remove(poses.begin(), poses.end(), pose), poses.end());
+    AnimPoolRemovePose(pose);
+    delete pose;
+    return 0;
+}
+
+// pose_reset(pose)   back to the rest pose
+int lib_pose_reset(lua_State *L)
+{
+    Pose *pose = CheckPose(L, 1);
+    pose->trs = pose->model->rest;
+    pose->weights = pose->model->rest_weights;
+    return 0;
+}
+
+// animation_sample(pose, clip, time [, loop [, weight]])
+//   Evaluates every channel of the clip (1 based) at time (seconds, wrapped when loop isn't
+//   false, else clamped) into the pose. weight < 1 blends over the pose's current values.
+//   Returns the time used.
+int lib_animation_sample(lua_State *L)
+{
+    Pose *pose = CheckPose(L, 1);
+    int clip = (int)luaL_checkinteger(L, 2) - 1;
+    float time = (float)luaL_checknumber(L, 3);
+    bool loop = lua_isnoneornil(L, 4) || lua_toboolean(L, 4);
+    float weight = (float)luaL_optnumber(L, 5, 1.0);
+    const AnimModel *model = pose->model;
+    if(clip < 0 || clip >= (int)model->clips.size()) {
+        return luaL_error(L, "animation_sample: no clip %d", clip + 1);
+    }
+    time = ClipTime(model->clips[clip], time, loop);
+    if(weight > 0.0f) SampleClip(model, model->clips[clip], time, weight, pose->trs.data(), pose->weights.data());
+    lua_pushnumber(L, time);
+    return 1;
+}
+
+// pose_get_node(pose, node)
+//   The node's (0 based, node.index) local transform: tx, ty, tz, rx, ry, rz, rw, sx, sy, sz
+int lib_pose_get_node(lua_State *L)
+{
+    Pose *pose = CheckPose(L, 1);
+    int node = (int)luaL_checkinteger(L, 2);
+    if(node < 0 || node >= pose->model->nodes) {
+        return luaL_error(L, "pose_get_node: no node %d", node);
+    }
+    const float *trs = &pose->trs[node * POSE_STRIDE];
+    for(int i=0; i<POSE_STRIDE; i++) lua_pushnumber(L, trs[i]);
+    return POSE_STRIDE;
+}
+
+// pose_get_trs(pose [, buffer])
+//   Copies the whole pose into a buffer with a "trs" stream (10 floats per node, as
+//   pose_get_node). Pass the buffer from the last call to refill it. Returns the buffer.
+int lib_pose_get_trs(lua_State *L)
+{
+    Pose *pose = CheckPose(L, 1);
+    uint32_t nodes = (uint32_t)pose->model->nodes;
+    dmBuffer::HBuffer buffer = 0;
+    if(!lua_isnoneornil(L, 2)) {
+        buffer = dmScript::CheckBufferUnpack(L, 2);
+        lua_pushvalue(L, 2);
+    }
+    else {
+        dmBuffer::StreamDeclaration decl[] = {
+            { dmHashString64(POSE_STREAM), dmBuffer::VALUE_TYPE_FLOAT32, POSE_STRIDE }
+        };
+        if(dmBuffer::Create(nodes > 0 ? nodes : 1, decl, 1, &buffer) != dmBuffer::RESULT_OK) {
+            printf("[Error] pose_get_trs: could not create buffer (%u nodes)\n", nodes);
+            lua_pushnil(L);
+            return 1;
+        }
+        dmScript::LuaHBuffer luabuf(buffer, dmScript::OWNER_LUA);
+        dmScript::PushBuffer(L, luabuf);
+    }
+
+    float *out = nullptr;
+    uint32_t count = 0, components = 0, stride = 0;
+    if(dmBuffer::GetStream(buffer, dmHashString64(POSE_STREAM), (void **)&out, &count, &components, &stride) != dmBuffer::RESULT_OK
+        || components != POSE_STRIDE || count < nodes) {
+        return luaL_error(L, "pose_get_trs: buffer needs a trs stream of %d floats for %u nodes", POSE_STRIDE, nodes);
+    }
+    for(uint32_t n=0; n<nodes; n++) memcpy(out + n * stride, &pose->trs[n * POSE_STRIDE], POSE_STRIDE * sizeof(float));
+    return 1;
+}
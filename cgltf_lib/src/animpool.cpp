@@ -0,0 +1,295 @@
+// animpool.cpp
+// Animation instances, all advanced by one animate_all(dt) per frame.
+//   An instance plays a clip into a pose (animation.cpp). Its state lives in flat arrays, one slot
+//   per instance (time, speed, weight, clip), so the times of every instance step 4 at a time.
+//   Instances playing the same clip of the same model are then evaluated 4 at a time: LINEAR
+//   translation, rotation and scale channels interpolate with one lane per instance.
+//   Instances with weight < 1 blend over their pose after the full weight ones, in the order they
+//   were made, so a pose can layer clips.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <algorithm>
+
+struct AnimPool
+{
+    // One slot per instance, rounded up to 4 slots. Free slots have speed 0.
+    std::vector<float>      time;
+    std::vector<float>      speed;
+    std::vector<float>      weight;
+    std::vector<int>        clip;
+    std::vector<uint8_t>    loop;
+    std::vector<Pose*>      pose;       // nullptr for a free slot
+    std::vector<int>        free_slots;
+    std::vector<int>        order;      // scratch for animate_all
+    std::vector<int>        blended;
+    std::vector<int>        keys;       // key and fraction of each clip track, per lane
+    std::vector<float>      fractions;
+};
+
+static AnimPool pool;
+
+static int NewSlot()
+{
+    if(!pool.free_slots.empty()) {
+        int slot = pool.free_slots.back();
+        pool.free_slots.pop_back();
+        return slot;
+    }
+    int slot = (int)pool.pose.size();
+    size_t size = (slot + 4) & ~3;
+    pool.time.resize(size, 0.0f);
+    pool.speed.resize(size, 0.0f);
+    pool.weight.resize(size, 0.0f);
+    pool.clip.resize(size, 0);
+    pool.loop.resize(size, 0);
+    pool.pose.resize(slot + 1, nullptr);
+    return slot;
+}
+
+static void FreeSlot(int slot)
+{
+    pool.pose[slot] = nullptr;
+    pool.speed[slot] = 0.0f;
+    pool.time[slot] = 0.0f;
+    pool.free_slots.push_back(slot);
+}
+
+// Drops the instances playing into pose (the pose is being freed)
+void AnimPoolRemovePose(Pose *pose)
+{
+    for(size_t s=0; s<pool.pose.size(); s++) {
+        if(pool.pose[s] == pose) FreeSlot((int)s);
+    }
+}
+
+// Groups instances by model and clip
+static bool SameClipFirst(int a, int b)
+{
+    const AnimModel *ma = pool.pose[a]->model, *mb = pool.pose[b]->model;
+    if(ma != mb) return ma < mb;
+    if(pool.clip[a] != pool.clip[b]) return pool.clip[a] < pool.clip[b];
+    return a < b;
+}
+
+// Finds the keys of 4 instances (slots) on every keyframe track of the clip, once for all the
+// channels sharing a track
+static void FindKeys4(const AnimClip &clip, const int *slots)
+{
+    pool.keys.resize(clip.tracks.size() * 4);
+    pool.fractions.resize(clip.tracks.size() * 4);
+    for(size_t t=0; t<clip.tracks.size(); t++) {
+        const std::vector<float> &times = clip.samplers[clip.tracks[t]].times;
+        for(int l=0; l<4; l++) pool.keys[t * 4 + l] = FindKeyframe(times, pool.time[slots[l]], &pool.fractions[t * 4 + l]);
+    }
+}
+
+// Evaluates one channel of the clip for 4 instances (slots, repeated to fill the 4), with their
+// keys from FindKeys4
+static void SampleChannel4(const AnimModel *model, const AnimClip &clip, int index, const int *slots)
+{
+    const AnimChannel &channel = clip.channels[index];
+    const AnimSampler &sampler = clip.samplers[channel.sampler];
+    if(channel.path == ANIM_PATH_WEIGHTS || sampler.interpolation != cgltf_interpolation_type_linear) {
+        for(int l=0; l<4; l++) {
+            if(l > 0 && slots[l] == slots[l - 1]) continue;
+            Pose *pose = pool.pose[slots[l]];
+            SampleChannel(model, clip, index, pool.time[slots[l]], 1.0f, pose->trs.data(), pose->weights.data());
+        }
+        return;
+    }
+
+    // Keys of each instance, one component per vector and one instance per lane
+    int n = sampler.components;
+    float a[4][4], b[4][4];
+    const int *keys = &pool.keys[sampler.track * 4];
+    const float *t = &pool.fractions[sampler.track * 4];
+    for(int l=0; l<4; l++) {
+        const float *key = &sampler.values[(size_t)keys[l] * n];
+        const float *next = t[l] > 0.0f ? key + n : key;
+        for(int c=0; c<n; c++) {
+            a[c][l] = key[c];
+            b[c][l] = next[c];
+        }
+    }
+
+    simd4f vt = simd_load(t);
+    float out[4][4];
+    if(channel.path == ANIM_PATH_ROTATION) {
+        simd4f va[4], vb[4];
+        simd4f dot = simd_splat(0.0f);
+        for(int c=0; c<4; c++) {
+            va[c] = simd_load(a[c]);
+            vb[c] = simd_load(b[c]);
+            dot = simd_madd(va[c], vb[c], dot);
+        }
+        // SlerpFactor
+        simd4f d = simd_abs(dot);
+        simd4f pa = simd_madd(d, simd_madd(d, simd_madd(d, simd_splat(-1.43519f), simd_splat(3.55645f)), simd_splat(-3.2452f)), simd_splat(1.0904f));
+        simd4f pb = simd_madd(d, simd_madd(d, simd_splat(0.215638f), simd_splat(-1.06021f)), simd_splat(0.848013f));
+        simd4f th = simd_sub(vt, simd_splat(0.5f));
+        simd4f k = simd_madd(pa, simd_mul(th, th), pb);
+        simd4f st = simd_madd(simd_mul(simd_mul(vt, th), simd_sub(vt, simd_splat(1.0f))), k, vt);
+        simd4f wa = simd_sub(simd_splat(1.0f), st);
+        simd4f wb = simd_mul(st, simd_sign(dot));
+
+        simd4f q[4];
+        simd4f len = simd_splat(0.0f);
+        for(int c=0; c<4; c++) {
+            q[c] = simd_madd(va[c], wa, simd_mul(vb[c], wb));
+            len = simd_madd(q[c], q[c], len);
+        }
+        simd4f inv = simd_div(simd_splat(1.0f), simd_sqrt(len));
+        for(int c=0; c<4; c++) simd_store(out[c], simd_mul(q[c], inv));
+    }
+    else {
+        for(int c=0; c<n; c++) {
+            simd4f va = simd_load(a[c]);
+            simd_store(out[c], simd_madd(simd_sub(simd_load(b[c]), va), vt, va));
+        }
+    }
+
+    int offset = channel.node * POSE_STRIDE + (channel.path == ANIM_PATH_TRANSLATION ? 0 : channel.path == ANIM_PATH_ROTATION ? 3 : 7);
+    for(int l=0; l<4; l++) {
+        float *dst = pool.pose[slots[l]]->trs.data() + offset;
+        for(int c=0; c<n; c++) dst[c] = out[c][l];
+    }
+}
+
+// Advances every instance by dt and evaluates them into their poses. Returns the number evaluated.
+int AnimateAll(float dt)
+{
+    size_t slots = pool.pose.size();
+    simd4f vdt = simd_splat(dt);
+    for(size_t s=0; s<slots; s+=4) {
+        simd_store(&pool.time[s], simd_madd(simd_load(&pool.speed[s]), vdt, simd_load(&pool.time[s])));
+    }
+
+    // Full weight instances, grouped by clip. Blended ones keep their order.
+    pool.order.clear();
+    pool.blended.clear();
+    for(size_t s=0; s<slots; s++) {
+        Pose *pose = pool.pose[s];
+        if(pose == nullptr) continue;
+        const AnimClip &clip = pose->model->clips[pool.clip[s]];
+        float time = pool.time[s];
+        if(time < 0.0f || time > clip.duration) pool.time[s] = ClipTime(clip, time, pool.loop[s] != 0);
+        if(pool.weight[s] >= 1.0f) pool.order.push_back((int)s);
+        else if(pool.weight[s] > 0.0f) pool.blended.push_back((int)s);
+    }
+    std::sort(pool.order.begin(), pool.order.end(), SameClipFirst);
+
+    size_t count = pool.order.size();
+    for(size_t first=0; first<count; ) {
+        int slot = pool.order[first];
+        const AnimModel *model = pool.pose[slot]->model;
+        const AnimClip &clip = model->clips[pool.clip[slot]];
+        size_t last = first + 1;
+        while(last < count && pool.pose[pool.order[last]]->model == model && pool.clip[pool.order[last]] == pool.clip[slot]) last++;
+
+        for(size_t i=first; i<last; i+=4) {
+            int lanes[4];
+            for(int l=0; l<4; l++) lanes[l] = pool.order[std::min(i + l, last - 1)];
+            FindKeys4(clip, lanes);
+            for(size_t c=0; c<clip.channels.size(); c++) SampleChannel4(model, clip, (int)c, lanes);
+        }
+        first = last;
+    }
+
+    for(size_t i=0; i<pool.blended.size(); i++) {
+        int s = pool.blended[i];
+        Pose *pose = pool.pose[s];
+        SampleClip(pose->model, pose->model->clips[pool.clip[s]], pool.time[s], pool.weight[s], pose->trs.data(), pose->weights.data());
+    }
+    return (int)(count + pool.blended.size());
+}
+
+// ---------------------------------------------------------------------------------------------
+
+static int CheckInstance(lua_State *L, int index)
+{
+    int slot = (int)luaL_checkinteger(L, index) - 1;
+    if(slot < 0 || slot >= (int)pool.pose.size() || pool.pose[slot] == nullptr) {
+        return luaL_error(L, "animation instance: no instance %d", slot + 1);
+    }
+    return slot;
+}
+
+static void CheckClip(lua_State *L, const Pose *pose, int clip)
+{
+    if(clip < 0 || clip >= (int)pose->model->clips.size()) luaL_error(L, "animation instance: no clip %d", clip + 1);
+}
+
+// anim_instance_new(pose, clip [, speed [, time [, loop]]])
+//   An instance playing clip (1 based) into pose (pose_new), from time (seconds) at speed
+//   (1 = real time), looping unless loop is false. Returns the instance id. Instances are freed
+//   with their pose.
+int lib_anim_instance_new(lua_State *L)
+{
+    Pose *pose = (Pose *)lua_touserdata(L, 1);
+    if(pose == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    int clip = (int)luaL_checkinteger(L, 2) - 1;
+    CheckClip(L, pose, clip);
+    int slot = NewSlot();
+    pool.pose[slot] = pose;
+    pool.clip[slot] = clip;
+    pool.speed[slot] = (float)luaL_optnumber(L, 3, 1.0);
+    pool.time[slot] = (float)luaL_optnumber(L, 4, 0.0);
+    pool.loop[slot] = lua_isnoneornil(L, 5) || lua_toboolean(L, 5);
+    pool.weight[slot] = 1.0f;
+    lua_pushinteger(L, slot + 1);
+    return 1;
+}
+
+// anim_instance_set(id, { clip, time, speed, weight, loop })   changes the fields given
+int lib_anim_instance_set(lua_State *L)
+{
+    int slot = CheckInstance(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "clip");
+    if(lua_isnumber(L, -1)) {
+        int clip = (int)lua_tointeger(L, -1) - 1;
+        CheckClip(L, pool.pose[slot], clip);
+        pool.clip[slot] = clip;
+    }
+    lua_getfield(L, 2, "time");
+    if(lua_isnumber(L, -1)) pool.time[slot] = (float)lua_tonumber(L, -1);
+    lua_getfield(L, 2, "speed");
+    if(lua_isnumber(L, -1)) pool.speed[slot] = (float)lua_tonumber(L, -1);
+    lua_getfield(L, 2, "weight");
+    if(lua_isnumber(L, -1)) pool.weight[slot] = (float)lua_tonumber(L, -1);
+    lua_getfield(L, 2, "loop");
+    if(!lua_isnil(L, -1)) pool.loop[slot] = lua_toboolean(L, -1);
+    lua_pop(L, 5);
+    return 0;
+}
+
+// anim_instance_get(id)   returns time, clip, speed, weight
+int lib_anim_instance_get(lua_State *L)
+{
+    int slot = CheckInstance(L, 1);
+    lua_pushnumber(L, pool.time[slot]);
+    lua_pushinteger(L, pool.clip[slot] + 1);
+    lua_pushnumber(L, pool.speed[slot]);
+    lua_pushnumber(L, pool.weight[slot]);
+    return 4;
+}
+
+int lib_anim_instance_free(lua_State *L)
+{
+    int slot = CheckInstance(L, 1);
+    FreeSlot(slot);
+    return 0;
+}
+
+// animate_all(dt)   advances and evaluates every instance, returns how many were evaluated
+int lib_animate_all(lua_State *L)
+{
+    float dt = (float)luaL_checknumber(L, 1);
+    lua_pushinteger(L, AnimateAll(dt));
+    return 1;
+}
@@ -0,0 +1,458 @@
+// atlas.cpp
+// Texture atlas for models with many small base color textures.
+//   Small images are decoded on the worker pool, packed into one atlas with a skyline packer
+//   (edge texels repeated into a gutter around each one, so filtering and the first mips don't
+//   bleed), and the TEXCOORD_0 data of every primitive using them is remapped into the atlas.
+//   Primitives that used different textures can then share one texture and batch.
+//
+//   Only safe cases are packed: an image qualifies when every material using it samples nothing
+//   but that base color texture, through TEXCOORD_0 without a transform, and every primitive
+//   drawn with those materials has UVs inside [0, 1] (no repeat) in an accessor no other image
+//   is mapped through.
+
+#include "cgltf_lib.h"
+#include "jobs.h"
+#include "hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+#define ATLAS_UV_EPSILON    1e-4f
+
+struct AtlasItem
+{
+    int             image;      // image index
+    cgltf_image *   image_ptr;
+    DecodedImage    decoded;
+    const char *    basepath;
+    bool            ok;
+    int             x;          // placement in the atlas, without the gutter
+    int             y;
+    bool            placed;
+};
+
+struct SkylineNode
+{
+    int x;
+    int y;
+    int width;
+};
+
+// ---------------------------------------------------------------------------------------------
+// Eligibility
+
+// The material's only texture is a plain base color texture on TEXCOORD_0
+static bool AtlasMaterial(const cgltf_material *mat)
+{
+    const cgltf_texture_view &base = mat->pbr_metallic_roughness.base_color_texture;
+    if(base.texture == nullptr || base.texture->image == nullptr || base.texture->basisu_image) return false;
+    if(base.texcoord != 0 || base.has_transform) return false;
+    const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+    int count = MaterialTextureViews(mat, views);
+    for(int v=0; v<count; v++) {
+        if(views[v] != &base && views[v]->texture) return false;
+    }
+    return true;
+}
+
+static bool UVsInRange(const cgltf_accessor *acc)
+{
+    if(acc->type != cgltf_type_vec2) return false;
+    std::vector<float> uvs(acc->count * 2);
+    if(cgltf_accessor_unpack_floats(acc, uvs.data(), uvs.size()) != uvs.size()) return false;
+    for(size_t i=0; i<uvs.size(); i++) {
+        if(uvs[i] < -ATLAS_UV_EPSILON || uvs[i] > 1.0f + ATLAS_UV_EPSILON) return false;
+    }
+    return true;
+}
+
+// Marks the images that can go in an atlas, and maps each UV accessor to the image it samples
+static void FindAtlasImages(cgltf_data *data, const std::vector<bool> &selected, std::vector<bool> &eligible, std::map<cgltf_accessor*, int> &uvs)
+{
+    eligible = selected;
+    for(cgltf_size i=0; i<data->images_count; i++) {
+        if(!selected[i]) continue;
+        const char *mime = data->images[i].mime_type;
+        if(mime && strcmp(mime, "image/ktx2") == 0) {
+            eligible[i] = false;
+            continue;
+        }
+        bool used = false;
+        // Every texture slot using the image must be a plain base color of an atlas material
+        for(cgltf_size m=0; m<data->materials_count && eligible[i]; m++) {
+            const cgltf_material *mat = &data->materials[m];
+            const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+            int count = MaterialTextureViews(mat, views);
+            for(int v=0; v<count; v++) {
+                const cgltf_texture *tex = views[v]->texture;
+                if(tex == nullptr || (tex->image != &data->images[i] && tex->basisu_image != &data->images[i])) continue;
+                used = true;
+                if(!AtlasMaterial(mat)) eligible[i] = false;
+            }
+        }
+        if(!used) eligible[i] = false;
+    }
+
+    // Primitives drawn with those materials (default or variant) need UVs in range, and an
+    // accessor mapped through only one image
+    std::map<cgltf_accessor*, bool> in_range;
+    for(cgltf_size m=0; m<data->meshes_count; m++) {
+        for(cgltf_size p=0; p<data->meshes[m].primitives_count; p++) {
+            cgltf_primitive *prim = &data->meshes[m].primitives[p];
+            cgltf_accessor *acc = const_cast<cgltf_accessor *>(cgltf_find_accessor(prim, cgltf_attribute_type_texcoord, 0));
+            for(cgltf_size v=0; v<=prim->mappings_count; v++) {
+                const cgltf_material *mat = v == 0 ? prim->material : prim->mappings[v - 1].material;
+                if(mat == nullptr) continue;
+                const cgltf_texture *tex = mat->pbr_metallic_roughness.base_color_texture.texture;
+                int image = tex && tex->image ? (int)cgltf_image_index(data, tex->image) : -1;
+                if(acc == nullptr) {
+                    if(image >= 0) eligible[image] = false;
+                    continue;
+                }
+                std::map<cgltf_accessor*, int>::iterator it = uvs.find(acc);
+                if(it != uvs.end() && it->second != image) {
+                    // Two images (or an image and an untextured material) share the UVs
+                    if(it->second >= 0) eligible[it->second] = false;
+                    if(image >= 0) eligible[image] = false;
+                    continue;
+                }
+                uvs[acc] = image;
+                if(image < 0) continue;
+                if(in_range.find(acc) == in_range.end()) in_range[acc] = UVsInRange(acc);
+                if(!in_range[acc]) eligible[image] = false;
+            }
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// Skyline packer (bottom left: the lowest top edge wins, then the narrowest segment)
+
+// Top of a w wide rect placed at node i, or -1 if it doesn't fit
+static int SkylineFit(const std::vector<SkylineNode> &sky, size_t i, int w, int h, int atlas_w, int atlas_h)
+{
+    if(sky[i].x + w > atlas_w) return -1;
+    int y = sky[i].y;
+    int left = w;
+    for(size_t n=i; left > 0; n++) {
+        if(n >= sky.size()) return -1;
+        y = std::max(y, sky[n].y);
+        if(y + h > atlas_h) return -1;
+        left -= sky[n].width;
+    }
+    return y;
+}
+
+static void SkylineAdd(std::vector<SkylineNode> &sky, size_t i, int x, int y, int w, int h)
+{
+    SkylineNode node = { x, y + h, w };
+    sky.insert(sky.begin() + i, node);
+    // Trim or drop the segments the new one covers
+    for(size_t n=i + 1; n < sky.size(); ) {
+        int end = sky[n - 1].x + sky[n - 1].width;
+        if(sky[n].x >= end) break;
+        int shrink = end - sky[n].x;
+        sky[n].x += shrink;
+        sky[n].width -= shrink;
+        if(sky[n].width > 0) break;
+        sky.erase(sky.begin() + n);
+    }
+    // Merge neighbours at the same height
+    for(size_t n=0; n + 1 < sky.size(); ) {
+        if(sky[n].y == sky[n + 1].y) {
+            sky[n].width += sky[n + 1].width;
+            sky.erase(sky.begin() + n + 1);
+        }
+        else n++;
+    }
+}
+
+static bool SkylinePlace(std::vector<SkylineNode> &sky, int w, int h, int atlas_w, int atlas_h, int *x, int *y)
+{
+    int best_top = -1, best_width = 0;
+    size_t best = 0;
+    for(size_t i=0; i<sky.size(); i++) {
+        int top = SkylineFit(sky, i, w, h, atlas_w, atlas_h);
+        if(top < 0) continue;
+        if(best_top < 0 || top + h < best_top || (top + h == best_top && sky[i].width < best_width)) {
+            best_top = top + h;
+            best_width = sky[i].width;
+            best = i;
+            *x = sky[i].x;
+            *y = top;
+        }
+    }
+    if(best_top < 0) return false;
+    SkylineAdd(sky, best, *x, *y, w, h);
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+
+static bool TallerFirst(const AtlasItem *a, const AtlasItem *b)
+{
+    return a->decoded.height != b->decoded.height ? a->decoded.height > b->decoded.height : a->decoded.width > b->decoded.width;
+}
+
+static void DecodeAtlasItem(void *ctx)
+{
+    AtlasItem *item = (AtlasItem *)ctx;
+    item->ok = DecodeImage(item->image_ptr, item->basepath, &item->decoded);
+}
+
+// Copies the image into the atlas and repeats its edge texels into the gutter around it
+static void BlitWithGutter(uint8_t *atlas, int atlas_w, int atlas_h, const DecodedImage &image, int x, int y, int gutter)
+{
+    for(int row=-gutter; row<image.height + gutter; row++) {
+        int ty = y + row;
+        if(ty < 0 || ty >= atlas_h) continue;
+        int sy = std::min(std::max(row, 0), image.height - 1);
+        const uint8_t *src = image.pixels + (size_t)sy * image.width * 4;
+        uint8_t *dst = atlas + ((size_t)ty * atlas_w) * 4;
+        for(int col=-gutter; col<image.width + gutter; col++) {
+            int tx = x + col;
+            if(tx < 0 || tx >= atlas_w) continue;
+            int sx = std::min(std::max(col, 0), image.width - 1);
+            memcpy(dst + tx * 4, src + sx * 4, 4);
+        }
+    }
+}
+
+// Remaps the accessor's UVs into the image's rect, into a new model owned buffer view
+static bool RemapUVs(cgltf_data *data, cgltf_accessor *acc, const AtlasItem &item, int atlas_w, int atlas_h)
+{
+    cgltf_size floats = acc->count * 2;
+    float *uvs = (float *)malloc(floats * sizeof(float));
+    if(uvs == nullptr || cgltf_accessor_unpack_floats(acc, uvs, floats) != floats) {
+        free(uvs);
+        return false;
+    }
+    float sx = (float)item.decoded.width / atlas_w;
+    float sy = (float)item.decoded.height / atlas_h;
+    float ox = (float)item.x / atlas_w;
+    float oy = (float)item.y / atlas_h;
+    for(cgltf_size i=0; i<acc->count; i++) {
+        uvs[i * 2] = ox + std::min(std::max(uvs[i * 2], 0.0f), 1.0f) * sx;
+        uvs[i * 2 + 1] = oy + std::min(std::max(uvs[i * 2 + 1], 0.0f), 1.0f) * sy;
+    }
+    acc->buffer_view = AttachBufferView(data, uvs, floats * sizeof(float), cgltf_buffer_view_type_vertices);
+    acc->offset = 0;
+    acc->stride = 2 * sizeof(float);
+    acc->component_type = cgltf_component_type_r_32f;
+    acc->normalized = false;
+    acc->is_sparse = false;
+    acc->has_min = acc->has_max = false;
+    return true;
+}
+
+// atlas_build(data [, basepath [, options]])
+//   Packs the model's small base color images into one atlas and remaps TEXCOORD_0 of the
+//   primitives using them (see the top of this file for which images qualify). options:
+//     images          image indices (+ 1) to consider, default all (see reachable_images)
+//     max_image_size  largest image (either dimension) that goes in, default 256
+//     size            largest atlas (either dimension), default 2048
+//     padding         gutter texels around each image, default 4
+//     mips, max_size  as for images_decode (the atlas is also fitted to the texture budget)
+//   Call it before images_decode, and leave the packed images out of that.
+//   Returns nil when fewer than two images could be packed, otherwise
+//     { texture, buffer, levels, width, height, bytes, images = { image indices + 1 } }
+//   where a texture already in the cache (the same atlas from another load) has no buffer.
+int lib_atlas_build(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr || data->images_count < 2) {
+        lua_pushnil(L);
+        return 1;
+    }
+    const char *basepath = lua_isstring(L, 2) ? lua_tostring(L, 2) : "";
+
+    std::vector<bool> selected(data->images_count, true);
+    int max_image_size = 256;
+    int max_atlas = 2048;
+    int padding = 4;
+    bool mips = false;
+    int max_size = 0;
+    if(lua_istable(L, 3)) {
+        lua_getfield(L, 3, "max_image_size");
+        if(lua_isnumber(L, -1)) max_image_size = (int)lua_tointeger(L, -1);
+        lua_getfield(L, 3, "size");
+        if(lua_isnumber(L, -1)) max_atlas = (int)lua_tointeger(L, -1);
+        lua_getfield(L, 3, "padding");
+        if(lua_isnumber(L, -1)) padding = std::max((int)lua_tointeger(L, -1), 0);
+        lua_getfield(L, 3, "mips");
+        mips = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "max_size");
+        max_size = (int)lua_tointeger(L, -1);
+        lua_pop(L, 5);
+        lua_getfield(L, 3, "images");
+        if(lua_istable(L, -1)) {
+            selected.assign(data->images_count, false);
+            for(int i=1; ; i++) {
+                lua_rawgeti(L, -1, i);
+                if(!lua_isnumber(L, -1)) {
+                    lua_pop(L, 1);
+                    break;
+                }
+                lua_Integer index = lua_tointeger(L, -1) - 1;
+                if(index >= 0 && index < (lua_Integer)data->images_count) selected[index] = true;
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    std::vector<bool> eligible;
+    std::map<cgltf_accessor*, int> uvs;
+    FindAtlasImages(data, selected, eligible, uvs);
+
+    std::vector<AtlasItem> items;
+    for(cgltf_size i=0; i<data->images_count; i++) {
+        if(!eligible[i]) continue;
+        AtlasItem item;
+        memset(&item, 0, sizeof(item));
+        item.image = (int)i;
+        item.image_ptr = &data->images[i];
+        item.basepath = basepath;
+        items.push_back(item);
+    }
+    if(items.size() < 2) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Decode on the worker pool. The vector is final, the jobs hold pointers into it.
+    JobBatch *batch = JobBatchNew();
+    for(size_t i=0; i<items.size(); i++) JobBatchAdd(batch, DecodeAtlasItem, &items[i]);
+    JobBatchWait(batch);
+    JobBatchDelete(batch);
+
+    // Biggest first packs tighter. Images that don't fit (or are too big) stay out.
+    std::vector<AtlasItem*> order;
+    for(size_t i=0; i<items.size(); i++) {
+        AtlasItem &item = items[i];
+        if(!item.ok) {
+            printf("[Error] atlas_build: image %d (%s)\n", item.image, item.decoded.error);
+            continue;
+        }
+        if(item.decoded.width <= max_image_size && item.decoded.height <= max_image_size) order.push_back(&item);
+    }
+    std::stable_sort(order.begin(), order.end(), TallerFirst);
+
+    int atlas_w = 1;
+    int needed = 0;
+    for(size_t i=0; i<order.size(); i++) {
+        needed += (order[i]->decoded.width + padding * 2) * (order[i]->decoded.height + padding * 2);
+    }
+    while(atlas_w < max_atlas && atlas_w * atlas_w < needed) atlas_w *= 2;
+    atlas_w = std::min(atlas_w, max_atlas);
+
+    std::vector<SkylineNode> sky;
+    SkylineNode start = { 0, 0, atlas_w };
+    sky.push_back(start);
+    int placed = 0, used_h = 0;
+    for(size_t i=0; i<order.size(); i++) {
+        AtlasItem *item = order[i];
+        int x, y;
+        if(!SkylinePlace(sky, item->decoded.width + padding * 2, item->decoded.height + padding * 2, atlas_w, max_atlas, &x, &y)) continue;
+        item->x = x + padding;
+        item->y = y + padding;
+        item->placed = true;
+        used_h = std::max(used_h, y + item->decoded.height + padding * 2);
+        placed++;
+    }
+
+    if(placed < 2) {
+        for(size_t i=0; i<items.size(); i++) FreeDecodedImage(&items[i].decoded);
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Height down to the power of two the packing needs
+    int atlas_h = 1;
+    while(atlas_h < used_h) atlas_h *= 2;
+    DecodedImage atlas;
+    memset(&atlas, 0, sizeof(atlas));
+    atlas.width = atlas_w;
+    atlas.height = atlas_h;
+    atlas.channels = 4;
+    atlas.pixels = (uint8_t *)calloc((size_t)atlas_w * atlas_h, 4);
+    for(size_t i=0; i<order.size(); i++) {
+        if(order[i]->placed) BlitWithGutter(atlas.pixels, atlas_w, atlas_h, order[i]->decoded, order[i]->x, order[i]->y, padding);
+    }
+
+    // Remap before fitting, the UVs are relative so a downscaled atlas still lines up
+    for(std::map<cgltf_accessor*, int>::iterator it = uvs.begin(); it != uvs.end(); ++it) {
+        if(it->second < 0) continue;
+        for(size_t i=0; i<order.size(); i++) {
+            if(order[i]->image != it->second || !order[i]->placed) continue;
+            if(!RemapUVs(data, it->first, *order[i], atlas_w, atlas_h)) {
+                printf("[Error] atlas_build: cannot read texcoords\n");
+            }
+            break;
+        }
+    }
+
+    uint64_t hash = XXH64(atlas.pixels, (size_t)atlas_w * atlas_h * 4, (uint64_t)(mips ? 1 : 0) | ((uint64_t)padding << 1));
+    char name[64];
+    TextureName(hash, name, sizeof(name));
+
+    lua_newtable(L);
+    lua_pushstring(L, "texture");
+    lua_pushstring(L, name);
+    lua_settable(L, -3);
+
+    int width, height;
+    if(TextureCacheFind(hash, &width, &height)) {
+        lua_pushstring(L, "shared");
+        lua_pushboolean(L, 1);
+        lua_settable(L, -3);
+        lua_pushstring(L, "bytes");
+        lua_pushinteger(L, 0);
+        lua_settable(L, -3);
+    }
+    else {
+        uint64_t bytes = FitImage(&atlas, -1, true, mips, max_size);
+        width = atlas.width;
+        height = atlas.height;
+        std::vector<uint8_t> chain;
+        std::vector<MipLevel> levels;
+        lua_pushstring(L, "buffer");
+        if(mips && GenerateMips(atlas.pixels, width, height, true, chain, levels)) {
+            PushImageBuffer(L, chain.data(), (uint32_t)chain.size());
+            lua_settable(L, -3);
+            lua_pushstring(L, "levels");
+            PushMipLevels(L, levels);
+        }
+        else PushImageBuffer(L, atlas.pixels, (uint32_t)(width * height * 4));
+        lua_settable(L, -3);
+        lua_pushstring(L, "bytes");
+        lua_pushinteger(L, (lua_Integer)bytes);
+        lua_settable(L, -3);
+        TextureCacheInsert(hash, width, height, bytes);
+    }
+    lua_pushstring(L, "width");
+    lua_pushinteger(L, width);
+    lua_settable(L, -3);
+    lua_pushstring(L, "height");
+    lua_pushinteger(L, height);
+    lua_settable(L, -3);
+
+    lua_pushstring(L, "images");
+    lua_newtable(L);
+    int count = 0;
+    for(size_t i=0; i<items.size(); i++) {
+        if(items[i].placed) {
+            lua_pushinteger(L, (lua_Integer)(items[i].image + 1));
+            lua_rawseti(L, -2, ++count);
+        }
+        FreeDecodedImage(&items[i].decoded);
+    }
+    lua_settable(L, -3);
+    FreeDecodedImage(&atlas);
+
+    printf("[Info] Atlas: %d images in %dx%d\n", placed, atlas_w, atlas_h);
+    return 1;
+}
@@ -0,0 +1,871 @@
+// basisu.cpp
+// Basis Universal decoders.
+//   ETC1S: the BasisLZ codebooks (endpoints and selectors) and slice tables come from the KTX2
+//   global data, and each slice decodes to ETC1 blocks, which is what ETC1S is a subset of. Other
+//   targets decode those blocks to RGBA.
+//   UASTC: each 16 byte block is unpacked (mode, ASTC partition, BISE endpoints and weights) and
+//   interpolated to RGBA the way an ASTC decoder would, the ETC1/BC7 hint bits are skipped.
+//   Both follow the basisu transcoder (github.com/BinomialLLC/basis_universal) and keep its
+//   names where they can.
+
+#include "basisu.h"
+
+#include <string.h>
+#include <algorithm>
+
+// Huffman code length codes (deflate style runs)
+#define HUFFMAN_MAX_CODE_SIZE           16
+#define HUFFMAN_MAX_SYMS_LOG2           14
+#define HUFFMAN_TOTAL_CODELENGTH_CODES  21
+#define HUFFMAN_SMALL_ZERO_RUN_CODE     17
+#define HUFFMAN_BIG_ZERO_RUN_CODE       18
+#define HUFFMAN_SMALL_REPEAT_CODE       19
+#define HUFFMAN_BIG_REPEAT_CODE         20
+#define HUFFMAN_FAST_BITS               10
+
+// Endpoint codebook deltas are coded with one of three tables picked by the previous value
+#define COLOR5_PAL0_PREV_HI             9
+#define COLOR5_PAL1_PREV_HI             21
+
+// Slice symbols
+#define ENDPOINT_PRED_REPEAT_LAST_SYMBOL    256
+#define ENDPOINT_PRED_COUNT_VLC_BITS        4
+#define ENDPOINT_PRED_MIN_REPEAT_COUNT      3
+#define SELECTOR_HISTORY_BUF_RLE_COUNT_THRESH   3
+#define SELECTOR_HISTORY_BUF_RLE_COUNT_TOTAL    64
+
+#define BASISLZ_HEADER_SIZE     20
+#define BASISLZ_IMAGE_SIZE      20
+
+#define UASTC_MODES                 19
+#define UASTC_MODE_SOLID            8
+#define UASTC_PARTITIONS2           30
+#define UASTC_PARTITIONS3           11
+#define UASTC_PARTITIONS_MODE7      19
+
+static const uint8_t huffman_sorted_codelength_codes[HUFFMAN_TOTAL_CODELENGTH_CODES] = {
+    HUFFMAN_SMALL_ZERO_RUN_CODE, HUFFMAN_BIG_ZERO_RUN_CODE, HUFFMAN_SMALL_REPEAT_CODE, HUFFMAN_BIG_REPEAT_CODE,
+    0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15, 16,
+};
+
+// ETC1 intensity modifiers, in selector order from the most negative to the most positive
+static const int etc1_inten_tables[8][4] = {
+    { -8, -2, 2, 8 }, { -17, -5, 5, 17 }, { -29, -9, 9, 29 }, { -42, -13, 13, 42 },
+    { -60, -18, 18, 60 }, { -80, -24, 24, 80 }, { -106, -33, 33, 106 }, { -183, -47, 47, 183 },
+};
+
+// ETC1 pixel index of each linear selector, and back
+static const uint8_t selector_to_etc1[4] = { 3, 2, 0, 1 };
+static const uint8_t etc1_to_selector[4] = { 2, 3, 1, 0 };
+
+// ---------------------------------------------------------------------------------------------
+// Bit reader, least significant bit first. Reads past the end give zeros.
+
+struct BitReader
+{
+    const uint8_t * p;
+    const uint8_t * end;
+    uint64_t        buf;
+    int             count;
+};
+
+static void BitsInit(BitReader *br, const uint8_t *data, size_t size)
+{
+    br->p = data;
+    br->end = data + size;
+    br->buf = 0;
+    br->count = 0;
+}
+
+static void BitsFill(BitReader *br, int count)
+{
+    while(br->count < count) {
+        uint64_t c = br->p < br->end ? *br->p++ : 0;
+        br->buf |= c << br->count;
+        br->count += 8;
+    }
+}
+
+static uint32_t GetBits(BitReader *br, int count)
+{
+    if(count == 0) return 0;
+    BitsFill(br, count);
+    uint32_t v = (uint32_t)(br->buf & (((uint64_t)1 << count) - 1));
+    br->buf >>= count;
+    br->count -= count;
+    return v;
+}
+
+// Groups of chunk_bits bits, each followed by a bit saying whether another group follows
+static uint32_t DecodeVLC(BitReader *br, int chunk_bits)
+{
+    uint32_t chunk_size = 1u << chunk_bits;
+    uint32_t v = 0;
+    for(int shift=0; shift<32; shift+=chunk_bits) {
+        uint32_t s = GetBits(br, chunk_bits + 1);
+        v |= (s & (chunk_size - 1)) << shift;
+        if((s & chunk_size) == 0) break;
+    }
+    return v;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Canonical Huffman codes. The first bit sent is the code's most significant one.
+
+static bool HuffmanInit(BasisHuffman *h, const uint8_t *sizes, uint32_t count)
+{
+    memset(h->counts, 0, sizeof(h->counts));
+    h->symbols.clear();
+    h->fast.assign(1 << HUFFMAN_FAST_BITS, 0);
+    for(uint32_t i=0; i<count; i++) {
+        if(sizes[i] > HUFFMAN_MAX_CODE_SIZE) return false;
+        if(sizes[i]) h->counts[sizes[i]]++;
+    }
+    int left = 1;
+    uint16_t offsets[HUFFMAN_MAX_CODE_SIZE + 2] = { 0 };
+    for(int len=1; len<=HUFFMAN_MAX_CODE_SIZE; len++) {
+        left = (left << 1) - h->counts[len];
+        if(left < 0) return false;
+        offsets[len + 1] = offsets[len] + h->counts[len];
+    }
+    h->symbols.resize(offsets[HUFFMAN_MAX_CODE_SIZE + 1]);
+    for(uint32_t i=0; i<count; i++) {
+        if(sizes[i]) h->symbols[offsets[sizes[i]]++] = (uint16_t)i;
+    }
+
+    uint32_t code = 0, index = 0;
+    for(int len=1; len<=HUFFMAN_MAX_CODE_SIZE; len++) {
+        for(int i=0; i<h->counts[len]; i++, code++, index++) {
+            if(len > HUFFMAN_FAST_BITS) continue;
+            uint32_t rev = 0;
+            for(int b=0; b<len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+            for(uint32_t j=rev; j<(1u << HUFFMAN_FAST_BITS); j+=1u << len) {
+                h->fast[j] = ((uint32_t)h->symbols[index] << 8) | (uint32_t)len;
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+static int HuffmanDecode(BitReader *br, const BasisHuffman *h)
+{
+    if(h->symbols.empty()) return -1;
+    BitsFill(br, HUFFMAN_MAX_CODE_SIZE);
+    uint32_t entry = h->fast[br->buf & ((1 << HUFFMAN_FAST_BITS) - 1)];
+    if(entry) {
+        br->buf >>= entry & 0xff;
+        br->count -= entry & 0xff;
+        return (int)(entry >> 8);
+    }
+    int code = 0, first = 0, index = 0;
+    for(int len=1; len<=HUFFMAN_MAX_CODE_SIZE; len++) {
+        code |= (int)((br->buf >> (len - 1)) & 1);
+        int count = h->counts[len];
+        if(code - first < count) {
+            br->buf >>= len;
+            br->count -= len;
+            return h->symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// Code sizes are themselves Huffman coded, with runs of zeros and repeats of the previous size
+static bool ReadHuffmanTable(BitReader *br, BasisHuffman *h)
+{
+    uint32_t total = GetBits(br, HUFFMAN_MAX_SYMS_LOG2);
+    if(total == 0) return HuffmanInit(h, 0, 0);
+
+    uint8_t codelength_sizes[HUFFMAN_TOTAL_CODELENGTH_CODES] = { 0 };
+    uint32_t codelength_count = GetBits(br, 5);
+    if(codelength_count < 1 || codelength_count > HUFFMAN_TOTAL_CODELENGTH_CODES) return false;
+    for(uint32_t i=0; i<codelength_count; i++) {
+        codelength_sizes[huffman_sorted_codelength_codes[i]] = (uint8_t)GetBits(br, 3);
+    }
+    BasisHuffman codelengths;
+    if(!HuffmanInit(&codelengths, codelength_sizes, HUFFMAN_TOTAL_CODELENGTH_CODES)) return false;
+
+    std::vector<uint8_t> sizes(total, 0);
+    uint32_t cur = 0;
+    while(cur < total) {
+        int c = HuffmanDecode(br, &codelengths);
+        if(c < 0) return false;
+        if(c <= 16) {
+            sizes[cur++] = (uint8_t)c;
+            continue;
+        }
+        uint32_t run;
+        if(c == HUFFMAN_SMALL_ZERO_RUN_CODE) run = GetBits(br, 3) + 3;
+        else if(c == HUFFMAN_BIG_ZERO_RUN_CODE) run = GetBits(br, 7) + 11;
+        else {
+            if(cur == 0 || sizes[cur - 1] == 0) return false;
+            run = c == HUFFMAN_SMALL_REPEAT_CODE ? GetBits(br, 2) + 3 : GetBits(br, 7) + 7;
+        }
+        if(cur + run > total) return false;
+        uint8_t size = c == HUFFMAN_SMALL_ZERO_RUN_CODE || c == HUFFMAN_BIG_ZERO_RUN_CODE ? 0 : sizes[cur - 1];
+        for(uint32_t i=0; i<run; i++) sizes[cur++] = size;
+    }
+    return HuffmanInit(h, sizes.data(), total);
+}
+
+// ---------------------------------------------------------------------------------------------
+// BasisLZ codebooks
+
+static uint16_t Read16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t Read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool DecodeEndpoints(const uint8_t *data, size_t size, uint32_t count, BasisLZ *lz)
+{
+    BitReader br;
+    BitsInit(&br, data, size);
+    BasisHuffman color5_delta[3], inten_delta;
+    for(int i=0; i<3; i++) {
+        if(!ReadHuffmanTable(&br, &color5_delta[i])) return false;
+    }
+    if(!ReadHuffmanTable(&br, &inten_delta)) return false;
+    bool grayscale = GetBits(&br, 1) != 0;
+
+    lz->endpoints.resize((size_t)count * 4);
+    int prev_color5[3] = { 16, 16, 16 };
+    int prev_inten = 0;
+    for(uint32_t i=0; i<count; i++) {
+        uint8_t *e = &lz->endpoints[(size_t)i * 4];
+        int delta = HuffmanDecode(&br, &inten_delta);
+        if(delta < 0) return false;
+        prev_inten = (delta + prev_inten) & 7;
+        e[3] = (uint8_t)prev_inten;
+        for(int c=0; c<(grayscale ? 1 : 3); c++) {
+            const BasisHuffman *table = &color5_delta[2];
+            if(prev_color5[c] <= COLOR5_PAL0_PREV_HI) table = &color5_delta[0];
+            else if(prev_color5[c] <= COLOR5_PAL1_PREV_HI) table = &color5_delta[1];
+            delta = HuffmanDecode(&br, table);
+            if(delta < 0) return false;
+            prev_color5[c] = (prev_color5[c] + delta) & 31;
+            e[c] = (uint8_t)prev_color5[c];
+        }
+        if(grayscale) e[1] = e[2] = e[0];
+    }
+    return true;
+}
+
+// Codebook selectors are one byte per row, two bits per texel. Stored as ETC1 selector bytes.
+static uint32_t SelectorRowsToETC1(const uint8_t rows[4])
+{
+    uint32_t msb = 0, lsb = 0;
+    for(int y=0; y<4; y++) {
+        for(int x=0; x<4; x++) {
+            int etc1 = selector_to_etc1[(rows[y] >> (x * 2)) & 3];
+            int p = x * 4 + y;
+            msb |= (uint32_t)(etc1 >> 1) << p;
+            lsb |= (uint32_t)(etc1 & 1) << p;
+        }
+    }
+    uint8_t bytes[4] = { (uint8_t)(msb >> 8), (uint8_t)msb, (uint8_t)(lsb >> 8), (uint8_t)lsb };
+    uint32_t v;
+    memcpy(&v, bytes, sizeof(v));
+    return v;
+}
+
+static bool DecodeSelectors(const uint8_t *data, size_t size, uint32_t count, BasisLZ *lz)
+{
+    BitReader br;
+    BitsInit(&br, data, size);
+    // Global and hybrid selector codebooks were dropped from the format
+    if(GetBits(&br, 1) != 0 || GetBits(&br, 1) != 0) return false;
+
+    lz->selectors.resize(count);
+    bool raw = GetBits(&br, 1) != 0;
+    BasisHuffman delta_model;
+    if(!raw && !ReadHuffmanTable(&br, &delta_model)) return false;
+    uint8_t rows[4] = { 0, 0, 0, 0 };
+    for(uint32_t i=0; i<count; i++) {
+        for(int y=0; y<4; y++) {
+            if(raw || i == 0) rows[y] = (uint8_t)GetBits(&br, 8);
+            else {
+                int delta = HuffmanDecode(&br, &delta_model);
+                if(delta < 0) return false;
+                rows[y] ^= (uint8_t)delta;
+            }
+        }
+        lz->selectors[i] = SelectorRowsToETC1(rows);
+    }
+    return true;
+}
+
+static bool DecodeTables(const uint8_t *data, size_t size, BasisLZ *lz)
+{
+    BitReader br;
+    BitsInit(&br, data, size);
+    if(!ReadHuffmanTable(&br, &lz->endpoint_pred) || lz->endpoint_pred.symbols.empty()) return false;
+    if(!ReadHuffmanTable(&br, &lz->endpoint_delta)) return false;
+    if(!ReadHuffmanTable(&br, &lz->selector)) return false;
+    if(!ReadHuffmanTable(&br, &lz->selector_run)) return false;
+    lz->history_size = GetBits(&br, 13);
+    return lz->history_size != 0;
+}
+
+bool BasisLZInit(const uint8_t *data, size_t size, uint32_t images, BasisLZ *lz, const char **error)
+{
+    *error = "truncated BasisLZ global data";
+    if(size < BASISLZ_HEADER_SIZE + (size_t)images * BASISLZ_IMAGE_SIZE) return false;
+    uint32_t endpoint_count = Read16(data);
+    uint32_t selector_count = Read16(data + 2);
+    uint64_t endpoints_size = Read32(data + 4);
+    uint64_t selectors_size = Read32(data + 8);
+    uint64_t tables_size = Read32(data + 12);
+    uint64_t extended_size = Read32(data + 16);
+    size_t offset = BASISLZ_HEADER_SIZE + (size_t)images * BASISLZ_IMAGE_SIZE;
+    if(offset + endpoints_size + selectors_size + tables_size + extended_size > size) return false;
+
+    lz->slices.resize(images);
+    for(uint32_t i=0; i<images; i++) {
+        const uint8_t *desc = data + BASISLZ_HEADER_SIZE + (size_t)i * BASISLZ_IMAGE_SIZE;
+        lz->slices[i].rgb_offset = Read32(desc + 4);
+        lz->slices[i].rgb_length = Read32(desc + 8);
+        lz->slices[i].alpha_offset = Read32(desc + 12);
+        lz->slices[i].alpha_length = Read32(desc + 16);
+    }
+
+    *error = "empty BasisLZ codebook";
+    if(endpoint_count == 0 || selector_count == 0) return false;
+    *error = "bad BasisLZ endpoint codebook";
+    if(!DecodeEndpoints(data + offset, (size_t)endpoints_size, endpoint_count, lz)) return false;
+    offset += (size_t)endpoints_size;
+    *error = "bad BasisLZ selector codebook";
+    if(!DecodeSelectors(data + offset, (size_t)selectors_size, selector_count, lz)) return false;
+    offset += (size_t)selectors_size;
+    *error = "bad BasisLZ slice tables";
+    if(!DecodeTables(data + offset, (size_t)tables_size, lz)) return false;
+    *error = 0;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// BasisLZ slices
+
+// Recently used selectors. Used entries move halfway to the front, new ones go in the middle.
+struct SelectorHistory
+{
+    std::vector<uint32_t>   values;
+    uint32_t                rover;
+};
+
+static void HistoryAdd(SelectorHistory *h, uint32_t value)
+{
+    h->values[h->rover++] = value;
+    if(h->rover == h->values.size()) h->rover = (uint32_t)h->values.size() / 2;
+}
+
+static void HistoryUse(SelectorHistory *h, uint32_t index)
+{
+    if(index == 0) return;
+    std::swap(h->values[index / 2], h->values[index]);
+}
+
+// Endpoint index and predictor bits of one block of the row above
+struct EndpointPred
+{
+    uint16_t    endpoint_index;
+    uint8_t     pred_bits;
+};
+
+bool BasisLZDecodeSlice(const BasisLZ *lz, const uint8_t *data, size_t size, int blocks_x, int blocks_y, uint8_t *etc1, const char **error)
+{
+    *error = "bad BasisLZ slice";
+    uint32_t endpoint_count = (uint32_t)(lz->endpoints.size() / 4);
+    uint32_t selector_count = (uint32_t)lz->selectors.size();
+    uint32_t history_first = selector_count;
+    uint32_t history_rle = selector_count + lz->history_size;
+    uint64_t total_blocks = (uint64_t)blocks_x * blocks_y;
+
+    BitReader br;
+    BitsInit(&br, data, size);
+    SelectorHistory history;
+    history.values.assign(lz->history_size, 0);
+    history.rover = lz->history_size / 2;
+
+    // Rows alternate between the two arrays, the other one holds the row above
+    std::vector<EndpointPred> preds[2];
+    preds[0].assign(blocks_x, EndpointPred());
+    preds[1].assign(blocks_x, EndpointPred());
+    uint32_t cur_pred_bits = 0;
+    int prev_endpoint_pred_sym = 0;
+    int endpoint_pred_repeat_count = 0;
+    uint32_t prev_endpoint_index = 0;
+    uint32_t selector_rle_count = 0;
+
+    for(int by=0; by<blocks_y; by++) {
+        std::vector<EndpointPred> &cur = preds[by & 1];
+        std::vector<EndpointPred> &above = preds[(by & 1) ^ 1];
+        for(int bx=0; bx<blocks_x; bx++) {
+            // One predictor symbol covers 2x2 blocks, 2 bits each. The lower row's half is kept.
+            if((bx & 1) == 0) {
+                if((by & 1) == 0) {
+                    if(endpoint_pred_repeat_count > 0) {
+                        endpoint_pred_repeat_count--;
+                        cur_pred_bits = prev_endpoint_pred_sym;
+                    }
+                    else {
+                        int sym = HuffmanDecode(&br, &lz->endpoint_pred);
+                        if(sym < 0) return false;
+                        if(sym == ENDPOINT_PRED_REPEAT_LAST_SYMBOL) {
+                            endpoint_pred_repeat_count = DecodeVLC(&br, ENDPOINT_PRED_COUNT_VLC_BITS) + ENDPOINT_PRED_MIN_REPEAT_COUNT - 1;
+                            cur_pred_bits = prev_endpoint_pred_sym;
+                        }
+                        else {
+                            cur_pred_bits = sym;
+                            prev_endpoint_pred_sym = sym;
+                        }
+                    }
+                    above[bx].pred_bits = (uint8_t)(cur_pred_bits >> 4);
+                }
+                else cur_pred_bits = cur[bx].pred_bits;
+            }
+
+            // Endpoint: left, above, above left, or a delta from the previous block's
+            uint32_t endpoint_index;
+            uint32_t pred = cur_pred_bits & 3;
+            cur_pred_bits >>= 2;
+            if(pred == 0) {
+                if(bx == 0) return false;
+                endpoint_index = prev_endpoint_index;
+            }
+            else if(pred == 1) {
+                if(by == 0) return false;
+                endpoint_index = above[bx].endpoint_index;
+            }
+            else if(pred == 2) {
+                if(bx == 0 || by == 0) return false;
+                endpoint_index = above[bx - 1].endpoint_index;
+            }
+            else {
+                int delta = HuffmanDecode(&br, &lz->endpoint_delta);
+                if(delta < 0) return false;
+                endpoint_index = (uint32_t)delta + prev_endpoint_index;
+                if(endpoint_index >= endpoint_count) endpoint_index -= endpoint_count;
+            }
+            if(endpoint_index >= endpoint_count) return false;
+            cur[bx].endpoint_index = (uint16_t)endpoint_index;
+            prev_endpoint_index = endpoint_index;
+
+            // Selector: a codebook index, a history entry, or a run of the last one
+            uint32_t selector_index;
+            if(selector_rle_count > 0) {
+                selector_rle_count--;
+                selector_index = history.values[0];
+            }
+            else {
+                int sym = HuffmanDecode(&br, &lz->selector);
+                if(sym < 0) return false;
+                if((uint32_t)sym == history_rle) {
+                    int run = HuffmanDecode(&br, &lz->selector_run);
+                    if(run < 0) return false;
+                    if(run == SELECTOR_HISTORY_BUF_RLE_COUNT_TOTAL - 1) selector_rle_count = DecodeVLC(&br, 7) + SELECTOR_HISTORY_BUF_RLE_COUNT_THRESH;
+                    else selector_rle_count = run + SELECTOR_HISTORY_BUF_RLE_COUNT_THRESH;
+                    if(selector_rle_count > total_blocks) return false;
+                    selector_index = history.values[0];
+                    selector_rle_count--;
+                }
+                else if((uint32_t)sym >= history_first) {
+                    uint32_t index = sym - history_first;
+                    if(index >= history.values.size()) return false;
+                    selector_index = history.values[index];
+                    HistoryUse(&history, index);
+                }
+                else {
+                    selector_index = sym;
+                    HistoryAdd(&history, selector_index);
+                }
+            }
+            if(selector_index >= selector_count) return false;
+
+            // Differential mode with a zero delta, both halves use the same table
+            const uint8_t *e = &lz->endpoints[(size_t)endpoint_index * 4];
+            uint8_t *block = etc1 + ((size_t)by * blocks_x + bx) * 8;
+            block[0] = (uint8_t)(e[0] << 3);
+            block[1] = (uint8_t)(e[1] << 3);
+            block[2] = (uint8_t)(e[2] << 3);
+            block[3] = (uint8_t)((e[3] << 5) | (e[3] << 2) | 2);
+            memcpy(block + 4, &lz->selectors[selector_index], 4);
+        }
+    }
+    *error = 0;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// ETC1 blocks
+
+static uint8_t Clamp255(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+void ETC1DecodeBlock(const uint8_t *block, uint8_t *rgba)
+{
+    int base[2][3];
+    bool diff = (block[3] & 2) != 0;
+    bool flip = (block[3] & 1) != 0;
+    for(int c=0; c<3; c++) {
+        if(diff) {
+            int c5 = block[c] >> 3;
+            int d = (block[c] & 7) ^ 4;
+            int c5b = c5 + d - 4;
+            base[0][c] = (c5 << 3) | (c5 >> 2);
+            base[1][c] = ((c5b & 31) << 3) | ((c5b & 31) >> 2);
+        }
+        else {
+            base[0][c] = (block[c] >> 4) * 17;
+            base[1][c] = (block[c] & 15) * 17;
+        }
+    }
+    int table[2] = { block[3] >> 5, (block[3] >> 2) & 7 };
+    uint32_t msb = ((uint32_t)block[4] << 8) | block[5];
+    uint32_t lsb = ((uint32_t)block[6] << 8) | block[7];
+    for(int y=0; y<4; y++) {
+        for(int x=0; x<4; x++) {
+            int p = x * 4 + y;
+            int half = flip ? (y >= 2) : (x >= 2);
+            int etc1 = (int)(((msb >> p) & 1) << 1 | ((lsb >> p) & 1));
+            int mod = etc1_inten_tables[table[half]][etc1_to_selector[etc1]];
+            uint8_t *out = rgba + (y * 4 + x) * 4;
+            for(int c=0; c<3; c++) out[c] = Clamp255(base[half][c] + mod);
+            out[3] = 255;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// UASTC blocks
+
+// Mode prefix codes (code, length), sent least significant bit first, and the mode of each
+// value of the block's first 7 bits
+static const uint8_t uastc_mode_codes[UASTC_MODES][2] = {
+    { 0x1, 4 }, { 0x35, 6 }, { 0x1D, 5 }, { 0x3, 5 }, { 0x13, 5 }, { 0xB, 5 }, { 0x1B, 5 }, { 0x7, 5 },
+    { 0x17, 5 }, { 0xF, 5 }, { 0x2, 3 }, { 0x0, 2 }, { 0x6, 3 }, { 0x1F, 5 }, { 0xD, 5 }, { 0x5, 7 },
+    { 0x15, 6 }, { 0x25, 6 }, { 0x9, 4 },
+};
+
+static const uint8_t uastc_modes[128] = {
+    11, 0, 10, 3, 11, 15, 12, 7, 11, 18, 10, 5, 11, 14, 12, 9, 11, 0, 10, 4, 11, 16, 12, 8, 11, 18, 10, 6, 11, 2, 12, 13,
+    11, 0, 10, 3, 11, 17, 12, 7, 11, 18, 10, 5, 11, 14, 12, 9, 11, 0, 10, 4, 11, 1, 12, 8, 11, 18, 10, 6, 11, 2, 12, 13,
+    11, 0, 10, 3, 11, 19, 12, 7, 11, 18, 10, 5, 11, 14, 12, 9, 11, 0, 10, 4, 11, 16, 12, 8, 11, 18, 10, 6, 11, 2, 12, 13,
+    11, 0, 10, 3, 11, 17, 12, 7, 11, 18, 10, 5, 11, 14, 12, 9, 11, 0, 10, 4, 11, 1, 12, 8, 11, 18, 10, 6, 11, 2, 12, 13,
+};
+
+// Per mode: weight bits, BISE endpoint range, components (3 RGB, 4 RGBA, 2 LA) and hint bits
+static const uint8_t uastc_mode_weight_bits[UASTC_MODES] = { 4, 2, 3, 2, 2, 3, 2, 2, 0, 2, 4, 2, 3, 1, 2, 4, 2, 2, 5 };
+static const uint8_t uastc_mode_endpoint_range[UASTC_MODES] = { 19, 20, 8, 7, 12, 20, 18, 12, 0, 8, 13, 13, 19, 20, 20, 20, 20, 20, 11 };
+static const uint8_t uastc_mode_comps[UASTC_MODES] = { 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, 3 };
+static const uint8_t uastc_mode_hint_bits[UASTC_MODES] = { 15, 15, 15, 15, 15, 15, 15, 15, 0, 23, 17, 17, 17, 23, 23, 23, 23, 23, 15 };
+
+// Bits, trits and quints of each ASTC BISE range
+static const uint8_t astc_bise_range[21][3] = {
+    { 1, 0, 0 }, { 0, 1, 0 }, { 2, 0, 0 }, { 0, 0, 1 }, { 1, 1, 0 }, { 3, 0, 0 }, { 1, 0, 1 }, { 2, 1, 0 },
+    { 4, 0, 0 }, { 2, 0, 1 }, { 3, 1, 0 }, { 5, 0, 0 }, { 3, 0, 1 }, { 4, 1, 0 }, { 6, 0, 0 }, { 4, 0, 1 },
+    { 5, 1, 0 }, { 7, 0, 0 }, { 5, 0, 1 }, { 6, 1, 0 }, { 8, 0, 0 },
+};
+
+// ASTC partition seeds of the partition patterns UASTC shares with BC7
+static const uint16_t uastc_partition_seeds2[UASTC_PARTITIONS2] = {
+    28, 20, 16, 29, 91, 9, 107, 72, 149, 204, 50, 114, 496, 17, 78, 39,
+    252, 828, 43, 156, 116, 210, 476, 273, 684, 359, 246, 195, 694, 524,
+};
+static const uint16_t uastc_partition_seeds3[UASTC_PARTITIONS3] = { 260, 74, 32, 156, 183, 15, 745, 0, 335, 902, 254 };
+static const uint16_t uastc_partition_seeds_mode7[UASTC_PARTITIONS_MODE7] = {
+    36, 48, 61, 137, 161, 183, 226, 281, 302, 307, 479, 495, 593, 594, 605, 799, 812, 988, 993,
+};
+
+// Subset of each texel, and the texels whose weight has an implied zero top bit (the first of
+// each subset), for the 2 subset, 3 subset and mode 7 patterns
+static uint8_t uastc_partitions[UASTC_PARTITIONS2 + UASTC_PARTITIONS3 + UASTC_PARTITIONS_MODE7][16];
+static uint16_t uastc_anchors[UASTC_PARTITIONS2 + UASTC_PARTITIONS3 + UASTC_PARTITIONS_MODE7];
+
+// Unquantized (0..255) BISE endpoint values of each range, and weights (0..64) of 1 to 5 bits
+static uint8_t astc_endpoints[21][256];
+static uint8_t astc_weights[6][32];
+
+static uint32_t Hash52(uint32_t p)
+{
+    p ^= p >> 15;   p -= p << 17;   p += p << 7;    p += p << 4;
+    p ^= p >> 5;    p += p << 16;   p ^= p >> 7;    p ^= p >> 3;
+    p ^= p << 6;    p ^= p >> 17;
+    return p;
+}
+
+// ASTC's partition function for a texel of a 4x4 block (which counts as a small block)
+static int ASTCPartition(int seed, int x, int y, int partitions)
+{
+    x <<= 1;
+    y <<= 1;
+    seed += (partitions - 1) * 1024;
+    uint32_t rnum = Hash52((uint32_t)seed);
+    uint8_t s[12];
+    for(int i=0; i<8; i++) s[i] = (rnum >> (i * 4)) & 0xF;
+    s[8] = (rnum >> 18) & 0xF;
+    s[9] = (rnum >> 22) & 0xF;
+    s[10] = (rnum >> 26) & 0xF;
+    s[11] = ((rnum >> 30) | (rnum << 2)) & 0xF;
+    for(int i=0; i<12; i++) s[i] = (uint8_t)(s[i] * s[i]);
+
+    int sh1, sh2;
+    if(seed & 1) {
+        sh1 = seed & 2 ? 4 : 5;
+        sh2 = partitions == 3 ? 6 : 5;
+    }
+    else {
+        sh1 = partitions == 3 ? 6 : 5;
+        sh2 = seed & 2 ? 4 : 5;
+    }
+    int sh3 = seed & 0x10 ? sh1 : sh2;
+    for(int i=0; i<8; i++) s[i] >>= i & 1 ? sh2 : sh1;
+    for(int i=8; i<12; i++) s[i] >>= sh3;
+
+    int a = (s[0] * x + s[1] * y + (int)(rnum >> 14)) & 0x3F;
+    int b = (s[2] * x + s[3] * y + (int)(rnum >> 10)) & 0x3F;
+    int c = partitions < 3 ? 0 : (s[4] * x + s[5] * y + (int)(rnum >> 6)) & 0x3F;
+    if(a >= b && a >= c) return 0;
+    if(b >= c) return 1;
+    return 2;
+}
+
+// count (up to 9) bits at *ofs of a block loaded as two little endian halves
+static uint32_t BlockBits(const uint64_t *block, int *ofs, int count)
+{
+    int at = *ofs;
+    *ofs += count;
+    if(count == 0 || at >= 128) return 0;
+    uint64_t v = block[at >> 6] >> (at & 63);
+    if((at & 63) + count > 64 && at < 64) v |= block[1] << (64 - (at & 63));
+    return (uint32_t)v & ((1u << count) - 1);
+}
+
+// BISE value (trit or quint in the top part) to 0..255, as in the ASTC spec
+static int UnquantizeEndpoint(int range, int v)
+{
+    int bits = astc_bise_range[range][0];
+    if(!astc_bise_range[range][1] && !astc_bise_range[range][2]) {
+        int r = 0;
+        for(int shift=8 - bits; shift > -bits; shift -= bits) r |= shift >= 0 ? v << shift : v >> -shift;
+        return r & 255;
+    }
+    int m = v & ((1 << bits) - 1);
+    int d = v >> bits;
+    int a = (m & 1) ? 0x1FF : 0;
+    int b1 = (m >> 1) & 1, c1 = (m >> 2) & 1, d1 = (m >> 3) & 1, e1 = (m >> 4) & 1, f1 = (m >> 5) & 1;
+    int b = 0, c = 0;
+    if(astc_bise_range[range][1]) {
+        switch(bits) {
+            case 1: c = 204; break;
+            case 2: c = 93; b = (b1 << 8) | (b1 << 4) | (b1 << 2) | (b1 << 1); break;
+            case 3: c = 44; b = (c1 << 8) | (b1 << 7) | (c1 << 3) | (b1 << 2) | (c1 << 1) | b1; break;
+            case 4: c = 22; b = (d1 << 8) | (c1 << 7) | (b1 << 6) | (d1 << 2) | (c1 << 1) | b1; break;
+            case 5: c = 11; b = (e1 << 8) | (d1 << 7) | (c1 << 6) | (b1 << 5) | (e1 << 1) | d1; break;
+            case 6: c = 5; b = (f1 << 8) | (e1 << 7) | (d1 << 6) | (c1 << 5) | (b1 << 4) | f1; break;
+        }
+    }
+    else {
+        switch(bits) {
+            case 1: c = 113; break;
+            case 2: c = 54; b = (b1 << 8) | (b1 << 3) | (b1 << 2); break;
+            case 3: c = 26; b = (c1 << 8) | (b1 << 7) | (c1 << 2) | (b1 << 1) | c1; break;
+            case 4: c = 13; b = (d1 << 8) | (c1 << 7) | (b1 << 6) | (d1 << 1) | c1; break;
+            case 5: c = 6; b = (e1 << 8) | (d1 << 7) | (c1 << 6) | (b1 << 5) | e1; break;
+        }
+    }
+    int t = (d * c + b) ^ a;
+    return (a & 0x80) | (t >> 2);
+}
+
+// Plain bit weights to 0..64
+static int UnquantizeWeight(int bits, int v)
+{
+    int w = 0;
+    for(int shift=6 - bits; shift > -bits; shift -= bits) w |= shift >= 0 ? v << shift : v >> -shift;
+    w &= 63;
+    return w > 32 ? w + 1 : w;
+}
+
+void BasisInit()
+{
+    for(int i=0; i<UASTC_PARTITIONS2 + UASTC_PARTITIONS3 + UASTC_PARTITIONS_MODE7; i++) {
+        int seed, partitions = 2;
+        if(i < UASTC_PARTITIONS2) seed = uastc_partition_seeds2[i];
+        else if(i < UASTC_PARTITIONS2 + UASTC_PARTITIONS3) {
+            seed = uastc_partition_seeds3[i - UASTC_PARTITIONS2];
+            partitions = 3;
+        }
+        else seed = uastc_partition_seeds_mode7[i - UASTC_PARTITIONS2 - UASTC_PARTITIONS3];
+        bool seen[3] = { false, false, false };
+        uastc_anchors[i] = 0;
+        for(int t=0; t<16; t++) {
+            int subset = ASTCPartition(seed, t & 3, t >> 2, partitions);
+            uastc_partitions[i][t] = (uint8_t)subset;
+            if(!seen[subset]) uastc_anchors[i] |= (uint16_t)(1 << t);
+            seen[subset] = true;
+        }
+    }
+    for(int range=0; range<21; range++) {
+        int levels = (1 << astc_bise_range[range][0]) * (astc_bise_range[range][1] ? 3 : astc_bise_range[range][2] ? 5 : 1);
+        for(int v=0; v<levels; v++) astc_endpoints[range][v] = (uint8_t)UnquantizeEndpoint(range, v);
+    }
+    for(int bits=1; bits<=5; bits++) {
+        for(int v=0; v<(1 << bits); v++) astc_weights[bits][v] = (uint8_t)UnquantizeWeight(bits, v);
+    }
+}
+
+bool UASTCDecodeBlock(const uint8_t *bytes, uint8_t *rgba)
+{
+    uint64_t block[2] = { 0, 0 };
+    for(int i=0; i<8; i++) {
+        block[0] |= (uint64_t)bytes[i] << (i * 8);
+        block[1] |= (uint64_t)bytes[i + 8] << (i * 8);
+    }
+    int mode = uastc_modes[bytes[0] & 127];
+    if(mode >= UASTC_MODES) return false;
+    int ofs = uastc_mode_codes[mode][1];
+
+    if(mode == UASTC_MODE_SOLID) {
+        uint8_t color[4];
+        for(int c=0; c<4; c++) color[c] = (uint8_t)BlockBits(block, &ofs, 8);
+        for(int i=0; i<16; i++) memcpy(rgba + i * 4, color, 4);
+        return true;
+    }
+    ofs += uastc_mode_hint_bits[mode];
+
+    // Partition pattern
+    const uint8_t *partition = 0;
+    uint16_t anchors = 1;
+    int subsets = 1;
+    if(mode == 3) {
+        uint32_t pattern = BlockBits(block, &ofs, 4);
+        if(pattern >= UASTC_PARTITIONS3) return false;
+        partition = uastc_partitions[UASTC_PARTITIONS2 + pattern];
+        anchors = uastc_anchors[UASTC_PARTITIONS2 + pattern];
+        subsets = 3;
+    }
+    else if(mode == 2 || mode == 4 || mode == 7 || mode == 9 || mode == 16) {
+        uint32_t pattern = BlockBits(block, &ofs, 5);
+        if(mode == 7) {
+            if(pattern >= UASTC_PARTITIONS_MODE7) return false;
+            pattern += UASTC_PARTITIONS2 + UASTC_PARTITIONS3;
+        }
+        else if(pattern >= UASTC_PARTITIONS2) return false;
+        partition = uastc_partitions[pattern];
+        anchors = uastc_anchors[pattern];
+        subsets = 2;
+    }
+
+    // Dual plane: component ccs takes the second set of weights
+    int planes = 1, ccs = -1;
+    if(mode == 6 || mode == 11 || mode == 13) {
+        ccs = (int)BlockBits(block, &ofs, 2);
+        planes = 2;
+    }
+    else if(mode == 17) {
+        ccs = 3;
+        planes = 2;
+    }
+
+    // Endpoints: the packed trits (5 to 8 bits) or quints (3 to 7 bits) first, then the low bits
+    int comps = uastc_mode_comps[mode];
+    int range = uastc_mode_endpoint_range[mode];
+    int total_values = comps * 2 * subsets;
+    int ep_bits = astc_bise_range[range][0];
+    int ep_trits = astc_bise_range[range][1];
+    int ep_quints = astc_bise_range[range][2];
+    int bundle = ep_trits ? 5 : ep_quints ? 3 : 0;
+    int total_tqs = bundle ? (total_values + bundle - 1) / bundle : 0;
+    uint32_t tq_values[8];
+    for(int i=0; i<total_tqs; i++) {
+        int num_bits = ep_trits ? 8 : 7;
+        if(i == total_tqs - 1) {
+            int remaining = total_values - (total_tqs - 1) * bundle;
+            static const int trit_bits[6] = { 0, 2, 4, 5, 7, 8 };
+            static const int quint_bits[4] = { 0, 3, 5, 7 };
+            num_bits = ep_trits ? trit_bits[remaining] : quint_bits[remaining];
+        }
+        tq_values[i] = BlockBits(block, &ofs, num_bits);
+    }
+    int endpoints[24];
+    uint32_t accum = 0;
+    int accum_remaining = 0, next_tq = 0;
+    for(int i=0; i<total_values; i++) {
+        int value = (int)BlockBits(block, &ofs, ep_bits);
+        if(bundle) {
+            if(accum_remaining == 0) {
+                accum = tq_values[next_tq++];
+                accum_remaining = bundle;
+            }
+            value |= (int)(accum % (ep_trits ? 3 : 5)) << ep_bits;
+            accum /= ep_trits ? 3 : 5;
+            accum_remaining--;
+        }
+        endpoints[i] = astc_endpoints[range][value];
+    }
+
+    // Weights, texel by texel (both planes of a texel together), anchors drop their top bit
+    int weight_bits = uastc_mode_weight_bits[mode];
+    int weights[32];
+    for(int i=0; i<16 * planes; i++) {
+        int texel = i / planes;
+        int bits = weight_bits;
+        if(planes == 2 ? texel == 0 : ((anchors >> texel) & 1) != 0) bits--;
+        weights[i] = astc_weights[weight_bits][BlockBits(block, &ofs, bits)];
+    }
+
+    // Endpoint colors of each subset (ASTC CEM 8, 12 and 4: direct RGB, RGBA and LA)
+    int e[3][2][4];
+    for(int s=0; s<subsets; s++) {
+        const int *v = endpoints + s * comps * 2;
+        if(comps == 2) {
+            for(int j=0; j<2; j++) {
+                e[s][j][0] = e[s][j][1] = e[s][j][2] = v[j];
+                e[s][j][3] = v[2 + j];
+            }
+            continue;
+        }
+        int a0 = comps == 4 ? v[6] : 255;
+        int a1 = comps == 4 ? v[7] : 255;
+        if(v[1] + v[3] + v[5] >= v[0] + v[2] + v[4]) {
+            for(int c=0; c<3; c++) {
+                e[s][0][c] = v[c * 2];
+                e[s][1][c] = v[c * 2 + 1];
+            }
+            e[s][0][3] = a0;
+            e[s][1][3] = a1;
+        }
+        else {
+            // Blue contraction, with the endpoints swapped
+            e[s][0][0] = (v[1] + v[5]) >> 1;
+            e[s][0][1] = (v[3] + v[5]) >> 1;
+            e[s][0][2] = v[5];
+            e[s][0][3] = a1;
+            e[s][1][0] = (v[0] + v[4]) >> 1;
+            e[s][1][1] = (v[2] + v[4]) >> 1;
+            e[s][1][2] = v[4];
+            e[s][1][3] = a0;
+        }
+    }
+
+    for(int t=0; t<16; t++) {
+        int s = partition ? partition[t] : 0;
+        for(int c=0; c<4; c++) {
+            int w = weights[t * planes + (c == ccs ? 1 : 0)];
+            int c0 = e[s][0][c] * 257, c1 = e[s][1][c] * 257;
+            rgba[t * 4 + c] = (uint8_t)(((c0 * (64 - w) + c1 * w + 32) >> 6) >> 8);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+// basisu.h
+// Basis Universal (ETC1S and UASTC) decoders used by KHR_texture_basisu (see basisu.cpp)
+
+#ifndef CGLTF_LIB_BASISU_H
+#define CGLTF_LIB_BASISU_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Canonical Huffman table of a BasisLZ stream
+struct BasisHuffman
+{
+    uint16_t                counts[17];     // codes of each length
+    std::vector<uint16_t>   symbols;        // ordered by code
+    std::vector<uint32_t>   fast;           // symbol << 8 | length for the next 10 bits, 0 when longer
+};
+
+// Image slices of the BasisLZ global data, offsets are from the start of the level
+struct BasisSlice
+{
+    uint32_t    rgb_offset;
+    uint32_t    rgb_length;
+    uint32_t    alpha_offset;
+    uint32_t    alpha_length;
+};
+
+// ETC1S codebooks and the slice tables shared by every image of a KTX2 file
+struct BasisLZ
+{
+    std::vector<uint8_t>    endpoints;      // r, g, b (5 bits) and intensity table of each endpoint
+    std::vector<uint32_t>   selectors;      // ETC1 selector bytes (block bytes 4-7) of each selector
+    std::vector<BasisSlice> slices;         // one per image, largest level first
+    BasisHuffman            endpoint_pred;
+    BasisHuffman            endpoint_delta;
+    BasisHuffman            selector;
+    BasisHuffman            selector_run;
+    uint32_t                history_size;
+};
+
+// Builds the UASTC partition tables, call once before decoding
+void BasisInit();
+
+// Reads the KTX2 supercompression global data of a BasisLZ file with the given image count.
+// On failure returns false with a static error string.
+bool BasisLZInit(const uint8_t *data, size_t size, uint32_t images, BasisLZ *lz, const char **error);
+
+// Decodes one ETC1S slice to blocks_x * blocks_y ETC1 blocks (8 bytes each, row by row)
+bool BasisLZDecodeSlice(const BasisLZ *lz, const uint8_t *data, size_t size, int blocks_x, int blocks_y, uint8_t *etc1, const char **error);
+
+// Decodes an ETC1 block to 16 RGBA texels, row by row
+void ETC1DecodeBlock(const uint8_t *block, uint8_t *rgba);
+
+// Decodes a 16 byte UASTC block to 16 RGBA texels, row by row. False for invalid blocks.
+bool UASTCDecodeBlock(const uint8_t *block, uint8_t *rgba);
+
+#endif
@@ -0,0 +1,482 @@
+// blockencode.cpp
+// CPU encoders from RGBA8 to GPU texture formats.
+//   Two channel formats for normal maps: RG8, BC5 (two BC4 blocks) and EAC RG11 (two EAC R11
+//   blocks). Only x and y are kept, the shader rebuilds z = sqrt(1 - x*x - y*y).
+//   Color formats: BC1 and ETC1 for opaque images, BC3 (BC4 alpha + BC1 color) and ETC2 RGBA
+//   (EAC alpha + ETC1 color, which ETC2 decoders read as is) with alpha. These are fast single
+//   pass encoders, not the exhaustive searches of offline tools. BC7 and ASTC aren't encoded.
+
+#include "cgltf_lib.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// 4x4 block of one channel, edge texels repeated for levels smaller than a block
+static void LoadBlockChannel(const uint8_t *rgba, int width, int height, int bx, int by, int channel, uint8_t *out)
+{
+    for(int y=0; y<4; y++) {
+        int sy = std::min(by + y, height - 1);
+        for(int x=0; x<4; x++) {
+            int sx = std::min(bx + x, width - 1);
+            out[y * 4 + x] = rgba[((size_t)sy * width + sx) * 4 + channel];
+        }
+    }
+}
+
+static void LoadBlockRGBA(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t *out)
+{
+    for(int y=0; y<4; y++) {
+        int sy = std::min(by + y, height - 1);
+        for(int x=0; x<4; x++) {
+            int sx = std::min(bx + x, width - 1);
+            memcpy(out + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// BC4: two 8 bit endpoints and 3 bit indices. Endpoints are the block's max and min, which
+// gives the 8 value mode.
+
+static void EncodeBC4Block(const uint8_t *values, uint8_t *out)
+{
+    int lo = 255, hi = 0;
+    for(int i=0; i<16; i++) {
+        lo = std::min(lo, (int)values[i]);
+        hi = std::max(hi, (int)values[i]);
+    }
+    memset(out, 0, 8);
+    out[0] = (uint8_t)hi;
+    out[1] = (uint8_t)lo;
+    if(hi == lo) return;
+
+    // Palette order is hi, lo, then 6 steps from hi to lo
+    static const int index_of_step[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+    uint64_t bits = 0;
+    int range = hi - lo;
+    for(int i=0; i<16; i++) {
+        int step = ((values[i] - lo) * 14 + range) / (range * 2);   // nearest of 0..7 from lo
+        bits |= (uint64_t)index_of_step[step] << (3 * i);
+    }
+    for(int b=0; b<6; b++) out[2 + b] = (uint8_t)(bits >> (8 * b));
+}
+
+// ---------------------------------------------------------------------------------------------
+// EAC R11: base codeword, multiplier and one of 16 modifier tables, with 3 bit indices. Values
+// are 11 bit, texels column major, bits big endian. Each table gets the base and multiplier
+// that fit the block's range.
+
+static const int eac_modifiers[16][8] = {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 }, { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 }, { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 }, { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 }, { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 }, { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 }, { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 }, { -3, -5,  -7,  -9, 2, 4, 6,  8 },
+};
+
+// Base and multiplier that center table t's palette on [lo, hi], palette in ascending order
+// (modifier index 3 2 1 0 4 5 6 7)
+static const int eac_ascending[8] = { 3, 2, 1, 0, 4, 5, 6, 7 };
+
+static void EACPalette(int t, int lo, int hi, int *base, int *mult, int *palette)
+{
+    const int *mod = eac_modifiers[t];
+    int span = (mod[7] - mod[3]) * 8;
+    *mult = std::min(std::max((hi - lo + span / 2) / span, 1), 15);
+    int center = (hi + lo) / 2 - 4 - (mod[7] + mod[3]) * *mult * 4;
+    *base = std::min(std::max((center + 4) / 8, 0), 255);
+    for(int k=0; k<8; k++) palette[k] = std::min(std::max(*base * 8 + 4 + mod[eac_ascending[k]] * *mult * 8, 0), 2047);
+}
+
+// Nearest palette entry of each texel, by counting the midpoints below it (branch free).
+// Returns the squared error.
+static int EACNearest(const int *palette, const int *target, int count, int *pos)
+{
+    int mid[7];
+    for(int k=0; k<7; k++) mid[k] = (palette[k] + palette[k + 1] + 1) / 2;
+    for(int i=0; i<count; i++) pos[i] = 0;
+    for(int k=0; k<7; k++) {
+        for(int i=0; i<count; i++) pos[i] += target[i] >= mid[k];
+    }
+    int error = 0;
+    for(int i=0; i<count; i++) {
+        int d = palette[pos[i]] - target[i];
+        error += d * d;
+    }
+    return error;
+}
+
+static void EncodeEACR11Block(const uint8_t *values, uint8_t *out)
+{
+    int target[16];
+    int lo = 2047, hi = 0;
+    for(int i=0; i<16; i++) {
+        target[i] = (values[i] * 2047 + 127) / 255;
+        lo = std::min(lo, target[i]);
+        hi = std::max(hi, target[i]);
+    }
+
+    int best_error = -1;
+    uint64_t best = 0;
+    int pos[16];
+    for(int t=0; t<16 && best_error != 0; t++) {
+        int base, mult, palette[8];
+        EACPalette(t, lo, hi, &base, &mult, palette);
+        int error = EACNearest(palette, target, 16, pos);
+        if(best_error >= 0 && error >= best_error) continue;
+        best_error = error;
+        best = ((uint64_t)base << 56) | ((uint64_t)mult << 52) | ((uint64_t)t << 48);
+        for(int i=0; i<16; i++) {
+            // texel (x, y) is index x * 4 + y
+            int x = i & 3, y = i >> 2;
+            best |= (uint64_t)eac_ascending[pos[i]] << (45 - 3 * (x * 4 + y));
+        }
+    }
+    for(int b=0; b<8; b++) out[b] = (uint8_t)(best >> (56 - 8 * b));
+}
+
+// ---------------------------------------------------------------------------------------------
+// EAC alpha (ETC2 RGBA): like R11 with 8 bit values, base + modifier * multiplier.
+
+static void EncodeEACAlphaBlock(const uint8_t *values, uint8_t *out)
+{
+    int target[16];
+    int lo = 255, hi = 0;
+    for(int i=0; i<16; i++) {
+        target[i] = values[i];
+        lo = std::min(lo, target[i]);
+        hi = std::max(hi, target[i]);
+    }
+
+    int best_error = -1;
+    uint64_t best = 0;
+    int pos[16];
+    for(int t=0; t<16 && best_error != 0; t++) {
+        const int *mod = eac_modifiers[t];
+        int span = mod[7] - mod[3];
+        int mult = std::min(std::max((hi - lo + span / 2) / span, 1), 15);
+        int base = std::min(std::max((hi + lo + 1) / 2 - (mod[7] + mod[3]) * mult / 2, 0), 255);
+        int palette[8];
+        for(int k=0; k<8; k++) palette[k] = std::min(std::max(base + mod[eac_ascending[k]] * mult, 0), 255);
+        int error = EACNearest(palette, target, 16, pos);
+        if(best_error >= 0 && error >= best_error) continue;
+        best_error = error;
+        best = ((uint64_t)base << 56) | ((uint64_t)mult << 52) | ((uint64_t)t << 48);
+        for(int i=0; i<16; i++) {
+            int x = i & 3, y = i >> 2;
+            best |= (uint64_t)eac_ascending[pos[i]] << (45 - 3 * (x * 4 + y));
+        }
+    }
+    for(int b=0; b<8; b++) out[b] = (uint8_t)(best >> (56 - 8 * b));
+}
+
+// ---------------------------------------------------------------------------------------------
+// BC1: two RGB565 endpoints and 2 bit indices. Endpoints are the block's extremes along its
+// principal axis, refined once by least squares. Always the 4 color mode (color0 > color1),
+// which is also what BC3's color block uses.
+
+static uint16_t Pack565(const float *c)
+{
+    int r = std::min(std::max((int)(c[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+    int g = std::min(std::max((int)(c[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+    int b = std::min(std::max((int)(c[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565(uint16_t c, int *out)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+// Indices of the 4 color palette, returns the squared error
+static int BC1Indices(const uint8_t *rgba, uint16_t c0, uint16_t c1, uint32_t *indices)
+{
+    int palette[4][3];
+    Unpack565(c0, palette[0]);
+    Unpack565(c1, palette[1]);
+    for(int c=0; c<3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    int error = 0;
+    *indices = 0;
+    for(int i=0; i<16; i++) {
+        const uint8_t *p = rgba + i * 4;
+        int best = 0, best_d = 0x7fffffff;
+        for(int k=0; k<4; k++) {
+            int dr = p[0] - palette[k][0], dg = p[1] - palette[k][1], db = p[2] - palette[k][2];
+            int d = dr * dr + dg * dg + db * db;
+            if(d < best_d) {
+                best_d = d;
+                best = k;
+            }
+        }
+        error += best_d;
+        *indices |= (uint32_t)best << (2 * i);
+    }
+    return error;
+}
+
+// Endpoints that fit the pixels best for the given indices (weights 1, 0, 2/3, 1/3 of color0)
+static bool BC1Refine(const uint8_t *rgba, uint32_t indices, float *e0, float *e1)
+{
+    static const float weight[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0, ab = 0, bb = 0, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+    for(int i=0; i<16; i++) {
+        float a = weight[(indices >> (2 * i)) & 3], b = 1.0f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for(int c=0; c<3; c++) {
+            ax[c] += a * rgba[i * 4 + c];
+            bx[c] += b * rgba[i * 4 + c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if(fabsf(det) < 1e-6f) return false;
+    for(int c=0; c<3; c++) {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+    return true;
+}
+
+static void EncodeBC1Block(const uint8_t *rgba, uint8_t *out)
+{
+    float mean[3] = { 0, 0, 0 };
+    for(int i=0; i<16; i++) {
+        for(int c=0; c<3; c++) mean[c] += rgba[i * 4 + c] / 16.0f;
+    }
+    float cov[6] = { 0, 0, 0, 0, 0, 0 };    // rr rg rb gg gb bb
+    for(int i=0; i<16; i++) {
+        float d[3] = { rgba[i * 4] - mean[0], rgba[i * 4 + 1] - mean[1], rgba[i * 4 + 2] - mean[2] };
+        cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+    }
+    // Principal axis by power iteration
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for(int it=0; it<4; it++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+        if(len < 1e-6f) break;
+        axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+    }
+    float lo = 1e30f, hi = -1e30f;
+    int lo_i = 0, hi_i = 0;
+    for(int i=0; i<16; i++) {
+        float t = (rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2];
+        if(t < lo) { lo = t; lo_i = i; }
+        if(t > hi) { hi = t; hi_i = i; }
+    }
+    float e0[3], e1[3];
+    for(int c=0; c<3; c++) {
+        e0[c] = rgba[hi_i * 4 + c];
+        e1[c] = rgba[lo_i * 4 + c];
+    }
+
+    uint16_t c0 = Pack565(e0), c1 = Pack565(e1);
+    if(c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    int error = 0;
+    if(c0 != c1) {
+        error = BC1Indices(rgba, c0, c1, &indices);
+        float r0[3], r1[3];
+        if(error > 0 && BC1Refine(rgba, indices, r0, r1)) {
+            uint16_t n0 = Pack565(r0), n1 = Pack565(r1);
+            if(n0 < n1) std::swap(n0, n1);
+            uint32_t refined = 0;
+            if(n0 != n1 && BC1Indices(rgba, n0, n1, &refined) < error) {
+                c0 = n0;
+                c1 = n1;
+                indices = refined;
+            }
+        }
+    }
+    out[0] = (uint8_t)c0; out[1] = (uint8_t)(c0 >> 8);
+    out[2] = (uint8_t)c1; out[3] = (uint8_t)(c1 >> 8);
+    for(int b=0; b<4; b++) out[4 + b] = (uint8_t)(indices >> (8 * b));
+}
+
+// ---------------------------------------------------------------------------------------------
+// ETC1: two 2x4 or 4x2 halves, each a base color plus one of 8 intensity tables. Each half's
+// base is its average, in differential mode (555 + 333 delta) when the two are close enough,
+// else individual mode (444 each). Both splits are tried.
+
+static const int etc1_modifiers[8][2] = {
+    { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+// Best table and indices of one half for a base color, returns the squared error
+static int ETC1Half(const uint8_t *rgba, const int *texels, const int *base, int *table, int *indices)
+{
+    int best_error = 0x7fffffff;
+    int pos[8];
+    for(int t=0; t<8; t++) {
+        const int mods[4] = { etc1_modifiers[t][0], etc1_modifiers[t][1], -etc1_modifiers[t][0], -etc1_modifiers[t][1] };
+        int error = 0;
+        for(int i=0; i<8 && error < best_error; i++) {
+            const uint8_t *p = rgba + texels[i] * 4;
+            int best_d = 0x7fffffff;
+            for(int k=0; k<4; k++) {
+                int d = 0;
+                for(int c=0; c<3; c++) {
+                    int v = std::min(std::max(base[c] + mods[k], 0), 255) - p[c];
+                    d += v * v;
+                }
+                if(d < best_d) {
+                    best_d = d;
+                    pos[i] = k;
+                }
+            }
+            error += best_d;
+        }
+        if(error < best_error) {
+            best_error = error;
+            *table = t;
+            memcpy(indices, pos, sizeof(pos));
+        }
+    }
+    return best_error;
+}
+
+static void EncodeETC1Block(const uint8_t *rgba, uint8_t *out)
+{
+    uint64_t best = 0;
+    int best_error = -1;
+    for(int flip=0; flip<2; flip++) {
+        // Texels (index y * 4 + x) of each half
+        int texels[2][8];
+        int count[2] = { 0, 0 };
+        for(int i=0; i<16; i++) {
+            int x = i & 3, y = i >> 2;
+            int half = flip ? (y >= 2) : (x >= 2);
+            texels[half][count[half]++] = i;
+        }
+        int avg[2][3];
+        for(int h=0; h<2; h++) {
+            for(int c=0; c<3; c++) {
+                int sum = 0;
+                for(int i=0; i<8; i++) sum += rgba[texels[h][i] * 4 + c];
+                avg[h][c] = (sum + 4) / 8;
+            }
+        }
+
+        int q[2][3], base[2][3];
+        bool diff = true;
+        for(int c=0; c<3; c++) {
+            q[0][c] = (avg[0][c] * 31 + 127) / 255;
+            q[1][c] = (avg[1][c] * 31 + 127) / 255;
+            int d = q[1][c] - q[0][c];
+            if(d < -4 || d > 3) diff = false;
+        }
+        for(int h=0; h<2; h++) {
+            for(int c=0; c<3; c++) {
+                if(diff) base[h][c] = (q[h][c] << 3) | (q[h][c] >> 2);
+                else {
+                    q[h][c] = (avg[h][c] * 15 + 127) / 255;
+                    base[h][c] = q[h][c] * 17;
+                }
+            }
+        }
+
+        int table[2], indices[2][8];
+        int error = ETC1Half(rgba, texels[0], base[0], &table[0], indices[0]) + ETC1Half(rgba, texels[1], base[1], &table[1], indices[1]);
+        if(best_error >= 0 && error >= best_error) continue;
+        best_error = error;
+
+        uint64_t bits = 0;
+        if(diff) {
+            for(int c=0; c<3; c++) {
+                bits |= (uint64_t)q[0][c] << (59 - 8 * c);
+                bits |= (uint64_t)((q[1][c] - q[0][c]) & 7) << (56 - 8 * c);
+            }
+            bits |= (uint64_t)1 << 33;
+        }
+        else {
+            for(int c=0; c<3; c++) {
+                bits |= (uint64_t)q[0][c] << (60 - 8 * c);
+                bits |= (uint64_t)q[1][c] << (56 - 8 * c);
+            }
+        }
+        bits |= (uint64_t)table[0] << 37;
+        bits |= (uint64_t)table[1] << 34;
+        bits |= (uint64_t)flip << 32;
+        // Modifier k (+a, +b, -a, -b) is index k, msb in the high half, texel (x, y) at bit x * 4 + y
+        for(int h=0; h<2; h++) {
+            for(int i=0; i<8; i++) {
+                int x = texels[h][i] & 3, y = texels[h][i] >> 2;
+                int bit = x * 4 + y;
+                bits |= (uint64_t)(indices[h][i] >> 1) << (16 + bit);
+                bits |= (uint64_t)(indices[h][i] & 1) << bit;
+            }
+        }
+        best = bits;
+    }
+    for(int b=0; b<8; b++) out[b] = (uint8_t)(best >> (56 - 8 * b));
+}
+
+// ---------------------------------------------------------------------------------------------
+
+// Encodes one level, out holds TextureFormatBytes(format, width, height) bytes
+bool EncodeLevel(int format, const uint8_t *rgba, int width, int height, uint8_t *out)
+{
+    if(format == TEXTURE_FORMAT_RG8) {
+        for(size_t i=0, count=(size_t)width * height; i<count; i++) {
+            out[i * 2 + 0] = rgba[i * 4 + 0];
+            out[i * 2 + 1] = rgba[i * 4 + 1];
+        }
+        return true;
+    }
+    if(format != TEXTURE_FORMAT_BC5 && format != TEXTURE_FORMAT_EAC_RG && format != TEXTURE_FORMAT_BC1
+        && format != TEXTURE_FORMAT_BC3 && format != TEXTURE_FORMAT_ETC1 && format != TEXTURE_FORMAT_ETC2) return false;
+
+    uint8_t values[16];
+    uint8_t block[64];
+    size_t block_bytes = (size_t)TextureFormatBytes(format, 4, 4);
+    for(int by=0; by<height; by+=4) {
+        for(int bx=0; bx<width; bx+=4) {
+            switch(format) {
+                case TEXTURE_FORMAT_BC5:
+                case TEXTURE_FORMAT_EAC_RG:
+                    for(int c=0; c<2; c++) {
+                        LoadBlockChannel(rgba, width, height, bx, by, c, values);
+                        if(format == TEXTURE_FORMAT_BC5) EncodeBC4Block(values, out + c * 8);
+                        else EncodeEACR11Block(values, out + c * 8);
+                    }
+                    break;
+                case TEXTURE_FORMAT_BC1:
+                    LoadBlockRGBA(rgba, width, height, bx, by, block);
+                    EncodeBC1Block(block, out);
+                    break;
+                case TEXTURE_FORMAT_ETC1:
+                    LoadBlockRGBA(rgba, width, height, bx, by, block);
+                    EncodeETC1Block(block, out);
+                    break;
+                case TEXTURE_FORMAT_BC3:
+                case TEXTURE_FORMAT_ETC2:
+                    LoadBlockRGBA(rgba, width, height, bx, by, block);
+                    LoadBlockChannel(rgba, width, height, bx, by, 3, values);
+                    if(format == TEXTURE_FORMAT_BC3) {
+                        EncodeBC4Block(values, out);
+                        EncodeBC1Block(block, out + 8);
+                    }
+                    else {
+                        EncodeEACAlphaBlock(values, out);
+                        EncodeETC1Block(block, out + 8);
+                    }
+                    break;
+            }
+            out += block_bytes;
+        }
+    }
+    return true;
+}
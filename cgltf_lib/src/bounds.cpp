@@ -0,0 +1,328 @@
+// bounds.cpp
+// Native bounds for primitives and nodes.
+//   Bounds are computed from the actual POSITION data (accessor min/max are optional in
+//   gltf and often missing), transformed into world space and merged up the node tree.
+//
+//   Every bounds entry is a flat run of BOUNDS_STRIDE floats:
+//     minx, miny, minz, maxx, maxy, maxz, cx, cy, cz, radius
+//   An empty entry has min > max and a radius of -1.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <vector>
+
+#define BOUNDS_STRIDE   10
+
+struct Bounds
+{
+    float min[4];
+    float max[4];
+    float center[4];
+    float radius;
+};
+
+static void BoundsReset(Bounds *b)
+{
+    for(int i=0; i<4; i++) {
+        b->min[i] = FLT_MAX;
+        b->max[i] = -FLT_MAX;
+        b->center[i] = 0.0f;
+    }
+    b->radius = -1.0f;
+}
+
+static bool BoundsValid(const Bounds *b)
+{
+    return b->min[0] <= b->max[0];
+}
+
+static void BoundsMerge(Bounds *dst, const Bounds *src)
+{
+    if(!BoundsValid(src)) return;
+    simd_store(dst->min, simd_min(simd_load(dst->min), simd_load(src->min)));
+    simd_store(dst->max, simd_max(simd_load(dst->max), simd_load(src->max)));
+
+    // Grow the sphere to enclose the incoming one
+    if(dst->radius < 0.0f) {
+        memcpy(dst->center, src->center, sizeof(dst->center));
+        dst->radius = src->radius;
+        return;
+    }
+    float dx = src->center[0] - dst->center[0];
+    float dy = src->center[1] - dst->center[1];
+    float dz = src->center[2] - dst->center[2];
+    float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+    if(dist + src->radius <= dst->radius) return;
+    if(dist + dst->radius <= src->radius) {
+        memcpy(dst->center, src->center, sizeof(dst->center));
+        dst->radius = src->radius;
+        return;
+    }
+    float radius = (dist + dst->radius + src->radius) * 0.5f;
+    float t = (radius - dst->radius) / dist;
+    dst->center[0] += dx * t;
+    dst->center[1] += dy * t;
+    dst->center[2] += dz * t;
+    dst->radius = radius;
+}
+
+// Returns the float pointer for tightly readable float3 positions or nullptr if the accessor
+// needs the generic (dequantizing/sparse) read path.
+static const float * FloatPositions(const cgltf_accessor *acc, cgltf_size *stride)
+{
+    if(acc->is_sparse || acc->component_type != cgltf_component_type_r_32f) return nullptr;
+    if(acc->type != cgltf_type_vec3 || acc->buffer_view == nullptr) return nullptr;
+    const uint8_t *data = cgltf_buffer_view_data(acc->buffer_view);
+    if(data == nullptr) return nullptr;
+    *stride = acc->stride ? acc->stride : 3 * sizeof(float);
+    if((*stride & 3) != 0) return nullptr;
+    return (const float *)(data + acc->offset);
+}
+
+// Tight aabb and bounding sphere of a position accessor.
+//   The aabb is a simd min/max sweep. The sphere is centered on the aabb and its radius is the
+//   furthest point from that center, which is tighter than the half diagonal of the box.
+static void ComputeAccessorBounds(const cgltf_accessor *acc, Bounds *out)
+{
+    BoundsReset(out);
+    if(acc == nullptr || acc->count == 0) return;
+
+    cgltf_size stride = 0;
+    const float *pos = FloatPositions(acc, &stride);
+    std::vector<float> unpacked;
+    if(pos == nullptr) {
+        // Quantized, normalized or sparse positions. Unpack once through cgltf.
+        unpacked.resize(acc->count * 3);
+        cgltf_accessor_unpack_floats(acc, unpacked.data(), unpacked.size());
+        pos = unpacked.data();
+        stride = 3 * sizeof(float);
+    }
+
+    const uint8_t *base = (const uint8_t *)pos;
+    cgltf_size count = acc->count;
+    simd4f vmin = simd_splat(FLT_MAX);
+    simd4f vmax = simd_splat(-FLT_MAX);
+    // The 4 wide load reads one float past the position. Only safe before the last vertex.
+    for(cgltf_size i=0; i<count - 1; i++) {
+        simd4f p = simd_load((const float *)(base + i * stride));
+        vmin = simd_min(vmin, p);
+        vmax = simd_max(vmax, p);
+    }
+    simd4f last = simd_load3((const float *)(base + (count - 1) * stride));
+    vmin = simd_min(vmin, last);
+    vmax = simd_max(vmax, last);
+
+    simd_store(out->min, vmin);
+    simd_store(out->max, vmax);
+    out->min[3] = out->max[3] = 0.0f;
+
+    simd4f center = simd_mul(simd_add(vmin, vmax), simd_splat(0.5f));
+    simd_store(out->center, center);
+    out->center[3] = 0.0f;
+
+    center = simd_load(out->center);
+    float radius2 = 0.0f;
+    float d2[4];
+    for(cgltf_size i=0; i<count; i++) {
+        const float *p = (const float *)(base + i * stride);
+        simd4f d = simd_sub((i < count - 1) ? simd_load(p) : simd_load3(p), center);
+        simd_store(d2, simd_mul(d, d));
+        float r2 = d2[0] + d2[1] + d2[2];
+        if(r2 > radius2) radius2 = r2;
+    }
+    out->radius = sqrtf(radius2);
+}
+
+static void ComputePrimitiveBounds(const cgltf_primitive *prim, Bounds *out)
+{
+    const cgltf_accessor *acc = cgltf_find_accessor(prim, cgltf_attribute_type_position, 0);
+    ComputeAccessorBounds(acc, out);
+}
+
+// Arvo's method: transform the box center and use |M| for the extents.
+static void TransformBounds(const Bounds *in, const float *m, Bounds *out)
+{
+    BoundsReset(out);
+    if(!BoundsValid(in)) return;
+
+    simd4f c0 = simd_load(&m[0]);
+    simd4f c1 = simd_load(&m[4]);
+    simd4f c2 = simd_load(&m[8]);
+    simd4f c3 = simd_load(&m[12]);
+
+    simd4f vmin = simd_load(in->min);
+    simd4f vmax = simd_load(in->max);
+    float c[4], e[4];
+    simd_store(c, simd_mul(simd_add(vmin, vmax), simd_splat(0.5f)));
+    simd_store(e, simd_mul(simd_sub(vmax, vmin), simd_splat(0.5f)));
+
+    simd4f wc = simd_madd(c0, simd_splat(c[0]), simd_madd(c1, simd_splat(c[1]), simd_madd(c2, simd_splat(c[2]), c3)));
+    simd4f we = simd_madd(simd_abs(c0), simd_splat(e[0]), simd_madd(simd_abs(c1), simd_splat(e[1]), simd_mul(simd_abs(c2), simd_splat(e[2]))));
+
+    simd_store(out->min, simd_sub(wc, we));
+    simd_store(out->max, simd_add(wc, we));
+    out->min[3] = out->max[3] = 0.0f;
+
+    // Sphere: transform the center, scale the radius by the largest axis scale
+    simd4f sc = simd_madd(c0, simd_splat(in->center[0]), simd_madd(c1, simd_splat(in->center[1]), simd_madd(c2, simd_splat(in->center[2]), c3)));
+    simd_store(out->center, sc);
+    float sx = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+    float sy = m[4] * m[4] + m[5] * m[5] + m[6] * m[6];
+    float sz = m[8] * m[8] + m[9] * m[9] + m[10] * m[10];
+    float smax = sx > sy ? sx : sy;
+    smax = smax > sz ? smax : sz;
+    out->radius = in->radius * sqrtf(smax);
+}
+
+// Merged spheres can end up looser than the sphere around the merged box. Keep the smaller.
+static void FinishMergedSphere(Bounds *b)
+{
+    if(!BoundsValid(b)) return;
+    float hx = (b->max[0] - b->min[0]) * 0.5f;
+    float hy = (b->max[1] - b->min[1]) * 0.5f;
+    float hz = (b->max[2] - b->min[2]) * 0.5f;
+    float radius = sqrtf(hx * hx + hy * hy + hz * hz);
+    if(b->radius >= 0.0f && b->radius <= radius) return;
+    b->center[0] = b->min[0] + hx;
+    b->center[1] = b->min[1] + hy;
+    b->center[2] = b->min[2] + hz;
+    b->radius = radius;
+}
+
+static void PushBounds(lua_State *L, const Bounds *b, int *index)
+{
+    const float values[BOUNDS_STRIDE] = {
+        b->min[0], b->min[1], b->min[2], b->max[0], b->max[1], b->max[2],
+        b->center[0], b->center[1], b->center[2], b->radius
+    };
+    for(int i=0; i<BOUNDS_STRIDE; i++) {
+        lua_pushnumber(L, values[i]);
+        lua_rawseti(L, -2, (*index)++);
+    }
+}
+
+// World bounds of a node subtree. Children are merged into the parent entry.
+static void ComputeNodeBounds(cgltf_data *data, cgltf_node *node, const std::vector<Bounds> &mesh_bounds,
+    const std::vector<size_t> &mesh_first, std::vector<Bounds> &node_bounds)
+{
+    size_t node_id = cgltf_node_index(data, node);
+    Bounds &nb = node_bounds[node_id];
+    BoundsReset(&nb);
+
+    if(node->mesh) {
+        // An instanced node draws its mesh once per instance, and never at the node itself
+        std::vector<float> matrices(16);
+        if(!NodeInstanceMatrices(node, true, matrices)) cgltf_node_transform_world(node, matrices.data());
+        size_t mesh_id = cgltf_mesh_index(data, node->mesh);
+        for(size_t m=0; m<matrices.size(); m+=16) {
+            for(cgltf_size p=0; p<node->mesh->primitives_count; p++) {
+                Bounds wb;
+                TransformBounds(&mesh_bounds[mesh_first[mesh_id] + p], &matrices[m], &wb);
+                BoundsMerge(&nb, &wb);
+            }
+        }
+    }
+
+    for(cgltf_size c=0; c<node->children_count; c++) {
+        ComputeNodeBounds(data, node->children[c], mesh_bounds, mesh_first, node_bounds);
+        BoundsMerge(&nb, &node_bounds[cgltf_node_index(data, node->children[c])]);
+    }
+    FinishMergedSphere(&nb);
+}
+
+// Compute all bounds for the current scene.
+//   Returns a table:
+//     primitives  - local bounds, mesh by mesh, primitive by primitive
+//     nodes       - world bounds of each node subtree, by node index
+//     scene       - world bounds of the whole scene
+//     stride      - floats per entry
+int lib_compute_bounds(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr) {
+        printf("[Error] compute_bounds: invalid gltf data.\n");
+        lua_pushnil(L);
+        return 1;
+    }
+
+    std::vector<size_t> mesh_first(data->meshes_count);
+    size_t prim_count = 0;
+    for(cgltf_size m=0; m<data->meshes_count; m++) {
+        mesh_first[m] = prim_count;
+        prim_count += data->meshes[m].primitives_count;
+    }
+
+    std::vector<Bounds> mesh_bounds(prim_count);
+    for(cgltf_size m=0; m<data->meshes_count; m++) {
+        cgltf_mesh *mesh = &data->meshes[m];
+        for(cgltf_size p=0; p<mesh->primitives_count; p++) {
+            ComputePrimitiveBounds(&mesh->primitives[p], &mesh_bounds[mesh_first[m] + p]);
+        }
+    }
+
+    std::vector<Bounds> node_bounds(data->nodes_count);
+    for(cgltf_size n=0; n<data->nodes_count; n++) {
+        BoundsReset(&node_bounds[n]);
+    }
+
+    Bounds scene;
+    BoundsReset(&scene);
+    if(data->scene) {
+        for(cgltf_size n=0; n<data->scene->nodes_count; n++) {
+            cgltf_node *node = data->scene->nodes[n];
+            ComputeNodeBounds(data, node, mesh_bounds, mesh_first, node_bounds);
+            BoundsMerge(&scene, &node_bounds[cgltf_node_index(data, node)]);
+        }
+    }
+    FinishMergedSphere(&scene);
+
+    lua_newtable(L);
+
+    lua_pushstring(L, "stride");
+    lua_pushinteger(L, BOUNDS_STRIDE);
+    lua_settable(L, -3);
+
+    int index = 1;
+    lua_pushstring(L, "primitives");
+    lua_createtable(L, (int)(prim_count * BOUNDS_STRIDE), 0);
+    for(size_t i=0; i<prim_count; i++) {
+        PushBounds(L, &mesh_bounds[i], &index);
+    }
+    lua_settable(L, -3);
+
+    index = 1;
+    lua_pushstring(L, "nodes");
+    lua_createtable(L, (int)(data->nodes_count * BOUNDS_STRIDE), 0);
+    for(cgltf_size i=0; i<data->nodes_count; i++) {
+        PushBounds(L, &node_bounds[i], &index);
+    }
+    lua_settable(L, -3);
+
+    index = 1;
+    lua_pushstring(L, "scene");
+    lua_createtable(L, BOUNDS_STRIDE, 0);
+    PushBounds(L, &scene, &index);
+    lua_settable(L, -3);
+
+    return 1;
+}
+
+// Local bounds of a single primitive as a flat table of BOUNDS_STRIDE floats.
+int lib_get_primitive_bounds(lua_State *L)
+{
+    cgltf_primitive * prim = (cgltf_primitive *)lua_touserdata(L, 1);
+    if(prim == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    Bounds b;
+    ComputePrimitiveBounds(prim, &b);
+    int index = 1;
+    lua_createtable(L, BOUNDS_STRIDE, 0);
+    PushBounds(L, &b, &index);
+    return 1;
+}
@@ -14,6 +14,7 @@
 /* Expose api for use by external */
 #include "cgltf/cgltf.h"
 #include "cgltf/cgltf_write.h"
+#include "cgltf_lib.h"
 
 /* cgltf files to make a simple cgltf lib */
 #define CGLTF_IMPLEMENTATION
@@ -22,17 +23,55 @@
 #define CGLTF_WRITE_IMPLEMENTATION
 #include "cgltf/cgltf_write.h"
 
-#define STB_IMAGE_STATIC
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#include "jobs.h"
 
 #include <vector>
 #include <map>
 #include <string>
 #include <fstream>
 
+struct ModelStorage
+{
+    std::vector<cgltf_buffer*>          buffers;
+    std::vector<cgltf_buffer_view*>     views;
+};
+
 static std::map<std::string, cgltf_data*>     loaded_files;
+static std::map<cgltf_data*, ModelStorage>    model_storage;
+
+// Wraps decoded memory in its own buffer + buffer view so accessors can point at it
+cgltf_buffer_view* AttachBufferView(cgltf_data *data, void *mem, cgltf_size size, cgltf_buffer_view_type type)
+{
+    ModelStorage &storage = model_storage[data];
+
+    cgltf_buffer *buffer = new cgltf_buffer();
+    buffer->size = size;
+    buffer->data = mem;
+    buffer->data_free_method = cgltf_data_free_method_none;
+    storage.buffers.push_back(buffer);
+
+    cgltf_buffer_view *bv = new cgltf_buffer_view();
+    bv->buffer = buffer;
+    bv->size = size;
+    bv->type = type;
+    storage.views.push_back(bv);
+    return bv;
+}
+
+static void FreeModelStorage(cgltf_data *data)
+{
+    std::map<cgltf_data*, ModelStorage>::iterator it = model_storage.find(data);
+    if(it == model_storage.end()) return;
+    ModelStorage &storage = it->second;
+    for(size_t i=0; i<storage.buffers.size(); i++) {
+        free(storage.buffers[i]->data);
+        delete storage.buffers[i];
+    }
+    for(size_t i=0; i<storage.views.size(); i++) {
+        delete storage.views[i];
+    }
+    model_storage.erase(it);
+}
 
 
 void DumpInfo(cgltf_data *data, const char *name) 
@@ -111,6 +150,9 @@ static int lib_cgltf_load_buffers(lua_State *L)
     cgltf_result result = cgltf_load_buffers(&options, data, filepath);
     if(result == cgltf_result_success) {
         printf("[Info] Loaded buffers: %s\n", filepath);
+        // EXT_meshopt_compression views are decoded up front so accessors read plain data
+        int decoded = DecodeMeshoptBufferViews(data);
+        if(decoded > 0) printf("[Info] Meshopt decoded buffer views: %d\n", decoded);
     } else {
         printf("[Error] Loading buffers: %s  Error: %d\n", filepath, (int)result);
         lua_pushnil(L);
@@ -121,6 +163,20 @@ static int lib_cgltf_load_buffers(lua_State *L)
     return 1;
 }
 
+// Free the gltf data and anything the native stages attached to it
+static int lib_cgltf_free(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data) {
+        FreeModelStorage(data);
+        MeshCacheFree(data);
+        AnimationFree(data);
+        SkinFree(data);
+        MorphFree(data);
+        cgltf_free(data);
+    }
+    return 0;
+}
 
 static int lib_cgltf_validate(lua_State *L)
 {
@@ -142,6 +198,8 @@ static int lib_cgltf_validate(lua_State *L)
     return 1;
 }
 
+// Copies the view into a Lua string. Images don't need it, images_decode and decode_image read
+// the view in place.
 static int lib_cgltf_buffer_view_data(lua_State *L)
 {
     cgltf_buffer_view * bv = (cgltf_buffer_view *)lua_touserdata(L, 1);
@@ -437,6 +495,17 @@ static int lib_get_texture_image(lua_State *L) {
     return 1;
 }
 
+// KHR_texture_basisu image of a texture, or nil
+static int lib_get_texture_basisu_image(lua_State *L) {
+    cgltf_texture * tex = (cgltf_texture *)lua_touserdata(L, 1);
+    if(tex == nullptr || tex->basisu_image == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushlightuserdata(L, tex->basisu_image);
+    return 1;
+}
+
 static int lib_get_materials_count(lua_State *L) {
     cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
     lua_pushnumber(L, data->materials_count);
@@ -507,6 +576,20 @@ static void fetchMaterial(lua_State *L, cgltf_data *data, cgltf_material *mat)
     lua_pushlightuserdata(L, mat->emissive_texture.texture);
     lua_settable(L, -3);
 
+    // KHR_texture_transform left on the base color texture after baking, as a row major 2x3 matrix
+    if(mat->pbr_metallic_roughness.base_color_texture.has_transform) {
+        float m[6];
+        TextureTransformMatrix(mat->pbr_metallic_roughness.base_color_texture.transform, m);
+        lua_pushstring(L, "base_color_transform");
+        lua_newtable(L);
+        for(int i=0; i<6; i++) {
+            lua_pushinteger(L, i+1);
+            lua_pushnumber(L, m[i]);
+            lua_settable(L, -3);
+        }
+        lua_settable(L, -3);
+    }
+
     lua_pushstring(L, "base_color_factor");
     lua_newtable(L);
 
@@ -596,6 +679,15 @@ static void addMesh(lua_State *L, cgltf_data *data, cgltf_mesh *mesh)
     lua_pushstring(L, "primitives" );
     lua_pushlightuserdata(L, mesh->primitives);
     lua_settable(L, -3);
+
+    lua_pushstring(L, "weights" );
+    lua_newtable(L);
+    for(cgltf_size i=0; i<mesh->weights_count; i++) {
+        lua_pushinteger(L, i+1);
+        lua_pushnumber(L, mesh->weights[i]);
+        lua_settable(L, -3);
+    }
+    lua_settable(L, -3);
 }
 
 static int lib_get_mesh_index(lua_State *L) {
@@ -618,7 +710,7 @@ static int lib_get_mesh(lua_State *L) {
 static int lib_get_mesh_primitive(lua_State *L) {
     cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
     cgltf_mesh * mesh = (cgltf_mesh *)lua_touserdata(L, 2);
-    int i = lua_tonumber(L, 2);
+    int i = lua_tonumber(L, 3);
 
     lua_newtable(L);
     cgltf_primitive * prim = &mesh->primitives[i];
@@ -643,6 +735,10 @@ static int lib_get_mesh_primitive(lua_State *L) {
     lua_pushinteger(L, prim->attributes_count);
     lua_settable(L, -3);
 
+    lua_pushstring(L, "targets_count");
+    lua_pushinteger(L, prim->targets_count);
+    lua_settable(L, -3);
+
     lua_pushstring(L, "attributes");
     lua_newtable(L);
     for(int i=0; i<prim->attributes_count; i++) {
@@ -696,6 +792,10 @@ static void addNodeData(lua_State *L, cgltf_data *data, cgltf_node *node)
     lua_pushstring(L, name);
     lua_settable(L, -3);
 
+    lua_pushstring(L, "index" );
+    lua_pushinteger(L, cgltf_node_index(data, node));
+    lua_settable(L, -3);
+
     lua_pushstring(L, "has_translation" );
     lua_pushboolean(L, node->has_translation);
     lua_settable(L, -3);
@@ -712,6 +812,10 @@ static void addNodeData(lua_State *L, cgltf_data *data, cgltf_node *node)
     lua_pushboolean(L, node->has_matrix);
     lua_settable(L, -3);
 
+    lua_pushstring(L, "has_instancing" );
+    lua_pushboolean(L, node->has_mesh_gpu_instancing);
+    lua_settable(L, -3);
+
     lua_pushstring(L, "translation");
     lua_newtable(L);
 
@@ -824,6 +928,7 @@ static const luaL_reg Module_methods[] =
 {
     {"cgltf_parse_file", lib_cgltf_parse_file},
     {"cgltf_load_buffers", lib_cgltf_load_buffers},
+    {"cgltf_free", lib_cgltf_free},
     {"cgltf_validate", lib_cgltf_validate},
     {"cgltf_buffer_view_data", lib_cgltf_buffer_view_data},
     {"cgltf_accessor_read_float", lib_cgltf_accessor_read_float},
@@ -844,6 +949,7 @@ static const luaL_reg Module_methods[] =
     {"get_texture_index", lib_get_texture_index},
     {"get_texture_name", lib_get_texture_name},
     {"get_texture_image", lib_get_texture_image},
+    {"get_texture_basisu_image", lib_get_texture_basisu_image},
 
     {"get_materials_count", lib_get_materials_count},
     {"get_material_index", lib_get_material_index},
@@ -861,6 +967,54 @@ static const luaL_reg Module_methods[] =
 
     {"get_accessor", lib_get_accessor},
 
+    {"compute_bounds", lib_compute_bounds},
+    {"get_primitive_bounds", lib_get_primitive_bounds},
+
+    {"draco_decode", lib_draco_decode},
+    {"draco_done", lib_draco_done},
+    {"draco_wait", lib_draco_wait},
+
+    {"get_node_instances", lib_get_node_instances},
+    {"batch_instances", lib_batch_instances},
+
+    {"mesh_cache_get", lib_mesh_cache_get},
+    {"mesh_cache_set", lib_mesh_cache_set},
+
+    {"decode_image", lib_decode_image},
+    {"generate_mips", lib_generate_mips},
+    {"mip_level", lib_mip_level},
+    {"set_texture_budget", lib_set_texture_budget},
+    {"texture_memory_release", lib_texture_memory_release},
+    {"get_texture_memory", lib_get_texture_memory},
+    {"texture_release", lib_texture_release},
+    {"images_decode", lib_images_decode},
+    {"images_done", lib_images_done},
+    {"images_poll", lib_images_poll},
+    {"reachable_images", lib_reachable_images},
+    {"get_primitive_material", lib_get_primitive_material},
+    {"images_wait", lib_images_wait},
+    {"supported_texture_formats", lib_supported_texture_formats},
+
+    {"bake_texture_transforms", lib_bake_texture_transforms},
+    {"atlas_build", lib_atlas_build},
+
+    {"animation_clips", lib_animation_clips},
+    {"animation_sample", lib_animation_sample},
+    {"pose_new", lib_pose_new},
+    {"pose_free", lib_pose_free},
+    {"pose_reset", lib_pose_reset},
+    {"pose_get_node", lib_pose_get_node},
+    {"pose_get_trs", lib_pose_get_trs},
+    {"anim_instance_new", lib_anim_instance_new},
+    {"anim_instance_set", lib_anim_instance_set},
+    {"anim_instance_get", lib_anim_instance_get},
+    {"anim_instance_free", lib_anim_instance_free},
+    {"animate_all", lib_animate_all},
+    {"skin_palette", lib_skin_palette},
+    {"skin_primitive", lib_skin_primitive},
+    {"skin_benchmark", lib_skin_benchmark},
+    {"morph_primitive", lib_morph_primitive},
+
     {"dump_info", DumpGLTFInfo},
     {0, 0}
 };
@@ -887,6 +1041,7 @@ static dmExtension::Result Initializecgltf_lib(dmExtension::Params* params)
 {
     // Init Lua
     LuaInit(params->m_L);
+    SetGraphicsContext(ExtensionParamsGetContextByName(params, "graphics"));
     dmLogInfo("Registered %s Extension", MODULE_NAME);
     return dmExtension::RESULT_OK;
 }
@@ -900,6 +1055,7 @@ static dmExtension::Result AppFinalizecgltf_lib(dmExtension::AppParams* params)
 static dmExtension::Result Finalizecgltf_lib(dmExtension::Params* params)
 {
     dmLogInfo("Finalizecgltf_lib");
+    JobsFinalize();
     return dmExtension::RESULT_OK;
 }
 
@@ -0,0 +1,244 @@
+// cgltf_lib.h
+// Shared declarations for the cgltf_lib native modules. The cgltf implementation itself
+// is compiled once in cgltf_lib.cpp, the other modules only need the declarations.
+
+#ifndef CGLTF_LIB_H
+#define CGLTF_LIB_H
+
+#include <dmsdk/sdk.h>
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+#ifndef CGLTF_EXPORT
+#define CGLTF_EXPORT extern
+#endif
+#include "cgltf/cgltf.h"
+
+// Model storage (cgltf_lib.cpp)
+//   Native stages that decode or generate data for a cgltf_data attach it here. The memory must
+//   come from malloc and is owned by the model until cgltf.cgltf_free is called.
+cgltf_buffer_view* AttachBufferView(cgltf_data *data, void *mem, cgltf_size size, cgltf_buffer_view_type type);
+
+// Bounds (bounds.cpp)
+int lib_compute_bounds(lua_State *L);
+int lib_get_primitive_bounds(lua_State *L);
+
+// Draco mesh decoding (draco.cpp)
+int lib_draco_decode(lua_State *L);
+int lib_draco_done(lua_State *L);
+int lib_draco_wait(lua_State *L);
+
+// EXT_mesh_gpu_instancing (instancing.cpp)
+bool NodeInstanceMatrices(cgltf_node *node, bool world, std::vector<float> &out);
+int lib_get_node_instances(lua_State *L);
+int lib_batch_instances(lua_State *L);
+
+// Shared mesh resources (meshcache.cpp)
+void MeshCacheFree(cgltf_data *data);
+int lib_mesh_cache_get(lua_State *L);
+int lib_mesh_cache_set(lua_State *L);
+
+// Image decoding (images.cpp)
+struct DecodedImage
+{
+    uint8_t *   pixels;     // RGBA8, free with FreeDecodedImage
+    int         width;
+    int         height;
+    int         channels;   // channels in the source image
+    char        error[128];
+};
+
+struct MipLevel
+{
+    uint32_t    offset;     // bytes into the chain
+    int         width;
+    int         height;
+    uint32_t    size;       // bytes of the level
+};
+
+bool DecodeImage(cgltf_image *image, const char *basepath, DecodedImage *out);
+void FreeDecodedImage(DecodedImage *image);
+bool GenerateMips(const uint8_t *pixels, int width, int height, bool srgb, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels, bool premultiplied = false);
+bool ImageIsSRGB(cgltf_data *data, cgltf_image *image);
+uint64_t FitImage(DecodedImage *image, int index, bool srgb, bool mips, int max_size);
+void PushImageBuffer(lua_State *L, const uint8_t *pixels, uint32_t size);
+void PushMipLevels(lua_State *L, const std::vector<MipLevel> &levels);
+int lib_decode_image(lua_State *L);
+int lib_generate_mips(lua_State *L);
+int lib_mip_level(lua_State *L);
+int lib_set_texture_budget(lua_State *L);
+int lib_texture_memory_release(lua_State *L);
+int lib_get_texture_memory(lua_State *L);
+int lib_texture_release(lua_State *L);
+void TextureName(uint64_t hash, char *name, size_t size);
+bool TextureCacheFind(uint64_t hash, int *width, int *height);
+void TextureCacheInsert(uint64_t hash, int width, int height, uint64_t bytes);
+
+// GPU texture formats an image can be uploaded in (bit n of a format mask is format n)
+enum TextureFormat
+{
+    TEXTURE_FORMAT_RGBA8,
+    TEXTURE_FORMAT_BC1,
+    TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC7,
+    TEXTURE_FORMAT_ETC1,
+    TEXTURE_FORMAT_ETC2,
+    TEXTURE_FORMAT_ASTC_4X4,
+    TEXTURE_FORMAT_RG8,         // two channel formats, for normal maps
+    TEXTURE_FORMAT_BC5,
+    TEXTURE_FORMAT_EAC_RG,
+    TEXTURE_FORMAT_COUNT
+};
+
+enum KTX2Basis
+{
+    KTX2_BASIS_NONE,
+    KTX2_BASIS_ETC1S,
+    KTX2_BASIS_UASTC,
+};
+
+struct KTX2Info
+{
+    int         width;
+    int         height;
+    int         levels;
+    uint32_t    supercompression;
+    int         basis;      // KTX2Basis
+    int         format;     // TextureFormat the levels come out in
+    bool        srgb;
+    bool        has_alpha;
+    char        error[128];
+};
+
+const char *TextureFormatName(int format);
+int TextureFormatFromName(const char *name);
+void SetGraphicsContext(void *context);
+int lib_supported_texture_formats(lua_State *L);
+uint64_t TextureFormatBytes(int format, int width, int height);
+bool IsKTX2(const uint8_t *data, size_t size);
+void KTX2Init();
+bool KTX2Open(const uint8_t *data, size_t size, uint32_t formats, KTX2Info *info);
+bool KTX2Transcode(const uint8_t *data, size_t size, KTX2Info *info, int first, int count, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels);
+bool EncodeLevel(int format, const uint8_t *rgba, int width, int height, uint8_t *out);
+bool DiskCacheLoad(const char *prefix, uint64_t hash, bool mips, KTX2Info *info, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels);
+bool DiskCacheStore(const char *prefix, uint64_t hash, bool mips, int format, const std::vector<uint8_t> &chain, const std::vector<MipLevel> &levels);
+int lib_images_decode(lua_State *L);
+int lib_images_done(lua_State *L);
+int lib_images_poll(lua_State *L);
+#define MATERIAL_TEXTURE_VIEWS  21
+int MaterialTextureViews(const cgltf_material *mat, const cgltf_texture_view **out);
+cgltf_material *VariantMaterial(const cgltf_primitive *prim, int variant);
+void ReachableImages(cgltf_data *data, cgltf_scene *scene, int variant, std::vector<bool> &images);
+int lib_reachable_images(lua_State *L);
+int lib_get_primitive_material(lua_State *L);
+int lib_images_wait(lua_State *L);
+
+// KHR_texture_transform (texture_transform.cpp)
+void TextureTransformMatrix(const cgltf_texture_transform &t, float *m);
+int BakeTextureTransforms(cgltf_data *data, int *remaining);
+int lib_bake_texture_transforms(lua_State *L);
+
+// Texture atlas (atlas.cpp)
+int lib_atlas_build(lua_State *L);
+
+// Animation (animation.cpp)
+#define POSE_STRIDE             10      // floats per node: translation xyz, rotation xyzw, scale xyz
+#define ANIM_MAX_COMPONENTS     256     // floats per keyframe value (morph weights)
+
+enum AnimPath
+{
+    ANIM_PATH_TRANSLATION,
+    ANIM_PATH_ROTATION,
+    ANIM_PATH_SCALE,
+    ANIM_PATH_WEIGHTS,
+};
+
+struct AnimSampler
+{
+    int                     interpolation;  // cgltf_interpolation_type
+    int                     components;     // floats per value
+    int                     track;          // into AnimClip::tracks, samplers sharing keyframe times share a track
+    std::vector<float>      times;
+    std::vector<float>      values;         // cubic: in tangent, value, out tangent per key. Padded by 4.
+};
+
+struct AnimChannel
+{
+    int         node;
+    int         path;       // AnimPath
+    int         sampler;    // into AnimClip::samplers
+};
+
+struct AnimClip
+{
+    std::string                 name;
+    float                       duration;
+    std::vector<AnimSampler>    samplers;
+    std::vector<AnimChannel>    channels;
+    std::vector<int>            tracks;     // a sampler with each distinct list of keyframe times
+};
+
+struct Pose;
+
+struct AnimModel
+{
+    cgltf_data *            data;
+    int                     nodes;
+    std::vector<AnimClip>   clips;
+    std::vector<float>      rest;           // POSE_STRIDE per node
+    std::vector<float>      rest_weights;   // morph weights of every node with targets
+    std::vector<int>        weight_offset;  // per node into the weights, -1 without targets
+    std::vector<int>        weight_count;
+    std::vector<Pose*>      poses;
+};
+
+struct Pose
+{
+    AnimModel *             model;
+    std::vector<float>      trs;
+    std::vector<float>      weights;
+};
+
+AnimModel *GetAnimModel(cgltf_data *data);
+void AnimationFree(cgltf_data *data);
+int FindKeyframe(const std::vector<float> &times, float time, float *t);
+float SlerpFactor(float t, float d);
+float ClipTime(const AnimClip &clip, float time, bool loop);
+void SampleChannel(const AnimModel *model, const AnimClip &clip, int index, float time, float weight, float *trs, float *weights);
+void SampleClip(const AnimModel *model, const AnimClip &clip, float time, float weight, float *trs, float *weights);
+int lib_animation_clips(lua_State *L);
+int lib_animation_sample(lua_State *L);
+int lib_pose_new(lua_State *L);
+int lib_pose_free(lua_State *L);
+int lib_pose_reset(lua_State *L);
+int lib_pose_get_node(lua_State *L);
+int lib_pose_get_trs(lua_State *L);
+
+// Animation instances (animpool.cpp)
+void AnimPoolRemovePose(Pose *pose);
+int AnimateAll(float dt);
+int lib_anim_instance_new(lua_State *L);
+int lib_anim_instance_set(lua_State *L);
+int lib_anim_instance_get(lua_State *L);
+int lib_anim_instance_free(lua_State *L);
+int lib_animate_all(lua_State *L);
+
+// Skinning (skinning.cpp)
+#define PALETTE_STRIDE          12      // floats per joint: the top three rows of its matrix
+void SkinFree(cgltf_data *data);
+bool UnpackSoA3(const cgltf_accessor *acc, uint32_t count, uint32_t padded, std::vector<float> &out);
+int lib_skin_palette(lua_State *L);
+int lib_skin_primitive(lua_State *L);
+int lib_skin_benchmark(lua_State *L);
+
+// Morph targets (morph.cpp)
+void MorphFree(cgltf_data *data);
+void MorphedVertices(const cgltf_primitive *prim, const float **position, const float **normal);
+int lib_morph_primitive(lua_State *L);
+
+// Meshopt buffer view decoding (meshopt.cpp)
+//   Decodes EXT_meshopt_compression views into buffer_view->data. Returns the number decoded.
+int DecodeMeshoptBufferViews(cgltf_data *data);
+
+#endif
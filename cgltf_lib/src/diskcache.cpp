@@ -0,0 +1,89 @@
+// diskcache.cpp
+// Block compressed textures kept on disk between runs.
+//   images_decode encodes decoded images to a GPU format on the worker pool, which is slow enough
+//   to be worth doing once per asset per device. The encoded chain is stored under a path prefix
+//   (a save file directory) and named by the texture's content hash, so a later load of the same
+//   image reads the blocks back and skips decoding and encoding altogether.
+//   File: "GLTC", version, format, width, height, levels (u32 each), the hash (u64), then the
+//   levels largest first, each TextureFormatBytes long.
+
+#include "cgltf_lib.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define DISK_CACHE_MAGIC        0x43544c47u     // "GLTC"
+#define DISK_CACHE_VERSION      1
+
+static void DiskCachePath(const char *prefix, uint64_t hash, bool mips, char *path, size_t size)
+{
+    snprintf(path, size, "%s%016llx%s.gltc", prefix, (unsigned long long)hash, mips ? "_mips" : "");
+}
+
+// Reads the chain stored for hash. info gets the format, size and level count.
+bool DiskCacheLoad(const char *prefix, uint64_t hash, bool mips, KTX2Info *info, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels)
+{
+    char path[1024];
+    DiskCachePath(prefix, hash, mips, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if(f == nullptr) return false;
+
+    uint32_t header[6];
+    uint64_t stored_hash = 0;
+    bool ok = fread(header, sizeof(header), 1, f) == 1 && fread(&stored_hash, sizeof(stored_hash), 1, f) == 1;
+    ok = ok && header[0] == DISK_CACHE_MAGIC && header[1] == DISK_CACHE_VERSION && stored_hash == hash;
+    ok = ok && header[2] < TEXTURE_FORMAT_COUNT && header[3] > 0 && header[4] > 0 && header[5] > 0 && header[5] <= 32;
+
+    memset(info, 0, sizeof(*info));
+    levels.clear();
+    if(ok) {
+        info->format = (int)header[2];
+        info->width = (int)header[3];
+        info->height = (int)header[4];
+        info->levels = (int)header[5];
+        uint32_t total = 0;
+        for(int l=0; l<info->levels; l++) {
+            MipLevel level;
+            level.offset = total;
+            level.width = info->width >> l > 0 ? info->width >> l : 1;
+            level.height = info->height >> l > 0 ? info->height >> l : 1;
+            level.size = (uint32_t)TextureFormatBytes(info->format, level.width, level.height);
+            levels.push_back(level);
+            total += level.size;
+        }
+        chain.resize(total);
+        ok = fread(chain.data(), 1, total, f) == total;
+    }
+    fclose(f);
+    if(!ok) {
+        chain.clear();
+        levels.clear();
+    }
+    return ok;
+}
+
+// Writes the chain (levels halving from the first) for hash. A temporary file is renamed into
+// place, so other loads never read a partial file.
+bool DiskCacheStore(const char *prefix, uint64_t hash, bool mips, int format, const std::vector<uint8_t> &chain, const std::vector<MipLevel> &levels)
+{
+    if(levels.empty()) return false;
+    char path[1024], temp[1040];
+    DiskCachePath(prefix, hash, mips, path, sizeof(path));
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *f = fopen(temp, "wb");
+    if(f == nullptr) return false;
+
+    uint32_t header[6] = { DISK_CACHE_MAGIC, DISK_CACHE_VERSION, (uint32_t)format, (uint32_t)levels[0].width, (uint32_t)levels[0].height, (uint32_t)levels.size() };
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1 && fwrite(&hash, sizeof(hash), 1, f) == 1;
+    ok = ok && fwrite(chain.data(), 1, chain.size(), f) == chain.size();
+    ok = fclose(f) == 0 && ok;
+    if(ok) {
+        remove(path);
+        ok = rename(temp, path) == 0;
+    }
+    if(!ok) {
+        remove(temp);
+        printf("[Error] Texture cache: cannot write %s\n", path);
+    }
+    return ok;
+}
@@ -0,0 +1,220 @@
+// draco.cpp
+// KHR_draco_mesh_compression decoding.
+//   Each compressed primitive is decoded on a worker thread. When the batch is finished the
+//   decoded attributes and indices are attached to the primitive's accessors (as new buffer
+//   views), so the normal accessor based vertex/index build path reads them like any other data.
+//
+//   The bitstream decoder is in dracodec.cpp, it is always built in.
+
+#include "cgltf_lib.h"
+#include "jobs.h"
+#include "dracodec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <type_traits>
+
+struct DracoOutput
+{
+    cgltf_accessor *    accessor;
+    void *              data;
+    cgltf_size          size;
+    cgltf_size          count;
+};
+
+struct DracoTask
+{
+    cgltf_data *                data;
+    cgltf_primitive *           prim;
+    std::vector<DracoOutput>    outputs;
+    bool                        ok;
+    char                        error[128];
+};
+
+struct DracoJob
+{
+    JobBatch *                  batch;
+    cgltf_data *                data;
+    std::vector<DracoTask*>     tasks;
+};
+
+// A primitive needs decoding if any of its accessors have no (fallback) buffer view
+static bool NeedsDecode(cgltf_primitive *prim)
+{
+    if(!prim->has_draco_mesh_compression || prim->draco_mesh_compression.buffer_view == nullptr) return false;
+    if(prim->indices && prim->indices->buffer_view == nullptr) return true;
+    for(cgltf_size i=0; i<prim->attributes_count; i++) {
+        if(prim->attributes[i].data->buffer_view == nullptr) return true;
+    }
+    return false;
+}
+
+template <typename T>
+static void* ReadDracoAttribute(const DracoMesh *mesh, const DracoAttribute *att, int components)
+{
+    // Normalized integers are scaled to 0..1 (or -1..1) when they are read as floats
+    static const double normalize[DRACO_DT_COUNT] = { 1, 127, 255, 32767, 65535, 2147483647.0, 4294967295.0, 1, 1, 1, 1, 1 };
+    double scale = (att->normalized && std::is_floating_point<T>::value) ? 1.0 / normalize[att->data_type] : 1.0;
+    T *out = (T *)malloc(mesh->points * components * sizeof(T));
+    for(uint32_t i=0; i<mesh->points; i++) {
+        for(int c=0; c<components; c++) out[i * components + c] = (T)(DracoAttributeValue(att, i, c) * scale);
+    }
+    return out;
+}
+
+static void* ReadAttribute(const DracoMesh *mesh, const DracoAttribute *att, const cgltf_accessor *acc, cgltf_size *size)
+{
+    int components = (int)cgltf_num_components(acc->type);
+    *size = mesh->points * components * cgltf_component_size(acc->component_type);
+    switch(acc->component_type)
+    {
+        case cgltf_component_type_r_8:      return ReadDracoAttribute<int8_t>(mesh, att, components);
+        case cgltf_component_type_r_8u:     return ReadDracoAttribute<uint8_t>(mesh, att, components);
+        case cgltf_component_type_r_16:     return ReadDracoAttribute<int16_t>(mesh, att, components);
+        case cgltf_component_type_r_16u:    return ReadDracoAttribute<uint16_t>(mesh, att, components);
+        case cgltf_component_type_r_32u:    return ReadDracoAttribute<uint32_t>(mesh, att, components);
+        case cgltf_component_type_r_32f:    return ReadDracoAttribute<float>(mesh, att, components);
+        default: break;
+    }
+    return nullptr;
+}
+
+static void* ReadIndices(const DracoMesh *mesh, const cgltf_accessor *acc, cgltf_size *size)
+{
+    cgltf_size count = mesh->indices.size();
+    cgltf_size csize = cgltf_component_size(acc->component_type);
+    *size = count * csize;
+    uint8_t *out = (uint8_t *)malloc(*size);
+    for(cgltf_size i=0; i<count; i++) {
+        uint32_t index = mesh->indices[i];
+        if(csize == 1) out[i] = (uint8_t)index;
+        else if(csize == 2) ((uint16_t *)out)[i] = (uint16_t)index;
+        else ((uint32_t *)out)[i] = index;
+    }
+    return out;
+}
+
+static void DecodeTask(void *ctx)
+{
+    DracoTask *task = (DracoTask *)ctx;
+    cgltf_primitive *prim = task->prim;
+    cgltf_buffer_view *bv = prim->draco_mesh_compression.buffer_view;
+    const uint8_t *src = cgltf_buffer_view_data(bv);
+    if(src == nullptr) {
+        snprintf(task->error, sizeof(task->error), "compressed buffer not loaded");
+        return;
+    }
+
+    DracoMesh mesh;
+    const char *error = nullptr;
+    if(!DracoDecodeMesh(src, bv->size, &mesh, &error)) {
+        snprintf(task->error, sizeof(task->error), "%s", error);
+        return;
+    }
+
+    if(prim->indices) {
+        DracoOutput out = { prim->indices, nullptr, 0, (cgltf_size)mesh.indices.size() };
+        out.data = ReadIndices(&mesh, prim->indices, &out.size);
+        task->outputs.push_back(out);
+    }
+
+    // Draco attributes reference the draco unique id. cgltf stores it as an accessor index.
+    cgltf_draco_mesh_compression *draco = &prim->draco_mesh_compression;
+    for(cgltf_size i=0; i<prim->attributes_count; i++) {
+        cgltf_attribute *attrib = &prim->attributes[i];
+        for(cgltf_size d=0; d<draco->attributes_count; d++) {
+            if(strcmp(draco->attributes[d].name, attrib->name) != 0) continue;
+            uint32_t unique_id = (uint32_t)cgltf_accessor_index(task->data, draco->attributes[d].data);
+            const DracoAttribute *att = DracoFindAttribute(&mesh, unique_id);
+            if(att == nullptr) break;
+            DracoOutput out = { attrib->data, nullptr, 0, (cgltf_size)mesh.points };
+            out.data = ReadAttribute(&mesh, att, attrib->data, &out.size);
+            if(out.data) task->outputs.push_back(out);
+            break;
+        }
+    }
+    task->ok = true;
+}
+
+// Start decoding all draco compressed primitives on the worker pool.
+//   Returns a job handle for draco_done/draco_wait, or nil when nothing needs decoding.
+int lib_draco_decode(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    DracoJob *job = new DracoJob;
+    job->data = data;
+    for(cgltf_size m=0; m<data->meshes_count; m++) {
+        for(cgltf_size p=0; p<data->meshes[m].primitives_count; p++) {
+            cgltf_primitive *prim = &data->meshes[m].primitives[p];
+            if(!NeedsDecode(prim)) continue;
+            DracoTask *task = new DracoTask;
+            task->data = data;
+            task->prim = prim;
+            task->ok = false;
+            task->error[0] = 0;
+            job->tasks.push_back(task);
+        }
+    }
+    if(job->tasks.empty()) {
+        delete job;
+        lua_pushnil(L);
+        return 1;
+    }
+
+    job->batch = JobBatchNew();
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        JobBatchAdd(job->batch, DecodeTask, job->tasks[i]);
+    }
+    lua_pushlightuserdata(L, job);
+    return 1;
+}
+
+int lib_draco_done(lua_State *L)
+{
+    DracoJob *job = (DracoJob *)lua_touserdata(L, 1);
+    lua_pushboolean(L, job == nullptr || JobBatchDone(job->batch));
+    return 1;
+}
+
+// Wait for the decode to finish and attach the results to the accessors. Frees the handle.
+//   Returns the number of primitives decoded.
+int lib_draco_wait(lua_State *L)
+{
+    DracoJob *job = (DracoJob *)lua_touserdata(L, 1);
+    if(job == nullptr) {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+    JobBatchDelete(job->batch);
+
+    int decoded = 0;
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        DracoTask *task = job->tasks[i];
+        if(task->ok) {
+            for(size_t o=0; o<task->outputs.size(); o++) {
+                DracoOutput &out = task->outputs[o];
+                cgltf_buffer_view_type type = (out.accessor == task->prim->indices) ? cgltf_buffer_view_type_indices : cgltf_buffer_view_type_vertices;
+                out.accessor->buffer_view = AttachBufferView(job->data, out.data, out.size, type);
+                out.accessor->offset = 0;
+                out.accessor->count = out.count;
+                out.accessor->stride = cgltf_calc_size(out.accessor->type, out.accessor->component_type);
+            }
+            decoded++;
+        }
+        else {
+            for(size_t o=0; o<task->outputs.size(); o++) free(task->outputs[o].data);
+            printf("[Error] Draco decode failed: %s\n", task->error);
+        }
+        delete task;
+    }
+    delete job;
+
+    lua_pushinteger(L, decoded);
+    return 1;
+}
@@ -0,0 +1,1907 @@
+// dracodec.cpp
+// Draco mesh decoder.
+//   Decodes the Draco 2.2 bitstream, which is what current Draco encoders and glTF tools write.
+//   It covers what glTF assets use: sequential and edgebreaker (standard and valence) connectivity,
+//   rANS coded symbols, and the generic, integer, quantized and octahedral normal attribute
+//   decoders with their prediction schemes (difference, parallelogram, multi and constrained
+//   multi parallelogram, portable texture coordinates and geometric normals).
+//   It follows the reference decoder (github.com/google/draco) step by step, and keeps its names
+//   where it can, so the two can be read side by side. Point clouds, older bitstream versions
+//   and the deprecated texture coordinate predictor are not supported. Metadata is skipped.
+
+#include "dracodec.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+#define INVALID                 -1
+
+#define ANS_L_BASE              4096
+#define ANS_IO_BASE             256
+
+// Encoder types and connectivity methods
+#define DRACO_TRIANGULAR_MESH   1
+#define DRACO_SEQUENTIAL        0
+#define DRACO_EDGEBREAKER       1
+#define DRACO_METADATA_FLAG     0x8000
+
+// Edgebreaker traversals and topology symbols (as bit patterns)
+#define TRAVERSAL_STANDARD      0
+#define TRAVERSAL_VALENCE       2
+#define TOPOLOGY_C              0x0
+#define TOPOLOGY_S              0x1
+#define TOPOLOGY_L              0x3
+#define TOPOLOGY_R              0x5
+#define TOPOLOGY_E              0x7
+#define TOPOLOGY_INVALID        0x9
+
+// Attribute decoders
+#define MESH_VERTEX_ATTRIBUTE           0
+#define MESH_CORNER_ATTRIBUTE           1
+#define TRAVERSAL_DEPTH_FIRST           0
+#define TRAVERSAL_PREDICTION_DEGREE     1
+#define SEQUENTIAL_GENERIC              0
+#define SEQUENTIAL_INTEGER              1
+#define SEQUENTIAL_QUANTIZATION         2
+#define SEQUENTIAL_NORMALS              3
+#define ATTRIBUTE_POSITION              0
+
+// Prediction schemes and their transforms
+#define PREDICTION_NONE                         -2
+#define PREDICTION_DIFFERENCE                   0
+#define PREDICTION_PARALLELOGRAM                1
+#define PREDICTION_MULTI_PARALLELOGRAM          2
+#define PREDICTION_TEX_COORDS_DEPRECATED        3
+#define PREDICTION_CONSTRAINED_PARALLELOGRAM    4
+#define PREDICTION_TEX_COORDS_PORTABLE          5
+#define PREDICTION_GEOMETRIC_NORMAL             6
+#define TRANSFORM_WRAP                          1
+#define TRANSFORM_NORMAL_OCTAHEDRON             2
+#define TRANSFORM_NORMAL_OCTAHEDRON_CANONICAL   3
+
+#define MAX_PARALLELOGRAMS      4
+#define MAX_COMPONENTS          16
+
+static const uint32_t symbol_to_topology[5] = { TOPOLOGY_C, TOPOLOGY_S, TOPOLOGY_L, TOPOLOGY_R, TOPOLOGY_E };
+
+static const int data_type_size[DRACO_DT_COUNT] = { 0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 1 };
+
+// ---------------------------------------------------------------------------------------------
+// Input buffer. Bit reads are least significant bit first and start at pos, which only moves
+// on to the next whole byte when EndBits is called.
+
+struct DracoBuffer
+{
+    const uint8_t * data;
+    size_t          size;
+    size_t          pos;
+    size_t          bit_pos;
+};
+
+static bool ReadBytes(DracoBuffer *b, void *out, size_t count)
+{
+    if(count > b->size - b->pos) return false;
+    memcpy(out, b->data + b->pos, count);
+    b->pos += count;
+    return true;
+}
+
+template <typename T>
+static bool Read(DracoBuffer *b, T *out)
+{
+    return ReadBytes(b, out, sizeof(T));
+}
+
+static bool ReadVarint(DracoBuffer *b, uint64_t *out)
+{
+    uint64_t value = 0;
+    for(int shift=0; shift<64; shift+=7) {
+        uint8_t c;
+        if(!Read(b, &c)) return false;
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if((c & 0x80) == 0) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ReadVarint32(DracoBuffer *b, uint32_t *out)
+{
+    uint64_t value;
+    if(!ReadVarint(b, &value) || value > 0xffffffffu) return false;
+    *out = (uint32_t)value;
+    return true;
+}
+
+static bool StartBits(DracoBuffer *b, uint64_t *size)
+{
+    if(size && !ReadVarint(b, size)) return false;
+    b->bit_pos = 0;
+    return true;
+}
+
+static bool ReadBits(DracoBuffer *b, int count, uint32_t *out)
+{
+    uint32_t value = 0;
+    for(int i=0; i<count; i++) {
+        size_t byte = b->pos + (b->bit_pos >> 3);
+        if(byte >= b->size) return false;
+        value |= (uint32_t)((b->data[byte] >> (b->bit_pos & 7)) & 1) << i;
+        b->bit_pos++;
+    }
+    *out = value;
+    return true;
+}
+
+static void EndBits(DracoBuffer *b)
+{
+    b->pos = std::min(b->size, b->pos + ((b->bit_pos + 7) >> 3));
+    b->bit_pos = 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// rANS. Bits are coded with an 8 bit probability of zero (rABS), symbols with a probability
+// table of 12 to 20 bits precision. Both read their data backwards from the end.
+
+struct RAnsBitDecoder
+{
+    const uint8_t * buf;
+    int             offset;
+    uint32_t        state;
+    uint8_t         prob_zero;
+};
+
+// Reads the initial state stored in the last 1-4 bytes, the top two bits give the byte count
+static bool AnsReadInit(const uint8_t *buf, int offset, int max_bytes, uint32_t l_base, int *out_offset, uint32_t *state)
+{
+    if(offset < 1) return false;
+    int x = buf[offset - 1] >> 6;
+    if(x >= max_bytes || offset < x + 1) return false;
+    uint32_t value = 0;
+    for(int i=0; i<=x; i++) value |= (uint32_t)buf[offset - 1 - x + i] << (8 * i);
+    *out_offset = offset - 1 - x;
+    *state = (value & ((1u << (8 * x + 6)) - 1)) + l_base;
+    return *state < l_base * ANS_IO_BASE;
+}
+
+static bool RAnsBitStart(RAnsBitDecoder *d, DracoBuffer *b)
+{
+    uint32_t size;
+    if(!Read(b, &d->prob_zero) || !ReadVarint32(b, &size) || size > b->size - b->pos) return false;
+    d->buf = b->data + b->pos;
+    b->pos += size;
+    return AnsReadInit(d->buf, (int)size, 3, ANS_L_BASE, &d->offset, &d->state);
+}
+
+static bool RAnsBitRead(RAnsBitDecoder *d)
+{
+    if(d->state < ANS_L_BASE && d->offset > 0) d->state = d->state * ANS_IO_BASE + d->buf[--d->offset];
+    uint32_t p = 256 - d->prob_zero;
+    uint32_t quot = d->state / 256, rem = d->state % 256;
+    uint32_t xn = quot * p;
+    bool val = rem < p;
+    d->state = val ? xn + rem : d->state - xn - p;
+    return val;
+}
+
+struct RAnsSymbolDecoder
+{
+    int                     precision_bits;
+    std::vector<uint32_t>   prob, cum_prob;
+    std::vector<uint32_t>   lut;            // slot -> symbol
+    const uint8_t *         buf;
+    int                     offset;
+    uint32_t                state;
+};
+
+static int RAnsPrecision(int symbol_bits)
+{
+    return std::max(12, std::min(20, (3 * symbol_bits) / 2));
+}
+
+// Probability table: 2 bit token per entry, 0-2 extra bytes, or 3 for a run of zero entries
+static bool RAnsSymbolCreate(RAnsSymbolDecoder *d, DracoBuffer *b, int precision_bits)
+{
+    uint32_t num_symbols;
+    if(!ReadVarint32(b, &num_symbols) || num_symbols / 64 > b->size - b->pos) return false;
+    d->precision_bits = precision_bits;
+    d->prob.assign(num_symbols, 0);
+    for(uint32_t i=0; i<num_symbols; i++) {
+        uint8_t prob_data;
+        if(!Read(b, &prob_data)) return false;
+        int token = prob_data & 3;
+        if(token == 3) {
+            uint32_t run = prob_data >> 2;
+            if(i + run >= num_symbols) return false;
+            i += run;
+            continue;
+        }
+        uint32_t prob = prob_data >> 2;
+        for(int e=0; e<token; e++) {
+            uint8_t extra;
+            if(!Read(b, &extra)) return false;
+            prob |= (uint32_t)extra << (8 * (e + 1) - 2);
+        }
+        d->prob[i] = prob;
+    }
+    if(num_symbols == 0) return true;
+
+    uint32_t precision = 1u << precision_bits;
+    d->cum_prob.resize(num_symbols);
+    d->lut.resize(precision);
+    uint32_t cum = 0;
+    for(uint32_t i=0; i<num_symbols; i++) {
+        d->cum_prob[i] = cum;
+        if(d->prob[i] > precision - cum) return false;
+        for(uint32_t j=cum; j<cum + d->prob[i]; j++) d->lut[j] = i;
+        cum += d->prob[i];
+    }
+    return cum == precision;
+}
+
+static bool RAnsSymbolStart(RAnsSymbolDecoder *d, DracoBuffer *b)
+{
+    uint64_t size;
+    if(!ReadVarint(b, &size) || size > b->size - b->pos || size > 0x7fffffff) return false;
+    d->buf = b->data + b->pos;
+    b->pos += (size_t)size;
+    return AnsReadInit(d->buf, (int)size, 4, 4u << d->precision_bits, &d->offset, &d->state);
+}
+
+static uint32_t RAnsSymbolRead(RAnsSymbolDecoder *d)
+{
+    uint32_t l_base = 4u << d->precision_bits;
+    while(d->state < l_base && d->offset > 0) d->state = d->state * ANS_IO_BASE + d->buf[--d->offset];
+    uint32_t quo = d->state >> d->precision_bits;
+    uint32_t rem = d->state & ((1u << d->precision_bits) - 1);
+    uint32_t symbol = d->lut[rem];
+    d->state = quo * d->prob[symbol] + rem - d->cum_prob[symbol];
+    return symbol;
+}
+
+// Tagged: a rANS coded bit length per value (all components), then the raw bits
+static bool DecodeTaggedSymbols(uint32_t num_values, int num_components, DracoBuffer *b, uint32_t *out)
+{
+    RAnsSymbolDecoder tags;
+    if(!RAnsSymbolCreate(&tags, b, RAnsPrecision(5)) || !RAnsSymbolStart(&tags, b) || tags.prob.empty()) return false;
+    StartBits(b, nullptr);
+    uint32_t value_id = 0;
+    for(uint32_t i=0; i<num_values; i+=num_components) {
+        uint32_t bit_length = RAnsSymbolRead(&tags);
+        if(bit_length > 32) return false;
+        for(int c=0; c<num_components && value_id < num_values; c++) {
+            if(!ReadBits(b, (int)bit_length, &out[value_id++])) return false;
+        }
+    }
+    EndBits(b);
+    return true;
+}
+
+static bool DecodeRawSymbols(uint32_t num_values, DracoBuffer *b, uint32_t *out)
+{
+    uint8_t max_bit_length;
+    if(!Read(b, &max_bit_length) || max_bit_length < 1 || max_bit_length > 18) return false;
+    RAnsSymbolDecoder decoder;
+    if(!RAnsSymbolCreate(&decoder, b, RAnsPrecision(max_bit_length)) || decoder.prob.empty()) return false;
+    if(!RAnsSymbolStart(&decoder, b)) return false;
+    for(uint32_t i=0; i<num_values; i++) out[i] = RAnsSymbolRead(&decoder);
+    return true;
+}
+
+static bool DecodeSymbols(uint32_t num_values, int num_components, DracoBuffer *b, uint32_t *out)
+{
+    if(num_values == 0) return true;
+    uint8_t scheme;
+    if(!Read(b, &scheme)) return false;
+    if(scheme == 0) return DecodeTaggedSymbols(num_values, num_components, b, out);
+    if(scheme == 1) return DecodeRawSymbols(num_values, b, out);
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Corner table: three corners per face, each with its vertex and the corner opposite to it
+// across the face's edge. Attribute tables are copies where seam edges have no opposite and
+// vertices are split along the seams.
+
+static inline int Next(int c)
+{
+    return c < 0 ? INVALID : ((c % 3) == 2 ? c - 2 : c + 1);
+}
+
+static inline int Previous(int c)
+{
+    return c < 0 ? INVALID : ((c % 3) == 0 ? c + 2 : c - 1);
+}
+
+struct CornerTable
+{
+    std::vector<int32_t>    vertex;         // corner -> vertex
+    std::vector<int32_t>    opposite;       // corner -> opposite corner
+    std::vector<int32_t>    left_most;      // vertex -> left most corner
+
+    int Corners() const                 { return (int)vertex.size(); }
+    int Vertices() const                { return (int)left_most.size(); }
+    int Vertex(int c) const             { return c < 0 ? INVALID : vertex[c]; }
+    int Opposite(int c) const           { return c < 0 ? INVALID : opposite[c]; }
+    int SwingLeft(int c) const          { return Next(Opposite(Next(c))); }
+    int SwingRight(int c) const         { return Previous(Opposite(Previous(c))); }
+    int LeftCorner(int c) const         { return Opposite(Previous(c)); }
+    int RightCorner(int c) const        { return Opposite(Next(c)); }
+    bool IsOnBoundary(int v) const      { return SwingLeft(left_most[v]) == INVALID; }
+};
+
+static void SetOpposite(CornerTable *t, int a, int b)
+{
+    t->opposite[a] = b;
+    t->opposite[b] = a;
+}
+
+// Walks the corners around the vertex at corner c: left first, then right from c on a boundary
+struct VertexCorners
+{
+    const CornerTable * table;
+    int                 start;
+    int                 corner;
+    bool                left;
+};
+
+static VertexCorners VertexCornersStart(const CornerTable *table, int corner)
+{
+    VertexCorners it = { table, corner, corner, true };
+    return it;
+}
+
+static void VertexCornersNext(VertexCorners *it)
+{
+    if(it->left) {
+        it->corner = it->table->SwingLeft(it->corner);
+        if(it->corner == INVALID) {
+            it->corner = it->table->SwingRight(it->start);
+            it->left = false;
+        }
+        else if(it->corner == it->start) it->corner = INVALID;
+    }
+    else it->corner = it->table->SwingRight(it->corner);
+}
+
+// Per attribute data of the attributes whose connectivity differs from the positions'
+struct EncodingData
+{
+    std::vector<int32_t>    data_to_corner;     // encoded value -> corner
+    std::vector<int32_t>    vertex_to_data;     // vertex -> encoded value
+};
+
+struct AttributeData
+{
+    int                     decoder_id;
+    bool                    connectivity_used;
+    std::vector<int32_t>    seam_corners;
+    std::vector<uint8_t>    edge_on_seam;       // per corner
+    std::vector<uint8_t>    vertex_on_seam;     // per position vertex
+    CornerTable             table;
+    EncodingData            encoding;
+};
+
+struct AttributesDecoder
+{
+    int                     att_data_id;        // -1: uses the position connectivity
+    int                     decoder_type;
+    int                     traversal;
+    std::vector<int>        attributes;         // into DracoMesh::attributes
+    std::vector<int>        sequential;         // decoder type of each attribute
+    std::vector<uint32_t>   point_ids;          // points in decoding order
+};
+
+struct DracoDecoder
+{
+    DracoBuffer                         buffer;
+    int                                 method;
+    DracoMesh *                         mesh;
+    CornerTable                         table;
+    std::vector<uint8_t>                is_vert_hole;
+    std::vector<AttributeData>          attribute_data;
+    EncodingData                        pos_encoding;
+    std::vector<AttributesDecoder>      decoders;
+    std::vector<std::vector<int32_t> >  portable;   // integer values of each attribute
+    const char *                        error;
+};
+
+static bool Fail(DracoDecoder *d, const char *error)
+{
+    if(d->error == nullptr) d->error = error;
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Edgebreaker traversal. Standard codes each symbol with 1 or 3 bits, valence codes them with
+// rANS in one stream per valence (2..7) of the active vertex.
+
+struct Traversal
+{
+    int                                     type;
+    DracoBuffer                             symbols;
+    RAnsBitDecoder                          start_faces;
+    std::vector<RAnsBitDecoder>             seams;
+    std::vector<int32_t>                    valences;
+    std::vector<std::vector<uint32_t> >     context_symbols;
+    std::vector<int>                        context_counters;
+    int                                     active_context;
+    uint32_t                                last_symbol;
+};
+
+static bool TraversalStart(Traversal *tr, DracoBuffer *b, int num_attribute_data, int num_vertices, int num_faces)
+{
+    DracoBuffer buf = *b;
+    if(tr->type == TRAVERSAL_STANDARD) {
+        uint64_t size;
+        if(!StartBits(&buf, &size) || size > buf.size - buf.pos) return false;
+        tr->symbols = buf;
+        buf.pos += (size_t)size;
+    }
+    if(!RAnsBitStart(&tr->start_faces, &buf)) return false;
+    tr->seams.resize(num_attribute_data);
+    for(int i=0; i<num_attribute_data; i++) {
+        if(!RAnsBitStart(&tr->seams[i], &buf)) return false;
+    }
+    if(tr->type == TRAVERSAL_VALENCE) {
+        tr->valences.assign(num_vertices, 0);
+        tr->context_symbols.resize(6);
+        tr->context_counters.assign(6, 0);
+        tr->active_context = -1;
+        for(int i=0; i<6; i++) {
+            uint32_t count;
+            if(!ReadVarint32(&buf, &count) || count > (uint32_t)num_faces) return false;
+            if(count == 0) continue;
+            tr->context_symbols[i].resize(count);
+            if(!DecodeSymbols(count, 1, &buf, tr->context_symbols[i].data())) return false;
+            tr->context_counters[i] = (int)count;
+        }
+    }
+    b->pos = buf.pos;
+    return true;
+}
+
+static uint32_t TraversalSymbol(Traversal *tr)
+{
+    if(tr->type == TRAVERSAL_STANDARD) {
+        uint32_t symbol, suffix;
+        if(!ReadBits(&tr->symbols, 1, &symbol)) return TOPOLOGY_INVALID;
+        if(symbol == TOPOLOGY_C) return symbol;
+        if(!ReadBits(&tr->symbols, 2, &suffix)) return TOPOLOGY_INVALID;
+        return symbol | (suffix << 1);
+    }
+    // The first symbol of each valence coded component is always E
+    if(tr->active_context == -1) tr->last_symbol = TOPOLOGY_E;
+    else {
+        int counter = --tr->context_counters[tr->active_context];
+        if(counter < 0) return TOPOLOGY_INVALID;
+        uint32_t symbol = tr->context_symbols[tr->active_context][counter];
+        if(symbol > 4) return TOPOLOGY_INVALID;
+        tr->last_symbol = symbol_to_topology[symbol];
+    }
+    return tr->last_symbol;
+}
+
+static void TraversalNewActiveCorner(Traversal *tr, const CornerTable &t, int corner)
+{
+    if(tr->type != TRAVERSAL_VALENCE) return;
+    int v = t.Vertex(corner), next = t.Vertex(Next(corner)), prev = t.Vertex(Previous(corner));
+    switch(tr->last_symbol)
+    {
+        case TOPOLOGY_C:
+        case TOPOLOGY_S:    tr->valences[next] += 1; tr->valences[prev] += 1; break;
+        case TOPOLOGY_R:    tr->valences[v] += 1; tr->valences[next] += 1; tr->valences[prev] += 2; break;
+        case TOPOLOGY_L:    tr->valences[v] += 1; tr->valences[next] += 2; tr->valences[prev] += 1; break;
+        case TOPOLOGY_E:    tr->valences[v] += 2; tr->valences[next] += 2; tr->valences[prev] += 2; break;
+        default: break;
+    }
+    tr->active_context = std::max(2, std::min(7, (int)tr->valences[next])) - 2;
+}
+
+static void TraversalMergeVertices(Traversal *tr, int dest, int source)
+{
+    if(tr->type == TRAVERSAL_VALENCE) tr->valences[dest] += tr->valences[source];
+}
+
+struct TopologySplit
+{
+    int     source_symbol;
+    int     split_symbol;
+    int     source_edge;    // 0 left, 1 right
+};
+
+static int AddVertex(CornerTable *t)
+{
+    t->left_most.push_back(INVALID);
+    return t->Vertices() - 1;
+}
+
+// Rebuilds the faces from the symbols, in reverse of the encoder's order. Returns the number of
+// vertices used, or -1 on error.
+static int DecodeConnectivity(DracoDecoder *d, Traversal *tr, int num_symbols, std::vector<TopologySplit> &splits)
+{
+    CornerTable &t = d->table;
+    std::vector<int> active_corners;
+    std::unordered_map<int, int> split_active_corners;
+    std::vector<int> invalid_vertices;
+    bool remove_invalid_vertices = d->attribute_data.empty();
+    int max_num_vertices = (int)d->is_vert_hole.size();
+    int num_faces = 0;
+
+    for(int symbol_id=0; symbol_id<num_symbols; symbol_id++) {
+        int corner = 3 * num_faces++;
+        bool check_topology_split = false;
+        uint32_t symbol = TraversalSymbol(tr);
+        if(symbol == TOPOLOGY_C) {
+            // New face between the active edge (opposite a) and the next boundary edge around
+            // vertex x (opposite b)
+            if(active_corners.empty()) return -1;
+            int corner_a = active_corners.back();
+            int vertex_x = t.Vertex(Next(corner_a));
+            int corner_b = Next(t.left_most[vertex_x]);
+            if(corner_a == corner_b || t.Opposite(corner_a) != INVALID || t.Opposite(corner_b) != INVALID) return -1;
+            SetOpposite(&t, corner_a, corner + 1);
+            SetOpposite(&t, corner_b, corner + 2);
+            int vert_a_prev = t.Vertex(Previous(corner_a));
+            int vert_b_next = t.Vertex(Next(corner_b));
+            if(vertex_x == vert_a_prev || vertex_x == vert_b_next) return -1;
+            t.vertex[corner] = vertex_x;
+            t.vertex[corner + 1] = vert_b_next;
+            t.vertex[corner + 2] = vert_a_prev;
+            t.left_most[vert_a_prev] = corner + 2;
+            d->is_vert_hole[vertex_x] = 0;
+            active_corners.back() = corner;
+        }
+        else if(symbol == TOPOLOGY_R || symbol == TOPOLOGY_L) {
+            // New face on the active edge with one new vertex, the new active edge is on its
+            // right (R) or left (L) side
+            if(active_corners.empty()) return -1;
+            int corner_a = active_corners.back();
+            if(t.Opposite(corner_a) != INVALID) return -1;
+            int opp_corner, corner_l, corner_r;
+            if(symbol == TOPOLOGY_R) {
+                opp_corner = corner + 2;
+                corner_l = corner + 1;
+                corner_r = corner;
+            }
+            else {
+                opp_corner = corner + 1;
+                corner_l = corner;
+                corner_r = corner + 2;
+            }
+            SetOpposite(&t, opp_corner, corner_a);
+            int new_vertex = AddVertex(&t);
+            if(t.Vertices() > max_num_vertices) return -1;
+            t.vertex[opp_corner] = new_vertex;
+            t.left_most[new_vertex] = opp_corner;
+            int vertex_r = t.Vertex(Previous(corner_a));
+            t.vertex[corner_r] = vertex_r;
+            t.left_most[vertex_r] = corner_r;
+            t.vertex[corner_l] = t.Vertex(Next(corner_a));
+            active_corners.back() = corner;
+            check_topology_split = true;
+        }
+        else if(symbol == TOPOLOGY_S) {
+            // New face joining the two last active edges, their vertices p and n are merged
+            if(active_corners.empty()) return -1;
+            int corner_b = active_corners.back();
+            active_corners.pop_back();
+            std::unordered_map<int, int>::iterator it = split_active_corners.find(symbol_id);
+            if(it != split_active_corners.end()) active_corners.push_back(it->second);
+            if(active_corners.empty()) return -1;
+            int corner_a = active_corners.back();
+            if(corner_a == corner_b || t.Opposite(corner_a) != INVALID || t.Opposite(corner_b) != INVALID) return -1;
+            SetOpposite(&t, corner_a, corner + 2);
+            SetOpposite(&t, corner_b, corner + 1);
+            int vertex_p = t.Vertex(Previous(corner_a));
+            t.vertex[corner] = vertex_p;
+            t.vertex[corner + 1] = t.Vertex(Next(corner_a));
+            int vert_b_prev = t.Vertex(Previous(corner_b));
+            t.vertex[corner + 2] = vert_b_prev;
+            t.left_most[vert_b_prev] = corner + 2;
+            int corner_n = Next(corner_b);
+            int vertex_n = t.Vertex(corner_n);
+            TraversalMergeVertices(tr, vertex_p, vertex_n);
+            t.left_most[vertex_p] = t.left_most[vertex_n];
+            int first_corner = corner_n;
+            while(corner_n != INVALID) {
+                t.vertex[corner_n] = vertex_p;
+                corner_n = t.SwingLeft(corner_n);
+                if(corner_n == first_corner) return -1;
+            }
+            t.left_most[vertex_n] = INVALID;
+            if(remove_invalid_vertices) invalid_vertices.push_back(vertex_n);
+            active_corners.back() = corner;
+        }
+        else if(symbol == TOPOLOGY_E) {
+            // New isolated face with three new vertices
+            int first_vertex = t.Vertices();
+            for(int c=0; c<3; c++) {
+                AddVertex(&t);
+                t.vertex[corner + c] = first_vertex + c;
+                t.left_most[first_vertex + c] = corner + c;
+            }
+            if(t.Vertices() > max_num_vertices) return -1;
+            active_corners.push_back(corner);
+            check_topology_split = true;
+        }
+        else return -1;
+
+        TraversalNewActiveCorner(tr, t, active_corners.back());
+
+        // Faces created by L, R and E can be the source of a topology split, which keeps one of
+        // their other edges active for a later S symbol
+        if(check_topology_split) {
+            int encoder_symbol_id = num_symbols - symbol_id - 1;
+            while(!splits.empty() && splits.back().source_symbol >= encoder_symbol_id) {
+                if(splits.back().source_symbol > encoder_symbol_id) return -1;
+                TopologySplit split = splits.back();
+                splits.pop_back();
+                int act_top_corner = active_corners.back();
+                int new_active_corner = split.source_edge == 1 ? Next(act_top_corner) : Previous(act_top_corner);
+                split_active_corners[num_symbols - split.split_symbol - 1] = new_active_corner;
+            }
+        }
+    }
+    if(t.Vertices() > max_num_vertices) return -1;
+
+    // Close the start faces: either an interior face on three open edges, or a boundary
+    while(!active_corners.empty()) {
+        int corner = active_corners.back();
+        active_corners.pop_back();
+        if(!RAnsBitRead(&tr->start_faces)) continue;
+        if(3 * num_faces >= t.Corners()) return -1;
+        int corner_a = corner;
+        int vert_n = t.Vertex(Next(corner_a));
+        int corner_b = Next(t.left_most[vert_n]);
+        int vert_x = t.Vertex(Next(corner_b));
+        int corner_c = Next(t.left_most[vert_x]);
+        if(corner == corner_b || corner == corner_c || corner_b == corner_c) return -1;
+        if(t.Opposite(corner) != INVALID || t.Opposite(corner_b) != INVALID || t.Opposite(corner_c) != INVALID) return -1;
+        int vert_p = t.Vertex(Next(corner_c));
+        int new_corner = 3 * num_faces++;
+        SetOpposite(&t, new_corner, corner);
+        SetOpposite(&t, new_corner + 1, corner_b);
+        SetOpposite(&t, new_corner + 2, corner_c);
+        t.vertex[new_corner] = vert_x;
+        t.vertex[new_corner + 1] = vert_p;
+        t.vertex[new_corner + 2] = vert_n;
+        for(int c=0; c<3; c++) d->is_vert_hole[t.vertex[new_corner + c]] = 0;
+    }
+    if(3 * num_faces != t.Corners()) return -1;
+
+    // Without attribute seams vertices are points, so fill the holes merged vertices left
+    int num_vertices = t.Vertices();
+    for(size_t i=0; i<invalid_vertices.size(); i++) {
+        int invalid_vert = invalid_vertices[i];
+        int src_vert = num_vertices - 1;
+        while(src_vert >= 0 && t.left_most[src_vert] == INVALID) src_vert = --num_vertices - 1;
+        if(src_vert < invalid_vert) continue;
+        for(VertexCorners it = VertexCornersStart(&t, t.left_most[src_vert]); it.corner != INVALID; VertexCornersNext(&it)) {
+            if(t.vertex[it.corner] != src_vert) return -1;
+            t.vertex[it.corner] = invalid_vert;
+        }
+        t.left_most[invalid_vert] = t.left_most[src_vert];
+        t.left_most[src_vert] = INVALID;
+        d->is_vert_hole[invalid_vert] = d->is_vert_hole[src_vert];
+        d->is_vert_hole[src_vert] = 0;
+        num_vertices--;
+    }
+    return num_vertices;
+}
+
+// One seam bit per attribute on each interior edge, boundary edges are always seams
+static void DecodeAttributeSeams(DracoDecoder *d, Traversal *tr)
+{
+    const CornerTable &t = d->table;
+    for(int corner=0; corner<t.Corners(); corner+=3) {
+        int corners[3] = { corner, Next(corner), Previous(corner) };
+        for(int c=0; c<3; c++) {
+            int opp = t.Opposite(corners[c]);
+            if(opp == INVALID) {
+                for(size_t i=0; i<d->attribute_data.size(); i++) d->attribute_data[i].seam_corners.push_back(corners[c]);
+                continue;
+            }
+            if(opp / 3 < corner / 3) continue;
+            for(size_t i=0; i<d->attribute_data.size(); i++) {
+                if(RAnsBitRead(&tr->seams[i])) d->attribute_data[i].seam_corners.push_back(corners[c]);
+            }
+        }
+    }
+}
+
+// The attribute's own corner table: no opposites across seams, and a new vertex wherever a
+// seam is crossed going around a position vertex
+static bool BuildAttributeTable(const CornerTable &base, AttributeData *ad)
+{
+    ad->edge_on_seam.assign(base.Corners(), 0);
+    ad->vertex_on_seam.assign(base.Vertices(), 0);
+    for(size_t i=0; i<ad->seam_corners.size(); i++) {
+        int c = ad->seam_corners[i];
+        int opp = base.Opposite(c);
+        ad->edge_on_seam[c] = 1;
+        ad->vertex_on_seam[base.Vertex(Next(c))] = 1;
+        ad->vertex_on_seam[base.Vertex(Previous(c))] = 1;
+        if(opp != INVALID) {
+            ad->edge_on_seam[opp] = 1;
+            ad->vertex_on_seam[base.Vertex(Next(opp))] = 1;
+            ad->vertex_on_seam[base.Vertex(Previous(opp))] = 1;
+        }
+    }
+
+    CornerTable &t = ad->table;
+    t.opposite = base.opposite;
+    for(int c=0; c<base.Corners(); c++) {
+        if(ad->edge_on_seam[c]) t.opposite[c] = INVALID;
+    }
+    t.vertex.assign(base.Corners(), INVALID);
+    t.left_most.clear();
+    for(int v=0; v<base.Vertices(); v++) {
+        int c = base.left_most[v];
+        if(c == INVALID) continue;
+        int first_c = c;
+        if(ad->vertex_on_seam[v]) {
+            for(int act_c = t.SwingLeft(first_c); act_c != INVALID; act_c = t.SwingLeft(act_c)) {
+                first_c = act_c;
+                if(t.SwingLeft(act_c) == c) return false;
+            }
+        }
+        int vert = t.Vertices();
+        t.vertex[first_c] = vert;
+        t.left_most.push_back(first_c);
+        for(int act_c = base.SwingRight(first_c); act_c != INVALID && act_c != first_c; act_c = base.SwingRight(act_c)) {
+            if(ad->edge_on_seam[Next(act_c)]) {
+                vert = t.Vertices();
+                t.left_most.push_back(act_c);
+            }
+            t.vertex[act_c] = vert;
+        }
+    }
+    return true;
+}
+
+// Points are vertices split wherever any attribute has a seam
+static bool AssignPointsToCorners(DracoDecoder *d, int num_connectivity_verts)
+{
+    const CornerTable &t = d->table;
+    std::vector<uint32_t> &indices = d->mesh->indices;
+    indices.assign(t.Corners(), 0);
+    if(d->attribute_data.empty()) {
+        for(int c=0; c<t.Corners(); c++) indices[c] = (uint32_t)t.vertex[c];
+        d->mesh->points = (uint32_t)num_connectivity_verts;
+        return true;
+    }
+
+    uint32_t points = 0;
+    for(int v=0; v<t.Vertices(); v++) {
+        int c = t.left_most[v];
+        if(c == INVALID) continue;
+        int first = c;
+        if(!d->is_vert_hole[v]) {
+            // Start at a seam of any attribute, so each point is one run of corners
+            for(size_t i=0; i<d->attribute_data.size(); i++) {
+                const AttributeData &ad = d->attribute_data[i];
+                if(!ad.vertex_on_seam[v]) continue;
+                int vert_id = ad.table.vertex[c];
+                bool seam_found = false;
+                for(int act_c = t.SwingRight(c); act_c != c; act_c = t.SwingRight(act_c)) {
+                    if(act_c == INVALID) return false;
+                    if(ad.table.vertex[act_c] != vert_id) {
+                        first = act_c;
+                        seam_found = true;
+                        break;
+                    }
+                }
+                if(seam_found) break;
+            }
+        }
+        c = first;
+        indices[c] = points++;
+        int prev_c = c;
+        for(c = t.SwingRight(c); c != INVALID && c != first; c = t.SwingRight(c)) {
+            bool seam = false;
+            for(size_t i=0; i<d->attribute_data.size() && !seam; i++) {
+                seam = d->attribute_data[i].table.vertex[c] != d->attribute_data[i].table.vertex[prev_c];
+            }
+            indices[c] = seam ? points++ : indices[prev_c];
+            prev_c = c;
+        }
+    }
+    d->mesh->points = points;
+    return true;
+}
+
+static bool DecodeEdgebreakerConnectivity(DracoDecoder *d)
+{
+    DracoBuffer *b = &d->buffer;
+    uint8_t traversal_type, num_attribute_data;
+    uint32_t num_vertices, num_faces, num_symbols, num_split_symbols, num_topology_splits;
+    if(!Read(b, &traversal_type) || !ReadVarint32(b, &num_vertices) || !ReadVarint32(b, &num_faces)) return Fail(d, "truncated connectivity");
+    if(!Read(b, &num_attribute_data) || !ReadVarint32(b, &num_symbols) || !ReadVarint32(b, &num_split_symbols)) return Fail(d, "truncated connectivity");
+    if(traversal_type != TRAVERSAL_STANDARD && traversal_type != TRAVERSAL_VALENCE) return Fail(d, "unsupported edgebreaker traversal");
+    if(num_faces > (1u << 28) || num_symbols > num_faces || num_vertices > 3 * num_faces || num_split_symbols > num_symbols) return Fail(d, "invalid connectivity header");
+
+    // Topology splits: the source symbol ids are delta coded, the split symbols relative to them
+    if(!ReadVarint32(b, &num_topology_splits) || num_topology_splits > num_faces) return Fail(d, "invalid topology splits");
+    std::vector<TopologySplit> splits(num_topology_splits);
+    int last_source_symbol = 0;
+    for(uint32_t i=0; i<num_topology_splits; i++) {
+        uint32_t source_delta, split_delta;
+        if(!ReadVarint32(b, &source_delta) || !ReadVarint32(b, &split_delta)) return Fail(d, "invalid topology splits");
+        int64_t source = (int64_t)last_source_symbol + source_delta;
+        if(source > (int64_t)num_symbols || split_delta > source) return Fail(d, "invalid topology splits");
+        splits[i].source_symbol = (int)source;
+        splits[i].split_symbol = (int)(source - split_delta);
+        last_source_symbol = (int)source;
+    }
+    if(num_topology_splits > 0) {
+        StartBits(b, nullptr);
+        for(uint32_t i=0; i<num_topology_splits; i++) {
+            uint32_t edge;
+            if(!ReadBits(b, 1, &edge)) return Fail(d, "invalid topology splits");
+            splits[i].source_edge = (int)edge;
+        }
+        EndBits(b);
+    }
+
+    int total_vertices = (int)(num_vertices + num_split_symbols);
+    d->table.vertex.assign(3 * num_faces, INVALID);
+    d->table.opposite.assign(3 * num_faces, INVALID);
+    d->table.left_most.clear();
+    d->table.left_most.reserve(total_vertices);
+    d->is_vert_hole.assign(total_vertices, 1);
+    d->attribute_data.resize(num_attribute_data);
+    for(int i=0; i<num_attribute_data; i++) {
+        d->attribute_data[i].decoder_id = -1;
+        d->attribute_data[i].connectivity_used = true;
+    }
+
+    Traversal tr;
+    tr.type = traversal_type;
+    if(!TraversalStart(&tr, b, num_attribute_data, total_vertices, (int)num_faces)) return Fail(d, "invalid traversal data");
+    int num_connectivity_verts = DecodeConnectivity(d, &tr, (int)num_symbols, splits);
+    if(num_connectivity_verts < 0) return Fail(d, "invalid edgebreaker connectivity");
+
+    if(num_attribute_data > 0) DecodeAttributeSeams(d, &tr);
+    for(int i=0; i<num_attribute_data; i++) {
+        if(!BuildAttributeTable(d->table, &d->attribute_data[i])) return Fail(d, "invalid attribute seams");
+    }
+    d->pos_encoding.vertex_to_data.assign(d->table.Vertices(), 0);
+    for(int i=0; i<num_attribute_data; i++) {
+        int vertices = std::max(d->attribute_data[i].table.Vertices(), d->table.Vertices());
+        d->attribute_data[i].encoding.vertex_to_data.assign(vertices, 0);
+    }
+    if(!AssignPointsToCorners(d, num_connectivity_verts)) return Fail(d, "invalid attribute seams");
+    return true;
+}
+
+static bool DecodeSequentialConnectivity(DracoDecoder *d)
+{
+    DracoBuffer *b = &d->buffer;
+    uint32_t num_faces, num_points;
+    uint8_t method;
+    if(!ReadVarint32(b, &num_faces) || !ReadVarint32(b, &num_points) || !Read(b, &method)) return Fail(d, "truncated connectivity");
+    if(num_faces > (1u << 28) || (uint64_t)num_faces * 3 > (uint64_t)(b->size - b->pos) * 8 + 64) return Fail(d, "invalid connectivity header");
+    std::vector<uint32_t> &indices = d->mesh->indices;
+    indices.resize((size_t)num_faces * 3);
+    if(method == 0) {
+        // Differences to the previous index, sign in the lowest bit
+        if(!DecodeSymbols((uint32_t)indices.size(), 1, b, indices.data())) return Fail(d, "invalid indices");
+        int32_t last = 0;
+        for(size_t i=0; i<indices.size(); i++) {
+            int32_t diff = (int32_t)(indices[i] >> 1);
+            if(indices[i] & 1) diff = -diff;
+            last += diff;
+            indices[i] = (uint32_t)last;
+        }
+    }
+    else {
+        for(size_t i=0; i<indices.size(); i++) {
+            bool ok;
+            if(num_points < 256) { uint8_t v = 0; ok = Read(b, &v); indices[i] = v; }
+            else if(num_points < (1 << 16)) { uint16_t v = 0; ok = Read(b, &v); indices[i] = v; }
+            else if(num_points < (1 << 21)) ok = ReadVarint32(b, &indices[i]);
+            else ok = Read(b, &indices[i]);
+            if(!ok) return Fail(d, "truncated indices");
+        }
+    }
+    for(size_t i=0; i<indices.size(); i++) {
+        if(indices[i] >= num_points) return Fail(d, "index out of range");
+    }
+    d->mesh->points = num_points;
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Attribute decoding order: a traversal of the decoder's corner table, each newly reached
+// vertex is the next value
+
+struct Sequencer
+{
+    const CornerTable *     table;
+    EncodingData *          encoding;
+    const uint32_t *        corner_to_point;
+    std::vector<uint32_t> * point_ids;
+    std::vector<uint8_t>    vertex_visited;
+    std::vector<uint8_t>    face_visited;
+    std::vector<int>        stacks[3];
+    std::vector<int>        prediction_degree;
+    int                     best_priority;
+};
+
+static void VisitVertex(Sequencer *s, int vertex, int corner)
+{
+    if(s->vertex_visited[vertex]) return;
+    s->vertex_visited[vertex] = 1;
+    s->point_ids->push_back(s->corner_to_point[corner]);
+    s->encoding->vertex_to_data[vertex] = (int32_t)s->encoding->data_to_corner.size();
+    s->encoding->data_to_corner.push_back(corner);
+}
+
+static bool FaceVisited(const Sequencer *s, int corner)
+{
+    return corner == INVALID || s->face_visited[corner / 3];
+}
+
+static bool TraverseDepthFirst(Sequencer *s, int corner)
+{
+    const CornerTable &t = *s->table;
+    if(FaceVisited(s, corner)) return true;
+    std::vector<int> &stack = s->stacks[0];
+    stack.clear();
+    stack.push_back(corner);
+    int next_vert = t.Vertex(Next(corner)), prev_vert = t.Vertex(Previous(corner));
+    if(next_vert == INVALID || prev_vert == INVALID) return false;
+    VisitVertex(s, next_vert, Next(corner));
+    VisitVertex(s, prev_vert, Previous(corner));
+
+    while(!stack.empty()) {
+        corner = stack.back();
+        if(FaceVisited(s, corner)) {
+            stack.pop_back();
+            continue;
+        }
+        while(true) {
+            s->face_visited[corner / 3] = 1;
+            int vert = t.Vertex(corner);
+            if(vert == INVALID) return false;
+            if(!s->vertex_visited[vert]) {
+                bool on_boundary = t.IsOnBoundary(vert);
+                VisitVertex(s, vert, corner);
+                if(!on_boundary) {
+                    corner = t.RightCorner(corner);
+                    continue;
+                }
+            }
+            int right = t.RightCorner(corner), left = t.LeftCorner(corner);
+            bool right_visited = FaceVisited(s, right), left_visited = FaceVisited(s, left);
+            if(right_visited && left_visited) {
+                stack.pop_back();
+                break;
+            }
+            if(right_visited) corner = left;
+            else if(left_visited) corner = right;
+            else {
+                // Both sides open: the right side is traversed first
+                stack.back() = left;
+                stack.push_back(right);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Prefers faces whose tip vertex is already predicted by other faces
+static int TraversalPriority(Sequencer *s, int corner)
+{
+    int v = s->table->Vertex(corner);
+    if(s->vertex_visited[v]) return 0;
+    return ++s->prediction_degree[v] > 1 ? 1 : 2;
+}
+
+static bool TraversePredictionDegree(Sequencer *s, int corner)
+{
+    const CornerTable &t = *s->table;
+    s->stacks[0].push_back(corner);
+    s->best_priority = 0;
+    VisitVertex(s, t.Vertex(Next(corner)), Next(corner));
+    VisitVertex(s, t.Vertex(Previous(corner)), Previous(corner));
+    VisitVertex(s, t.Vertex(corner), corner);
+
+    while(true) {
+        corner = INVALID;
+        for(int i=s->best_priority; i<3 && corner == INVALID; i++) {
+            if(s->stacks[i].empty()) continue;
+            corner = s->stacks[i].back();
+            s->stacks[i].pop_back();
+            s->best_priority = i;
+        }
+        if(corner == INVALID) break;
+        if(FaceVisited(s, corner)) continue;
+        while(true) {
+            s->face_visited[corner / 3] = 1;
+            VisitVertex(s, t.Vertex(corner), corner);
+            int right = t.RightCorner(corner), left = t.LeftCorner(corner);
+            bool right_visited = FaceVisited(s, right), left_visited = FaceVisited(s, left);
+            if(!left_visited) {
+                int priority = TraversalPriority(s, left);
+                if(right_visited && priority <= s->best_priority) {
+                    corner = left;
+                    continue;
+                }
+                s->stacks[priority].push_back(left);
+                s->best_priority = std::min(s->best_priority, priority);
+            }
+            if(!right_visited) {
+                int priority = TraversalPriority(s, right);
+                if(priority <= s->best_priority) {
+                    corner = right;
+                    continue;
+                }
+                s->stacks[priority].push_back(right);
+                s->best_priority = std::min(s->best_priority, priority);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+static bool GenerateSequence(DracoDecoder *d, AttributesDecoder *dec)
+{
+    dec->point_ids.clear();
+    if(d->method == DRACO_SEQUENTIAL) {
+        for(uint32_t p=0; p<d->mesh->points; p++) dec->point_ids.push_back(p);
+        return true;
+    }
+    Sequencer s;
+    s.table = &d->table;
+    s.encoding = &d->pos_encoding;
+    if(dec->att_data_id >= 0) {
+        AttributeData &ad = d->attribute_data[dec->att_data_id];
+        s.encoding = &ad.encoding;
+        if(dec->decoder_type == MESH_CORNER_ATTRIBUTE) s.table = &ad.table;
+    }
+    s.corner_to_point = d->mesh->indices.data();
+    s.point_ids = &dec->point_ids;
+    s.vertex_visited.assign(s.table->Vertices(), 0);
+    s.face_visited.assign(s.table->Corners() / 3, 0);
+    s.prediction_degree.assign(s.table->Vertices(), 0);
+    s.encoding->data_to_corner.clear();
+    for(int corner=0; corner<s.table->Corners(); corner+=3) {
+        bool ok = dec->traversal == TRAVERSAL_PREDICTION_DEGREE ? TraversePredictionDegree(&s, corner) : TraverseDepthFirst(&s, corner);
+        if(!ok) return false;
+    }
+
+    // Each point's value is the one of its vertex in the traversed table
+    for(size_t i=0; i<dec->attributes.size(); i++) {
+        std::vector<uint32_t> &point_map = d->mesh->attributes[dec->attributes[i]].point_map;
+        point_map.assign(d->mesh->points, 0);
+        for(int c=0; c<s.table->Corners(); c++) {
+            int vert = s.table->vertex[c];
+            if(vert == INVALID) return false;
+            point_map[d->mesh->indices[c]] = (uint32_t)s.encoding->vertex_to_data[vert];
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Prediction transforms. Wrap keeps corrections in the value range, the octahedron ones wrap
+// corrections around the octahedral normal map (canonicalized: rotated so the prediction is in
+// the bottom left quadrant).
+
+struct Octahedron
+{
+    int32_t     quantization_bits;
+    int32_t     max_quantized_value;
+    int32_t     max_value;
+    int32_t     center_value;
+    float       dequantization_scale;
+};
+
+static bool OctahedronInit(Octahedron *o, int32_t q)
+{
+    if(q < 2 || q > 30) return false;
+    o->quantization_bits = q;
+    o->max_quantized_value = (1 << q) - 1;
+    o->max_value = o->max_quantized_value - 1;
+    o->dequantization_scale = 2.0f / o->max_value;
+    o->center_value = o->max_value / 2;
+    return true;
+}
+
+static void OctahedronCanonicalizeVector(const Octahedron &o, int32_t *vec)
+{
+    int64_t abs_sum = (int64_t)abs(vec[0]) + abs(vec[1]) + abs(vec[2]);
+    if(abs_sum == 0) {
+        vec[0] = o.center_value;
+        return;
+    }
+    vec[0] = (int32_t)((int64_t)vec[0] * o.center_value / abs_sum);
+    vec[1] = (int32_t)((int64_t)vec[1] * o.center_value / abs_sum);
+    int32_t z = o.center_value - abs(vec[0]) - abs(vec[1]);
+    vec[2] = vec[2] >= 0 ? z : -z;
+}
+
+static void OctahedronCanonicalizeCoords(const Octahedron &o, int32_t s, int32_t t, int32_t *out_s, int32_t *out_t)
+{
+    int32_t max = o.max_value, center = o.center_value;
+    if((s == 0 && t == 0) || (s == 0 && t == max) || (s == max && t == 0)) {
+        s = max;
+        t = max;
+    }
+    else if(s == 0 && t > center) t = center - (t - center);
+    else if(s == max && t < center) t = center + (center - t);
+    else if(t == max && s < center) s = center + (center - s);
+    else if(t == 0 && s > center) s = center - (s - center);
+    *out_s = s;
+    *out_t = t;
+}
+
+static void OctahedronVectorToCoords(const Octahedron &o, const int32_t *vec, int32_t *out_s, int32_t *out_t)
+{
+    int32_t s, t;
+    if(vec[0] >= 0) {
+        s = vec[1] + o.center_value;
+        t = vec[2] + o.center_value;
+    }
+    else {
+        s = vec[1] < 0 ? abs(vec[2]) : o.max_value - abs(vec[2]);
+        t = vec[2] < 0 ? abs(vec[1]) : o.max_value - abs(vec[1]);
+    }
+    OctahedronCanonicalizeCoords(o, s, t, out_s, out_t);
+}
+
+static void OctahedronCoordsToUnitVector(const Octahedron &o, int32_t in_s, int32_t in_t, float *out)
+{
+    float y = in_s * o.dequantization_scale - 1.0f;
+    float z = in_t * o.dequantization_scale - 1.0f;
+    float x = 1.0f - fabsf(y) - fabsf(z);
+    float x_offset = std::max(-x, 0.0f);
+    y += y < 0 ? x_offset : -x_offset;
+    z += z < 0 ? x_offset : -x_offset;
+    float norm_squared = x * x + y * y + z * z;
+    if(norm_squared < 1e-6f) {
+        out[0] = out[1] = out[2] = 0.0f;
+        return;
+    }
+    float inv = 1.0f / sqrtf(norm_squared);
+    out[0] = x * inv;
+    out[1] = y * inv;
+    out[2] = z * inv;
+}
+
+struct PredictionTransform
+{
+    int         type;
+    int         components;
+    int32_t     min_value, max_value, max_dif;
+    Octahedron  octahedron;
+};
+
+static inline int32_t AddAsUnsigned(int32_t a, int32_t b)
+{
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static bool DecodeTransformData(PredictionTransform *t, DracoBuffer *b)
+{
+    if(t->type == TRANSFORM_WRAP) {
+        if(!Read(b, &t->min_value) || !Read(b, &t->max_value) || t->min_value > t->max_value) return false;
+        int64_t dif = (int64_t)t->max_value - t->min_value;
+        if(dif >= 0x7fffffff) return false;
+        t->max_dif = (int32_t)(1 + dif);
+        return true;
+    }
+    // The canonicalized transform still stores the (derived) center value
+    int32_t max_quantized_value, center_value;
+    if(!Read(b, &max_quantized_value) || max_quantized_value <= 0 || (max_quantized_value % 2) == 0) return false;
+    if(t->type == TRANSFORM_NORMAL_OCTAHEDRON_CANONICAL && !Read(b, &center_value)) return false;
+    int msb = 31;
+    while(((uint32_t)max_quantized_value >> msb) == 0) msb--;
+    return OctahedronInit(&t->octahedron, msb + 1);
+}
+
+static void InvertDiamond(const Octahedron &o, int32_t *s, int32_t *t)
+{
+    int32_t sign_s, sign_t;
+    if(*s >= 0 && *t >= 0) sign_s = sign_t = 1;
+    else if(*s <= 0 && *t <= 0) sign_s = sign_t = -1;
+    else {
+        sign_s = *s > 0 ? 1 : -1;
+        sign_t = *t > 0 ? 1 : -1;
+    }
+    int32_t corner_s = sign_s * o.center_value, corner_t = sign_t * o.center_value;
+    int32_t us = 2 * *s - corner_s, ut = 2 * *t - corner_t;
+    if(sign_s * sign_t >= 0) {
+        int32_t temp = us;
+        us = -ut;
+        ut = -temp;
+    }
+    else std::swap(us, ut);
+    *s = (us + corner_s) / 2;
+    *t = (ut + corner_t) / 2;
+}
+
+static inline int32_t ModMax(const Octahedron &o, int32_t x)
+{
+    if(x > o.center_value) return x - o.max_quantized_value;
+    if(x < -o.center_value) return x + o.max_quantized_value;
+    return x;
+}
+
+static void RotatePoint(int32_t *p, int rotation)
+{
+    int32_t x = p[0], y = p[1];
+    switch(rotation)
+    {
+        case 1: p[0] = y; p[1] = -x; break;
+        case 2: p[0] = -x; p[1] = -y; break;
+        case 3: p[0] = -y; p[1] = x; break;
+        default: break;
+    }
+}
+
+static void ComputeOriginalValue(const PredictionTransform &t, const int32_t *pred, const int32_t *corr, int32_t *out)
+{
+    if(t.type == TRANSFORM_WRAP) {
+        for(int i=0; i<t.components; i++) {
+            int32_t p = std::max(t.min_value, std::min(t.max_value, pred[i]));
+            int32_t v = AddAsUnsigned(p, corr[i]);
+            if(v > t.max_value) v -= t.max_dif;
+            else if(v < t.min_value) v += t.max_dif;
+            out[i] = v;
+        }
+        return;
+    }
+
+    const Octahedron &o = t.octahedron;
+    int32_t p[2] = { pred[0] - o.center_value, pred[1] - o.center_value };
+    bool in_diamond = abs(p[0]) + abs(p[1]) <= o.center_value;
+    if(!in_diamond) InvertDiamond(o, &p[0], &p[1]);
+    int rotation = 0;
+    bool bottom_left = true;
+    if(t.type == TRANSFORM_NORMAL_OCTAHEDRON_CANONICAL) {
+        bottom_left = (p[0] == 0 && p[1] == 0) || (p[0] < 0 && p[1] <= 0);
+        if(p[0] == 0) rotation = p[1] == 0 ? 0 : (p[1] > 0 ? 3 : 1);
+        else if(p[0] > 0) rotation = p[1] >= 0 ? 2 : 1;
+        else rotation = p[1] <= 0 ? 0 : 3;
+        if(!bottom_left) RotatePoint(p, rotation);
+    }
+    int32_t v[2] = { ModMax(o, AddAsUnsigned(p[0], corr[0])), ModMax(o, AddAsUnsigned(p[1], corr[1])) };
+    if(!bottom_left) RotatePoint(v, (4 - rotation) % 4);
+    if(!in_diamond) InvertDiamond(o, &v[0], &v[1]);
+    out[0] = v[0] + o.center_value;
+    out[1] = v[1] + o.center_value;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Prediction schemes
+
+struct Prediction
+{
+    int                         method;
+    PredictionTransform         transform;
+    const CornerTable *         table;
+    const EncodingData *        encoding;
+    const uint32_t *            entry_to_point;     // the decoder's point ids
+    const int32_t *             positions;          // integer positions of the parent attribute
+    const uint32_t *            position_map;
+    std::vector<uint8_t>        crease[MAX_PARALLELOGRAMS];
+    std::vector<uint8_t>        orientations;
+    RAnsBitDecoder              flip_normals;
+};
+
+static bool DecodePredictionData(Prediction *p, DracoBuffer *b)
+{
+    if(p->method == PREDICTION_CONSTRAINED_PARALLELOGRAM) {
+        for(int i=0; i<MAX_PARALLELOGRAMS; i++) {
+            uint32_t num_flags;
+            if(!ReadVarint32(b, &num_flags) || num_flags > (uint32_t)p->table->Corners()) return false;
+            if(num_flags == 0) continue;
+            RAnsBitDecoder decoder;
+            if(!RAnsBitStart(&decoder, b)) return false;
+            p->crease[i].resize(num_flags);
+            for(uint32_t j=0; j<num_flags; j++) p->crease[i][j] = RAnsBitRead(&decoder);
+        }
+    }
+    else if(p->method == PREDICTION_TEX_COORDS_PORTABLE) {
+        int32_t num_orientations;
+        if(!Read(b, &num_orientations) || num_orientations < 0 || num_orientations > p->table->Corners()) return false;
+        RAnsBitDecoder decoder;
+        if(!RAnsBitStart(&decoder, b)) return false;
+        p->orientations.resize(num_orientations);
+        bool last_orientation = true;
+        for(int32_t i=0; i<num_orientations; i++) {
+            if(!RAnsBitRead(&decoder)) last_orientation = !last_orientation;
+            p->orientations[i] = last_orientation;
+        }
+    }
+    else if(p->method == PREDICTION_GEOMETRIC_NORMAL) {
+        return DecodeTransformData(&p->transform, b) && RAnsBitStart(&p->flip_normals, b);
+    }
+    return DecodeTransformData(&p->transform, b);
+}
+
+// Parallelogram from the face opposite corner ci, if all its values are already decoded
+static bool ParallelogramPrediction(const Prediction &p, int data_id, int ci, const int32_t *data, int components, int32_t *out)
+{
+    const CornerTable &t = *p.table;
+    int oci = t.Opposite(ci);
+    if(oci == INVALID) return false;
+    const std::vector<int32_t> &v2d = p.encoding->vertex_to_data;
+    int vert_opp = v2d[t.Vertex(oci)], vert_next = v2d[t.Vertex(Next(oci))], vert_prev = v2d[t.Vertex(Previous(oci))];
+    if(vert_opp >= data_id || vert_next >= data_id || vert_prev >= data_id) return false;
+    for(int c=0; c<components; c++) {
+        int64_t v = (int64_t)data[vert_next * components + c] + data[vert_prev * components + c] - data[vert_opp * components + c];
+        out[c] = (int32_t)v;
+    }
+    return true;
+}
+
+static void PositionForEntry(const Prediction &p, int entry, int64_t *out)
+{
+    uint32_t value = p.position_map[p.entry_to_point[entry]];
+    for(int c=0; c<3; c++) out[c] = p.positions[value * 3 + c];
+}
+
+static uint64_t IntSqrt(uint64_t number)
+{
+    if(number == 0) return 0;
+    uint64_t act_number = number, square_root = 1;
+    while(act_number >= 2) {
+        square_root *= 2;
+        act_number /= 4;
+    }
+    do {
+        square_root = (square_root + number / square_root) / 2;
+    } while(square_root * square_root > number);
+    return square_root;
+}
+
+// UV from the positions of the triangle and the UVs of its two other corners
+static bool TexCoordPrediction(Prediction *p, int corner, const int32_t *data, int data_id, int32_t *out)
+{
+    const CornerTable &t = *p->table;
+    int next_data_id = p->encoding->vertex_to_data[t.Vertex(Next(corner))];
+    int prev_data_id = p->encoding->vertex_to_data[t.Vertex(Previous(corner))];
+    if(prev_data_id < data_id && next_data_id < data_id) {
+        int64_t n_uv[2] = { data[next_data_id * 2], data[next_data_id * 2 + 1] };
+        int64_t p_uv[2] = { data[prev_data_id * 2], data[prev_data_id * 2 + 1] };
+        if(p_uv[0] == n_uv[0] && p_uv[1] == n_uv[1]) {
+            out[0] = (int32_t)p_uv[0];
+            out[1] = (int32_t)p_uv[1];
+            return true;
+        }
+        int64_t tip_pos[3], next_pos[3], prev_pos[3];
+        PositionForEntry(*p, data_id, tip_pos);
+        PositionForEntry(*p, next_data_id, next_pos);
+        PositionForEntry(*p, prev_data_id, prev_pos);
+        int64_t pn[3], cn[3];
+        for(int c=0; c<3; c++) {
+            pn[c] = prev_pos[c] - next_pos[c];
+            cn[c] = tip_pos[c] - next_pos[c];
+        }
+        uint64_t pn_norm2_squared = pn[0] * pn[0] + pn[1] * pn[1] + pn[2] * pn[2];
+        if(pn_norm2_squared != 0) {
+            const int64_t int64_max = 0x7fffffffffffffffLL;
+            int64_t cn_dot_pn = pn[0] * cn[0] + pn[1] * cn[1] + pn[2] * cn[2];
+            int64_t pn_uv[2] = { p_uv[0] - n_uv[0], p_uv[1] - n_uv[1] };
+            int64_t n_uv_absmax = std::max(llabs(n_uv[0]), llabs(n_uv[1]));
+            if(n_uv_absmax > int64_max / (int64_t)pn_norm2_squared) return false;
+            int64_t pn_uv_absmax = std::max(llabs(pn_uv[0]), llabs(pn_uv[1]));
+            if(pn_uv_absmax != 0 && cn_dot_pn > int64_max / pn_uv_absmax) return false;
+            int64_t x_uv[2] = { n_uv[0] * (int64_t)pn_norm2_squared + cn_dot_pn * pn_uv[0], n_uv[1] * (int64_t)pn_norm2_squared + cn_dot_pn * pn_uv[1] };
+            int64_t pn_absmax = std::max(std::max(llabs(pn[0]), llabs(pn[1])), llabs(pn[2]));
+            if(cn_dot_pn > int64_max / pn_absmax) return false;
+            uint64_t cx_norm2_squared = 0;
+            for(int c=0; c<3; c++) {
+                int64_t x_pos = next_pos[c] + (cn_dot_pn * pn[c]) / (int64_t)pn_norm2_squared;
+                int64_t cx = tip_pos[c] - x_pos;
+                cx_norm2_squared += cx * cx;
+            }
+            uint64_t norm_squared = IntSqrt(cx_norm2_squared * pn_norm2_squared);
+            int64_t cx_uv[2] = { pn_uv[1] * (int64_t)norm_squared, -pn_uv[0] * (int64_t)norm_squared };
+            if(p->orientations.empty()) return false;
+            bool orientation = p->orientations.back();
+            p->orientations.pop_back();
+            for(int c=0; c<2; c++) {
+                uint64_t v = orientation ? (uint64_t)x_uv[c] + (uint64_t)cx_uv[c] : (uint64_t)x_uv[c] - (uint64_t)cx_uv[c];
+                out[c] = (int32_t)((int64_t)v / (int64_t)pn_norm2_squared);
+            }
+            return true;
+        }
+    }
+    // Not enough decoded neighbours, use one of them or the previous value
+    int data_offset = 0;
+    if(prev_data_id < data_id) data_offset = prev_data_id * 2;
+    if(next_data_id < data_id) data_offset = next_data_id * 2;
+    else if(data_id > 0) data_offset = (data_id - 1) * 2;
+    else {
+        out[0] = out[1] = 0;
+        return true;
+    }
+    out[0] = data[data_offset];
+    out[1] = data[data_offset + 1];
+    return true;
+}
+
+// Area weighted normal of the faces around the corner's vertex, from the integer positions
+static void GeometricNormalPrediction(const Prediction &p, int corner, int32_t *out)
+{
+    const CornerTable &t = *p.table;
+    int64_t pos_cent[3], normal[3] = { 0, 0, 0 };
+    PositionForEntry(p, p.encoding->vertex_to_data[t.Vertex(corner)], pos_cent);
+    for(VertexCorners it = VertexCornersStart(&t, corner); it.corner != INVALID; VertexCornersNext(&it)) {
+        int64_t pos_next[3], pos_prev[3], dn[3], dp[3];
+        PositionForEntry(p, p.encoding->vertex_to_data[t.Vertex(Next(it.corner))], pos_next);
+        PositionForEntry(p, p.encoding->vertex_to_data[t.Vertex(Previous(it.corner))], pos_prev);
+        for(int c=0; c<3; c++) {
+            dn[c] = pos_next[c] - pos_cent[c];
+            dp[c] = pos_prev[c] - pos_cent[c];
+        }
+        normal[0] = (int64_t)((uint64_t)normal[0] + (uint64_t)(dn[1] * dp[2] - dn[2] * dp[1]));
+        normal[1] = (int64_t)((uint64_t)normal[1] + (uint64_t)(dn[2] * dp[0] - dn[0] * dp[2]));
+        normal[2] = (int64_t)((uint64_t)normal[2] + (uint64_t)(dn[0] * dp[1] - dn[1] * dp[0]));
+    }
+    const int64_t upper_bound = 1 << 29;
+    int64_t abs_sum = llabs(normal[0]) + llabs(normal[1]) + llabs(normal[2]);
+    if(abs_sum > upper_bound) {
+        int64_t quotient = abs_sum / upper_bound;
+        for(int c=0; c<3; c++) normal[c] /= quotient;
+    }
+    for(int c=0; c<3; c++) out[c] = (int32_t)normal[c];
+}
+
+static bool ComputeOriginalValues(Prediction *p, const int32_t *corr, int32_t *data, int num_values, int components)
+{
+    PredictionTransform &t = p->transform;
+    t.components = components;
+    int32_t pred[MAX_COMPONENTS] = {};
+    int entries = num_values / components;
+
+    if(p->method == PREDICTION_DIFFERENCE) {
+        ComputeOriginalValue(t, pred, corr, data);
+        for(int i=components; i<num_values; i+=components) ComputeOriginalValue(t, data + i - components, corr + i, data + i);
+        return true;
+    }
+
+    int corner_map_size = (int)p->encoding->data_to_corner.size();
+    if(corner_map_size != entries) return false;
+
+    if(p->method == PREDICTION_PARALLELOGRAM) {
+        ComputeOriginalValue(t, pred, corr, data);
+        for(int e=1; e<entries; e++) {
+            int corner = p->encoding->data_to_corner[e];
+            int dst = e * components;
+            if(ParallelogramPrediction(*p, e, corner, data, components, pred)) ComputeOriginalValue(t, pred, corr + dst, data + dst);
+            else ComputeOriginalValue(t, data + dst - components, corr + dst, data + dst);
+        }
+        return true;
+    }
+
+    if(p->method == PREDICTION_MULTI_PARALLELOGRAM || p->method == PREDICTION_CONSTRAINED_PARALLELOGRAM) {
+        bool constrained = p->method == PREDICTION_CONSTRAINED_PARALLELOGRAM;
+        int32_t pred_vals[MAX_PARALLELOGRAMS][MAX_COMPONENTS];
+        int crease_pos[MAX_PARALLELOGRAMS] = {};
+        ComputeOriginalValue(t, pred, corr, data);
+        for(int e=1; e<entries; e++) {
+            int start_corner = p->encoding->data_to_corner[e];
+            int dst = e * components;
+            int num_parallelograms = 0;
+            int num_used = 0;
+            memset(pred, 0, sizeof(pred));
+            if(constrained) {
+                // Up to four parallelograms, swinging left then right from a boundary
+                bool first_pass = true;
+                for(int corner = start_corner; corner != INVALID; ) {
+                    if(ParallelogramPrediction(*p, e, corner, data, components, pred_vals[num_parallelograms])) {
+                        if(++num_parallelograms == MAX_PARALLELOGRAMS) break;
+                    }
+                    corner = first_pass ? p->table->SwingLeft(corner) : p->table->SwingRight(corner);
+                    if(corner == start_corner) break;
+                    if(corner == INVALID && first_pass) {
+                        first_pass = false;
+                        corner = p->table->SwingRight(start_corner);
+                    }
+                }
+                // A crease flag per parallelogram says whether it's left out
+                for(int i=0; i<num_parallelograms; i++) {
+                    int context = num_parallelograms - 1;
+                    int pos = crease_pos[context]++;
+                    if(pos >= (int)p->crease[context].size()) return false;
+                    if(p->crease[context][pos]) continue;
+                    num_used++;
+                    for(int c=0; c<components; c++) pred[c] = AddAsUnsigned(pred[c], pred_vals[i][c]);
+                }
+            }
+            else {
+                for(int corner = start_corner; corner != INVALID; ) {
+                    if(ParallelogramPrediction(*p, e, corner, data, components, pred_vals[0])) {
+                        for(int c=0; c<components; c++) pred[c] = AddAsUnsigned(pred[c], pred_vals[0][c]);
+                        num_used++;
+                    }
+                    corner = p->table->SwingRight(corner);
+                    if(corner == start_corner) break;
+                }
+            }
+            if(num_used == 0) ComputeOriginalValue(t, data + dst - components, corr + dst, data + dst);
+            else {
+                for(int c=0; c<components; c++) pred[c] /= num_used;
+                ComputeOriginalValue(t, pred, corr + dst, data + dst);
+            }
+        }
+        return true;
+    }
+
+    if(p->method == PREDICTION_TEX_COORDS_PORTABLE) {
+        if(components != 2) return false;
+        for(int e=0; e<entries; e++) {
+            if(!TexCoordPrediction(p, p->encoding->data_to_corner[e], data, e, pred)) return false;
+            ComputeOriginalValue(t, pred, corr + e * 2, data + e * 2);
+        }
+        return true;
+    }
+
+    if(p->method == PREDICTION_GEOMETRIC_NORMAL) {
+        if(components != 2) return false;
+        const Octahedron &o = t.octahedron;
+        for(int e=0; e<entries; e++) {
+            int32_t normal[3];
+            GeometricNormalPrediction(*p, p->encoding->data_to_corner[e], normal);
+            OctahedronCanonicalizeVector(o, normal);
+            if(RAnsBitRead(&p->flip_normals)) {
+                for(int c=0; c<3; c++) normal[c] = -normal[c];
+            }
+            OctahedronVectorToCoords(o, normal, &pred[0], &pred[1]);
+            ComputeOriginalValue(t, pred, corr + e * 2, data + e * 2);
+        }
+        return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Attribute values
+
+// Integer values of one attribute: optional prediction, then entropy coded corrections
+static bool DecodeIntegerValues(DracoDecoder *d, int decoder_id, int index)
+{
+    DracoBuffer *b = &d->buffer;
+    AttributesDecoder &dec = d->decoders[decoder_id];
+    int a = dec.attributes[index];
+    int sequential = dec.sequential[index];
+    DracoAttribute &att = d->mesh->attributes[a];
+    int components = sequential == SEQUENTIAL_NORMALS ? 2 : att.components;
+
+    int8_t method, transform = -1;
+    if(!Read(b, &method) || method < PREDICTION_NONE || method > PREDICTION_GEOMETRIC_NORMAL) return Fail(d, "invalid prediction scheme");
+    if(method != PREDICTION_NONE && !Read(b, &transform)) return Fail(d, "invalid prediction scheme");
+
+    Prediction p;
+    p.method = PREDICTION_NONE;
+    if(method != PREDICTION_NONE) {
+        if(sequential == SEQUENTIAL_NORMALS && transform != TRANSFORM_NORMAL_OCTAHEDRON && transform != TRANSFORM_NORMAL_OCTAHEDRON_CANONICAL) return Fail(d, "invalid prediction transform");
+        if(sequential != SEQUENTIAL_NORMALS && transform != TRANSFORM_WRAP) return Fail(d, "invalid prediction transform");
+        if(components > MAX_COMPONENTS) return Fail(d, "too many components to predict");
+        p.transform.type = transform;
+        p.method = PREDICTION_DIFFERENCE;
+        // Mesh predictions need the connectivity, the normal transforms only go with geometric normals
+        if(d->method == DRACO_EDGEBREAKER && method != PREDICTION_DIFFERENCE) {
+            if(method == PREDICTION_TEX_COORDS_DEPRECATED) return Fail(d, "deprecated texture coordinate prediction");
+            if((transform == TRANSFORM_WRAP) != (method == PREDICTION_GEOMETRIC_NORMAL)) p.method = method;
+        }
+        p.table = &d->table;
+        p.encoding = &d->pos_encoding;
+        if(dec.att_data_id >= 0) {
+            AttributeData &ad = d->attribute_data[dec.att_data_id];
+            p.encoding = &ad.encoding;
+            if(ad.connectivity_used) p.table = &ad.table;
+        }
+        p.entry_to_point = dec.point_ids.data();
+        if(p.method == PREDICTION_TEX_COORDS_PORTABLE || p.method == PREDICTION_GEOMETRIC_NORMAL) {
+            // Predicted from the integer positions, which need to be decoded already
+            int pos = -1;
+            for(size_t i=0; i<d->mesh->attributes.size() && pos < 0; i++) {
+                if(d->mesh->attributes[i].type == ATTRIBUTE_POSITION) pos = (int)i;
+            }
+            if(pos < 0 || d->mesh->attributes[pos].components != 3 || d->portable[pos].empty()) return Fail(d, "prediction needs decoded positions");
+            p.positions = d->portable[pos].data();
+            p.position_map = d->mesh->attributes[pos].point_map.data();
+        }
+    }
+
+    size_t num_values = dec.point_ids.size() * components;
+    std::vector<int32_t> &values = d->portable[a];
+    values.assign(num_values, 0);
+    uint8_t compressed;
+    if(!Read(b, &compressed)) return Fail(d, "truncated attribute");
+    if(compressed) {
+        if(!DecodeSymbols((uint32_t)num_values, components, b, (uint32_t *)values.data())) return Fail(d, "invalid attribute symbols");
+    }
+    else {
+        uint8_t num_bytes;
+        if(!Read(b, &num_bytes) || num_bytes == 0 || num_bytes > 4) return Fail(d, "invalid attribute values");
+        for(size_t i=0; i<num_values; i++) {
+            uint32_t v = 0;
+            if(!ReadBytes(b, &v, num_bytes)) return Fail(d, "truncated attribute");
+            values[i] = (int32_t)v;
+        }
+    }
+
+    // Corrections are zig-zag coded, except the octahedron transforms' which are positive
+    bool positive = p.method != PREDICTION_NONE && p.transform.type != TRANSFORM_WRAP;
+    if(!positive) {
+        for(size_t i=0; i<num_values; i++) {
+            uint32_t v = (uint32_t)values[i];
+            values[i] = (v & 1) ? -(int32_t)(v >> 1) - 1 : (int32_t)(v >> 1);
+        }
+    }
+    if(p.method != PREDICTION_NONE) {
+        if(!DecodePredictionData(&p, b)) return Fail(d, "invalid prediction data");
+        if(num_values > 0) {
+            std::vector<int32_t> corr(values);
+            if(!ComputeOriginalValues(&p, corr.data(), values.data(), (int)num_values, components)) return Fail(d, "prediction failed");
+        }
+    }
+    return true;
+}
+
+struct AttributeTransform
+{
+    std::vector<float>  min_values;
+    float               range;
+    uint8_t             quantization_bits;
+};
+
+// Turns the integer values into the attribute's data type
+static bool StoreValues(DracoDecoder *d, int a, int sequential, const AttributeTransform &transform)
+{
+    DracoAttribute &att = d->mesh->attributes[a];
+    const std::vector<int32_t> &values = d->portable[a];
+    if(sequential == SEQUENTIAL_QUANTIZATION) {
+        if(att.data_type != DRACO_DT_FLOAT32) return false;
+        int32_t max_quantized_value = (int32_t)((1u << transform.quantization_bits) - 1);
+        float delta = transform.range / (float)max_quantized_value;
+        att.values.resize(values.size() * sizeof(float));
+        float *out = (float *)att.values.data();
+        for(size_t i=0; i<values.size(); i++) out[i] = (float)values[i] * delta + transform.min_values[i % att.components];
+        return true;
+    }
+    if(sequential == SEQUENTIAL_NORMALS) {
+        Octahedron o;
+        if(att.data_type != DRACO_DT_FLOAT32 || att.components != 3 || !OctahedronInit(&o, transform.quantization_bits)) return false;
+        size_t count = values.size() / 2;
+        att.values.resize(count * 3 * sizeof(float));
+        float *out = (float *)att.values.data();
+        for(size_t i=0; i<count; i++) OctahedronCoordsToUnitVector(o, values[i * 2], values[i * 2 + 1], out + i * 3);
+        return true;
+    }
+    int size = data_type_size[att.data_type];
+    att.values.resize(values.size() * size);
+    for(size_t i=0; i<values.size(); i++) {
+        uint8_t *out = att.values.data() + i * size;
+        switch(att.data_type)
+        {
+            case DRACO_DT_INT8:
+            case DRACO_DT_UINT8:
+            case DRACO_DT_BOOL:     *out = (uint8_t)values[i]; break;
+            case DRACO_DT_INT16:
+            case DRACO_DT_UINT16:   { uint16_t v = (uint16_t)values[i]; memcpy(out, &v, 2); break; }
+            case DRACO_DT_INT32:
+            case DRACO_DT_UINT32:   memcpy(out, &values[i], 4); break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+static bool DecodeAttributes(DracoDecoder *d, int decoder_id)
+{
+    DracoBuffer *b = &d->buffer;
+    AttributesDecoder &dec = d->decoders[decoder_id];
+    if(!GenerateSequence(d, &dec)) return Fail(d, "invalid attribute traversal");
+
+    for(size_t i=0; i<dec.attributes.size(); i++) {
+        DracoAttribute &att = d->mesh->attributes[dec.attributes[i]];
+        if(dec.sequential[i] == SEQUENTIAL_GENERIC) {
+            size_t size = dec.point_ids.size() * att.components * data_type_size[att.data_type];
+            att.values.resize(size);
+            if(!ReadBytes(b, att.values.data(), size)) return Fail(d, "truncated attribute");
+        }
+        else if(!DecodeIntegerValues(d, decoder_id, (int)i)) return false;
+    }
+
+    // Dequantization parameters come after all the decoder's values
+    std::vector<AttributeTransform> transforms(dec.attributes.size());
+    for(size_t i=0; i<dec.attributes.size(); i++) {
+        AttributeTransform &transform = transforms[i];
+        if(dec.sequential[i] == SEQUENTIAL_QUANTIZATION) {
+            transform.min_values.resize(d->mesh->attributes[dec.attributes[i]].components);
+            if(!ReadBytes(b, transform.min_values.data(), transform.min_values.size() * sizeof(float))) return Fail(d, "truncated quantization");
+            if(!Read(b, &transform.range) || !Read(b, &transform.quantization_bits)) return Fail(d, "truncated quantization");
+            if(transform.quantization_bits < 1 || transform.quantization_bits > 30) return Fail(d, "invalid quantization");
+        }
+        else if(dec.sequential[i] == SEQUENTIAL_NORMALS) {
+            if(!Read(b, &transform.quantization_bits)) return Fail(d, "truncated quantization");
+        }
+    }
+    for(size_t i=0; i<dec.attributes.size(); i++) {
+        if(dec.sequential[i] == SEQUENTIAL_GENERIC) continue;
+        if(!StoreValues(d, dec.attributes[i], dec.sequential[i], transforms[i])) return Fail(d, "unsupported attribute type");
+    }
+    return true;
+}
+
+static bool DecodePointAttributes(DracoDecoder *d)
+{
+    DracoBuffer *b = &d->buffer;
+    uint8_t num_decoders;
+    if(!Read(b, &num_decoders)) return Fail(d, "truncated attributes");
+    d->decoders.resize(num_decoders);
+
+    // Which connectivity each decoder uses, and how it's traversed
+    bool pos_decoder = false;
+    for(int i=0; i<num_decoders; i++) {
+        AttributesDecoder &dec = d->decoders[i];
+        dec.att_data_id = -1;
+        dec.decoder_type = MESH_VERTEX_ATTRIBUTE;
+        dec.traversal = TRAVERSAL_DEPTH_FIRST;
+        if(d->method != DRACO_EDGEBREAKER) continue;
+        int8_t att_data_id;
+        uint8_t decoder_type, traversal;
+        if(!Read(b, &att_data_id) || !Read(b, &decoder_type) || !Read(b, &traversal)) return Fail(d, "truncated attributes");
+        if(att_data_id >= (int)d->attribute_data.size() || traversal > TRAVERSAL_PREDICTION_DEGREE || decoder_type > MESH_CORNER_ATTRIBUTE) return Fail(d, "invalid attribute decoder");
+        if(att_data_id >= 0) {
+            d->attribute_data[att_data_id].decoder_id = i;
+            if(decoder_type == MESH_VERTEX_ATTRIBUTE) d->attribute_data[att_data_id].connectivity_used = false;
+        }
+        else {
+            if(pos_decoder) return Fail(d, "invalid attribute decoder");
+            pos_decoder = true;
+        }
+        if(decoder_type == MESH_CORNER_ATTRIBUTE && (traversal != TRAVERSAL_DEPTH_FIRST || att_data_id < 0)) return Fail(d, "invalid attribute decoder");
+        dec.att_data_id = att_data_id;
+        dec.decoder_type = decoder_type;
+        dec.traversal = traversal;
+    }
+
+    // The attributes of each decoder
+    for(int i=0; i<num_decoders; i++) {
+        AttributesDecoder &dec = d->decoders[i];
+        uint32_t num_attributes;
+        if(!ReadVarint32(b, &num_attributes) || num_attributes == 0 || num_attributes > b->size - b->pos) return Fail(d, "invalid attributes");
+        for(uint32_t j=0; j<num_attributes; j++) {
+            uint8_t type, data_type, components, normalized;
+            uint32_t unique_id;
+            if(!Read(b, &type) || !Read(b, &data_type) || !Read(b, &components) || !Read(b, &normalized) || !ReadVarint32(b, &unique_id)) return Fail(d, "truncated attributes");
+            if(type > 4 || data_type == DRACO_DT_INVALID || data_type >= DRACO_DT_COUNT || components == 0) return Fail(d, "invalid attribute");
+            DracoAttribute att;
+            att.type = type;
+            att.data_type = data_type;
+            att.components = components;
+            att.normalized = normalized > 0;
+            att.unique_id = unique_id;
+            dec.attributes.push_back((int)d->mesh->attributes.size());
+            d->mesh->attributes.push_back(att);
+        }
+        for(uint32_t j=0; j<num_attributes; j++) {
+            uint8_t sequential;
+            if(!Read(b, &sequential) || sequential > SEQUENTIAL_NORMALS) return Fail(d, "invalid attribute decoder");
+            dec.sequential.push_back(sequential);
+        }
+    }
+    d->portable.resize(d->mesh->attributes.size());
+
+    for(int i=0; i<num_decoders; i++) {
+        if(!DecodeAttributes(d, i)) return false;
+    }
+    return true;
+}
+
+// Metadata isn't used, it only has to be stepped over
+static bool SkipMetadataEntries(DracoBuffer *b, int depth)
+{
+    uint32_t num_entries, num_sub_metadata;
+    if(depth > 32 || !ReadVarint32(b, &num_entries)) return false;
+    for(uint32_t i=0; i<num_entries; i++) {
+        uint8_t name_size;
+        uint32_t data_size;
+        if(!Read(b, &name_size) || name_size > b->size - b->pos) return false;
+        b->pos += name_size;
+        if(!ReadVarint32(b, &data_size) || data_size == 0 || data_size > b->size - b->pos) return false;
+        b->pos += data_size;
+    }
+    if(!ReadVarint32(b, &num_sub_metadata)) return false;
+    for(uint32_t i=0; i<num_sub_metadata; i++) {
+        uint8_t name_size;
+        if(!Read(b, &name_size) || name_size > b->size - b->pos) return false;
+        b->pos += name_size;
+        if(!SkipMetadataEntries(b, depth + 1)) return false;
+    }
+    return true;
+}
+
+static bool SkipMetadata(DracoBuffer *b)
+{
+    uint32_t num_attribute_metadata;
+    if(!ReadVarint32(b, &num_attribute_metadata)) return false;
+    for(uint32_t i=0; i<num_attribute_metadata; i++) {
+        uint32_t unique_id;
+        if(!ReadVarint32(b, &unique_id) || !SkipMetadataEntries(b, 0)) return false;
+    }
+    return SkipMetadataEntries(b, 0);
+}
+
+bool DracoDecodeMesh(const uint8_t *src, size_t size, DracoMesh *mesh, const char **error)
+{
+    DracoDecoder d;
+    d.buffer.data = src;
+    d.buffer.size = size;
+    d.buffer.pos = 0;
+    d.buffer.bit_pos = 0;
+    d.mesh = mesh;
+    d.error = nullptr;
+    mesh->points = 0;
+    mesh->indices.clear();
+    mesh->attributes.clear();
+
+    char magic[5];
+    uint8_t major, minor, encoder_type, method;
+    uint16_t flags;
+    bool ok = ReadBytes(&d.buffer, magic, 5) && memcmp(magic, "DRACO", 5) == 0;
+    ok = ok && Read(&d.buffer, &major) && Read(&d.buffer, &minor) && Read(&d.buffer, &encoder_type);
+    ok = ok && Read(&d.buffer, &method) && Read(&d.buffer, &flags);
+    if(!ok) Fail(&d, "not a draco buffer");
+    else if(major != 2 || minor != 2) Fail(&d, "unsupported draco bitstream version (2.2 is supported)");
+    else if(encoder_type != DRACO_TRIANGULAR_MESH) Fail(&d, "not a triangle mesh");
+    else if((flags & DRACO_METADATA_FLAG) && !SkipMetadata(&d.buffer)) Fail(&d, "invalid metadata");
+    else {
+        d.method = method;
+        if(method == DRACO_EDGEBREAKER) ok = DecodeEdgebreakerConnectivity(&d);
+        else if(method == DRACO_SEQUENTIAL) ok = DecodeSequentialConnectivity(&d);
+        else ok = Fail(&d, "unknown connectivity method");
+        if(ok) DecodePointAttributes(&d);
+    }
+    *error = d.error;
+    return d.error == nullptr;
+}
+
+const DracoAttribute *DracoFindAttribute(const DracoMesh *mesh, uint32_t unique_id)
+{
+    for(size_t i=0; i<mesh->attributes.size(); i++) {
+        if(mesh->attributes[i].unique_id == unique_id) return &mesh->attributes[i];
+    }
+    return nullptr;
+}
+
+double DracoAttributeValue(const DracoAttribute *att, uint32_t point, int c)
+{
+    if(c >= att->components) return 0.0;
+    int size = data_type_size[att->data_type];
+    size_t offset = ((size_t)att->point_map[point] * att->components + c) * size;
+    if(offset + size > att->values.size()) return 0.0;
+    const uint8_t *p = att->values.data() + offset;
+    switch(att->data_type)
+    {
+        case DRACO_DT_INT8:     return (int8_t)*p;
+        case DRACO_DT_UINT8:
+        case DRACO_DT_BOOL:     return *p;
+        case DRACO_DT_INT16:    { int16_t v; memcpy(&v, p, 2); return v; }
+        case DRACO_DT_UINT16:   { uint16_t v; memcpy(&v, p, 2); return v; }
+        case DRACO_DT_INT32:    { int32_t v; memcpy(&v, p, 4); return v; }
+        case DRACO_DT_UINT32:   { uint32_t v; memcpy(&v, p, 4); return v; }
+        case DRACO_DT_INT64:    { int64_t v; memcpy(&v, p, 8); return (double)v; }
+        case DRACO_DT_UINT64:   { uint64_t v; memcpy(&v, p, 8); return (double)v; }
+        case DRACO_DT_FLOAT32:  { float v; memcpy(&v, p, 4); return v; }
+        case DRACO_DT_FLOAT64:  { double v; memcpy(&v, p, 8); return v; }
+        default: break;
+    }
+    return 0.0;
+}
@@ -0,0 +1,45 @@
+// dracodec.h
+// Draco mesh decoder used by KHR_draco_mesh_compression (see dracodec.cpp)
+
+#ifndef CGLTF_LIB_DRACODEC_H
+#define CGLTF_LIB_DRACODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Draco attribute data types, as stored in the bitstream
+enum DracoDataType
+{
+    DRACO_DT_INVALID, DRACO_DT_INT8, DRACO_DT_UINT8, DRACO_DT_INT16, DRACO_DT_UINT16, DRACO_DT_INT32,
+    DRACO_DT_UINT32, DRACO_DT_INT64, DRACO_DT_UINT64, DRACO_DT_FLOAT32, DRACO_DT_FLOAT64, DRACO_DT_BOOL,
+    DRACO_DT_COUNT
+};
+
+struct DracoAttribute
+{
+    int                     type;           // position, normal, color, texcoord, generic
+    int                     data_type;      // DracoDataType
+    int                     components;
+    bool                    normalized;
+    uint32_t                unique_id;      // what the glTF extension's attributes refer to
+    std::vector<uint8_t>    values;         // decoded values, packed in data_type
+    std::vector<uint32_t>   point_map;      // value index of each point
+};
+
+struct DracoMesh
+{
+    uint32_t                        points;
+    std::vector<uint32_t>           indices;    // three points per face
+    std::vector<DracoAttribute>     attributes;
+};
+
+// Decodes a Draco triangle mesh. On failure returns false with a static error string.
+bool DracoDecodeMesh(const uint8_t *src, size_t size, DracoMesh *mesh, const char **error);
+
+const DracoAttribute *DracoFindAttribute(const DracoMesh *mesh, uint32_t unique_id);
+
+// Component c of a point's value, converted to double
+double DracoAttributeValue(const DracoAttribute *att, uint32_t point, int c);
+
+#endif
@@ -0,0 +1,107 @@
+// hash.h
+// XXH64 (xxHash, 64 bit) for content hashing large blobs like encoded images.
+//   dmHashBuffer64 keeps a reverse lookup copy of the data in debug builds, which is not what we
+//   want for multi megabyte images.
+
+#ifndef CGLTF_LIB_HASH_H
+#define CGLTF_LIB_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define XXH_PRIME64_1   0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2   0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3   0x165667B19E3779F9ULL
+#define XXH_PRIME64_4   0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5   0x27D4EB2F165667C5ULL
+
+static inline uint64_t XXH_rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t XXH_read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t XXH_read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t XXH64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = XXH_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t XXH64_merge(uint64_t acc, uint64_t val)
+{
+    acc ^= XXH64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// Little endian targets only (all Defold platforms)
+static inline uint64_t XXH64(const void *input, size_t len, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)input;
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if(len >= 32) {
+        const uint8_t *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        do {
+            v1 = XXH64_round(v1, XXH_read64(p));
+            v2 = XXH64_round(v2, XXH_read64(p + 8));
+            v3 = XXH64_round(v3, XXH_read64(p + 16));
+            v4 = XXH64_round(v4, XXH_read64(p + 24));
+            p += 32;
+        } while(p <= limit);
+
+        h = XXH_rotl64(v1, 1) + XXH_rotl64(v2, 7) + XXH_rotl64(v3, 12) + XXH_rotl64(v4, 18);
+        h = XXH64_merge(h, v1);
+        h = XXH64_merge(h, v2);
+        h = XXH64_merge(h, v3);
+        h = XXH64_merge(h, v4);
+    }
+    else {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += (uint64_t)len;
+    while(p + 8 <= end) {
+        h ^= XXH64_round(0, XXH_read64(p));
+        h = XXH_rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if(p + 4 <= end) {
+        h ^= (uint64_t)XXH_read32(p) * XXH_PRIME64_1;
+        h = XXH_rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while(p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = XXH_rotl64(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+#endif
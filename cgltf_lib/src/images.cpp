@@ -0,0 +1,1508 @@
+// images.cpp
+// Native image decoding.
+//   Images (uri, data uri or buffer view) are decoded with stb_image straight into RGBA8 Defold
+//   buffers that can be handed to resource.create_texture as is. A model's images can be decoded
+//   together on the worker pool (images_decode/images_done/images_wait).
+//   Separate occlusion and metallic-roughness maps of a material can be packed into one ORM image.
+//   KTX2 images (KHR_texture_basisu) are copied or transcoded into a GPU format instead, see ktx2.cpp.
+//   Other images can be block compressed after decoding (blockencode.cpp), and the result kept on
+//   disk so later runs skip both steps (diskcache.cpp).
+//   Textures are named by a hash of their encoded bytes, so identical images (within a model or
+//   across models) are decoded and uploaded once and shared by reference count.
+
+#include "cgltf_lib.h"
+#include "jobs.h"
+#include "hash.h"
+#include "simd.h"
+
+#include <dmsdk/dlib/mutex.h>
+
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <map>
+#include <algorithm>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Mip levels use stb_image_resize2's SSE2/NEON/wasm paths, unless simd is turned off for the lib
+#if defined(CGLTF_LIB_NO_SIMD)
+#define STBIR_NO_SIMD
+#endif
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "stb_image_resize2.h"
+
+#define IMAGE_STREAM        "rgba"
+#define TEXTURE_MIN_SIZE    64      // the budget never shrinks a texture below this
+
+// Global texture memory budget in bytes (0 = unlimited), shared by every load
+static std::atomic<uint64_t>    texture_budget(0);
+static std::atomic<uint64_t>    texture_used(0);
+
+// Content hashed texture cache, shared by every load. An entry is created by the first task that
+// sees the hash (the owner) and is ready once its images_wait has run.
+struct TextureCacheEntry
+{
+    int         refs;
+    bool        ready;
+    uint32_t    job;        // owner's ImageJob serial (never reused, unlike its address) and image index
+    int         index;
+    int         width;
+    int         height;
+    uint64_t    bytes;
+};
+
+static std::map<uint64_t, TextureCacheEntry>   texture_cache;
+static dmMutex::HMutex                          texture_cache_mutex = 0;
+static uint32_t                                 image_job_serial = 0;
+
+void TextureName(uint64_t hash, char *name, size_t size)
+{
+    snprintf(name, size, "/gltf_texture_%016llx.texturec", (unsigned long long)hash);
+}
+
+// Hash seed for everything besides the source bytes that changes the texture: color conversion,
+// the encoded format, the mip chain and the size limit. Equal seeds mean equal results.
+static uint64_t TextureSeed(bool linearize, bool premultiply, int encode, bool mips, int max_size)
+{
+    uint64_t seed = (linearize ? 1 : 0) | (premultiply ? 2 : 0) | (mips ? 4 : 0);
+    seed |= (uint64_t)(encode + 1) << 3;
+    seed |= (uint64_t)(max_size > 0 ? max_size : 0) << 16;
+    return seed;
+}
+
+static bool TextureHashFromName(const char *name, uint64_t *hash)
+{
+    unsigned long long h = 0;
+    if(name == nullptr || sscanf(name, "/gltf_texture_%16llx.texturec", &h) != 1) return false;
+    *hash = (uint64_t)h;
+    return true;
+}
+
+// Encoded image bytes. Buffer view images point straight into the loaded buffer, data uris own
+// their decoded base64 and file uris the file contents.
+struct ImageBytes
+{
+    const uint8_t *         data;
+    size_t                  size;
+    std::vector<uint8_t>    storage;
+    void *                  owned;      // malloc'd by cgltf's base64 decoder
+
+    ImageBytes() : data(nullptr), size(0), owned(nullptr) {}
+    ~ImageBytes() { free(owned); }
+    ImageBytes(const ImageBytes &) = delete;
+    ImageBytes &operator=(const ImageBytes &) = delete;
+};
+
+static bool ReadFile(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *f = fopen(path, "rb");
+    if(f == nullptr) return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    out.resize(size > 0 ? (size_t)size : 0);
+    size_t read = out.empty() ? 0 : fread(out.data(), 1, out.size(), f);
+    fclose(f);
+    return size > 0 && read == out.size();
+}
+
+static bool LoadImageBytes(cgltf_image *image, const char *basepath, ImageBytes *out, char *error, size_t error_size)
+{
+    out->data = nullptr;
+    out->size = 0;
+    if(image->buffer_view) {
+        out->data = cgltf_buffer_view_data(image->buffer_view);
+        out->size = image->buffer_view->size;
+        if(out->data == nullptr) snprintf(error, error_size, "buffer view not loaded");
+        return out->data != nullptr;
+    }
+    if(image->uri == nullptr) {
+        snprintf(error, error_size, "no image data");
+        return false;
+    }
+
+    if(strncmp(image->uri, "data:", 5) == 0) {
+        const char *comma = strchr(image->uri, ',');
+        if(comma == nullptr || comma - image->uri < 7 || strncmp(comma - 7, ";base64", 7) != 0) {
+            snprintf(error, error_size, "unsupported data uri");
+            return false;
+        }
+        const char *b64 = comma + 1;
+        size_t len = strlen(b64);
+        size_t decoded = len / 4 * 3;
+        if(len >= 1 && b64[len - 1] == '=') decoded--;
+        if(len >= 2 && b64[len - 2] == '=') decoded--;
+        cgltf_options options;
+        memset(&options, 0, sizeof(options));
+        if(cgltf_load_buffer_base64(&options, decoded, b64, &out->owned) != cgltf_result_success) {
+            snprintf(error, error_size, "bad base64 data");
+            return false;
+        }
+        out->data = (const uint8_t *)out->owned;
+        out->size = decoded;
+        return true;
+    }
+
+    // Relative file uri, which may be percent encoded
+    std::string uri(image->uri);
+    uri.resize(cgltf_decode_uri(&uri[0]));
+    std::string path = std::string(basepath ? basepath : "") + uri;
+    if(!ReadFile(path.c_str(), out->storage)) {
+        snprintf(error, error_size, "cannot read %s", path.c_str());
+        return false;
+    }
+    out->data = out->storage.data();
+    out->size = out->storage.size();
+    return true;
+}
+
+static bool DecodeImageBytes(const ImageBytes &bytes, DecodedImage *out)
+{
+    int comp = 0;
+    out->pixels = stbi_load_from_memory(bytes.data, (int)bytes.size, &out->width, &out->height, &comp, 4);
+    if(out->pixels == nullptr) {
+        snprintf(out->error, sizeof(out->error), "%s", stbi_failure_reason());
+        return false;
+    }
+    out->channels = comp;
+    return true;
+}
+
+bool DecodeImage(cgltf_image *image, const char *basepath, DecodedImage *out)
+{
+    memset(out, 0, sizeof(*out));
+    ImageBytes bytes;
+    if(!LoadImageBytes(image, basepath, &bytes, out->error, sizeof(out->error))) return false;
+    return DecodeImageBytes(bytes, out);
+}
+
+void FreeDecodedImage(DecodedImage *image)
+{
+    if(image->pixels) stbi_image_free(image->pixels);
+    image->pixels = nullptr;
+}
+
+// Build the full mip chain of an RGBA8 image into one contiguous block, level 0 first.
+//   Color maps are filtered in linear light (sRGB decode/encode) with alpha weighting, data maps
+//   (normals, metal/roughness, occlusion) as plain independent channels. Premultiplied color maps
+//   are filtered as is, the alpha weighting is already in them.
+bool GenerateMips(const uint8_t *pixels, int width, int height, bool srgb, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels, bool premultiplied)
+{
+    levels.clear();
+    size_t total = 0;
+    int w = width, h = height;
+    while(true) {
+        MipLevel level = { (uint32_t)total, w, h, (uint32_t)(w * h * 4) };
+        levels.push_back(level);
+        total += (size_t)w * h * 4;
+        if(w == 1 && h == 1) break;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    chain.resize(total);
+    memcpy(chain.data(), pixels, (size_t)width * height * 4);
+    for(size_t i=1; i<levels.size(); i++) {
+        const MipLevel &src = levels[i - 1];
+        const MipLevel &dst = levels[i];
+        const uint8_t *in = chain.data() + src.offset;
+        uint8_t *out = chain.data() + dst.offset;
+        unsigned char *res = srgb
+            ? stbir_resize_uint8_srgb(in, src.width, src.height, 0, out, dst.width, dst.height, 0, premultiplied ? STBIR_RGBA_PM : STBIR_RGBA)
+            : stbir_resize_uint8_linear(in, src.width, src.height, 0, out, dst.width, dst.height, 0, STBIR_4CHANNEL);
+        if(res == nullptr) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Color space conversion and alpha premultiplication, for targets without sRGB texture formats
+// and for blended materials. Lookups convert to and from linear light, the math is 4 wide.
+
+static float    srgb_to_linear[256];
+static uint8_t  srgb_to_linear8[256];
+static uint8_t  linear_to_srgb8[4096];     // indexed by linear * 4095
+
+static void InitColorTables()
+{
+    static bool initialized = false;
+    if(initialized) return;
+    for(int i=0; i<256; i++) {
+        float c = i / 255.0f;
+        srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        srgb_to_linear8[i] = (uint8_t)(srgb_to_linear[i] * 255.0f + 0.5f);
+    }
+    for(int i=0; i<4096; i++) {
+        float l = i / 4095.0f;
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+        linear_to_srgb8[i] = (uint8_t)(c * 255.0f + 0.5f);
+    }
+    initialized = true;
+}
+
+// In place over RGBA8 pixels (alpha is kept as is):
+//   linearize     sRGB encoded color to linear
+//   premultiply   color times alpha, in linear light for sRGB images that stay sRGB encoded
+static void ConvertPixels(uint8_t *pixels, size_t count, bool srgb, bool linearize, bool premultiply)
+{
+    if(!premultiply) {
+        if(!srgb || !linearize) return;
+        for(size_t i=0; i<count; i++) {
+            uint8_t *p = pixels + i * 4;
+            p[0] = srgb_to_linear8[p[0]];
+            p[1] = srgb_to_linear8[p[1]];
+            p[2] = srgb_to_linear8[p[2]];
+        }
+        return;
+    }
+
+    const float inv255 = 1.0f / 255.0f;
+    const simd4f scale = simd_splat(inv255);
+    const simd4f half = simd_splat(0.5f);
+    bool to_srgb = srgb && !linearize;
+    const simd4f encode = simd_splat(to_srgb ? 4095.0f : 255.0f);
+
+    // 4 pixels at a time, one pixel per lane and one vector per channel
+    const simd4i byte = simd_splati(0xff);
+    const simd4i alpha_mask = simd_splati(0xff000000u);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        uint8_t *p = pixels + i * 4;
+        simd4i px = simd_loadi(p);
+        simd4f alpha = simd_mul(simd_itof(simd_shri(px, 24)), scale);
+        simd4f r, g, b;
+        if(srgb) {
+            r = simd_set(srgb_to_linear[p[0]], srgb_to_linear[p[4]], srgb_to_linear[p[8]], srgb_to_linear[p[12]]);
+            g = simd_set(srgb_to_linear[p[1]], srgb_to_linear[p[5]], srgb_to_linear[p[9]], srgb_to_linear[p[13]]);
+            b = simd_set(srgb_to_linear[p[2]], srgb_to_linear[p[6]], srgb_to_linear[p[10]], srgb_to_linear[p[14]]);
+        }
+        else {
+            r = simd_mul(simd_itof(simd_andi(px, byte)), scale);
+            g = simd_mul(simd_itof(simd_andi(simd_shri(px, 8), byte)), scale);
+            b = simd_mul(simd_itof(simd_andi(simd_shri(px, 16), byte)), scale);
+        }
+        simd4i ri = simd_ftoi(simd_madd(simd_mul(r, alpha), encode, half));
+        simd4i gi = simd_ftoi(simd_madd(simd_mul(g, alpha), encode, half));
+        simd4i bi = simd_ftoi(simd_madd(simd_mul(b, alpha), encode, half));
+        if(to_srgb) {
+            uint32_t idx[12];
+            simd_storei(idx, ri);
+            simd_storei(idx + 4, gi);
+            simd_storei(idx + 8, bi);
+            for(int l=0; l<4; l++) {
+                p[l * 4 + 0] = linear_to_srgb8[idx[l]];
+                p[l * 4 + 1] = linear_to_srgb8[idx[l + 4]];
+                p[l * 4 + 2] = linear_to_srgb8[idx[l + 8]];
+            }
+        }
+        else {
+            simd4i rgb = simd_ori(ri, simd_ori(simd_shli(gi, 8), simd_shli(bi, 16)));
+            simd_storei(p, simd_ori(rgb, simd_andi(px, alpha_mask)));
+        }
+    }
+
+    // Remaining pixels
+    float out[4];
+    for(; i<count; i++) {
+        uint8_t *p = pixels + i * 4;
+        simd4f color = srgb
+            ? simd_set(srgb_to_linear[p[0]], srgb_to_linear[p[1]], srgb_to_linear[p[2]], 0.0f)
+            : simd_mul(simd_set(p[0], p[1], p[2], 0.0f), scale);
+        color = simd_mul(color, simd_splat(p[3] * inv255));
+        simd_store(out, simd_madd(color, encode, half));
+        if(to_srgb) {
+            p[0] = linear_to_srgb8[(int)out[0]];
+            p[1] = linear_to_srgb8[(int)out[1]];
+            p[2] = linear_to_srgb8[(int)out[2]];
+        }
+        else {
+            p[0] = (uint8_t)out[0];
+            p[1] = (uint8_t)out[1];
+            p[2] = (uint8_t)out[2];
+        }
+    }
+}
+
+// Is the image used as a normal map, and for nothing else?
+static bool ImageIsNormalMap(cgltf_data *data, cgltf_image *image)
+{
+    bool normal = false;
+    for(cgltf_size i=0; i<data->materials_count; i++) {
+        cgltf_material *mat = &data->materials[i];
+        const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+        int count = MaterialTextureViews(mat, views);
+        for(int v=0; v<count; v++) {
+            const cgltf_texture *tex = views[v]->texture;
+            if(tex == nullptr || tex->image != image) continue;
+            if(views[v] != &mat->normal_texture && views[v] != &mat->clearcoat.clearcoat_normal_texture) return false;
+            normal = true;
+        }
+    }
+    return normal;
+}
+
+// Two channel format normal maps are encoded to: the first one in the mask, -1 for none
+static int NormalMapFormat(uint32_t formats)
+{
+    static const int order[] = { TEXTURE_FORMAT_BC5, TEXTURE_FORMAT_EAC_RG, TEXTURE_FORMAT_RG8 };
+    for(size_t i=0; i<sizeof(order)/sizeof(order[0]); i++) {
+        if(formats & (1u << order[i])) return order[i];
+    }
+    return -1;
+}
+
+// Is the image the base color of a blended material?
+static bool ImageIsBlended(cgltf_data *data, cgltf_image *image)
+{
+    for(cgltf_size i=0; i<data->materials_count; i++) {
+        cgltf_material *mat = &data->materials[i];
+        if(mat->alpha_mode != cgltf_alpha_mode_blend) continue;
+        const cgltf_texture *color[] = {
+            mat->pbr_metallic_roughness.base_color_texture.texture,
+            mat->pbr_specular_glossiness.diffuse_texture.texture,
+        };
+        for(int c=0; c<2; c++) {
+            if(color[c] && (color[c]->image == image || color[c]->basisu_image == image)) return true;
+        }
+    }
+    return false;
+}
+
+// Is the image's alpha used, as the base color of a blended or masked material?
+static bool ImageUsesAlpha(cgltf_data *data, cgltf_image *image)
+{
+    for(cgltf_size i=0; i<data->materials_count; i++) {
+        cgltf_material *mat = &data->materials[i];
+        if(mat->alpha_mode == cgltf_alpha_mode_opaque) continue;
+        const cgltf_texture *color[] = {
+            mat->pbr_metallic_roughness.base_color_texture.texture,
+            mat->pbr_specular_glossiness.diffuse_texture.texture,
+        };
+        for(int c=0; c<2; c++) {
+            if(color[c] && color[c]->image == image) return true;
+        }
+    }
+    return false;
+}
+
+// Block format images are compressed to: the first one in the mask that blockencode.cpp can
+// encode, with alpha when it's used. -1 for none.
+static int CompressFormat(uint32_t formats, bool alpha)
+{
+    static const int opaque[] = { TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_ETC1, TEXTURE_FORMAT_ETC2, TEXTURE_FORMAT_BC3 };
+    static const int blended[] = { TEXTURE_FORMAT_BC3, TEXTURE_FORMAT_ETC2 };
+    const int *order = alpha ? blended : opaque;
+    size_t count = alpha ? sizeof(blended) / sizeof(blended[0]) : sizeof(opaque) / sizeof(opaque[0]);
+    for(size_t i=0; i<count; i++) {
+        if(formats & (1u << order[i])) return order[i];
+    }
+    return -1;
+}
+
+// Is the image used as a color map (base color or emissive) by any material?
+bool ImageIsSRGB(cgltf_data *data, cgltf_image *image)
+{
+    for(cgltf_size i=0; i<data->materials_count; i++) {
+        cgltf_material *mat = &data->materials[i];
+        const cgltf_texture *color[] = {
+            mat->pbr_metallic_roughness.base_color_texture.texture,
+            mat->pbr_specular_glossiness.diffuse_texture.texture,
+            mat->emissive_texture.texture,
+        };
+        for(int c=0; c<3; c++) {
+            if(color[c] && (color[c]->image == image || color[c]->basisu_image == image)) return true;
+        }
+    }
+    return false;
+}
+
+// Bytes of an RGBA8 image, with or without its full mip chain
+static uint64_t TextureBytes(int width, int height, bool mips)
+{
+    uint64_t total = 0;
+    while(true) {
+        total += (uint64_t)width * height * 4;
+        if(!mips || (width == 1 && height == 1)) break;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return total;
+}
+
+static bool ReserveTextureMemory(uint64_t bytes, bool force)
+{
+    uint64_t used = texture_used.load();
+    while(true) {
+        uint64_t budget = texture_budget.load();
+        if(!force && budget != 0 && used + bytes > budget) return false;
+        if(texture_used.compare_exchange_weak(used, used + bytes)) return true;
+    }
+}
+
+static bool ResizeImage(DecodedImage *image, int width, int height, bool srgb)
+{
+    uint8_t *out = (uint8_t *)malloc((size_t)width * height * 4);
+    unsigned char *res = srgb
+        ? stbir_resize_uint8_srgb(image->pixels, image->width, image->height, 0, out, width, height, 0, STBIR_RGBA)
+        : stbir_resize_uint8_linear(image->pixels, image->width, image->height, 0, out, width, height, 0, STBIR_4CHANNEL);
+    if(res == nullptr) {
+        free(out);
+        return false;
+    }
+    // stb_image allocates with malloc, so FreeDecodedImage can release either
+    stbi_image_free(image->pixels);
+    image->pixels = out;
+    image->width = width;
+    image->height = height;
+    return true;
+}
+
+// Downscale a decoded image (halving) until it fits max_size and the global texture budget, then
+// reserve its memory against the budget. Returns the bytes reserved.
+uint64_t FitImage(DecodedImage *image, int index, bool srgb, bool mips, int max_size)
+{
+    int src_w = image->width;
+    int src_h = image->height;
+    int w = src_w;
+    int h = src_h;
+    uint64_t before = TextureBytes(w, h, mips);
+    if(max_size > 0) {
+        while(w > max_size || h > max_size) {
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+
+    uint64_t bytes = 0;
+    bool over_budget = false;
+    while(true) {
+        bytes = TextureBytes(w, h, mips);
+        if(ReserveTextureMemory(bytes, false)) break;
+        if(w <= TEXTURE_MIN_SIZE && h <= TEXTURE_MIN_SIZE) {
+            ReserveTextureMemory(bytes, true);
+            over_budget = true;
+            break;
+        }
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    if((w != src_w || h != src_h) && !ResizeImage(image, w, h, srgb)) {
+        // Keep the source size if the resize fails, and move the reservation to match
+        texture_used -= bytes;
+        bytes = before;
+        ReserveTextureMemory(bytes, true);
+    }
+
+    printf("[Info] Texture %d: %dx%d (%llu KB) -> %dx%d (%llu KB)%s\n", index, src_w, src_h, (unsigned long long)(before / 1024),
+        image->width, image->height, (unsigned long long)(bytes / 1024), over_budget ? " over budget" : "");
+    return bytes;
+}
+
+// Pick the KTX2 (or disk cache) levels to keep: the top levels are skipped until the texture fits
+// max_size and the budget (compressed levels can't be resized). Returns the bytes reserved.
+static uint64_t FitKTX2(const KTX2Info &info, int index, bool mips, int max_size, int *first, int *count)
+{
+    int last = mips ? info.levels : 1;
+    uint64_t before = 0;
+    for(int l=0; l<last; l++) before += TextureFormatBytes(info.format, std::max(info.width >> l, 1), std::max(info.height >> l, 1));
+
+    uint64_t bytes = before;
+    int level = 0;
+    bool over_budget = false;
+    while(true) {
+        int w = std::max(info.width >> level, 1);
+        int h = std::max(info.height >> level, 1);
+        bool last_level = level + 1 >= info.levels;
+        if(max_size > 0 && (w > max_size || h > max_size) && !last_level) {
+            bytes -= mips ? TextureFormatBytes(info.format, w, h) : 0;
+            level++;
+            continue;
+        }
+        if(!mips) bytes = TextureFormatBytes(info.format, w, h);
+        if(ReserveTextureMemory(bytes, false)) break;
+        if((w <= TEXTURE_MIN_SIZE && h <= TEXTURE_MIN_SIZE) || last_level) {
+            ReserveTextureMemory(bytes, true);
+            over_budget = true;
+            break;
+        }
+        bytes -= mips ? TextureFormatBytes(info.format, w, h) : 0;
+        level++;
+    }
+    *first = level;
+    *count = mips ? info.levels - level : 1;
+
+    printf("[Info] Texture %d: %dx%d %s (%llu KB) -> %dx%d (%llu KB)%s\n", index, info.width, info.height, TextureFormatName(info.format),
+        (unsigned long long)(before / 1024), std::max(info.width >> level, 1), std::max(info.height >> level, 1),
+        (unsigned long long)(bytes / 1024), over_budget ? " over budget" : "");
+    return bytes;
+}
+
+// Push the levels as { { offset, width, height, size }, .. } (offset and size in bytes in the chain)
+void PushMipLevels(lua_State *L, const std::vector<MipLevel> &levels)
+{
+    lua_newtable(L);
+    for(size_t i=0; i<levels.size(); i++) {
+        lua_pushinteger(L, (lua_Integer)(i + 1));
+        lua_newtable(L);
+        lua_pushstring(L, "offset");
+        lua_pushinteger(L, levels[i].offset);
+        lua_settable(L, -3);
+        lua_pushstring(L, "width");
+        lua_pushinteger(L, levels[i].width);
+        lua_settable(L, -3);
+        lua_pushstring(L, "height");
+        lua_pushinteger(L, levels[i].height);
+        lua_settable(L, -3);
+        lua_pushstring(L, "size");
+        lua_pushinteger(L, levels[i].size);
+        lua_settable(L, -3);
+        lua_settable(L, -3);
+    }
+}
+
+// Copy decoded pixels into a new Defold buffer (stream "rgba", 4 x uint8) and push it
+void PushImageBuffer(lua_State *L, const uint8_t *pixels, uint32_t size)
+{
+    dmBuffer::StreamDeclaration decl[] = {
+        { dmHashString64(IMAGE_STREAM), dmBuffer::VALUE_TYPE_UINT8, 4 }
+    };
+    dmBuffer::HBuffer buffer = 0;
+    dmBuffer::Create(size / 4, decl, 1, &buffer);
+
+    uint8_t *data = nullptr;
+    uint32_t datasize = 0;
+    dmBuffer::GetBytes(buffer, (void **)&data, &datasize);
+    memcpy(data, pixels, size);
+
+    dmScript::LuaHBuffer luabuf(buffer, dmScript::OWNER_LUA);
+    dmScript::PushBuffer(L, luabuf);
+}
+
+// decode_image(image [, basepath [, max_size]])
+//   Decodes a cgltf_image to RGBA8. basepath is prepended to file uris. The image is downscaled
+//   to max_size and the texture budget like images_decode, and is added to the texture cache by
+//   content, so texture_release(texture) gives its bytes back to the budget.
+//   Returns buffer, width, height, bytes, texture, or nil on failure. bytes is 0 when the texture
+//   was already in the cache (its owner holds the memory).
+int lib_decode_image(lua_State *L)
+{
+    cgltf_image * image = (cgltf_image *)lua_touserdata(L, 1);
+    const char *basepath = lua_isstring(L, 2) ? lua_tostring(L, 2) : nullptr;
+    int max_size = (int)luaL_optinteger(L, 3, 0);
+    if(image == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    ImageBytes bytes;
+    DecodedImage decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    if(!LoadImageBytes(image, basepath, &bytes, decoded.error, sizeof(decoded.error)) || !DecodeImageBytes(bytes, &decoded)) {
+        printf("[Error] decode_image: %s (%s)\n", image->uri ? image->uri : (image->name ? image->name : "buffer view"), decoded.error);
+        lua_pushnil(L);
+        return 1;
+    }
+
+    // Same hash as an unconverted images_decode result without mips, so both share one texture
+    uint64_t hash = XXH64(bytes.data, bytes.size, TextureSeed(false, false, -1, false, max_size));
+    int width = 0, height = 0;
+    bool shared = TextureCacheFind(hash, &width, &height);
+    uint64_t reserved = FitImage(&decoded, -1, false, false, max_size);
+    if(shared) {
+        texture_used -= reserved;
+        reserved = 0;
+    }
+    else TextureCacheInsert(hash, decoded.width, decoded.height, reserved);
+
+    char name[64];
+    TextureName(hash, name, sizeof(name));
+    PushImageBuffer(L, decoded.pixels, (uint32_t)(decoded.width * decoded.height * 4));
+    lua_pushinteger(L, decoded.width);
+    lua_pushinteger(L, decoded.height);
+    lua_pushinteger(L, (lua_Integer)reserved);
+    lua_pushstring(L, name);
+    FreeDecodedImage(&decoded);
+    return 5;
+}
+
+// set_texture_budget(bytes)   0 turns the budget off
+int lib_set_texture_budget(lua_State *L)
+{
+    texture_budget = (uint64_t)luaL_checknumber(L, 1);
+    return 0;
+}
+
+// texture_memory_release(bytes)   returns texture memory to the budget when a texture is freed
+int lib_texture_memory_release(lua_State *L)
+{
+    uint64_t bytes = (uint64_t)luaL_checknumber(L, 1);
+    uint64_t used = texture_used.load();
+    while(!texture_used.compare_exchange_weak(used, used > bytes ? used - bytes : 0)) {}
+    return 0;
+}
+
+// get_texture_memory()   returns used, budget
+int lib_get_texture_memory(lua_State *L)
+{
+    lua_pushnumber(L, (lua_Number)texture_used.load());
+    lua_pushnumber(L, (lua_Number)texture_budget.load());
+    return 2;
+}
+
+// generate_mips(buffer, width, height [, srgb])
+//   Returns the full mip chain of an RGBA8 buffer as one buffer, and the level table.
+int lib_generate_mips(lua_State *L)
+{
+    dmBuffer::HBuffer src = dmScript::CheckBufferUnpack(L, 1);
+    int width = (int)luaL_checkinteger(L, 2);
+    int height = (int)luaL_checkinteger(L, 3);
+    bool srgb = lua_toboolean(L, 4);
+
+    uint8_t *pixels = nullptr;
+    uint32_t size = 0;
+    dmBuffer::GetBytes(src, (void **)&pixels, &size);
+    if(size < (uint32_t)(width * height * 4)) {
+        return luaL_error(L, "generate_mips: buffer is smaller than %dx%d RGBA8", width, height);
+    }
+
+    std::vector<uint8_t> chain;
+    std::vector<MipLevel> levels;
+    if(!GenerateMips(pixels, width, height, srgb, chain, levels)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    PushImageBuffer(L, chain.data(), (uint32_t)chain.size());
+    PushMipLevels(L, levels);
+    return 2;
+}
+
+// mip_level(chain, level)
+//   Copies one level (from the table returned with the chain) into its own buffer for
+//   resource.set_texture, which takes one buffer per mip level. Levels without a size are RGBA8.
+int lib_mip_level(lua_State *L)
+{
+    dmBuffer::HBuffer chain = dmScript::CheckBufferUnpack(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_getfield(L, 2, "offset");
+    uint32_t offset = (uint32_t)lua_tointeger(L, -1);
+    lua_getfield(L, 2, "width");
+    uint32_t width = (uint32_t)lua_tointeger(L, -1);
+    lua_getfield(L, 2, "height");
+    uint32_t height = (uint32_t)lua_tointeger(L, -1);
+    lua_getfield(L, 2, "size");
+    uint32_t level_size = lua_isnumber(L, -1) ? (uint32_t)lua_tointeger(L, -1) : width * height * 4;
+    lua_pop(L, 4);
+
+    uint8_t *pixels = nullptr;
+    uint32_t size = 0;
+    dmBuffer::GetBytes(chain, (void **)&pixels, &size);
+    if(offset + level_size > size) {
+        return luaL_error(L, "mip_level: level is outside the chain");
+    }
+    PushImageBuffer(L, pixels + offset, level_size);
+    return 1;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Batched decoding on the worker pool
+
+struct ImageTask
+{
+    cgltf_image *           image;
+    int                     index;
+    const char *            basepath;
+    DecodedImage            decoded;
+    bool                    ok;
+    bool                    mips;
+    bool                    srgb;
+    int                     max_size;
+    uint64_t                bytes;
+    uint64_t                hash;
+    bool                    shared;     // another task or load owns the texture
+    bool                    deferred;   // KTX2 fallback, only decoded if the KTX2 image fails
+    bool                    packed;     // only used through ORM pack tasks, decoded if they fail
+    bool                    queued;     // deferred or packed task handed to the workers once needed
+    bool                    linearize;  // convert sRGB color to linear at decode
+    bool                    premultiply;// premultiply color by alpha at decode
+    int                     encode;     // TextureFormat the RGBA8 levels are encoded to, -1 for none
+    const char *            cache_path; // disk cache prefix for encoded textures, null for none
+    bool                    downscaled; // made smaller to fit, not stored in the disk cache
+    cgltf_image *           occlusion;  // ORM pack task: occlusion image, image is metallic-roughness
+    uint32_t                formats;    // TextureFormat mask for KTX2 images
+    int                     format;     // TextureFormat of the result
+    std::vector<uint8_t>    chain;
+    std::vector<MipLevel>   levels;
+    uint32_t                job;        // ImageJob::serial
+    int                     owner;      // index of the owner when it is in the same job, else -1
+    bool                    emitted;    // returned by images_poll/images_wait already
+    std::atomic<bool> *     done;
+};
+
+struct ImageJob
+{
+    cgltf_data *                    data;
+    uint32_t                        serial;
+    JobBatch *                      batch;
+    std::string                     basepath;
+    std::string                     cache_path;
+    std::vector<ImageTask>          tasks;
+    std::vector<std::atomic<bool>>  done;
+};
+
+// ORM texel: R from the occlusion map, G (roughness) and B (metallic) from the metallic-roughness
+// map, opaque alpha. out may be mr.
+static void PackORM(const uint8_t *occlusion, const uint8_t *mr, uint8_t *out, size_t pixels)
+{
+    const simd4i rmask = simd_splati(0x000000ffu);
+    const simd4i gbmask = simd_splati(0x00ffff00u);
+    const simd4i alpha = simd_splati(0xff000000u);
+    size_t i = 0;
+    for(; i + 4 <= pixels; i += 4) {
+        simd4i o = simd_andi(simd_loadi(occlusion + i * 4), rmask);
+        simd4i gb = simd_andi(simd_loadi(mr + i * 4), gbmask);
+        simd_storei(out + i * 4, simd_ori(simd_ori(o, gb), alpha));
+    }
+    for(; i < pixels; i++) {
+        out[i * 4 + 0] = occlusion[i * 4];
+        out[i * 4 + 1] = mr[i * 4 + 1];
+        out[i * 4 + 2] = mr[i * 4 + 2];
+        out[i * 4 + 3] = 255;
+    }
+}
+
+// Find the task's texture in the cache, or make the task its owner. Returns true when shared.
+static bool ClaimTexture(ImageTask *task)
+{
+    DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+    std::map<uint64_t, TextureCacheEntry>::iterator it = texture_cache.find(task->hash);
+    if(it != texture_cache.end()) {
+        it->second.refs++;
+        task->shared = true;
+        task->ok = true;
+        if(it->second.job == task->job) task->owner = it->second.index;
+        return true;
+    }
+    TextureCacheEntry &entry = texture_cache[task->hash];
+    memset(&entry, 0, sizeof(entry));
+    entry.refs = 1;
+    entry.job = task->job;
+    entry.index = task->index;
+    return false;
+}
+
+// Textures built outside images_decode (atlases) are cached too. Find takes a reference and
+// returns the size when the texture is already there, Insert adds a ready entry for a new one.
+bool TextureCacheFind(uint64_t hash, int *width, int *height)
+{
+    if(texture_cache_mutex == 0) texture_cache_mutex = dmMutex::New();
+    DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+    std::map<uint64_t, TextureCacheEntry>::iterator it = texture_cache.find(hash);
+    if(it == texture_cache.end()) return false;
+    it->second.refs++;
+    *width = it->second.width;
+    *height = it->second.height;
+    return true;
+}
+
+void TextureCacheInsert(uint64_t hash, int width, int height, uint64_t bytes)
+{
+    DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+    TextureCacheEntry &entry = texture_cache[hash];
+    memset(&entry, 0, sizeof(entry));
+    entry.refs = 1;
+    entry.ready = true;
+    entry.index = -1;
+    entry.width = width;
+    entry.height = height;
+    entry.bytes = bytes;
+}
+
+// Encodes the RGBA8 levels (the chain, or level 0 alone) into task->encode, and gives back the
+// budget the smaller levels don't use
+static void EncodeTask(ImageTask *task)
+{
+    std::vector<MipLevel> levels = task->levels;
+    if(levels.empty()) {
+        MipLevel level = { 0, task->decoded.width, task->decoded.height, (uint32_t)(task->decoded.width * task->decoded.height * 4) };
+        levels.push_back(level);
+    }
+    const uint8_t *src = task->levels.empty() ? task->decoded.pixels : task->chain.data();
+
+    uint32_t total = 0;
+    for(size_t l=0; l<levels.size(); l++) {
+        levels[l].offset = total;
+        levels[l].size = (uint32_t)TextureFormatBytes(task->encode, levels[l].width, levels[l].height);
+        total += levels[l].size;
+    }
+    std::vector<uint8_t> chain(total);
+    for(size_t l=0; l<levels.size(); l++) {
+        const MipLevel &in = task->levels.empty() ? levels[0] : task->levels[l];
+        EncodeLevel(task->encode, src + (task->levels.empty() ? 0 : in.offset), in.width, in.height, chain.data() + levels[l].offset);
+    }
+
+    uint64_t rgba_bytes = task->bytes;
+    task->bytes = 0;
+    for(size_t l=0; l<levels.size(); l++) task->bytes += levels[l].size;
+    if(rgba_bytes > task->bytes) texture_used -= rgba_bytes - task->bytes;
+
+    task->chain.swap(chain);
+    task->levels.swap(levels);
+    task->format = task->encode;
+    FreeDecodedImage(&task->decoded);
+    if(task->cache_path && !task->downscaled) DiskCacheStore(task->cache_path, task->hash, task->mips, task->format, task->chain, task->levels);
+}
+
+// Budget, color conversion, mips, then encoding for a task with decoded pixels
+static void FinishDecodedTask(ImageTask *task)
+{
+    int width = task->decoded.width, height = task->decoded.height;
+    task->bytes = FitImage(&task->decoded, task->index, task->srgb, task->mips, task->max_size);
+    task->downscaled = task->decoded.width != width || task->decoded.height != height;
+    ConvertPixels(task->decoded.pixels, (size_t)task->decoded.width * task->decoded.height, task->srgb, task->linearize, task->premultiply);
+    // Linearized images are filtered as plain channels from here on
+    bool srgb = task->srgb && !task->linearize;
+    if(task->mips) {
+        if(GenerateMips(task->decoded.pixels, task->decoded.width, task->decoded.height, srgb, task->chain, task->levels, task->premultiply)) {
+            FreeDecodedImage(&task->decoded);
+        }
+        else {
+            // Fall back to level 0 only
+            task->levels.clear();
+            task->chain.clear();
+        }
+    }
+    if(task->encode >= 0) EncodeTask(task);
+}
+
+// Keeps levels [first, first + count) of a chain
+static void KeepLevels(std::vector<uint8_t> &chain, std::vector<MipLevel> &levels, int first, int count)
+{
+    uint32_t start = levels[first].offset;
+    const MipLevel &last = levels[first + count - 1];
+    std::vector<uint8_t>(chain.begin() + start, chain.begin() + last.offset + last.size).swap(chain);
+    std::vector<MipLevel>(levels.begin() + first, levels.begin() + first + count).swap(levels);
+    for(size_t l=0; l<levels.size(); l++) levels[l].offset -= start;
+}
+
+// Takes an encoded texture from the disk cache instead of decoding and encoding it again
+static bool LoadCachedTask(ImageTask *task)
+{
+    if(task->encode < 0 || task->cache_path == nullptr) return false;
+    KTX2Info info;
+    if(!DiskCacheLoad(task->cache_path, task->hash, task->mips, &info, task->chain, task->levels)) return false;
+    if(info.format != task->encode) {
+        task->chain.clear();
+        task->levels.clear();
+        return false;
+    }
+    int first = 0, count = 0;
+    task->bytes = FitKTX2(info, task->index, task->mips, task->max_size, &first, &count);
+    KeepLevels(task->chain, task->levels, first, count);
+    task->format = info.format;
+    task->decoded.width = task->levels[0].width;
+    task->decoded.height = task->levels[0].height;
+    task->decoded.channels = 4;
+    task->ok = true;
+    return true;
+}
+
+// Decode both maps of an ORM pack task and pack them. The occlusion map is resized to the
+// metallic-roughness map if they differ.
+static void DecodeORMTask(ImageTask *task)
+{
+    ImageBytes occlusion_bytes, mr_bytes;
+    if(!LoadImageBytes(task->occlusion, task->basepath, &occlusion_bytes, task->decoded.error, sizeof(task->decoded.error))) return;
+    if(!LoadImageBytes(task->image, task->basepath, &mr_bytes, task->decoded.error, sizeof(task->decoded.error))) return;
+    if(IsKTX2(occlusion_bytes.data, occlusion_bytes.size) || IsKTX2(mr_bytes.data, mr_bytes.size)) {
+        snprintf(task->decoded.error, sizeof(task->decoded.error), "ORM: KTX2 images can't be packed");
+        return;
+    }
+
+    uint64_t seed = TextureSeed(false, false, task->encode, task->mips, task->max_size);
+    task->hash = XXH64(mr_bytes.data, mr_bytes.size, XXH64(occlusion_bytes.data, occlusion_bytes.size, seed));
+    if(ClaimTexture(task) || LoadCachedTask(task)) return;
+
+    DecodedImage occlusion;
+    memset(&occlusion, 0, sizeof(occlusion));
+    if(!DecodeImageBytes(occlusion_bytes, &occlusion)) {
+        snprintf(task->decoded.error, sizeof(task->decoded.error), "ORM occlusion: %s", occlusion.error);
+        return;
+    }
+    task->ok = DecodeImageBytes(mr_bytes, &task->decoded);
+    if(task->ok && (occlusion.width != task->decoded.width || occlusion.height != task->decoded.height)) {
+        task->ok = ResizeImage(&occlusion, task->decoded.width, task->decoded.height, false);
+        if(!task->ok) snprintf(task->decoded.error, sizeof(task->decoded.error), "ORM: occlusion resize failed");
+    }
+    if(task->ok) {
+        PackORM(occlusion.pixels, task->decoded.pixels, task->decoded.pixels, (size_t)task->decoded.width * task->decoded.height);
+        FinishDecodedTask(task);
+    }
+    FreeDecodedImage(&occlusion);
+}
+
+static void DecodeTask(ImageTask *task)
+{
+    if(task->occlusion) {
+        DecodeORMTask(task);
+        return;
+    }
+
+    ImageBytes bytes;
+    if(!LoadImageBytes(task->image, task->basepath, &bytes, task->decoded.error, sizeof(task->decoded.error))) return;
+
+    // KTX2 levels are used as they are. Converted, mipped or size limited pixels are different
+    // content, the seed keeps them apart from other copies of the same file in the cache.
+    bool ktx2 = IsKTX2(bytes.data, bytes.size);
+    if(ktx2) {
+        task->linearize = task->premultiply = false;
+        task->encode = -1;
+    }
+    uint64_t seed = TextureSeed(task->linearize, task->premultiply, task->encode, task->mips, task->max_size);
+    task->hash = XXH64(bytes.data, bytes.size, seed);
+    if(ClaimTexture(task) || LoadCachedTask(task)) return;
+
+    if(ktx2) {
+        KTX2Info info;
+        task->ok = KTX2Open(bytes.data, bytes.size, task->formats, &info);
+        int first = 0, count = 0;
+        if(task->ok) {
+            task->bytes = FitKTX2(info, task->index, task->mips, task->max_size, &first, &count);
+            task->ok = KTX2Transcode(bytes.data, bytes.size, &info, first, count, task->chain, task->levels);
+            if(!task->ok) {
+                texture_used -= task->bytes;
+                task->bytes = 0;
+            }
+        }
+        if(!task->ok) {
+            snprintf(task->decoded.error, sizeof(task->decoded.error), "KTX2: %s", info.error);
+            return;
+        }
+        task->format = info.format;
+        task->decoded.width = task->levels[0].width;
+        task->decoded.height = task->levels[0].height;
+        task->decoded.channels = info.has_alpha ? 4 : 3;
+        return;
+    }
+
+    task->ok = DecodeImageBytes(bytes, &task->decoded);
+    if(task->ok) FinishDecodedTask(task);
+}
+
+static void PushTextureField(lua_State *L, const char *key, lua_Integer value)
+{
+    lua_pushstring(L, key);
+    lua_pushinteger(L, value);
+    lua_settable(L, -3);
+}
+
+struct ORMPair
+{
+    cgltf_image *   occlusion;
+    cgltf_image *   mr;
+};
+
+static bool CanPackORM(const cgltf_material *mat)
+{
+    const cgltf_texture_view &occlusion = mat->occlusion_texture;
+    const cgltf_texture_view &mr = mat->pbr_metallic_roughness.metallic_roughness_texture;
+    if(!mat->has_pbr_metallic_roughness || occlusion.texture == nullptr || mr.texture == nullptr) return false;
+    if(occlusion.texture->image == nullptr || mr.texture->image == nullptr) return false;
+    if(occlusion.texture->image == mr.texture->image) return false;     // already one image
+    if(occlusion.texture->basisu_image || mr.texture->basisu_image) return false;
+    // One texture replaces both slots, so they have to be sampled the same way
+    return occlusion.texcoord == mr.texcoord && !occlusion.has_transform && !mr.has_transform
+        && occlusion.texture->sampler == mr.texture->sampler;
+}
+
+// Materials with separate occlusion and metallic-roughness images get one pack task per image pair.
+// packed marks images only used through those pairs, they needn't be decoded on their own.
+static void FindORMPairs(cgltf_data *data, const std::vector<bool> &selected, std::vector<ORMPair> &pairs, std::vector<bool> &packed)
+{
+    std::vector<bool> pack_use(data->images_count, false), other_use(data->images_count, false);
+    for(cgltf_size m=0; m<data->materials_count; m++) {
+        const cgltf_material *mat = &data->materials[m];
+        bool pack = CanPackORM(mat)
+            && selected[cgltf_image_index(data, mat->occlusion_texture.texture->image)]
+            && selected[cgltf_image_index(data, mat->pbr_metallic_roughness.metallic_roughness_texture.texture->image)];
+        if(pack) {
+            ORMPair pair = { mat->occlusion_texture.texture->image, mat->pbr_metallic_roughness.metallic_roughness_texture.texture->image };
+            bool found = false;
+            for(size_t p=0; p<pairs.size(); p++) found = found || (pairs[p].occlusion == pair.occlusion && pairs[p].mr == pair.mr);
+            if(!found) pairs.push_back(pair);
+        }
+
+        const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+        int count = MaterialTextureViews(mat, views);
+        for(int v=0; v<count; v++) {
+            const cgltf_texture *tex = views[v]->texture;
+            if(tex == nullptr || tex->image == nullptr) continue;
+            bool orm_slot = views[v] == &mat->occlusion_texture || views[v] == &mat->pbr_metallic_roughness.metallic_roughness_texture;
+            cgltf_size index = cgltf_image_index(data, tex->image);
+            if(pack && orm_slot) pack_use[index] = true;
+            else other_use[index] = true;
+        }
+    }
+    packed.assign(data->images_count, false);
+    for(cgltf_size i=0; i<data->images_count; i++) packed[i] = pack_use[i] && !other_use[i];
+}
+
+static void DecodeImageTask(void *ctx)
+{
+    ImageTask *task = (ImageTask *)ctx;
+    DecodeTask(task);
+    task->done->store(true);
+}
+
+// images_decode(data [, basepath [, options]])
+//   Starts decoding every image of the model across the worker pool. options:
+//     mips        build the full chain in the same job (sRGB filtered for color maps)
+//     max_size    downscale images larger than this (in either dimension)
+//     pack_orm    pack separate occlusion and metallic-roughness images into one ORM image
+//                 (R occlusion, G roughness, B metallic), returned after the model's images
+//     linearize   convert color maps from sRGB to linear, for targets without sRGB formats
+//     premultiply premultiply the base color maps of blended materials by alpha
+//     pack_normals encode normal maps to the first two channel format (bc5, eac_rg, rg8) in formats
+//     compress    block compress the other images to bc1/etc1, or bc3/etc2 when their alpha is used
+//                 (the first of those in formats)
+//     cache_path  with compress, encoded textures are kept in files starting with this path and
+//                 read back by later loads instead of being decoded and encoded again
+//     images      image indices (+ 1) to decode, the rest are skipped (see reachable_images)
+//     formats     GPU formats KTX2 images may be transcoded to, { "astc", "bc7", "etc2", .. }
+//                 (RGBA8 is always allowed). The fallback image of a KHR_texture_basisu texture
+//                 is only decoded when its KTX2 image fails.
+//   Images are also downscaled to fit the global texture budget (set_texture_budget).
+//   Returns a job handle for images_done/images_wait, or nil when the model has no images, and
+//   with pack_orm the list of packed pairs { { occlusion, metallic_roughness, index }, .. } (image
+//   indices + 1, index is the pair's key in the results).
+int lib_images_decode(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr || data->images_count == 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    bool mips = false;
+    int max_size = 0;
+    uint32_t formats = 1u << TEXTURE_FORMAT_RGBA8;
+    std::vector<bool> selected(data->images_count, true);
+    bool pack_orm = false;
+    bool linearize = false;
+    bool premultiply = false;
+    bool pack_normals = false;
+    bool compress = false;
+    if(lua_istable(L, 3)) {
+        lua_getfield(L, 3, "pack_orm");
+        pack_orm = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "linearize");
+        linearize = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "premultiply");
+        premultiply = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "pack_normals");
+        pack_normals = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "compress");
+        compress = lua_toboolean(L, -1);
+        lua_pop(L, 5);
+        lua_getfield(L, 3, "mips");
+        mips = lua_toboolean(L, -1);
+        lua_getfield(L, 3, "max_size");
+        max_size = (int)lua_tointeger(L, -1);
+        lua_pop(L, 2);
+        lua_getfield(L, 3, "formats");
+        if(lua_istable(L, -1)) {
+            for(int i=1; ; i++) {
+                lua_rawgeti(L, -1, i);
+                if(!lua_isstring(L, -1)) {
+                    lua_pop(L, 1);
+                    break;
+                }
+                int format = TextureFormatFromName(lua_tostring(L, -1));
+                if(format >= 0) formats |= 1u << format;
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+        lua_getfield(L, 3, "images");
+        if(lua_istable(L, -1)) {
+            selected.assign(data->images_count, false);
+            for(int i=1; ; i++) {
+                lua_rawgeti(L, -1, i);
+                if(!lua_isnumber(L, -1)) {
+                    lua_pop(L, 1);
+                    break;
+                }
+                lua_Integer index = lua_tointeger(L, -1) - 1;
+                if(index >= 0 && index < (lua_Integer)data->images_count) selected[index] = true;
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+    KTX2Init();
+    InitColorTables();
+
+    if(texture_cache_mutex == 0) texture_cache_mutex = dmMutex::New();
+
+    std::vector<ORMPair> pairs;
+    std::vector<bool> packed(data->images_count, false);
+    if(pack_orm) FindORMPairs(data, selected, pairs, packed);
+    int normal_format = pack_normals ? NormalMapFormat(formats) : -1;
+
+    ImageJob *job = new ImageJob;
+    job->data = data;
+    job->serial = ++image_job_serial;
+    job->basepath = lua_isstring(L, 2) ? lua_tostring(L, 2) : "";
+    if(lua_istable(L, 3)) {
+        lua_getfield(L, 3, "cache_path");
+        if(lua_isstring(L, -1)) job->cache_path = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
+    size_t task_count = data->images_count + pairs.size();
+    job->tasks.resize(task_count);
+    std::vector<std::atomic<bool>>(task_count).swap(job->done);
+    for(size_t i=0; i<task_count; i++) {
+        ImageTask &task = job->tasks[i];
+        bool pair = i >= data->images_count;
+        task.job = job->serial;
+        task.owner = -1;
+        task.emitted = false;
+        task.done = &job->done[i];
+        task.done->store(false);
+        task.image = pair ? pairs[i - data->images_count].mr : &data->images[i];
+        task.occlusion = pair ? pairs[i - data->images_count].occlusion : nullptr;
+        task.index = (int)i;
+        task.basepath = job->basepath.c_str();
+        task.ok = false;
+        task.mips = mips;
+        task.srgb = !pair && ImageIsSRGB(data, task.image);
+        task.max_size = max_size;
+        task.bytes = 0;
+        task.hash = 0;
+        task.shared = false;
+        task.deferred = false;
+        task.queued = false;
+        task.packed = !pair && packed[i];
+        task.linearize = linearize && task.srgb;
+        task.premultiply = premultiply && !pair && ImageIsBlended(data, task.image);
+        task.encode = !pair && normal_format >= 0 && ImageIsNormalMap(data, task.image) ? normal_format : -1;
+        if(task.encode < 0 && compress) task.encode = CompressFormat(formats, !pair && ImageUsesAlpha(data, task.image));
+        task.cache_path = task.encode >= 0 && !job->cache_path.empty() ? job->cache_path.c_str() : nullptr;
+        task.downscaled = false;
+        task.formats = formats;
+        task.format = TEXTURE_FORMAT_RGBA8;
+        memset(&task.decoded, 0, sizeof(task.decoded));
+    }
+
+    // Fallback images only used by KHR_texture_basisu textures wait for their KTX2 image
+    for(cgltf_size i=0; i<data->images_count; i++) {
+        int uses = 0, fallback = 0;
+        for(cgltf_size t=0; t<data->textures_count; t++) {
+            cgltf_texture *tex = &data->textures[t];
+            if(tex->image == &data->images[i]) fallback += tex->basisu_image ? 1 : 0;
+            if(tex->image == &data->images[i] || tex->basisu_image == &data->images[i]) uses++;
+        }
+        job->tasks[i].deferred = uses > 0 && uses == fallback;
+    }
+
+    // Images left out of the images option are never decoded or returned
+    for(cgltf_size i=0; i<data->images_count; i++) {
+        if(selected[i]) continue;
+        job->tasks[i].deferred = false;
+        job->tasks[i].emitted = true;
+        job->tasks[i].done->store(true);
+    }
+
+    // Tasks are only added once the vector is final, the workers hold pointers into it
+    job->batch = JobBatchNew();
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        if(!job->tasks[i].deferred && !job->tasks[i].packed && !job->tasks[i].emitted) JobBatchAdd(job->batch, DecodeImageTask, &job->tasks[i]);
+    }
+    lua_pushlightuserdata(L, job);
+    if(!pack_orm) return 1;
+
+    lua_newtable(L);
+    for(size_t p=0; p<pairs.size(); p++) {
+        lua_newtable(L);
+        PushTextureField(L, "occlusion", (lua_Integer)cgltf_image_index(data, pairs[p].occlusion) + 1);
+        PushTextureField(L, "metallic_roughness", (lua_Integer)cgltf_image_index(data, pairs[p].mr) + 1);
+        PushTextureField(L, "index", (lua_Integer)(data->images_count + p + 1));
+        lua_rawseti(L, -2, (int)p + 1);
+    }
+    return 2;
+}
+
+int lib_images_done(lua_State *L)
+{
+    ImageJob *job = (ImageJob *)lua_touserdata(L, 1);
+    lua_pushboolean(L, job == nullptr || JobBatchDone(job->batch));
+    return 1;
+}
+
+// Is a deferred KTX2 fallback needed? Returns -1 while its KTX2 images are still decoding.
+static int FallbackNeeded(ImageJob *job, ImageTask &task)
+{
+    cgltf_data *data = job->data;
+    int needed = 0;
+    for(cgltf_size t=0; t<data->textures_count; t++) {
+        cgltf_texture *tex = &data->textures[t];
+        if(tex->image != task.image) continue;
+        ImageTask &ktx2 = job->tasks[cgltf_image_index(data, tex->basisu_image)];
+        if(!ktx2.done->load()) return -1;
+        if(!ktx2.ok) needed = 1;
+    }
+    return needed;
+}
+
+// Is an image only used through ORM pack tasks needed on its own? -1 while they're decoding.
+static int PackedNeeded(ImageJob *job, ImageTask &task)
+{
+    int needed = 0;
+    for(size_t i=job->data->images_count; i<job->tasks.size(); i++) {
+        ImageTask &pack = job->tasks[i];
+        if(pack.image != task.image && pack.occlusion != task.image) continue;
+        if(!pack.done->load()) return -1;
+        if(!pack.ok) needed = 1;
+    }
+    return needed;
+}
+
+static void PushTextureName(lua_State *L, uint64_t hash)
+{
+    char name[64];
+    TextureName(hash, name, sizeof(name));
+    lua_pushstring(L, "texture");
+    lua_pushstring(L, name);
+    lua_settable(L, -3);
+}
+
+// Add every finished image that hasn't been returned yet to the results table (see images_wait).
+//   Shared images wait for their owner when it is in the same job.
+static void PushFinishedImages(lua_State *L, ImageJob *job, int results)
+{
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        ImageTask &task = job->tasks[i];
+        if(task.emitted || task.queued || !(task.deferred || task.packed) || task.done->load()) continue;
+        int needed = task.deferred ? FallbackNeeded(job, task) : PackedNeeded(job, task);
+        if(needed < 0) continue;
+        // A KTX2 image or ORM pack failed: its source images are decoded on the workers like the
+        // rest, and returned by a later poll
+        if(needed) {
+            task.queued = true;
+            JobBatchAdd(job->batch, DecodeImageTask, &task);
+        }
+        else task.done->store(true);
+    }
+
+    // Owners first, so shared images can reference their tables
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        ImageTask &task = job->tasks[i];
+        if(task.emitted || task.shared || !task.done->load()) continue;
+        task.emitted = true;
+        if((task.deferred || task.packed) && !task.ok && task.hash == 0) {
+            lua_pushinteger(L, (lua_Integer)(i + 1));
+            lua_newtable(L);
+            lua_pushstring(L, "skipped");
+            lua_pushboolean(L, 1);
+            lua_settable(L, -3);
+            lua_settable(L, results);
+            continue;
+        }
+        if(!task.ok) {
+            printf("[Error] images_wait: image %d (%s)\n", (int)i, task.decoded.error);
+            // A failed image keeps no memory reserved
+            if(task.bytes > 0) {
+                texture_used -= task.bytes;
+                task.bytes = 0;
+            }
+            if(task.hash != 0) {
+                DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+                texture_cache.erase(task.hash);
+            }
+            continue;
+        }
+        {
+            DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+            TextureCacheEntry &entry = texture_cache[task.hash];
+            entry.ready = true;
+            entry.width = task.decoded.width;
+            entry.height = task.decoded.height;
+            entry.bytes = task.bytes;
+        }
+
+        lua_pushinteger(L, (lua_Integer)(i + 1));
+        lua_newtable(L);
+        PushTextureName(L, task.hash);
+        lua_pushstring(L, "buffer");
+        if(!task.levels.empty()) PushImageBuffer(L, task.chain.data(), (uint32_t)task.chain.size());
+        else PushImageBuffer(L, task.decoded.pixels, (uint32_t)(task.decoded.width * task.decoded.height * 4));
+        lua_settable(L, -3);
+        if(!task.levels.empty()) {
+            lua_pushstring(L, "levels");
+            PushMipLevels(L, task.levels);
+            lua_settable(L, -3);
+        }
+        PushTextureField(L, "width", task.decoded.width);
+        PushTextureField(L, "height", task.decoded.height);
+        PushTextureField(L, "bytes", (lua_Integer)task.bytes);
+        lua_pushstring(L, "format");
+        lua_pushstring(L, TextureFormatName(task.format));
+        lua_settable(L, -3);
+        if(task.deferred) {
+            lua_pushstring(L, "fallback");
+            lua_pushboolean(L, 1);
+            lua_settable(L, -3);
+        }
+        if(task.linearize) {
+            lua_pushstring(L, "linear");
+            lua_pushboolean(L, 1);
+            lua_settable(L, -3);
+        }
+        if(task.premultiply) {
+            lua_pushstring(L, "premultiplied");
+            lua_pushboolean(L, 1);
+            lua_settable(L, -3);
+        }
+        lua_settable(L, results);
+        FreeDecodedImage(&task.decoded);
+        std::vector<uint8_t>().swap(task.chain);
+    }
+
+    for(size_t i=0; i<job->tasks.size(); i++) {
+        ImageTask &task = job->tasks[i];
+        if(task.emitted || !task.shared || !task.done->load()) continue;
+        if(task.owner >= 0) {
+            ImageTask &owner = job->tasks[task.owner];
+            if(!owner.emitted) continue;
+            task.emitted = true;
+            if(!owner.ok) {
+                printf("[Error] images_wait: image %d (shared image failed to decode)\n", (int)i);
+                continue;
+            }
+            // Same table when the owner is in this batch of results, otherwise a reference to it
+            lua_pushinteger(L, (lua_Integer)(i + 1));
+            lua_pushinteger(L, (lua_Integer)(task.owner + 1));
+            lua_gettable(L, results);
+            if(lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+                lua_newtable(L);
+                PushTextureName(L, task.hash);
+                PushTextureField(L, "owner", task.owner + 1);
+                PushTextureField(L, "width", owner.decoded.width);
+                PushTextureField(L, "height", owner.decoded.height);
+                PushTextureField(L, "bytes", 0);
+            }
+            lua_settable(L, results);
+            continue;
+        }
+        task.emitted = true;
+
+        TextureCacheEntry entry;
+        bool found = false;
+        {
+            DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+            std::map<uint64_t, TextureCacheEntry>::iterator it = texture_cache.find(task.hash);
+            found = it != texture_cache.end();
+            if(found) entry = it->second;
+        }
+        if(!found) {
+            printf("[Error] images_wait: image %d (shared image failed to decode)\n", (int)i);
+            continue;
+        }
+
+        // Owned by another load. It may still be decoding, in which case the size is not known yet.
+        lua_pushinteger(L, (lua_Integer)(i + 1));
+        lua_newtable(L);
+        PushTextureName(L, task.hash);
+        lua_pushstring(L, "shared");
+        lua_pushboolean(L, 1);
+        lua_settable(L, -3);
+        PushTextureField(L, "width", entry.ready ? entry.width : 0);
+        PushTextureField(L, "height", entry.ready ? entry.height : 0);
+        PushTextureField(L, "bytes", 0);
+        lua_settable(L, results);
+    }
+}
+
+// images_poll(job)
+//   Returns the images finished since the last poll (same table layout as images_wait) without
+//   blocking, and true once every image has been returned. Free the handle with images_wait.
+//   A shared image whose owner came in an earlier poll is { texture, owner, width, height }, owner
+//   being the owner's image index + 1.
+int lib_images_poll(lua_State *L)
+{
+    ImageJob *job = (ImageJob *)lua_touserdata(L, 1);
+    lua_newtable(L);
+    if(job == nullptr) {
+        lua_pushboolean(L, 1);
+        return 2;
+    }
+    PushFinishedImages(L, job, lua_gettop(L));
+
+    bool all = true;
+    for(size_t i=0; i<job->tasks.size(); i++) all = all && job->tasks[i].emitted;
+    lua_pushboolean(L, all);
+    return 2;
+}
+
+// images_wait(job)
+//   Waits for the decode and frees the handle. Returns a table indexed by image index + 1 of
+//   { texture, buffer, width, height, bytes, format [, levels] } for every image not returned by
+//   images_poll yet. Images that failed to decode are left out. Unused KTX2 fallbacks and images
+//   only used through ORM pairs are { skipped = true }, used fallbacks have fallback = true, and
+//   ORM images follow the model's images (see images_decode). format is "rgba" for decoded images.
+//   texture is the content hashed resource name. Images with the same content share one result
+//   table, and images already decoded by an earlier load only get { texture, width, height, shared }
+//   with no buffer: the texture resource exists already.
+//   bytes is what the texture counts against the budget (see texture_release).
+//   With mips, buffer holds the whole chain and levels is the mip level table.
+int lib_images_wait(lua_State *L)
+{
+    ImageJob *job = (ImageJob *)lua_touserdata(L, 1);
+    lua_newtable(L);
+    if(job == nullptr) return 1;
+    // The first pass queues the fallbacks of failed KTX2 images and ORM packs, the second returns them
+    JobBatchWait(job->batch);
+    PushFinishedImages(L, job, lua_gettop(L));
+    JobBatchDelete(job->batch);
+    PushFinishedImages(L, job, lua_gettop(L));
+    delete job;
+    return 1;
+}
+
+// texture_release(name)
+//   Drops one reference to a texture from images_wait. Returns true when it was the last one: the
+//   texture's memory is returned to the budget and the caller should release the resource.
+int lib_texture_release(lua_State *L)
+{
+    uint64_t hash = 0;
+    if(!TextureHashFromName(lua_tostring(L, 1), &hash) || texture_cache_mutex == 0) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    uint64_t bytes = 0;
+    bool last = false;
+    {
+        DM_MUTEX_SCOPED_LOCK(texture_cache_mutex);
+        std::map<uint64_t, TextureCacheEntry>::iterator it = texture_cache.find(hash);
+        if(it != texture_cache.end() && --it->second.refs <= 0) {
+            bytes = it->second.bytes;
+            texture_cache.erase(it);
+            last = true;
+        }
+    }
+    if(bytes > 0) {
+        uint64_t used = texture_used.load();
+        while(!texture_used.compare_exchange_weak(used, used > bytes ? used - bytes : 0)) {}
+    }
+    lua_pushboolean(L, last);
+    return 1;
+}
@@ -0,0 +1,283 @@
+// instancing.cpp
+// EXT_mesh_gpu_instancing.
+//   The TRS instance accessors of a node are expanded into packed column major matrices, stored
+//   in one Defold buffer (stream "mtx_world", 16 floats per instance).
+//   Defold mesh components can't draw instances from a user buffer, so batch_instances bakes a
+//   primitive's vertex buffer once per instance (or per range of instances, for large sets baked
+//   in chunks). One mesh component then draws each chunk instead of one game object per instance.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <string.h>
+#include <vector>
+
+#define INSTANCE_STREAM     "mtx_world"
+
+static cgltf_accessor* FindInstanceAttribute(cgltf_node *node, const char *name)
+{
+    cgltf_mesh_gpu_instancing *inst = &node->mesh_gpu_instancing;
+    for(cgltf_size i=0; i<inst->attributes_count; i++) {
+        if(strcmp(inst->attributes[i].name, name) == 0) return inst->attributes[i].data;
+    }
+    return nullptr;
+}
+
+// Unpack a whole accessor to floats (handles normalized and sparse data)
+static bool ReadInstanceAttribute(cgltf_node *node, const char *name, cgltf_size count, cgltf_size components, std::vector<float> &out)
+{
+    cgltf_accessor *acc = FindInstanceAttribute(node, name);
+    if(acc == nullptr || acc->count != count || cgltf_num_components(acc->type) != components) return false;
+    out.resize(count * components);
+    return cgltf_accessor_unpack_floats(acc, out.data(), out.size()) == out.size();
+}
+
+// Column major 4x4: out = a * b
+static void MatrixMul(float *out, const float *a, const float *b)
+{
+    simd4f c0 = simd_load(a);
+    simd4f c1 = simd_load(a + 4);
+    simd4f c2 = simd_load(a + 8);
+    simd4f c3 = simd_load(a + 12);
+    for(int j=0; j<4; j++) {
+        const float *bc = b + j * 4;
+        simd4f r = simd_mul(c0, simd_splat(bc[0]));
+        r = simd_madd(c1, simd_splat(bc[1]), r);
+        r = simd_madd(c2, simd_splat(bc[2]), r);
+        r = simd_madd(c3, simd_splat(bc[3]), r);
+        simd_store(out + j * 4, r);
+    }
+}
+
+static void MatrixFromTRS(float *m, const float *t, const float *r, const float *s)
+{
+    float x = r[0], y = r[1], z = r[2], w = r[3];
+    m[0]  = (1 - 2 * (y * y + z * z)) * s[0];
+    m[1]  = (2 * (x * y + z * w)) * s[0];
+    m[2]  = (2 * (x * z - y * w)) * s[0];
+    m[3]  = 0.0f;
+    m[4]  = (2 * (x * y - z * w)) * s[1];
+    m[5]  = (1 - 2 * (x * x + z * z)) * s[1];
+    m[6]  = (2 * (y * z + x * w)) * s[1];
+    m[7]  = 0.0f;
+    m[8]  = (2 * (x * z + y * w)) * s[2];
+    m[9]  = (2 * (y * z - x * w)) * s[2];
+    m[10] = (1 - 2 * (x * x + y * y)) * s[2];
+    m[11] = 0.0f;
+    m[12] = t[0];
+    m[13] = t[1];
+    m[14] = t[2];
+    m[15] = 1.0f;
+}
+
+// The node's instance translations, rotations and scales. Missing attributes are left empty.
+// Returns the instance count, 0 if the node is not instanced.
+static cgltf_size ReadInstanceTRS(cgltf_node *node, std::vector<float> &t, std::vector<float> &r, std::vector<float> &s)
+{
+    if(node == nullptr || !node->has_mesh_gpu_instancing || node->mesh_gpu_instancing.attributes_count == 0) return 0;
+
+    // The extension requires every attribute to have the same count (checked by cgltf_validate)
+    cgltf_size count = node->mesh_gpu_instancing.attributes[0].data->count;
+    bool has_t = ReadInstanceAttribute(node, "TRANSLATION", count, 3, t);
+    bool has_r = ReadInstanceAttribute(node, "ROTATION", count, 4, r);
+    bool has_s = ReadInstanceAttribute(node, "SCALE", count, 3, s);
+    if(!has_t) t.clear();
+    if(!has_r) r.clear();
+    if(!has_s) s.clear();
+    return has_t || has_r || has_s ? count : 0;
+}
+
+static const float instance_zero[3] = { 0.0f, 0.0f, 0.0f };
+static const float instance_one[3] = { 1.0f, 1.0f, 1.0f };
+static const float instance_identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+// Column major matrices (16 floats) of the node's instances, relative to the node or with its world
+// transform premultiplied. Returns false if the node is not instanced.
+bool NodeInstanceMatrices(cgltf_node *node, bool world, std::vector<float> &out)
+{
+    std::vector<float> t, r, s;
+    cgltf_size count = ReadInstanceTRS(node, t, r, s);
+    if(count == 0) return false;
+
+    float node_world[16];
+    if(world) cgltf_node_transform_world(node, node_world);
+
+    out.resize(count * 16);
+    for(cgltf_size i=0; i<count; i++) {
+        float local[16];
+        MatrixFromTRS(local, t.empty() ? instance_zero : &t[i * 3], r.empty() ? instance_identity : &r[i * 4], s.empty() ? instance_one : &s[i * 3]);
+        if(world) MatrixMul(&out[i * 16], node_world, local);
+        else memcpy(&out[i * 16], local, sizeof(local));
+    }
+    return true;
+}
+
+// Returns a buffer of instance matrices for the node and the instance count, or nil if the node
+// is not instanced.
+//   world = true premultiplies the node's world transform, otherwise the matrices are relative to
+//   the node (which is what the spec stores).
+int lib_get_node_instances(lua_State *L)
+{
+    cgltf_node * node = (cgltf_node *)lua_touserdata(L, 2);
+    bool world = lua_toboolean(L, 3);
+    std::vector<float> matrices;
+    if(!NodeInstanceMatrices(node, world, matrices)) {
+        if(node && node->has_mesh_gpu_instancing) {
+            printf("[Error] EXT_mesh_gpu_instancing: no TRANSLATION, ROTATION or SCALE on node %d\n", (int)cgltf_node_index((cgltf_data *)lua_touserdata(L, 1), node));
+        }
+        lua_pushnil(L);
+        return 1;
+    }
+    uint32_t count = (uint32_t)(matrices.size() / 16);
+
+    dmBuffer::StreamDeclaration decl[] = {
+        { dmHashString64(INSTANCE_STREAM), dmBuffer::VALUE_TYPE_FLOAT32, 16 }
+    };
+    dmBuffer::HBuffer buffer = 0;
+    if(dmBuffer::Create(count, decl, 1, &buffer) != dmBuffer::RESULT_OK) {
+        printf("[Error] EXT_mesh_gpu_instancing: could not create instance buffer (%d)\n", (int)count);
+        lua_pushnil(L);
+        return 1;
+    }
+
+    float *out = nullptr;
+    uint32_t out_count = 0, components = 0, stride = 0;
+    dmBuffer::GetStream(buffer, dmHashString64(INSTANCE_STREAM), (void **)&out, &out_count, &components, &stride);
+    for(uint32_t i=0; i<count; i++) memcpy(out + i * stride, &matrices[i * 16], 16 * sizeof(float));
+
+    dmScript::LuaHBuffer luabuf(buffer, dmScript::OWNER_LUA);
+    dmScript::PushBuffer(L, luabuf);
+    lua_pushinteger(L, (lua_Integer)count);
+    return 2;
+}
+
+// Inverse transpose of the upper 3x3 (cofactors), for normals under non uniform scale
+static void NormalMatrix(float *n, const float *m)
+{
+    n[0] = m[5] * m[10] - m[6] * m[9];
+    n[1] = m[6] * m[8] - m[4] * m[10];
+    n[2] = m[4] * m[9] - m[5] * m[8];
+    n[3] = 0.0f;
+    n[4] = m[9] * m[2] - m[10] * m[1];
+    n[5] = m[10] * m[0] - m[8] * m[2];
+    n[6] = m[8] * m[1] - m[9] * m[0];
+    n[7] = 0.0f;
+    n[8] = m[1] * m[6] - m[2] * m[5];
+    n[9] = m[2] * m[4] - m[0] * m[6];
+    n[10] = m[0] * m[5] - m[1] * m[4];
+    n[11] = 0.0f;
+}
+
+struct BatchStream
+{
+    dmhash_t    name;
+    float *     src;
+    uint32_t    src_stride;
+    float *     dst;
+    uint32_t    dst_stride;
+    uint32_t    components;
+};
+
+// Bake a vertex buffer (the float streams written by meshes.create_buffer) once per instance.
+//   batch_instances(vertex_buffer, instance_buffer [, first, count])
+//   position is transformed by the instance matrix, normal by its normal matrix, the rest copied.
+//   Returns the new buffer and its vertex count.
+int lib_batch_instances(lua_State *L)
+{
+    dmBuffer::HBuffer src = dmScript::CheckBufferUnpack(L, 1);
+    dmBuffer::HBuffer inst = dmScript::CheckBufferUnpack(L, 2);
+
+    float *matrices = nullptr;
+    uint32_t inst_count = 0, inst_components = 0, inst_stride = 0;
+    if(dmBuffer::GetStream(inst, dmHashString64(INSTANCE_STREAM), (void **)&matrices, &inst_count, &inst_components, &inst_stride) != dmBuffer::RESULT_OK) {
+        return luaL_error(L, "batch_instances: instance buffer has no %s stream", INSTANCE_STREAM);
+    }
+    uint32_t first = (uint32_t)luaL_optinteger(L, 3, 1) - 1;
+    uint32_t count = (uint32_t)luaL_optinteger(L, 4, inst_count);
+    if(first >= inst_count) {
+        lua_pushnil(L);
+        return 1;
+    }
+    if(count > inst_count - first) count = inst_count - first;
+
+    static const char *names[] = { "position", "normal", "texcoord0", "color" };
+    const int name_count = sizeof(names) / sizeof(names[0]);
+    BatchStream streams[name_count];
+    dmBuffer::StreamDeclaration decl[name_count];
+    uint32_t stream_count = 0;
+    uint32_t vcount = 0;
+    for(int i=0; i<name_count; i++) {
+        BatchStream &bs = streams[stream_count];
+        bs.name = dmHashString64(names[i]);
+        uint32_t n = 0;
+        if(dmBuffer::GetStream(src, bs.name, (void **)&bs.src, &n, &bs.components, &bs.src_stride) != dmBuffer::RESULT_OK) continue;
+        vcount = n;
+        decl[stream_count].m_Name = bs.name;
+        decl[stream_count].m_Type = dmBuffer::VALUE_TYPE_FLOAT32;
+        decl[stream_count].m_Count = (uint8_t)bs.components;
+        decl[stream_count].m_Flags = 0;
+        decl[stream_count].m_Reserved = 0;
+        stream_count++;
+    }
+    if(stream_count == 0 || streams[0].name != dmHashString64("position")) {
+        return luaL_error(L, "batch_instances: vertex buffer has no position stream");
+    }
+
+    dmBuffer::HBuffer dst = 0;
+    if(dmBuffer::Create(vcount * count, decl, (uint8_t)stream_count, &dst) != dmBuffer::RESULT_OK) {
+        printf("[Error] batch_instances: could not create buffer (%u vertices)\n", vcount * count);
+        lua_pushnil(L);
+        return 1;
+    }
+    for(uint32_t s=0; s<stream_count; s++) {
+        uint32_t n = 0, c = 0;
+        dmBuffer::GetStream(dst, streams[s].name, (void **)&streams[s].dst, &n, &c, &streams[s].dst_stride);
+    }
+
+    dmhash_t normal_name = dmHashString64("normal");
+    for(uint32_t i=0; i<count; i++) {
+        const float *m = matrices + (first + i) * inst_stride;
+        float nm[12];
+        NormalMatrix(nm, m);
+        simd4f c0 = simd_load(m), c1 = simd_load(m + 4), c2 = simd_load(m + 8), c3 = simd_load(m + 12);
+        simd4f n0 = simd_load(nm), n1 = simd_load(nm + 4), n2 = simd_load(nm + 8);
+
+        for(uint32_t s=0; s<stream_count; s++) {
+            BatchStream &bs = streams[s];
+            const float *in = bs.src;
+            float *out = bs.dst + (size_t)i * vcount * bs.dst_stride;
+            if(s == 0) {
+                for(uint32_t v=0; v<vcount; v++, in += bs.src_stride, out += bs.dst_stride) {
+                    simd4f p = simd_madd(c0, simd_splat(in[0]), c3);
+                    p = simd_madd(c1, simd_splat(in[1]), p);
+                    p = simd_madd(c2, simd_splat(in[2]), p);
+                    float tmp[4];
+                    simd_store(tmp, p);
+                    out[0] = tmp[0]; out[1] = tmp[1]; out[2] = tmp[2];
+                }
+            }
+            else if(bs.name == normal_name && bs.components >= 3) {
+                for(uint32_t v=0; v<vcount; v++, in += bs.src_stride, out += bs.dst_stride) {
+                    simd4f n = simd_mul(n0, simd_splat(in[0]));
+                    n = simd_madd(n1, simd_splat(in[1]), n);
+                    n = simd_madd(n2, simd_splat(in[2]), n);
+                    float tmp[4];
+                    simd_store(tmp, n);
+                    float len = sqrtf(tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2]);
+                    float inv = len > 0.0f ? 1.0f / len : 0.0f;
+                    out[0] = tmp[0] * inv; out[1] = tmp[1] * inv; out[2] = tmp[2] * inv;
+                }
+            }
+            else {
+                for(uint32_t v=0; v<vcount; v++, in += bs.src_stride, out += bs.dst_stride) {
+                    memcpy(out, in, bs.components * sizeof(float));
+                }
+            }
+        }
+    }
+
+    dmScript::LuaHBuffer luabuf(dst, dmScript::OWNER_LUA);
+    dmScript::PushBuffer(L, luabuf);
+    lua_pushinteger(L, (lua_Integer)(vcount * count));
+    return 2;
+}
@@ -0,0 +1,178 @@
+// jobs.cpp
+// Worker pool used by the native decode stages. See jobs.h
+
+#include <dmsdk/sdk.h>
+#include <dmsdk/dlib/mutex.h>
+#include <dmsdk/dlib/thread.h>
+#include <dmsdk/dlib/condition_variable.h>
+
+#include "jobs.h"
+
+#include <deque>
+#include <vector>
+#include <thread>
+
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    #define JOBS_INLINE
+#endif
+
+#define JOBS_MAX_WORKERS    8
+#define JOBS_STACK_SIZE     (256 * 1024)
+
+struct JobBatch
+{
+    uint32_t    pending;
+};
+
+struct Job
+{
+    JobFunc     func;
+    void *      ctx;
+    JobBatch *  batch;
+};
+
+struct JobPool
+{
+    dmMutex::HMutex                         mutex;
+    dmConditionVariable::HConditionVariable work_cond;
+    dmConditionVariable::HConditionVariable done_cond;
+    std::deque<Job>                         queue;
+    std::vector<dmThread::Thread>           threads;
+    bool                                    running;
+    bool                                    initialized;
+};
+
+static JobPool pool = { 0, 0, 0, std::deque<Job>(), std::vector<dmThread::Thread>(), false, false };
+
+static void JobFinish(const Job &job)
+{
+    DM_MUTEX_SCOPED_LOCK(pool.mutex);
+    job.batch->pending--;
+    dmConditionVariable::Broadcast(pool.done_cond);
+}
+
+static void WorkerMain(void *arg)
+{
+    while(true) {
+        Job job;
+        {
+            DM_MUTEX_SCOPED_LOCK(pool.mutex);
+            while(pool.running && pool.queue.empty()) {
+                dmConditionVariable::Wait(pool.work_cond, pool.mutex);
+            }
+            if(!pool.running && pool.queue.empty()) return;
+            job = pool.queue.front();
+            pool.queue.pop_front();
+        }
+        job.func(job.ctx);
+        JobFinish(job);
+    }
+}
+
+// Lazily start the pool the first time a batch is made, so apps that never decode anything
+// natively never spin up threads.
+static void JobsInitialize()
+{
+    if(pool.initialized) return;
+    pool.initialized = true;
+    pool.mutex = dmMutex::New();
+    pool.work_cond = dmConditionVariable::New();
+    pool.done_cond = dmConditionVariable::New();
+    pool.running = true;
+
+#if !defined(JOBS_INLINE)
+    uint32_t cores = std::thread::hardware_concurrency();
+    uint32_t count = cores > 1 ? cores - 1 : 1;
+    if(count > JOBS_MAX_WORKERS) count = JOBS_MAX_WORKERS;
+    for(uint32_t i=0; i<count; i++) {
+        dmThread::Thread thread = dmThread::New(WorkerMain, JOBS_STACK_SIZE, 0, "cgltf_worker");
+        if(thread) pool.threads.push_back(thread);
+    }
+#endif
+    dmLogInfo("cgltf jobs: %d worker threads", (int)pool.threads.size());
+}
+
+void JobsFinalize()
+{
+    if(!pool.initialized) return;
+    {
+        DM_MUTEX_SCOPED_LOCK(pool.mutex);
+        pool.running = false;
+        dmConditionVariable::Broadcast(pool.work_cond);
+    }
+    for(size_t i=0; i<pool.threads.size(); i++) {
+        dmThread::Join(pool.threads[i]);
+    }
+    pool.threads.clear();
+    dmConditionVariable::Delete(pool.work_cond);
+    dmConditionVariable::Delete(pool.done_cond);
+    dmMutex::Delete(pool.mutex);
+    pool.initialized = false;
+}
+
+uint32_t JobsWorkerCount()
+{
+    JobsInitialize();
+    return (uint32_t)pool.threads.size();
+}
+
+JobBatch* JobBatchNew()
+{
+    JobsInitialize();
+    JobBatch *batch = new JobBatch;
+    batch->pending = 0;
+    return batch;
+}
+
+void JobBatchAdd(JobBatch *batch, JobFunc func, void *ctx)
+{
+    Job job = { func, ctx, batch };
+    if(pool.threads.empty()) {
+        func(ctx);
+        return;
+    }
+    DM_MUTEX_SCOPED_LOCK(pool.mutex);
+    batch->pending++;
+    pool.queue.push_back(job);
+    dmConditionVariable::Signal(pool.work_cond);
+}
+
+bool JobBatchDone(JobBatch *batch)
+{
+    DM_MUTEX_SCOPED_LOCK(pool.mutex);
+    return batch->pending == 0;
+}
+
+void JobBatchWait(JobBatch *batch)
+{
+    while(true) {
+        Job job;
+        {
+            DM_MUTEX_SCOPED_LOCK(pool.mutex);
+            if(batch->pending == 0) return;
+            // Help out with this batch's queued jobs rather than sleeping
+            bool found = false;
+            for(std::deque<Job>::iterator it = pool.queue.begin(); it != pool.queue.end(); ++it) {
+                if(it->batch == batch) {
+                    job = *it;
+                    pool.queue.erase(it);
+                    found = true;
+                    break;
+                }
+            }
+            if(!found) {
+                dmConditionVariable::Wait(pool.done_cond, pool.mutex);
+                continue;
+            }
+        }
+        job.func(job.ctx);
+        JobFinish(job);
+    }
+}
+
+void JobBatchDelete(JobBatch *batch)
+{
+    if(batch == 0) return;
+    JobBatchWait(batch);
+    delete batch;
+}
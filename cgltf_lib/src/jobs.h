@@ -0,0 +1,26 @@
+// jobs.h
+// A small worker pool for the heavy native stages (mesh decompression, image decoding..)
+//   Jobs are grouped into batches. A batch can be polled from the main thread each frame, or
+//   waited on, in which case the caller helps running queued jobs.
+//   Builds without threads (html5 without pthreads) run each job inline when it is added.
+
+#ifndef CGLTF_LIB_JOBS_H
+#define CGLTF_LIB_JOBS_H
+
+#include <stdint.h>
+
+typedef void (*JobFunc)(void *ctx);
+
+struct JobBatch;
+
+void        JobsFinalize();
+uint32_t    JobsWorkerCount();
+
+JobBatch*   JobBatchNew();
+void        JobBatchAdd(JobBatch *batch, JobFunc func, void *ctx);
+bool        JobBatchDone(JobBatch *batch);
+void        JobBatchWait(JobBatch *batch);
+// Waits for any outstanding jobs before freeing the batch
+void        JobBatchDelete(JobBatch *batch);
+
+#endif
@@ -0,0 +1,419 @@
+// ktx2.cpp
+// KTX2 textures (KHR_texture_basisu).
+//   The KTX2 container is parsed here. Levels already in a GPU format the platform supports
+//   (BCn, ETC/EAC, ASTC 4x4, RGBA8) are copied as is, after Zstandard supercompression is undone.
+//   Basis Universal payloads (ETC1S/UASTC) are decoded by basisu.cpp. ETC1S goes to ETC1 without
+//   loss. Other targets, and UASTC, are decoded to RGBA and block encoded again (blockencode.cpp),
+//   so they can't go to BC7 or ASTC.
+
+#include "cgltf_lib.h"
+#include "basisu.h"
+#include "zstd/zstd.h"
+
+#include <dmsdk/graphics/graphics.h>
+#include <string.h>
+#include <algorithm>
+
+#define KTX2_HEADER_SIZE        80
+#define KTX2_LEVEL_SIZE         24
+
+// Supercompression schemes
+#define KTX2_SUPERCOMPRESSION_NONE      0
+#define KTX2_SUPERCOMPRESSION_BASISLZ   1
+#define KTX2_SUPERCOMPRESSION_ZSTD      2
+
+// vkFormat values that can be passed through untouched
+#define VK_FORMAT_UNDEFINED                 0
+#define VK_FORMAT_R8G8B8A8_UNORM            37
+#define VK_FORMAT_R8G8B8A8_SRGB             43
+#define VK_FORMAT_BC1_RGB_UNORM_BLOCK       131
+#define VK_FORMAT_BC1_RGB_SRGB_BLOCK        132
+#define VK_FORMAT_BC3_UNORM_BLOCK           137
+#define VK_FORMAT_BC3_SRGB_BLOCK            138
+#define VK_FORMAT_BC5_UNORM_BLOCK           141
+#define VK_FORMAT_BC7_UNORM_BLOCK           145
+#define VK_FORMAT_BC7_SRGB_BLOCK            146
+#define VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK 151
+#define VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK  152
+#define VK_FORMAT_EAC_R11G11_UNORM_BLOCK    155
+#define VK_FORMAT_ASTC_4x4_UNORM_BLOCK      157
+#define VK_FORMAT_ASTC_4x4_SRGB_BLOCK       158
+
+// Data format descriptor color models and channels (KHR_DF)
+#define KHR_DF_MODEL_ETC1S          163
+#define KHR_DF_MODEL_UASTC          166
+#define KHR_DF_TRANSFER_SRGB        2
+#define KHR_DF_CHANNEL_ETC1S_AAA    15
+#define KHR_DF_CHANNEL_UASTC_RGBA   3
+#define KHR_DF_CHANNEL_UASTC_RRRG   5
+
+static const uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static const char *texture_format_names[TEXTURE_FORMAT_COUNT] = { "rgba", "bc1", "bc3", "bc7", "etc1", "etc2", "astc", "rg8", "bc5", "eac_rg" };
+
+// Preferred order when several formats are supported
+static const int texture_format_order[] = {
+    TEXTURE_FORMAT_ASTC_4X4, TEXTURE_FORMAT_BC7, TEXTURE_FORMAT_ETC2, TEXTURE_FORMAT_BC3,
+    TEXTURE_FORMAT_BC1, TEXTURE_FORMAT_ETC1, TEXTURE_FORMAT_RGBA8,
+};
+
+const char *TextureFormatName(int format)
+{
+    return format >= 0 && format < TEXTURE_FORMAT_COUNT ? texture_format_names[format] : "";
+}
+
+int TextureFormatFromName(const char *name)
+{
+    for(int i=0; i<TEXTURE_FORMAT_COUNT && name; i++) {
+        if(strcmp(name, texture_format_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// The engine's format for each TextureFormat (rg8 goes up as luminance-alpha, see image-utils.lua)
+static const dmGraphics::TextureFormat texture_format_engine[TEXTURE_FORMAT_COUNT] = {
+    dmGraphics::TEXTURE_FORMAT_RGBA, dmGraphics::TEXTURE_FORMAT_RGB_BC1, dmGraphics::TEXTURE_FORMAT_RGBA_BC3,
+    dmGraphics::TEXTURE_FORMAT_RGBA_BC7, dmGraphics::TEXTURE_FORMAT_RGB_ETC1, dmGraphics::TEXTURE_FORMAT_RGBA_ETC2,
+    dmGraphics::TEXTURE_FORMAT_RGBA_ASTC_4x4, dmGraphics::TEXTURE_FORMAT_LUMINANCE_ALPHA, dmGraphics::TEXTURE_FORMAT_RG_BC5,
+    dmGraphics::TEXTURE_FORMAT_RG_ETC2,
+};
+
+static dmGraphics::HContext graphics_context = 0;
+
+// Set by the extension's Initialize, null when the engine doesn't hand out its graphics context
+void SetGraphicsContext(void *context)
+{
+    graphics_context = (dmGraphics::HContext)context;
+}
+
+// supported_texture_formats()
+//   Names of the formats (see images_decode) the graphics context can sample, asked of the
+//   context itself. nil when the context is not available, the caller has to pick safe formats.
+int lib_supported_texture_formats(lua_State *L)
+{
+    if(graphics_context == 0) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_newtable(L);
+    int count = 0;
+    for(int i=0; i<TEXTURE_FORMAT_COUNT; i++) {
+        if(!dmGraphics::IsTextureFormatSupported(graphics_context, texture_format_engine[i])) continue;
+        lua_pushstring(L, texture_format_names[i]);
+        lua_rawseti(L, -2, ++count);
+    }
+    return 1;
+}
+
+static bool TextureFormatHasAlpha(int format)
+{
+    return format != TEXTURE_FORMAT_BC1 && format != TEXTURE_FORMAT_ETC1 && format != TEXTURE_FORMAT_RG8
+        && format != TEXTURE_FORMAT_BC5 && format != TEXTURE_FORMAT_EAC_RG;
+}
+
+uint64_t TextureFormatBytes(int format, int width, int height)
+{
+    if(format == TEXTURE_FORMAT_RGBA8) return (uint64_t)width * height * 4;
+    if(format == TEXTURE_FORMAT_RG8) return (uint64_t)width * height * 2;
+    uint64_t blocks = (uint64_t)((width + 3) / 4) * ((height + 3) / 4);
+    return blocks * (format == TEXTURE_FORMAT_BC1 || format == TEXTURE_FORMAT_ETC1 ? 8 : 16);
+}
+
+static int VkFormatToTextureFormat(uint32_t vk_format, bool *srgb)
+{
+    *srgb = false;
+    switch(vk_format) {
+        case VK_FORMAT_R8G8B8A8_SRGB:               *srgb = true; // fallthrough
+        case VK_FORMAT_R8G8B8A8_UNORM:              return TEXTURE_FORMAT_RGBA8;
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:          *srgb = true; // fallthrough
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:         return TEXTURE_FORMAT_BC1;
+        case VK_FORMAT_BC3_SRGB_BLOCK:              *srgb = true; // fallthrough
+        case VK_FORMAT_BC3_UNORM_BLOCK:             return TEXTURE_FORMAT_BC3;
+        case VK_FORMAT_BC5_UNORM_BLOCK:             return TEXTURE_FORMAT_BC5;
+        case VK_FORMAT_BC7_SRGB_BLOCK:              *srgb = true; // fallthrough
+        case VK_FORMAT_BC7_UNORM_BLOCK:             return TEXTURE_FORMAT_BC7;
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:    *srgb = true; // fallthrough
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:   return TEXTURE_FORMAT_ETC2;
+        case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:      return TEXTURE_FORMAT_EAC_RG;
+        case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:         *srgb = true; // fallthrough
+        case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:        return TEXTURE_FORMAT_ASTC_4X4;
+        default:                                    return -1;
+    }
+}
+
+static uint32_t Read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t Read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+bool IsKTX2(const uint8_t *data, size_t size)
+{
+    return size >= KTX2_HEADER_SIZE && memcmp(data, ktx2_identifier, sizeof(ktx2_identifier)) == 0;
+}
+
+bool KTX2Open(const uint8_t *data, size_t size, uint32_t formats, KTX2Info *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->format = -1;
+    if(!IsKTX2(data, size)) {
+        snprintf(info->error, sizeof(info->error), "not a KTX2 file");
+        return false;
+    }
+
+    uint32_t vk_format = Read32(data + 12);
+    info->width = (int)Read32(data + 20);
+    info->height = (int)Read32(data + 24);
+    uint32_t depth = Read32(data + 28);
+    uint32_t layers = Read32(data + 32);
+    uint32_t faces = Read32(data + 36);
+    info->levels = (int)Read32(data + 40);
+    if(info->levels == 0) info->levels = 1;
+    info->supercompression = Read32(data + 44);
+    if(depth > 1 || layers > 1 || faces != 1 || info->width <= 0 || info->height <= 0) {
+        snprintf(info->error, sizeof(info->error), "only 2D KTX2 textures are supported");
+        return false;
+    }
+    if(KTX2_HEADER_SIZE + (size_t)info->levels * KTX2_LEVEL_SIZE > size) {
+        snprintf(info->error, sizeof(info->error), "truncated level index");
+        return false;
+    }
+
+    // Basic data format descriptor: color model, transfer function and the channels of each sample
+    uint32_t dfd_offset = Read32(data + 48);
+    uint32_t dfd_length = Read32(data + 52);
+    if(dfd_length >= 4 + 24 && (size_t)dfd_offset + dfd_length <= size) {
+        const uint8_t *block = data + dfd_offset + 4;
+        uint32_t block_size = Read32(block + 4) >> 16;
+        uint8_t model = block[8];
+        info->srgb = block[10] == KHR_DF_TRANSFER_SRGB;
+        if(model == KHR_DF_MODEL_ETC1S) info->basis = KTX2_BASIS_ETC1S;
+        if(model == KHR_DF_MODEL_UASTC) info->basis = KTX2_BASIS_UASTC;
+        for(uint32_t s=24; s + 16 <= block_size && s + 16 <= dfd_length - 4; s += 16) {
+            uint8_t channel = block[s + 3] & 0x0f;
+            if(info->basis == KTX2_BASIS_ETC1S && channel == KHR_DF_CHANNEL_ETC1S_AAA) info->has_alpha = true;
+            if(info->basis == KTX2_BASIS_UASTC && (channel == KHR_DF_CHANNEL_UASTC_RGBA || channel == KHR_DF_CHANNEL_UASTC_RRRG)) info->has_alpha = true;
+        }
+    }
+
+    if(vk_format != VK_FORMAT_UNDEFINED) {
+        bool srgb = false;
+        int format = VkFormatToTextureFormat(vk_format, &srgb);
+        if(format < 0 || (info->supercompression != KTX2_SUPERCOMPRESSION_NONE && info->supercompression != KTX2_SUPERCOMPRESSION_ZSTD)) {
+            snprintf(info->error, sizeof(info->error), "unsupported vkFormat %u (supercompression %u)", vk_format, info->supercompression);
+            return false;
+        }
+        if((formats & (1u << format)) == 0) {
+            snprintf(info->error, sizeof(info->error), "format %s is not supported here", TextureFormatName(format));
+            return false;
+        }
+        info->format = format;
+        info->srgb = srgb;
+        info->has_alpha = TextureFormatHasAlpha(format);
+        return true;
+    }
+
+    if(info->basis == KTX2_BASIS_NONE) {
+        snprintf(info->error, sizeof(info->error), "unknown KTX2 data format");
+        return false;
+    }
+    bool etc1s = info->basis == KTX2_BASIS_ETC1S;
+    if(info->supercompression != (etc1s ? KTX2_SUPERCOMPRESSION_BASISLZ : KTX2_SUPERCOMPRESSION_NONE)
+        && (etc1s || info->supercompression != KTX2_SUPERCOMPRESSION_ZSTD)) {
+        snprintf(info->error, sizeof(info->error), "bad supercompression %u for %s", info->supercompression, etc1s ? "ETC1S" : "UASTC");
+        return false;
+    }
+    // Transcoded levels are block encoded again, which BC7 and ASTC aren't
+    for(size_t i=0; i<sizeof(texture_format_order)/sizeof(texture_format_order[0]); i++) {
+        int format = texture_format_order[i];
+        if((formats & (1u << format)) == 0) continue;
+        if(format == TEXTURE_FORMAT_BC7 || format == TEXTURE_FORMAT_ASTC_4X4) continue;
+        if(info->has_alpha && !TextureFormatHasAlpha(format)) continue;
+        info->format = format;
+        return true;
+    }
+    info->format = TEXTURE_FORMAT_RGBA8;
+    return true;
+}
+
+void KTX2Init()
+{
+    static bool initialized = false;
+    if(!initialized) BasisInit();
+    initialized = true;
+}
+
+// Level data, with Zstandard supercompression undone into unpacked
+static const uint8_t *LevelData(const uint8_t *data, size_t size, KTX2Info *info, int level, std::vector<uint8_t> &unpacked, size_t *length)
+{
+    const uint8_t *entry = data + KTX2_HEADER_SIZE + (size_t)level * KTX2_LEVEL_SIZE;
+    uint64_t offset = Read64(entry);
+    uint64_t byte_length = Read64(entry + 8);
+    if(offset > size || byte_length > size - offset) {
+        snprintf(info->error, sizeof(info->error), "level %d is truncated", level);
+        return 0;
+    }
+    *length = (size_t)byte_length;
+    if(info->supercompression != KTX2_SUPERCOMPRESSION_ZSTD) return data + offset;
+
+    uint64_t uncompressed = Read64(entry + 16);
+    if(uncompressed > ((uint64_t)1 << 31)) {
+        snprintf(info->error, sizeof(info->error), "level %d is too large", level);
+        return 0;
+    }
+    unpacked.resize((size_t)uncompressed);
+    size_t result = ZSTD_decompress(unpacked.data(), unpacked.size(), data + offset, (size_t)byte_length);
+    if(ZSTD_isError(result) || result != unpacked.size()) {
+        snprintf(info->error, sizeof(info->error), "level %d: zstd failed", level);
+        return 0;
+    }
+    *length = result;
+    return unpacked.data();
+}
+
+// Writes decoded 4x4 blocks (16 RGBA texels each) into a width x height image, or only their
+// first channel into the image's alpha
+static void StoreBlock(const uint8_t *texels, int bx, int by, int width, int height, bool alpha, uint8_t *rgba)
+{
+    for(int y=0; y<4 && by * 4 + y < height; y++) {
+        for(int x=0; x<4 && bx * 4 + x < width; x++) {
+            uint8_t *out = rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4;
+            const uint8_t *in = texels + (y * 4 + x) * 4;
+            if(alpha) out[3] = in[1];
+            else memcpy(out, in, 4);
+        }
+    }
+}
+
+static bool DecodeETC1SSlice(const BasisLZ *lz, const uint8_t *src, size_t length, uint32_t offset, uint32_t size, int width, int height,
+    bool alpha, std::vector<uint8_t> &blocks, uint8_t *rgba, KTX2Info *info)
+{
+    int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    const char *error = 0;
+    blocks.resize((size_t)blocks_x * blocks_y * 8);
+    if(offset > length || size > length - offset) error = "slice is truncated";
+    else BasisLZDecodeSlice(lz, src + offset, size, blocks_x, blocks_y, blocks.data(), &error);
+    if(error) {
+        snprintf(info->error, sizeof(info->error), "ETC1S: %s", error);
+        return false;
+    }
+    if(!rgba) return true;
+    uint8_t texels[64];
+    for(int by=0; by<blocks_y; by++) {
+        for(int bx=0; bx<blocks_x; bx++) {
+            ETC1DecodeBlock(&blocks[((size_t)by * blocks_x + bx) * 8], texels);
+            StoreBlock(texels, bx, by, width, height, alpha, rgba);
+        }
+    }
+    return true;
+}
+
+// Transcode (or copy) levels [first, first + count) into one contiguous chain, largest first
+bool KTX2Transcode(const uint8_t *data, size_t size, KTX2Info *info, int first, int count, std::vector<uint8_t> &chain, std::vector<MipLevel> &levels)
+{
+    chain.clear();
+    levels.clear();
+    if(first < 0 || count <= 0 || first + count > info->levels) {
+        snprintf(info->error, sizeof(info->error), "bad level range");
+        return false;
+    }
+
+    size_t total = 0;
+    for(int i=first; i<first + count; i++) {
+        int w = info->width >> i;
+        int h = info->height >> i;
+        MipLevel level;
+        level.offset = (uint32_t)total;
+        level.width = w > 0 ? w : 1;
+        level.height = h > 0 ? h : 1;
+        level.size = (uint32_t)TextureFormatBytes(info->format, level.width, level.height);
+        levels.push_back(level);
+        total += level.size;
+    }
+    chain.resize(total);
+
+    std::vector<uint8_t> unpacked;
+    if(info->basis == KTX2_BASIS_NONE) {
+        for(int i=0; i<count; i++) {
+            size_t length = 0;
+            const uint8_t *src = LevelData(data, size, info, first + i, unpacked, &length);
+            if(!src) return false;
+            if(length != levels[i].size) {
+                snprintf(info->error, sizeof(info->error), "level %d is truncated", first + i);
+                return false;
+            }
+            memcpy(chain.data() + levels[i].offset, src, levels[i].size);
+        }
+        return true;
+    }
+
+    // The ETC1S codebooks are shared by all levels
+    BasisLZ lz;
+    if(info->basis == KTX2_BASIS_ETC1S) {
+        uint64_t sgd_offset = Read64(data + 64);
+        uint64_t sgd_length = Read64(data + 72);
+        const char *error = 0;
+        if(sgd_offset > size || sgd_length > size - sgd_offset) error = "truncated global data";
+        else BasisLZInit(data + sgd_offset, (size_t)sgd_length, (uint32_t)info->levels, &lz, &error);
+        if(error) {
+            snprintf(info->error, sizeof(info->error), "ETC1S: %s", error);
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> rgba, blocks;
+    for(int i=0; i<count; i++) {
+        int level = first + i;
+        int width = levels[i].width, height = levels[i].height;
+        int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+        uint8_t *out = chain.data() + levels[i].offset;
+        size_t length = 0;
+        const uint8_t *src = LevelData(data, size, info, level, unpacked, &length);
+        if(!src) return false;
+
+        if(info->basis == KTX2_BASIS_ETC1S) {
+            const BasisSlice &slice = lz.slices[level];
+            if(info->format == TEXTURE_FORMAT_ETC1) {
+                if(!DecodeETC1SSlice(&lz, src, length, slice.rgb_offset, slice.rgb_length, width, height, false, blocks, 0, info)) return false;
+                memcpy(out, blocks.data(), blocks.size());
+                continue;
+            }
+            rgba.resize((size_t)width * height * 4);
+            if(!DecodeETC1SSlice(&lz, src, length, slice.rgb_offset, slice.rgb_length, width, height, false, blocks, rgba.data(), info)) return false;
+            if(slice.alpha_length > 0
+                && !DecodeETC1SSlice(&lz, src, length, slice.alpha_offset, slice.alpha_length, width, height, true, blocks, rgba.data(), info)) return false;
+        }
+        else {
+            if(length != (size_t)blocks_x * blocks_y * 16) {
+                snprintf(info->error, sizeof(info->error), "UASTC level %d has the wrong size", level);
+                return false;
+            }
+            rgba.resize((size_t)width * height * 4);
+            uint8_t texels[64];
+            for(int by=0; by<blocks_y; by++) {
+                for(int bx=0; bx<blocks_x; bx++) {
+                    if(!UASTCDecodeBlock(src + ((size_t)by * blocks_x + bx) * 16, texels)) {
+                        snprintf(info->error, sizeof(info->error), "UASTC level %d has an invalid block", level);
+                        return false;
+                    }
+                    StoreBlock(texels, bx, by, width, height, false, rgba.data());
+                }
+            }
+        }
+
+        if(info->format == TEXTURE_FORMAT_RGBA8) memcpy(out, rgba.data(), rgba.size());
+        else if(!EncodeLevel(info->format, rgba.data(), width, height, out)) {
+            snprintf(info->error, sizeof(info->error), "can't encode to %s", TextureFormatName(info->format));
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+// meshcache.cpp
+// Shared mesh resources.
+//   Every node that references the same cgltf_mesh uses the same primitive buffers. The first node
+//   builds them, and later nodes find the entry here, keyed by (cgltf_mesh_index, primitive).
+//   The key name is unique per loaded model, so it can be used directly in resource paths.
+
+#include "cgltf_lib.h"
+
+#include <map>
+
+struct MeshCacheEntry
+{
+    uint32_t    vertex_count;
+    uint32_t    index_count;
+};
+
+struct MeshCache
+{
+    uint32_t                                serial;
+    std::map<uint64_t, MeshCacheEntry>      entries;
+};
+
+static std::map<cgltf_data*, MeshCache>    mesh_caches;
+static uint32_t                            mesh_cache_serial = 0;
+
+static MeshCache& GetMeshCache(cgltf_data *data)
+{
+    std::map<cgltf_data*, MeshCache>::iterator it = mesh_caches.find(data);
+    if(it != mesh_caches.end()) return it->second;
+    MeshCache &cache = mesh_caches[data];
+    cache.serial = ++mesh_cache_serial;
+    return cache;
+}
+
+static uint64_t MeshCacheKey(cgltf_data *data, cgltf_mesh *mesh, int prim)
+{
+    return ((uint64_t)cgltf_mesh_index(data, mesh) << 32) | (uint32_t)prim;
+}
+
+void MeshCacheFree(cgltf_data *data)
+{
+    mesh_caches.erase(data);
+}
+
+// mesh_cache_get(data, mesh, prim_index)
+//   Returns the shared name for this mesh primitive (unique per primitive), and { vertex_count, index_count } if it
+//   has already been built (nil otherwise).
+int lib_mesh_cache_get(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    cgltf_mesh * mesh = (cgltf_mesh *)lua_touserdata(L, 2);
+    int prim = (int)lua_tointeger(L, 3);
+    if(data == nullptr || mesh == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    MeshCache &cache = GetMeshCache(data);
+    char name[64];
+    snprintf(name, sizeof(name), "gltf%u_mesh_%03d_%02d", cache.serial, (int)cgltf_mesh_index(data, mesh), prim);
+    lua_pushstring(L, name);
+
+    std::map<uint64_t, MeshCacheEntry>::iterator it = cache.entries.find(MeshCacheKey(data, mesh, prim));
+    if(it == cache.entries.end()) {
+        lua_pushnil(L);
+        return 2;
+    }
+    lua_newtable(L);
+    lua_pushstring(L, "vertex_count");
+    lua_pushinteger(L, it->second.vertex_count);
+    lua_settable(L, -3);
+    lua_pushstring(L, "index_count");
+    lua_pushinteger(L, it->second.index_count);
+    lua_settable(L, -3);
+    return 2;
+}
+
+// mesh_cache_set(data, mesh, prim_index, vertex_count, index_count)
+int lib_mesh_cache_set(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    cgltf_mesh * mesh = (cgltf_mesh *)lua_touserdata(L, 2);
+    int prim = (int)lua_tointeger(L, 3);
+    if(data == nullptr || mesh == nullptr) return 0;
+
+    MeshCacheEntry entry;
+    entry.vertex_count = (uint32_t)lua_tointeger(L, 4);
+    entry.index_count = (uint32_t)lua_tointeger(L, 5);
+    GetMeshCache(data).entries[MeshCacheKey(data, mesh, prim)] = entry;
+    return 0;
+}
@@ -0,0 +1,540 @@
+// meshopt.cpp
+// EXT_meshopt_compression buffer view decoding.
+//   Compressed buffer views are decoded once when the buffers are loaded. The decoded data is
+//   stored in buffer_view->data (cgltf reads it from there and frees it in cgltf_free), so all
+//   accessor reads after that see plain gltf data.
+//
+//   Implements the bitstream described in the EXT_meshopt_compression spec:
+//     attributes mode  - vertex codec (byte groups + delta/zigzag per byte channel)
+//     triangles mode   - index codec (edge/vertex fifos)
+//     indices mode     - index sequence codec (varint deltas)
+//   and the octahedral, quaternion and exponential filters. The filters run 4 wide with simd.h.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define MESHOPT_VERTEX_HEADER       0xa0
+#define MESHOPT_INDEX_HEADER        0xe0
+#define MESHOPT_SEQUENCE_HEADER     0xd0
+
+#define MESHOPT_BYTE_GROUP_SIZE     16
+#define MESHOPT_GROUP_DECODE_LIMIT  24
+#define MESHOPT_BLOCK_SIZE_BYTES    8192
+#define MESHOPT_BLOCK_MAX_SIZE      256
+#define MESHOPT_TAIL_MAX_SIZE       32
+
+// ---------------------------------------------------------------------------------------------
+// Vertex codec
+
+static const uint8_t* DecodeBytesGroup(const uint8_t *data, uint8_t *buffer, int bitslog2)
+{
+    switch(bitslog2)
+    {
+        case 0:
+            memset(buffer, 0, MESHOPT_BYTE_GROUP_SIZE);
+            return data;
+        case 1:
+        case 2:
+        {
+            // 2 or 4 bit values. An all ones value means the real byte follows the packed bits.
+            int bits = bitslog2 == 1 ? 2 : 4;
+            int per_byte = 8 / bits;
+            uint8_t mask = (uint8_t)((1 << bits) - 1);
+            const uint8_t *extra = data + MESHOPT_BYTE_GROUP_SIZE / per_byte;
+            for(int i=0; i<MESHOPT_BYTE_GROUP_SIZE / per_byte; i++) {
+                uint8_t byte = data[i];
+                for(int b=0; b<per_byte; b++) {
+                    uint8_t enc = byte >> (8 - bits);
+                    byte = (uint8_t)(byte << bits);
+                    uint8_t encv = *extra;
+                    *buffer++ = (enc == mask) ? encv : enc;
+                    extra += (enc == mask);
+                }
+            }
+            return extra;
+        }
+        default:
+            memcpy(buffer, data, MESHOPT_BYTE_GROUP_SIZE);
+            return data + MESHOPT_BYTE_GROUP_SIZE;
+    }
+}
+
+static const uint8_t* DecodeBytes(const uint8_t *data, const uint8_t *data_end, uint8_t *buffer, size_t buffer_size)
+{
+    size_t header_size = (buffer_size / MESHOPT_BYTE_GROUP_SIZE + 3) / 4;
+    if((size_t)(data_end - data) < header_size) return nullptr;
+
+    const uint8_t *header = data;
+    data += header_size;
+    for(size_t i=0; i<buffer_size; i+=MESHOPT_BYTE_GROUP_SIZE) {
+        if((size_t)(data_end - data) < MESHOPT_GROUP_DECODE_LIMIT) return nullptr;
+        size_t header_offset = i / MESHOPT_BYTE_GROUP_SIZE;
+        int bitslog2 = (header[header_offset / 4] >> ((header_offset % 4) * 2)) & 3;
+        data = DecodeBytesGroup(data, buffer + i, bitslog2);
+    }
+    return data;
+}
+
+static const uint8_t* DecodeVertexBlock(const uint8_t *data, const uint8_t *data_end, uint8_t *vertex_data,
+    size_t vertex_count, size_t vertex_size, uint8_t last_vertex[256])
+{
+    uint8_t buffer[MESHOPT_BLOCK_MAX_SIZE];
+    uint8_t transposed[MESHOPT_BLOCK_SIZE_BYTES];
+    size_t vertex_count_aligned = (vertex_count + MESHOPT_BYTE_GROUP_SIZE - 1) & ~(size_t)(MESHOPT_BYTE_GROUP_SIZE - 1);
+
+    for(size_t k=0; k<vertex_size; k++) {
+        data = DecodeBytes(data, data_end, buffer, vertex_count_aligned);
+        if(data == nullptr) return nullptr;
+
+        // Undo the zigzag delta against the previous vertex for this byte channel
+        uint8_t p = last_vertex[k];
+        for(size_t i=0; i<vertex_count; i++) {
+            uint8_t v = (uint8_t)((buffer[i] >> 1) ^ -(buffer[i] & 1));
+            p = (uint8_t)(p + v);
+            transposed[i * vertex_size + k] = p;
+        }
+        last_vertex[k] = p;
+    }
+    memcpy(vertex_data, transposed, vertex_count * vertex_size);
+    return data;
+}
+
+static bool DecodeVertexBuffer(uint8_t *destination, size_t vertex_count, size_t vertex_size, const uint8_t *buffer, size_t buffer_size)
+{
+    if(vertex_size == 0 || vertex_size > 256 || (vertex_size & 3) != 0) return false;
+    const uint8_t *data = buffer;
+    const uint8_t *data_end = buffer + buffer_size;
+    if((size_t)(data_end - data) < 1 + vertex_size) return false;
+    if(*data++ != MESHOPT_VERTEX_HEADER) return false;
+
+    // The stream ends with the first vertex, used as the starting delta base
+    uint8_t last_vertex[256];
+    memcpy(last_vertex, data_end - vertex_size, vertex_size);
+
+    size_t block_size = (MESHOPT_BLOCK_SIZE_BYTES / vertex_size) & ~(size_t)(MESHOPT_BYTE_GROUP_SIZE - 1);
+    if(block_size > MESHOPT_BLOCK_MAX_SIZE) block_size = MESHOPT_BLOCK_MAX_SIZE;
+
+    size_t vertex_offset = 0;
+    while(vertex_offset < vertex_count) {
+        size_t count = vertex_count - vertex_offset;
+        if(count > block_size) count = block_size;
+        data = DecodeVertexBlock(data, data_end, destination + vertex_offset * vertex_size, count, vertex_size, last_vertex);
+        if(data == nullptr) return false;
+        vertex_offset += count;
+    }
+
+    size_t tail_size = vertex_size < MESHOPT_TAIL_MAX_SIZE ? MESHOPT_TAIL_MAX_SIZE : vertex_size;
+    return (size_t)(data_end - data) == tail_size;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Index codecs
+
+static uint32_t DecodeVByte(const uint8_t *&data)
+{
+    uint8_t lead = *data++;
+    if(lead < 128) return lead;
+
+    uint32_t result = lead & 127;
+    uint32_t shift = 7;
+    for(int i=0; i<4; i++) {
+        uint8_t group = *data++;
+        result |= (uint32_t)(group & 127) << shift;
+        shift += 7;
+        if(group < 128) break;
+    }
+    return result;
+}
+
+static uint32_t DecodeIndex(const uint8_t *&data, uint32_t last)
+{
+    uint32_t v = DecodeVByte(data);
+    uint32_t d = (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+    return last + d;
+}
+
+static void WriteTriangle(void *destination, size_t offset, size_t index_size, uint32_t a, uint32_t b, uint32_t c)
+{
+    if(index_size == 2) {
+        uint16_t *out = (uint16_t *)destination + offset;
+        out[0] = (uint16_t)a; out[1] = (uint16_t)b; out[2] = (uint16_t)c;
+    }
+    else {
+        uint32_t *out = (uint32_t *)destination + offset;
+        out[0] = a; out[1] = b; out[2] = c;
+    }
+}
+
+struct IndexFifos
+{
+    uint32_t    edges[16][2];
+    uint32_t    vertices[16];
+    size_t      edge_offset;
+    size_t      vertex_offset;
+
+    void PushEdge(uint32_t a, uint32_t b)
+    {
+        edges[edge_offset][0] = a;
+        edges[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    }
+
+    void PushVertex(uint32_t v, bool cond = true)
+    {
+        vertices[vertex_offset] = v;
+        vertex_offset = (vertex_offset + (cond ? 1 : 0)) & 15;
+    }
+};
+
+static bool DecodeIndexBuffer(void *destination, size_t index_count, size_t index_size, const uint8_t *buffer, size_t buffer_size)
+{
+    if(index_count % 3 != 0) return false;
+    // header, 1 byte per triangle and the 16 byte codeaux table
+    if(buffer_size < 1 + index_count / 3 + 16) return false;
+    if((buffer[0] & 0xf0) != MESHOPT_INDEX_HEADER) return false;
+    int version = buffer[0] & 0x0f;
+    if(version > 1) return false;
+
+    IndexFifos fifo;
+    memset(&fifo, -1, sizeof(fifo));
+    fifo.edge_offset = 0;
+    fifo.vertex_offset = 0;
+
+    uint32_t next = 0;
+    uint32_t last = 0;
+    int fecmax = version >= 1 ? 13 : 15;
+
+    const uint8_t *code = buffer + 1;
+    const uint8_t *data = code + index_count / 3;
+    const uint8_t *data_safe_end = buffer + buffer_size - 16;
+    const uint8_t *codeaux_table = data_safe_end;
+
+    for(size_t i=0; i<index_count; i+=3) {
+        // A triangle reads at most 16 bytes, which the codeaux table at the end pads for
+        if(data > data_safe_end) return false;
+
+        uint8_t codetri = *code++;
+        if(codetri < 0xf0) {
+            // Edge from the fifo plus a vertex that is new, cached or free (delta coded)
+            int fe = codetri >> 4;
+            uint32_t a = fifo.edges[(fifo.edge_offset - 1 - fe) & 15][0];
+            uint32_t b = fifo.edges[(fifo.edge_offset - 1 - fe) & 15][1];
+            int fec = codetri & 15;
+
+            if(fec < fecmax) {
+                uint32_t cf = fifo.vertices[(fifo.vertex_offset - 1 - fec) & 15];
+                uint32_t c = (fec == 0) ? next : cf;
+                bool fec0 = fec == 0;
+                next += fec0 ? 1 : 0;
+
+                WriteTriangle(destination, i, index_size, a, b, c);
+                fifo.PushVertex(c, fec0);
+                fifo.PushEdge(c, b);
+                fifo.PushEdge(a, c);
+            }
+            else {
+                // 13 and 14 decode to -1 and +1 from the last free index (version 1)
+                uint32_t c = (fec != 15) ? last + (fec - (fec ^ 3)) : DecodeIndex(data, last);
+                last = c;
+
+                WriteTriangle(destination, i, index_size, a, b, c);
+                fifo.PushVertex(c);
+                fifo.PushEdge(c, b);
+                fifo.PushEdge(a, c);
+            }
+        }
+        else if(codetri < 0xfe) {
+            // All three vertices new or cached, layout from the codeaux table
+            uint8_t codeaux = codeaux_table[codetri & 15];
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            uint32_t a = next++;
+            uint32_t bf = fifo.vertices[(fifo.vertex_offset - feb) & 15];
+            uint32_t b = (feb == 0) ? next : bf;
+            bool feb0 = feb == 0;
+            next += feb0 ? 1 : 0;
+
+            uint32_t cf = fifo.vertices[(fifo.vertex_offset - fec) & 15];
+            uint32_t c = (fec == 0) ? next : cf;
+            bool fec0 = fec == 0;
+            next += fec0 ? 1 : 0;
+
+            WriteTriangle(destination, i, index_size, a, b, c);
+            fifo.PushVertex(a);
+            fifo.PushVertex(b, feb0);
+            fifo.PushVertex(c, fec0);
+            fifo.PushEdge(b, a);
+            fifo.PushEdge(c, b);
+            fifo.PushEdge(a, c);
+        }
+        else {
+            // Full codeaux byte, any vertex may be free
+            uint8_t codeaux = *data++;
+            int fea = codetri == 0xfe ? 0 : 15;
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            if(codeaux == 0) next = 0;
+
+            uint32_t a = (fea == 0) ? next++ : 0;
+            uint32_t b = (feb == 0) ? next++ : fifo.vertices[(fifo.vertex_offset - feb) & 15];
+            uint32_t c = (fec == 0) ? next++ : fifo.vertices[(fifo.vertex_offset - fec) & 15];
+
+            if(fea == 15) last = a = DecodeIndex(data, last);
+            if(feb == 15) last = b = DecodeIndex(data, last);
+            if(fec == 15) last = c = DecodeIndex(data, last);
+
+            WriteTriangle(destination, i, index_size, a, b, c);
+            fifo.PushVertex(a);
+            fifo.PushVertex(b, (feb == 0) || (feb == 15));
+            fifo.PushVertex(c, (fec == 0) || (fec == 15));
+            fifo.PushEdge(b, a);
+            fifo.PushEdge(c, b);
+            fifo.PushEdge(a, c);
+        }
+    }
+    return data == data_safe_end;
+}
+
+static bool DecodeIndexSequence(void *destination, size_t index_count, size_t index_size, const uint8_t *buffer, size_t buffer_size)
+{
+    // header, 1 byte per index and a 4 byte tail
+    if(buffer_size < 1 + index_count + 4) return false;
+    if((buffer[0] & 0xf0) != MESHOPT_SEQUENCE_HEADER) return false;
+    int version = buffer[0] & 0x0f;
+    if(version > 1) return false;
+
+    const uint8_t *data = buffer + 1;
+    const uint8_t *data_safe_end = buffer + buffer_size - 4;
+    uint32_t last[2] = { 0, 0 };
+
+    for(size_t i=0; i<index_count; i++) {
+        if(data >= data_safe_end) return false;
+        uint32_t v = DecodeVByte(data);
+
+        // Low bit picks one of two baselines, the rest is a zigzag delta from it
+        uint32_t current = v & 1;
+        v >>= 1;
+        uint32_t d = (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+        uint32_t index = last[current] + d;
+        last[current] = index;
+
+        if(index_size == 2) ((uint16_t *)destination)[i] = (uint16_t)index;
+        else ((uint32_t *)destination)[i] = index;
+    }
+    return data == data_safe_end;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Filters
+
+static inline int RoundToInt(float v)
+{
+    return (int)(v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+// Octahedral normals/tangents as 4 x int8 or 4 x int16. The 4th component passes through.
+template <typename T>
+static void DecodeFilterOct(T *data, size_t count)
+{
+    const float max = (float)((1 << (sizeof(T) * 8 - 1)) - 1);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        T *e = data + i * 4;
+        simd4f x = simd_set(e[0], e[4], e[8], e[12]);
+        simd4f y = simd_set(e[1], e[5], e[9], e[13]);
+        simd4f z = simd_sub(simd_sub(simd_set(e[2], e[6], e[10], e[14]), simd_abs(x)), simd_abs(y));
+
+        // Fold back the lower hemisphere
+        simd4f t = simd_min(z, simd_splat(0.0f));
+        x = simd_add(x, simd_mul(t, simd_sign(x)));
+        y = simd_add(y, simd_mul(t, simd_sign(y)));
+
+        simd4f len = simd_sqrt(simd_madd(x, x, simd_madd(y, y, simd_mul(z, z))));
+        simd4f s = simd_div(simd_splat(max), len);
+        simd4f half = simd_splat(0.5f);
+        float fx[4], fy[4], fz[4];
+        simd_store(fx, simd_madd(x, s, simd_mul(simd_sign(x), half)));
+        simd_store(fy, simd_madd(y, s, simd_mul(simd_sign(y), half)));
+        simd_store(fz, simd_madd(z, s, simd_mul(simd_sign(z), half)));
+        for(int j=0; j<4; j++) {
+            e[j * 4 + 0] = (T)(int)fx[j];
+            e[j * 4 + 1] = (T)(int)fy[j];
+            e[j * 4 + 2] = (T)(int)fz[j];
+        }
+    }
+    for(; i<count; i++) {
+        T *e = data + i * 4;
+        float x = (float)e[0];
+        float y = (float)e[1];
+        float z = (float)e[2] - fabsf(x) - fabsf(y);
+        float t = (z < 0.0f) ? z : 0.0f;
+        x += (x >= 0.0f) ? t : -t;
+        y += (y >= 0.0f) ? t : -t;
+        float s = max / sqrtf(x * x + y * y + z * z);
+        e[0] = (T)RoundToInt(x * s);
+        e[1] = (T)RoundToInt(y * s);
+        e[2] = (T)RoundToInt(z * s);
+    }
+}
+
+// Quaternions as 3 x int16 + (max component index | scale) in the 4th component
+static void DecodeFilterQuat(int16_t *data, size_t count)
+{
+    const float scale = 1.0f / sqrtf(2.0f);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        int16_t *e = data + i * 4;
+        simd4f ss = simd_div(simd_splat(scale), simd_set((float)(e[3] | 3), (float)(e[7] | 3), (float)(e[11] | 3), (float)(e[15] | 3)));
+        simd4f x = simd_mul(simd_set(e[0], e[4], e[8], e[12]), ss);
+        simd4f y = simd_mul(simd_set(e[1], e[5], e[9], e[13]), ss);
+        simd4f z = simd_mul(simd_set(e[2], e[6], e[10], e[14]), ss);
+        simd4f ww = simd_sub(simd_splat(1.0f), simd_madd(x, x, simd_madd(y, y, simd_mul(z, z))));
+        simd4f w = simd_sqrt(simd_max(ww, simd_splat(0.0f)));
+
+        simd4f q = simd_splat(32767.0f);
+        simd4f half = simd_splat(0.5f);
+        float fx[4], fy[4], fz[4], fw[4];
+        simd_store(fx, simd_madd(x, q, simd_mul(simd_sign(x), half)));
+        simd_store(fy, simd_madd(y, q, simd_mul(simd_sign(y), half)));
+        simd_store(fz, simd_madd(z, q, simd_mul(simd_sign(z), half)));
+        simd_store(fw, simd_madd(w, q, half));
+        for(int j=0; j<4; j++) {
+            int16_t *o = e + j * 4;
+            int qc = o[3] & 3;
+            o[(qc + 1) & 3] = (int16_t)(int)fx[j];
+            o[(qc + 2) & 3] = (int16_t)(int)fy[j];
+            o[(qc + 3) & 3] = (int16_t)(int)fz[j];
+            o[(qc + 0) & 3] = (int16_t)(int)fw[j];
+        }
+    }
+    for(; i<count; i++) {
+        int16_t *e = data + i * 4;
+        float ss = scale / (float)(e[3] | 3);
+        float x = e[0] * ss;
+        float y = e[1] * ss;
+        float z = e[2] * ss;
+        float ww = 1.0f - x * x - y * y - z * z;
+        float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+        int qc = e[3] & 3;
+        e[(qc + 1) & 3] = (int16_t)RoundToInt(x * 32767.0f);
+        e[(qc + 2) & 3] = (int16_t)RoundToInt(y * 32767.0f);
+        e[(qc + 3) & 3] = (int16_t)RoundToInt(z * 32767.0f);
+        e[(qc + 0) & 3] = (int16_t)(int)(w * 32767.0f + 0.5f);
+    }
+}
+
+// Exponential: 24 bit signed mantissa + 8 bit signed exponent per 32 bit component
+static void DecodeFilterExp(uint32_t *data, size_t count)
+{
+    size_t i = 0;
+#if defined(CGLTF_SIMD_SSE2)
+    for(; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+        __m128i e = _mm_srai_epi32(v, 24);
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+        _mm_storeu_ps((float *)(data + i), _mm_mul_ps(scale, _mm_cvtepi32_ps(m)));
+    }
+#elif defined(CGLTF_SIMD_NEON)
+    for(; i + 4 <= count; i += 4) {
+        int32x4_t v = vreinterpretq_s32_u32(vld1q_u32(data + i));
+        int32x4_t m = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+        int32x4_t e = vshrq_n_s32(v, 24);
+        float32x4_t scale = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(e, vdupq_n_s32(127)), 23));
+        vst1q_f32((float *)(data + i), vmulq_f32(scale, vcvtq_f32_s32(m)));
+    }
+#elif defined(CGLTF_SIMD_WASM)
+    for(; i + 4 <= count; i += 4) {
+        v128_t v = wasm_v128_load(data + i);
+        v128_t m = wasm_i32x4_shr(wasm_i32x4_shl(v, 8), 8);
+        v128_t e = wasm_i32x4_shr(v, 24);
+        v128_t scale = wasm_i32x4_shl(wasm_i32x4_add(e, wasm_i32x4_splat(127)), 23);
+        wasm_v128_store(data + i, wasm_f32x4_mul(scale, wasm_f32x4_convert_i32x4(m)));
+    }
+#endif
+    for(; i<count; i++) {
+        uint32_t v = data[i];
+        int32_t m = (int32_t)(v << 8) >> 8;
+        int32_t e = (int32_t)v >> 24;
+        union { float f; uint32_t ui; } u;
+        u.ui = (uint32_t)(e + 127) << 23;
+        u.f = u.f * (float)m;
+        data[i] = u.ui;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+static bool DecodeBufferView(cgltf_data *data, cgltf_buffer_view *bv)
+{
+    cgltf_meshopt_compression *mc = &bv->meshopt_compression;
+    if(mc->buffer == nullptr || mc->buffer->data == nullptr) {
+        printf("[Error] Meshopt: compressed buffer not loaded for buffer view %d\n", (int)cgltf_buffer_view_index(data, bv));
+        return false;
+    }
+
+    const uint8_t *src = (const uint8_t *)mc->buffer->data + mc->offset;
+    cgltf_size size = mc->stride * mc->count;
+    uint8_t *dst = (uint8_t *)data->memory.alloc_func(data->memory.user_data, size);
+    if(dst == nullptr) return false;
+
+    bool ok = false;
+    switch(mc->mode)
+    {
+        case cgltf_meshopt_compression_mode_attributes:
+            ok = DecodeVertexBuffer(dst, mc->count, mc->stride, src, mc->size);
+            break;
+        case cgltf_meshopt_compression_mode_triangles:
+            ok = DecodeIndexBuffer(dst, mc->count, mc->stride, src, mc->size);
+            break;
+        case cgltf_meshopt_compression_mode_indices:
+            ok = DecodeIndexSequence(dst, mc->count, mc->stride, src, mc->size);
+            break;
+        default:
+            break;
+    }
+
+    if(ok) {
+        switch(mc->filter)
+        {
+            case cgltf_meshopt_compression_filter_octahedral:
+                if(mc->stride == 4) DecodeFilterOct<int8_t>((int8_t *)dst, mc->count);
+                else DecodeFilterOct<int16_t>((int16_t *)dst, mc->count);
+                break;
+            case cgltf_meshopt_compression_filter_quaternion:
+                DecodeFilterQuat((int16_t *)dst, mc->count);
+                break;
+            case cgltf_meshopt_compression_filter_exponential:
+                DecodeFilterExp((uint32_t *)dst, mc->count * (mc->stride / 4));
+                break;
+            default:
+                break;
+        }
+    }
+
+    if(!ok) {
+        printf("[Error] Meshopt: failed to decode buffer view %d (mode %d)\n", (int)cgltf_buffer_view_index(data, bv), (int)mc->mode);
+        data->memory.free_func(data->memory.user_data, dst);
+        return false;
+    }
+    bv->data = dst;
+    return true;
+}
+
+// Decode every meshopt compressed buffer view that has not been decoded yet.
+//   Returns the number of views decoded.
+int DecodeMeshoptBufferViews(cgltf_data *data)
+{
+    int decoded = 0;
+    for(cgltf_size i=0; i<data->buffer_views_count; i++) {
+        cgltf_buffer_view *bv = &data->buffer_views[i];
+        if(!bv->has_meshopt_compression || bv->data != nullptr) continue;
+        if(DecodeBufferView(data, bv)) decoded++;
+    }
+    return decoded;
+}
@@ -0,0 +1,243 @@
+// morph.cpp
+// Morph targets (blend shapes).
+//   A primitive's base positions and normals, and every target's deltas, are unpacked once (sparse
+//   accessors included) as x[], y[], z[] arrays padded to 4 vertices, the layout skinning.cpp
+//   reads. Each target keeps the range of vertices its deltas move, so a sparse target only blends
+//   that range. Per frame, the targets with a non zero weight are added to the base with a
+//   multiply-add, 4 floats at a time. Weights come from a pose, so animated weights channels
+//   (animation.cpp) drive them. A skinned primitive skins the blended vertices.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <math.h>
+#include <string.h>
+#include <map>
+#include <algorithm>
+
+#define MORPH_MIN_WEIGHT    1e-5f   // targets weighted less are skipped
+
+struct MorphTarget
+{
+    std::vector<float>      position;   // deltas x[], y[], z[], empty when the target has none
+    std::vector<float>      normal;
+    uint32_t                first;      // vertices [first, last) with a delta, multiples of 4
+    uint32_t                last;
+};
+
+struct MorphMesh
+{
+    uint32_t                    vertices;
+    uint32_t                    padded;
+    std::vector<float>          base_position;
+    std::vector<float>          base_normal;    // empty without normals
+    std::vector<MorphTarget>    targets;
+    std::vector<uint32_t>       indices;        // source vertex of each vertex in the mesh buffer
+    std::vector<float>          position;       // the last blend
+    std::vector<float>          normal;
+    bool                        blended;
+};
+
+static std::map<const cgltf_primitive*, MorphMesh*> morph_meshes;
+
+// Vertex range [first, last) where any component of the deltas is non zero, rounded out to 4
+static void DeltaRange(const std::vector<float> &deltas, uint32_t padded, uint32_t *first, uint32_t *last)
+{
+    if(deltas.empty()) return;
+    for(uint32_t v=0; v<padded; v++) {
+        if(deltas[v] == 0.0f && deltas[padded + v] == 0.0f && deltas[2 * padded + v] == 0.0f) continue;
+        *first = std::min(*first, v & ~3u);
+        *last = std::max(*last, (v + 4) & ~3u);
+    }
+}
+
+static MorphMesh *LoadMorphMesh(const cgltf_primitive *prim)
+{
+    const cgltf_accessor *position = nullptr, *normal = nullptr;
+    for(cgltf_size a=0; a<prim->attributes_count; a++) {
+        if(prim->attributes[a].type == cgltf_attribute_type_position) position = prim->attributes[a].data;
+        else if(prim->attributes[a].type == cgltf_attribute_type_normal) normal = prim->attributes[a].data;
+    }
+    if(position == nullptr || prim->targets_count == 0) return nullptr;
+
+    MorphMesh *mesh = new MorphMesh;
+    mesh->vertices = (uint32_t)position->count;
+    mesh->padded = (mesh->vertices + 3) & ~3u;
+    mesh->blended = false;
+    bool ok = UnpackSoA3(position, mesh->vertices, mesh->padded, mesh->base_position);
+    if(ok && normal && !UnpackSoA3(normal, mesh->vertices, mesh->padded, mesh->base_normal)) mesh->base_normal.clear();
+
+    mesh->targets.resize(prim->targets_count);
+    for(cgltf_size t=0; ok && t<prim->targets_count; t++) {
+        const cgltf_morph_target &src = prim->targets[t];
+        MorphTarget &target = mesh->targets[t];
+        target.first = mesh->padded;
+        target.last = 0;
+        for(cgltf_size a=0; ok && a<src.attributes_count; a++) {
+            const cgltf_attribute &attr = src.attributes[a];
+            if(attr.type == cgltf_attribute_type_position) {
+                ok = UnpackSoA3(attr.data, mesh->vertices, mesh->padded, target.position);
+            }
+            else if(attr.type == cgltf_attribute_type_normal && !mesh->base_normal.empty()) {
+                ok = UnpackSoA3(attr.data, mesh->vertices, mesh->padded, target.normal);
+            }
+        }
+        DeltaRange(target.position, mesh->padded, &target.first, &target.last);
+        DeltaRange(target.normal, mesh->padded, &target.first, &target.last);
+    }
+
+    if(prim->indices) {
+        mesh->indices.resize(prim->indices->count);
+        for(cgltf_size i=0; i<prim->indices->count; i++) {
+            cgltf_size index = cgltf_accessor_read_index(prim->indices, i);
+            ok = ok && index < mesh->vertices;
+            mesh->indices[i] = (uint32_t)index;
+        }
+    }
+    else {
+        mesh->indices.resize(mesh->vertices);
+        for(uint32_t v=0; v<mesh->vertices; v++) mesh->indices[v] = v;
+    }
+    if(!ok) {
+        printf("[Error] Morph targets: could not read the primitive's targets\n");
+        delete mesh;
+        return nullptr;
+    }
+    return mesh;
+}
+
+static MorphMesh *GetMorphMesh(const cgltf_primitive *prim)
+{
+    std::map<const cgltf_primitive*, MorphMesh*>::iterator it = morph_meshes.find(prim);
+    if(it != morph_meshes.end()) return it->second;
+    MorphMesh *mesh = LoadMorphMesh(prim);
+    if(mesh) morph_meshes[prim] = mesh;
+    return mesh;
+}
+
+void MorphFree(cgltf_data *data)
+{
+    for(cgltf_size m=0; m<data->meshes_count && !morph_meshes.empty(); m++) {
+        for(cgltf_size p=0; p<data->meshes[m].primitives_count; p++) {
+            std::map<const cgltf_primitive*, MorphMesh*>::iterator it = morph_meshes.find(&data->meshes[m].primitives[p]);
+            if(it == morph_meshes.end()) continue;
+            delete it->second;
+            morph_meshes.erase(it);
+        }
+    }
+}
+
+// out += deltas * weight over vertices [first, last) of each component array
+static void AddDeltas(const std::vector<float> &deltas, float weight, uint32_t padded, uint32_t first, uint32_t last, float *out)
+{
+    if(deltas.empty()) return;
+    simd4f w = simd_splat(weight);
+    for(int c=0; c<3; c++) {
+        const float *d = &deltas[c * padded];
+        float *o = out + c * padded;
+        for(uint32_t v=first; v<last; v+=4) simd_store(o + v, simd_madd(simd_load(d + v), w, simd_load(o + v)));
+    }
+}
+
+// Blends the targets by weights (count of them) into mesh.position and mesh.normal. Returns the
+// number of targets used.
+static int MorphBlend(MorphMesh &mesh, const float *weights, int count)
+{
+    uint32_t n = mesh.padded;
+    mesh.position = mesh.base_position;
+    mesh.normal = mesh.base_normal;
+    int active = 0;
+    bool normals = false;
+    count = std::min(count, (int)mesh.targets.size());
+    for(int t=0; t<count; t++) {
+        if(fabsf(weights[t]) < MORPH_MIN_WEIGHT) continue;
+        const MorphTarget &target = mesh.targets[t];
+        if(target.first >= target.last) continue;
+        AddDeltas(target.position, weights[t], n, target.first, target.last, mesh.position.data());
+        if(!mesh.normal.empty()) AddDeltas(target.normal, weights[t], n, target.first, target.last, mesh.normal.data());
+        normals = normals || !target.normal.empty();
+        active++;
+    }
+
+    if(normals && !mesh.normal.empty()) {
+        float *x = &mesh.normal[0], *y = x + n, *z = y + n;
+        for(uint32_t v=0; v<n; v+=4) {
+            simd4f nx = simd_load(x + v), ny = simd_load(y + v), nz = simd_load(z + v);
+            simd4f len = simd_max(simd_sqrt(simd_madd(nx, nx, simd_madd(ny, ny, simd_mul(nz, nz)))), simd_splat(1e-20f));
+            simd4f inv = simd_div(simd_splat(1.0f), len);
+            simd_store(x + v, simd_mul(nx, inv));
+            simd_store(y + v, simd_mul(ny, inv));
+            simd_store(z + v, simd_mul(nz, inv));
+        }
+    }
+    mesh.blended = true;
+    return active;
+}
+
+// The primitive's last blended positions and normals (x[], y[], z[], padded to 4 vertices), for
+// skinning. Leaves position and normal alone when the primitive has no blend or no normals.
+void MorphedVertices(const cgltf_primitive *prim, const float **position, const float **normal)
+{
+    std::map<const cgltf_primitive*, MorphMesh*>::iterator it = morph_meshes.find(prim);
+    if(it == morph_meshes.end() || !it->second->blended) return;
+    *position = it->second->position.data();
+    if(!it->second->normal.empty()) *normal = it->second->normal.data();
+}
+
+// Writes the blend into the unindexed mesh buffer streams
+static void WriteMorphed(const MorphMesh &mesh, float *position, uint32_t position_stride, float *normal, uint32_t normal_stride)
+{
+    uint32_t n = mesh.padded;
+    for(size_t i=0; i<mesh.indices.size(); i++) {
+        uint32_t v = mesh.indices[i];
+        float *p = position + i * position_stride;
+        p[0] = mesh.position[v];
+        p[1] = mesh.position[n + v];
+        p[2] = mesh.position[2 * n + v];
+        if(normal == nullptr) continue;
+        float *q = normal + i * normal_stride;
+        q[0] = mesh.normal[v];
+        q[1] = mesh.normal[n + v];
+        q[2] = mesh.normal[2 * n + v];
+    }
+}
+
+// morph_primitive(prim, pose, node [, buffer])
+//   Blends the primitive's (prim.addr) morph targets with the weights of node (0 based) in the
+//   pose, and writes the "position" and "normal" streams of buffer, the primitive's unindexed mesh
+//   buffer. Without a buffer the blend is only kept for skin_primitive, which then skins it.
+//   Returns the number of targets blended.
+int lib_morph_primitive(lua_State *L)
+{
+    const cgltf_primitive *prim = (const cgltf_primitive *)lua_touserdata(L, 1);
+    Pose *pose = (Pose *)lua_touserdata(L, 2);
+    MorphMesh *mesh = prim ? GetMorphMesh(prim) : nullptr;
+    if(mesh == nullptr || pose == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    int node = (int)luaL_checkinteger(L, 3);
+    const AnimModel *model = pose->model;
+    if(node < 0 || node >= model->nodes || model->weight_offset[node] < 0) {
+        return luaL_error(L, "morph_primitive: node %d has no morph weights", node);
+    }
+    int active = MorphBlend(*mesh, &pose->weights[model->weight_offset[node]], model->weight_count[node]);
+
+    if(!lua_isnoneornil(L, 4)) {
+        dmBuffer::HBuffer buffer = dmScript::CheckBufferUnpack(L, 4);
+        float *position = nullptr, *normal = nullptr;
+        uint32_t count = 0, components = 0, position_stride = 0, normal_stride = 0;
+        if(dmBuffer::GetStream(buffer, dmHashString64("position"), (void **)&position, &count, &components, &position_stride) != dmBuffer::RESULT_OK
+            || components != 3 || count != mesh->indices.size()) {
+            return luaL_error(L, "morph_primitive: buffer needs a position stream of %u vertices", (uint32_t)mesh->indices.size());
+        }
+        uint32_t normal_count = 0;
+        if(mesh->normal.empty() || dmBuffer::GetStream(buffer, dmHashString64("normal"), (void **)&normal, &normal_count, &components, &normal_stride) != dmBuffer::RESULT_OK
+            || components != 3 || normal_count != count) {
+            normal = nullptr;
+        }
+        WriteMorphed(*mesh, position, position_stride, normal, normal_stride);
+    }
+    lua_pushinteger(L, active);
+    return 1;
+}
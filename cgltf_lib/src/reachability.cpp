@@ -0,0 +1,134 @@
+// reachability.cpp
+// Which images a scene actually uses.
+//   Walks scene -> nodes -> meshes -> primitives -> materials -> textures -> images, so a load can
+//   skip images that only unused materials, variants or other scenes reference. With an active
+//   KHR_materials_variants variant, a primitive's mapped material replaces its default one.
+
+#include "cgltf_lib.h"
+
+#include <string.h>
+
+static void MarkTexture(cgltf_data *data, const cgltf_texture_view &view, std::vector<bool> &images)
+{
+    const cgltf_texture *tex = view.texture;
+    if(tex == nullptr) return;
+    if(tex->image) images[cgltf_image_index(data, tex->image)] = true;
+    if(tex->basisu_image) images[cgltf_image_index(data, tex->basisu_image)] = true;
+}
+
+// Every texture slot of a material (MATERIAL_TEXTURE_VIEWS entries, some may have no texture)
+int MaterialTextureViews(const cgltf_material *mat, const cgltf_texture_view **out)
+{
+    const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS] = {
+        &mat->pbr_metallic_roughness.base_color_texture,
+        &mat->pbr_metallic_roughness.metallic_roughness_texture,
+        &mat->pbr_specular_glossiness.diffuse_texture,
+        &mat->pbr_specular_glossiness.specular_glossiness_texture,
+        &mat->clearcoat.clearcoat_texture,
+        &mat->clearcoat.clearcoat_roughness_texture,
+        &mat->clearcoat.clearcoat_normal_texture,
+        &mat->transmission.transmission_texture,
+        &mat->specular.specular_texture,
+        &mat->specular.specular_color_texture,
+        &mat->volume.thickness_texture,
+        &mat->sheen.sheen_color_texture,
+        &mat->sheen.sheen_roughness_texture,
+        &mat->iridescence.iridescence_texture,
+        &mat->iridescence.iridescence_thickness_texture,
+        &mat->diffuse_transmission.diffuse_transmission_texture,
+        &mat->diffuse_transmission.diffuse_transmission_color_texture,
+        &mat->anisotropy.anisotropy_texture,
+        &mat->normal_texture,
+        &mat->occlusion_texture,
+        &mat->emissive_texture,
+    };
+    memcpy(out, views, sizeof(views));
+    return MATERIAL_TEXTURE_VIEWS;
+}
+
+static void MarkMaterial(cgltf_data *data, const cgltf_material *mat, std::vector<bool> &images)
+{
+    if(mat == nullptr) return;
+    const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+    int count = MaterialTextureViews(mat, views);
+    for(int i=0; i<count; i++) {
+        MarkTexture(data, *views[i], images);
+    }
+}
+
+// The primitive's material with the variant (-1 for the default materials) active
+cgltf_material *VariantMaterial(const cgltf_primitive *prim, int variant)
+{
+    cgltf_material *mat = prim->material;
+    for(cgltf_size m=0; m<prim->mappings_count && variant >= 0; m++) {
+        if(prim->mappings[m].variant == (cgltf_size)variant) mat = prim->mappings[m].material;
+    }
+    return mat;
+}
+
+static void MarkNode(cgltf_data *data, const cgltf_node *node, int variant, std::vector<bool> &images)
+{
+    if(node->mesh) {
+        for(cgltf_size p=0; p<node->mesh->primitives_count; p++) {
+            MarkMaterial(data, VariantMaterial(&node->mesh->primitives[p], variant), images);
+        }
+    }
+    for(cgltf_size c=0; c<node->children_count; c++) {
+        MarkNode(data, node->children[c], variant, images);
+    }
+}
+
+// Marks the images used by the scene (the default scene, or the first one, when scene is null).
+// Files without scenes use every root node.
+void ReachableImages(cgltf_data *data, cgltf_scene *scene, int variant, std::vector<bool> &images)
+{
+    images.assign(data->images_count, false);
+    if(scene == nullptr) scene = data->scene ? data->scene : (data->scenes_count > 0 ? &data->scenes[0] : nullptr);
+    if(scene) {
+        for(cgltf_size n=0; n<scene->nodes_count; n++) {
+            MarkNode(data, scene->nodes[n], variant, images);
+        }
+        return;
+    }
+    for(cgltf_size n=0; n<data->nodes_count; n++) {
+        if(data->nodes[n].parent == nullptr) MarkNode(data, &data->nodes[n], variant, images);
+    }
+}
+
+// reachable_images(data [, scene [, variant]])
+//   Returns the image indices (+ 1) the scene uses, in order. variant is the 0 based
+//   KHR_materials_variants index, or nil for the default materials.
+int lib_reachable_images(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    if(data == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    cgltf_scene * scene = (cgltf_scene *)lua_touserdata(L, 2);
+    int variant = lua_isnumber(L, 3) ? (int)lua_tointeger(L, 3) : -1;
+
+    std::vector<bool> images;
+    ReachableImages(data, scene, variant, images);
+    lua_newtable(L);
+    int count = 0;
+    for(size_t i=0; i<images.size(); i++) {
+        if(!images[i]) continue;
+        lua_pushinteger(L, (lua_Integer)(i + 1));
+        lua_rawseti(L, -2, ++count);
+    }
+    return 1;
+}
+
+// get_primitive_material(prim [, variant])
+//   The primitive's (prim.addr) material when the 0 based KHR_materials_variants variant is
+//   active, its default material for nil or a variant without a mapping. nil when it has none.
+int lib_get_primitive_material(lua_State *L)
+{
+    const cgltf_primitive *prim = (const cgltf_primitive *)lua_touserdata(L, 1);
+    int variant = lua_isnumber(L, 2) ? (int)lua_tointeger(L, 2) : -1;
+    cgltf_material *mat = prim ? VariantMaterial(prim, variant) : nullptr;
+    if(mat == nullptr) lua_pushnil(L);
+    else lua_pushlightuserdata(L, mat);
+    return 1;
+}
@@ -0,0 +1,382 @@
+// simd.h
+// Small 4 wide float helpers for the native kernels.
+//   SSE2 on x86, NEON on arm, simd128 on wasm (when built with -msimd128) and plain
+//   scalar code everywhere else. Define CGLTF_LIB_NO_SIMD to force the scalar path.
+
+#ifndef CGLTF_LIB_SIMD_H
+#define CGLTF_LIB_SIMD_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(CGLTF_LIB_NO_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define CGLTF_SIMD_SSE2
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define CGLTF_SIMD_NEON
+        #include <arm_neon.h>
+    #elif defined(__wasm_simd128__)
+        #define CGLTF_SIMD_WASM
+        #include <wasm_simd128.h>
+    #endif
+#endif
+
+#if defined(CGLTF_SIMD_SSE2)
+typedef __m128 simd4f;
+#elif defined(CGLTF_SIMD_NEON)
+typedef float32x4_t simd4f;
+#elif defined(CGLTF_SIMD_WASM)
+typedef v128_t simd4f;
+#else
+struct simd4f { float v[4]; };
+#endif
+
+static inline simd4f simd_set(float x, float y, float z, float w)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_set_ps(w, z, y, x);
+#elif defined(CGLTF_SIMD_NEON)
+    float tmp[4] = { x, y, z, w };
+    return vld1q_f32(tmp);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_f32x4_make(x, y, z, w);
+#else
+    simd4f r = {{ x, y, z, w }};
+    return r;
+#endif
+}
+
+static inline simd4f simd_splat(float x)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_set1_ps(x);
+#elif defined(CGLTF_SIMD_NEON)
+    return vdupq_n_f32(x);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_f32x4_splat(x);
+#else
+    return simd_set(x, x, x, x);
+#endif
+}
+
+// Unaligned load of 4 floats
+static inline simd4f simd_load(const float *p)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_loadu_ps(p);
+#elif defined(CGLTF_SIMD_NEON)
+    return vld1q_f32(p);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_v128_load(p);
+#else
+    return simd_set(p[0], p[1], p[2], p[3]);
+#endif
+}
+
+// Load 3 floats, w = 0. Never reads past p[2].
+static inline simd4f simd_load3(const float *p)
+{
+    return simd_set(p[0], p[1], p[2], 0.0f);
+}
+
+// Unaligned store of 4 floats
+static inline void simd_store(float *p, simd4f a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    _mm_storeu_ps(p, a);
+#elif defined(CGLTF_SIMD_NEON)
+    vst1q_f32(p, a);
+#elif defined(CGLTF_SIMD_WASM)
+    wasm_v128_store(p, a);
+#else
+    p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3];
+#endif
+}
+
+#if defined(CGLTF_SIMD_SSE2)
+    #define SIMD_BINOP(name, sse, neon, wasm, op) \
+        static inline simd4f name(simd4f a, simd4f b) { return sse(a, b); }
+#elif defined(CGLTF_SIMD_NEON)
+    #define SIMD_BINOP(name, sse, neon, wasm, op) \
+        static inline simd4f name(simd4f a, simd4f b) { return neon(a, b); }
+#elif defined(CGLTF_SIMD_WASM)
+    #define SIMD_BINOP(name, sse, neon, wasm, op) \
+        static inline simd4f name(simd4f a, simd4f b) { return wasm(a, b); }
+#else
+    #define SIMD_BINOP(name, sse, neon, wasm, op) \
+        static inline simd4f name(simd4f a, simd4f b) { \
+            simd4f r; for(int i=0; i<4; i++) r.v[i] = op(a.v[i], b.v[i]); return r; }
+#endif
+
+static inline float simd_op_add(float a, float b) { return a + b; }
+static inline float simd_op_sub(float a, float b) { return a - b; }
+static inline float simd_op_mul(float a, float b) { return a * b; }
+static inline float simd_op_min(float a, float b) { return a < b ? a : b; }
+static inline float simd_op_max(float a, float b) { return a > b ? a : b; }
+
+SIMD_BINOP(simd_add, _mm_add_ps, vaddq_f32, wasm_f32x4_add, simd_op_add)
+SIMD_BINOP(simd_sub, _mm_sub_ps, vsubq_f32, wasm_f32x4_sub, simd_op_sub)
+SIMD_BINOP(simd_mul, _mm_mul_ps, vmulq_f32, wasm_f32x4_mul, simd_op_mul)
+SIMD_BINOP(simd_min, _mm_min_ps, vminq_f32, wasm_f32x4_pmin, simd_op_min)
+SIMD_BINOP(simd_max, _mm_max_ps, vmaxq_f32, wasm_f32x4_pmax, simd_op_max)
+
+#undef SIMD_BINOP
+
+// a * b + c
+static inline simd4f simd_madd(simd4f a, simd4f b, simd4f c)
+{
+#if defined(CGLTF_SIMD_NEON)
+    return vmlaq_f32(c, a, b);
+#else
+    return simd_add(simd_mul(a, b), c);
+#endif
+}
+
+static inline simd4f simd_abs(simd4f a)
+{
+    return simd_max(a, simd_sub(simd_splat(0.0f), a));
+}
+
+static inline simd4f simd_div(simd4f a, simd4f b)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_div_ps(a, b);
+#elif defined(CGLTF_SIMD_NEON) && defined(__aarch64__)
+    return vdivq_f32(a, b);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_f32x4_div(a, b);
+#else
+    float x[4], y[4];
+    simd_store(x, a);
+    simd_store(y, b);
+    return simd_set(x[0] / y[0], x[1] / y[1], x[2] / y[2], x[3] / y[3]);
+#endif
+}
+
+static inline simd4f simd_sqrt(simd4f a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_sqrt_ps(a);
+#elif defined(CGLTF_SIMD_NEON) && defined(__aarch64__)
+    return vsqrtq_f32(a);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_f32x4_sqrt(a);
+#else
+    float x[4];
+    simd_store(x, a);
+    return simd_set(sqrtf(x[0]), sqrtf(x[1]), sqrtf(x[2]), sqrtf(x[3]));
+#endif
+}
+
+// +1 or -1 with the sign bit of a
+static inline simd4f simd_sign(simd4f a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_or_ps(_mm_and_ps(a, _mm_set1_ps(-0.0f)), _mm_set1_ps(1.0f));
+#elif defined(CGLTF_SIMD_NEON)
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x80000000u));
+    return vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(1.0f))));
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_v128_or(wasm_v128_and(a, wasm_f32x4_splat(-0.0f)), wasm_f32x4_splat(1.0f));
+#else
+    float x[4];
+    simd_store(x, a);
+    return simd_set(copysignf(1.0f, x[0]), copysignf(1.0f, x[1]), copysignf(1.0f, x[2]), copysignf(1.0f, x[3]));
+#endif
+}
+
+// Horizontal max of the first three lanes
+static inline float simd_hmax3(simd4f a)
+{
+    float tmp[4];
+    simd_store(tmp, a);
+    float m = tmp[0] > tmp[1] ? tmp[0] : tmp[1];
+    return m > tmp[2] ? m : tmp[2];
+}
+
+// (y, x, w, z): swaps the two floats of each pair, for interleaved xy data
+static inline simd4f simd_swap_pairs(simd4f a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+#elif defined(CGLTF_SIMD_NEON)
+    return vrev64q_f32(a);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_i32x4_shuffle(a, a, 1, 0, 3, 2);
+#else
+    simd4f r = {{ a.v[1], a.v[0], a.v[3], a.v[2] }};
+    return r;
+#endif
+}
+
+// Transposes the 4x4 matrix with rows a, b, c, d, for switching between one vector per item and
+// one item per lane
+static inline void simd_transpose(simd4f &a, simd4f &b, simd4f &c, simd4f &d)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+#elif defined(CGLTF_SIMD_NEON)
+    float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d);
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+#elif defined(CGLTF_SIMD_WASM)
+    v128_t t0 = wasm_i32x4_shuffle(a, b, 0, 4, 1, 5), t1 = wasm_i32x4_shuffle(a, b, 2, 6, 3, 7);
+    v128_t t2 = wasm_i32x4_shuffle(c, d, 0, 4, 1, 5), t3 = wasm_i32x4_shuffle(c, d, 2, 6, 3, 7);
+    a = wasm_i32x4_shuffle(t0, t2, 0, 1, 4, 5);
+    b = wasm_i32x4_shuffle(t0, t2, 2, 3, 6, 7);
+    c = wasm_i32x4_shuffle(t1, t3, 0, 1, 4, 5);
+    d = wasm_i32x4_shuffle(t1, t3, 2, 3, 6, 7);
+#else
+    simd4f r[4] = { a, b, c, d };
+    simd4f t[4];
+    for(int i=0; i<4; i++) {
+        for(int j=0; j<4; j++) t[i].v[j] = r[j].v[i];
+    }
+    a = t[0]; b = t[1]; c = t[2]; d = t[3];
+#endif
+}
+
+// 4 x uint32 lanes, one RGBA8 pixel each (unaligned loads and stores)
+#if defined(CGLTF_SIMD_SSE2)
+typedef __m128i simd4i;
+#elif defined(CGLTF_SIMD_NEON)
+typedef uint32x4_t simd4i;
+#elif defined(CGLTF_SIMD_WASM)
+typedef v128_t simd4i;
+#else
+struct simd4i { uint32_t v[4]; };
+#endif
+
+static inline simd4i simd_loadi(const void *p)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_loadu_si128((const __m128i *)p);
+#elif defined(CGLTF_SIMD_NEON)
+    return vreinterpretq_u32_u8(vld1q_u8((const uint8_t *)p));
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_v128_load(p);
+#else
+    simd4i r;
+    memcpy(r.v, p, sizeof(r.v));
+    return r;
+#endif
+}
+
+static inline void simd_storei(void *p, simd4i a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    _mm_storeu_si128((__m128i *)p, a);
+#elif defined(CGLTF_SIMD_NEON)
+    vst1q_u8((uint8_t *)p, vreinterpretq_u8_u32(a));
+#elif defined(CGLTF_SIMD_WASM)
+    wasm_v128_store(p, a);
+#else
+    memcpy(p, a.v, sizeof(a.v));
+#endif
+}
+
+static inline simd4i simd_splati(uint32_t x)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_set1_epi32((int)x);
+#elif defined(CGLTF_SIMD_NEON)
+    return vdupq_n_u32(x);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_i32x4_splat((int)x);
+#else
+    simd4i r = {{ x, x, x, x }};
+    return r;
+#endif
+}
+
+static inline simd4i simd_andi(simd4i a, simd4i b)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_and_si128(a, b);
+#elif defined(CGLTF_SIMD_NEON)
+    return vandq_u32(a, b);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_v128_and(a, b);
+#else
+    simd4i r = {{ a.v[0] & b.v[0], a.v[1] & b.v[1], a.v[2] & b.v[2], a.v[3] & b.v[3] }};
+    return r;
+#endif
+}
+
+static inline simd4i simd_ori(simd4i a, simd4i b)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_or_si128(a, b);
+#elif defined(CGLTF_SIMD_NEON)
+    return vorrq_u32(a, b);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_v128_or(a, b);
+#else
+    simd4i r = {{ a.v[0] | b.v[0], a.v[1] | b.v[1], a.v[2] | b.v[2], a.v[3] | b.v[3] }};
+    return r;
+#endif
+}
+
+// Logical shifts of every lane by n bits
+static inline simd4i simd_shri(simd4i a, int n)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_srli_epi32(a, n);
+#elif defined(CGLTF_SIMD_NEON)
+    return vshlq_u32(a, vdupq_n_s32(-n));
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_u32x4_shr(a, n);
+#else
+    simd4i r = {{ a.v[0] >> n, a.v[1] >> n, a.v[2] >> n, a.v[3] >> n }};
+    return r;
+#endif
+}
+
+static inline simd4i simd_shli(simd4i a, int n)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_slli_epi32(a, n);
+#elif defined(CGLTF_SIMD_NEON)
+    return vshlq_u32(a, vdupq_n_s32(n));
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_i32x4_shl(a, n);
+#else
+    simd4i r = {{ a.v[0] << n, a.v[1] << n, a.v[2] << n, a.v[3] << n }};
+    return r;
+#endif
+}
+
+// Lanes to float. Only for values below 2^31.
+static inline simd4f simd_itof(simd4i a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_cvtepi32_ps(a);
+#elif defined(CGLTF_SIMD_NEON)
+    return vcvtq_f32_u32(a);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_f32x4_convert_i32x4(a);
+#else
+    return simd_set((float)a.v[0], (float)a.v[1], (float)a.v[2], (float)a.v[3]);
+#endif
+}
+
+// Truncates to integer lanes. Only for values in [0, 2^31).
+static inline simd4i simd_ftoi(simd4f a)
+{
+#if defined(CGLTF_SIMD_SSE2)
+    return _mm_cvttps_epi32(a);
+#elif defined(CGLTF_SIMD_NEON)
+    return vcvtq_u32_f32(a);
+#elif defined(CGLTF_SIMD_WASM)
+    return wasm_i32x4_trunc_sat_f32x4(a);
+#else
+    simd4i r = {{ (uint32_t)a.v[0], (uint32_t)a.v[1], (uint32_t)a.v[2], (uint32_t)a.v[3] }};
+    return r;
+#endif
+}
+
+#endif
@@ -0,0 +1,601 @@
+// skinning.cpp
+// Skin joint palettes from an animated pose.
+//   For each skin, the joints and every node above them are put in parent first order once, with
+//   the inverse bind matrices unpacked. A palette then walks that list: each node's local matrix
+//   from the pose (animation.cpp), times its parent's world matrix, and each joint's world matrix
+//   times its inverse bind matrix. Matrices are column major and multiplied 4 floats at a time.
+//   A palette entry is the top three rows of the joint matrix (the last row is 0 0 0 1), 12 floats,
+//   so a shader or CPU skinning reads v' = (dot(row0, v), dot(row1, v), dot(row2, v)).
+// CPU skinning, for materials without vertex shader skinning: a primitive's positions, normals,
+//   JOINTS_0 and WEIGHTS_0 are unpacked once (positions and normals as x[], y[], z[]). Each frame
+//   4 vertices at a time blend their joint rows and transform one vertex per SIMD lane. The
+//   results are then written through the index list into the mesh's unindexed vertex buffer.
+//   Large meshes can be split over the worker threads.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+#include "jobs.h"
+
+#include <string.h>
+#include <map>
+#include <algorithm>
+#include <chrono>
+
+#define PALETTE_STREAM          "palette"
+#define SKIN_JOB_VERTICES       8192    // vertices per job when skinning on the worker threads
+
+struct SkinJoints
+{
+    std::vector<int>        nodes;          // joints and their ancestors, parents first
+    std::vector<int>        parents;        // per node, into nodes (-1 at a root)
+    std::vector<int>        joints;         // per joint, into nodes
+    std::vector<float>      inverse_bind;   // 16 per joint
+    std::vector<float>      world;          // 16 per node, scratch
+};
+
+struct SkinModel
+{
+    std::vector<SkinJoints> skins;
+};
+
+// A skinned primitive's vertex data. Arrays are padded to a multiple of 4 vertices.
+struct SkinMesh
+{
+    uint32_t                vertices;
+    uint32_t                padded;
+    std::vector<float>      position;   // x[], y[], z[]
+    std::vector<float>      normal;     // x[], y[], z[], empty without normals
+    std::vector<uint16_t>   joints;     // 4 per vertex
+    std::vector<float>      weights;    // 4 per vertex, summing to 1
+    std::vector<uint32_t>   indices;    // source vertex of each vertex in the mesh buffer
+    int                     max_joint;
+    std::vector<float>      skinned;    // 8 per vertex: position xyz_, normal xyz_
+    const float *           source_position;    // what this pass skins: position and normal, or
+    const float *           source_normal;      // a morph target blend (morph.cpp)
+};
+
+static std::map<cgltf_data*, SkinModel*>   skin_models;
+static std::map<const cgltf_primitive*, SkinMesh*> skin_meshes;
+
+static void LoadSkin(cgltf_data *data, const cgltf_skin *skin, SkinJoints &out)
+{
+    // Depth of every node a joint needs
+    std::vector<int> depth(data->nodes_count, -1);
+    for(cgltf_size j=0; j<skin->joints_count; j++) {
+        for(const cgltf_node *node = skin->joints[j]; node && depth[cgltf_node_index(data, node)] < 0; node = node->parent) {
+            int d = 0;
+            for(const cgltf_node *p = node->parent; p; p = p->parent) d++;
+            depth[cgltf_node_index(data, node)] = d;
+        }
+    }
+    std::vector<std::pair<int, int> > order;
+    for(cgltf_size n=0; n<data->nodes_count; n++) {
+        if(depth[n] >= 0) order.push_back(std::make_pair(depth[n], (int)n));
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<int> slot(data->nodes_count, -1);
+    for(size_t i=0; i<order.size(); i++) {
+        int n = order[i].second;
+        const cgltf_node *parent = data->nodes[n].parent;
+        slot[n] = (int)i;
+        out.nodes.push_back(n);
+        out.parents.push_back(parent ? slot[cgltf_node_index(data, parent)] : -1);
+    }
+    out.world.resize(out.nodes.size() * 16);
+
+    out.inverse_bind.resize(skin->joints_count * 16);
+    for(cgltf_size j=0; j<skin->joints_count; j++) {
+        out.joints.push_back(slot[cgltf_node_index(data, skin->joints[j])]);
+        float *m = &out.inverse_bind[j * 16];
+        if(skin->inverse_bind_matrices == nullptr || !cgltf_accessor_read_float(skin->inverse_bind_matrices, j, m, 16)) {
+            memset(m, 0, 16 * sizeof(float));
+            m[0] = m[5] = m[10] = m[15] = 1.0f;
+        }
+    }
+}
+
+static SkinModel *GetSkinModel(cgltf_data *data)
+{
+    std::map<cgltf_data*, SkinModel*>::iterator it = skin_models.find(data);
+    if(it != skin_models.end()) return it->second;
+    SkinModel *model = new SkinModel;
+    model->skins.resize(data->skins_count);
+    for(cgltf_size s=0; s<data->skins_count; s++) LoadSkin(data, &data->skins[s], model->skins[s]);
+    skin_models[data] = model;
+    return model;
+}
+
+void SkinFree(cgltf_data *data)
+{
+    for(cgltf_size m=0; m<data->meshes_count && !skin_meshes.empty(); m++) {
+        for(cgltf_size p=0; p<data->meshes[m].primitives_count; p++) {
+            std::map<const cgltf_primitive*, SkinMesh*>::iterator mesh = skin_meshes.find(&data->meshes[m].primitives[p]);
+            if(mesh == skin_meshes.end()) continue;
+            delete mesh->second;
+            skin_meshes.erase(mesh);
+        }
+    }
+    std::map<cgltf_data*, SkinModel*>::iterator it = skin_models.find(data);
+    if(it == skin_models.end()) return;
+    delete it->second;
+    skin_models.erase(it);
+}
+
+// Column major matrix of a pose entry (translation, rotation xyzw, scale)
+static void TRSMatrix(const float *trs, float *m)
+{
+    float x = trs[3], y = trs[4], z = trs[5], w = trs[6];
+    float sx = trs[7], sy = trs[8], sz = trs[9];
+    m[0] = (1.0f - 2.0f * (y * y + z * z)) * sx;
+    m[1] = 2.0f * (x * y + w * z) * sx;
+    m[2] = 2.0f * (x * z - w * y) * sx;
+    m[3] = 0.0f;
+    m[4] = 2.0f * (x * y - w * z) * sy;
+    m[5] = (1.0f - 2.0f * (x * x + z * z)) * sy;
+    m[6] = 2.0f * (y * z + w * x) * sy;
+    m[7] = 0.0f;
+    m[8] = 2.0f * (x * z + w * y) * sz;
+    m[9] = 2.0f * (y * z - w * x) * sz;
+    m[10] = (1.0f - 2.0f * (x * x + y * y)) * sz;
+    m[11] = 0.0f;
+    m[12] = trs[0];
+    m[13] = trs[1];
+    m[14] = trs[2];
+    m[15] = 1.0f;
+}
+
+// out = a * b (column major, out may not be a or b)
+static void MatMul(const float *a, const float *b, float *out)
+{
+    simd4f a0 = simd_load(a), a1 = simd_load(a + 4), a2 = simd_load(a + 8), a3 = simd_load(a + 12);
+    for(int c=0; c<4; c++) {
+        const float *bc = b + c * 4;
+        simd4f r = simd_mul(a0, simd_splat(bc[0]));
+        r = simd_madd(a1, simd_splat(bc[1]), r);
+        r = simd_madd(a2, simd_splat(bc[2]), r);
+        simd_store(out + c * 4, simd_madd(a3, simd_splat(bc[3]), r));
+    }
+}
+
+// Joint matrices of skin for a pose, PALETTE_STRIDE floats per joint
+static void ComputePalette(SkinJoints &skin, const float *trs, float *palette)
+{
+    float local[16], joint[16];
+    for(size_t i=0; i<skin.nodes.size(); i++) {
+        float *world = &skin.world[i * 16];
+        if(skin.parents[i] < 0) {
+            TRSMatrix(trs + skin.nodes[i] * POSE_STRIDE, world);
+            continue;
+        }
+        TRSMatrix(trs + skin.nodes[i] * POSE_STRIDE, local);
+        MatMul(&skin.world[skin.parents[i] * 16], local, world);
+    }
+    for(size_t j=0; j<skin.joints.size(); j++) {
+        MatMul(&skin.world[skin.joints[j] * 16], &skin.inverse_bind[j * 16], joint);
+        float *row = palette + j * PALETTE_STRIDE;
+        for(int r=0; r<3; r++) {
+            row[r * 4 + 0] = joint[r];
+            row[r * 4 + 1] = joint[4 + r];
+            row[r * 4 + 2] = joint[8 + r];
+            row[r * 4 + 3] = joint[12 + r];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// CPU skinning
+
+// Unpacks a float attribute (sparse too) as count x[], y[], z[] arrays, each padded
+bool UnpackSoA3(const cgltf_accessor *acc, uint32_t count, uint32_t padded, std::vector<float> &out)
+{
+    if(acc == nullptr || acc->count != count || cgltf_num_components(acc->type) != 3) return false;
+    std::vector<float> xyz(count * 3);
+    if(cgltf_accessor_unpack_floats(acc, xyz.data(), count * 3) != count * 3) return false;
+    out.assign(padded * 3, 0.0f);
+    for(uint32_t v=0; v<count; v++) {
+        for(int c=0; c<3; c++) out[c * padded + v] = xyz[v * 3 + c];
+    }
+    return true;
+}
+
+static SkinMesh *LoadSkinMesh(const cgltf_primitive *prim)
+{
+    const cgltf_accessor *position = nullptr, *normal = nullptr, *joints = nullptr, *weights = nullptr;
+    for(cgltf_size a=0; a<prim->attributes_count; a++) {
+        const cgltf_attribute &attr = prim->attributes[a];
+        if(attr.type == cgltf_attribute_type_position) position = attr.data;
+        else if(attr.type == cgltf_attribute_type_normal) normal = attr.data;
+        else if(attr.type == cgltf_attribute_type_joints && attr.index == 0) joints = attr.data;
+        else if(attr.type == cgltf_attribute_type_weights && attr.index == 0) weights = attr.data;
+    }
+    if(position == nullptr || joints == nullptr || weights == nullptr || joints->count != position->count || weights->count != position->count) {
+        printf("[Error] Skinning: primitive needs POSITION, JOINTS_0 and WEIGHTS_0\n");
+        return nullptr;
+    }
+
+    SkinMesh *mesh = new SkinMesh;
+    mesh->vertices = (uint32_t)position->count;
+    mesh->padded = (mesh->vertices + 3) & ~3u;
+    bool ok = UnpackSoA3(position, mesh->vertices, mesh->padded, mesh->position);
+    if(ok && normal && !UnpackSoA3(normal, mesh->vertices, mesh->padded, mesh->normal)) mesh->normal.clear();
+
+    // Padding vertices take joint 0 at full weight
+    mesh->joints.assign(mesh->padded * 4, 0);
+    mesh->weights.assign(mesh->padded * 4, 0.0f);
+    mesh->max_joint = 0;
+    for(uint32_t v=0; ok && v<mesh->padded; v++) {
+        float *w = &mesh->weights[v * 4];
+        if(v >= mesh->vertices) {
+            w[0] = 1.0f;
+            continue;
+        }
+        cgltf_uint j[4] = { 0, 0, 0, 0 };
+        ok = cgltf_accessor_read_uint(joints, v, j, 4) && cgltf_accessor_read_float(weights, v, w, 4);
+        float sum = w[0] + w[1] + w[2] + w[3];
+        for(int k=0; k<4; k++) {
+            w[k] = sum > 0.0f ? w[k] / sum : (k == 0 ? 1.0f : 0.0f);
+            mesh->joints[v * 4 + k] = (uint16_t)(w[k] > 0.0f ? j[k] : 0);
+            mesh->max_joint = std::max(mesh->max_joint, (int)mesh->joints[v * 4 + k]);
+        }
+    }
+
+    if(prim->indices) {
+        mesh->indices.resize(prim->indices->count);
+        for(cgltf_size i=0; i<prim->indices->count; i++) {
+            cgltf_size index = cgltf_accessor_read_index(prim->indices, i);
+            ok = ok && index < mesh->vertices;
+            mesh->indices[i] = (uint32_t)index;
+        }
+    }
+    else {
+        mesh->indices.resize(mesh->vertices);
+        for(uint32_t v=0; v<mesh->vertices; v++) mesh->indices[v] = v;
+    }
+    if(!ok) {
+        printf("[Error] Skinning: could not read the primitive's vertices\n");
+        delete mesh;
+        return nullptr;
+    }
+    mesh->skinned.resize(mesh->padded * 8);
+    mesh->source_position = mesh->position.data();
+    mesh->source_normal = mesh->normal.empty() ? nullptr : mesh->normal.data();
+    return mesh;
+}
+
+static SkinMesh *GetSkinMesh(const cgltf_primitive *prim)
+{
+    std::map<const cgltf_primitive*, SkinMesh*>::iterator it = skin_meshes.find(prim);
+    if(it != skin_meshes.end()) return it->second;
+    SkinMesh *mesh = LoadSkinMesh(prim);
+    if(mesh) skin_meshes[prim] = mesh;
+    return mesh;
+}
+
+// Skins vertices [first, last) (multiples of 4) into mesh.skinned
+static void SkinVertices(SkinMesh &mesh, const float *palette, uint32_t first, uint32_t last)
+{
+    uint32_t n = mesh.padded;
+    bool normals = !mesh.normal.empty();
+    const float *px = mesh.source_position, *py = px + n, *pz = py + n;
+    const float *nx0 = mesh.source_normal;
+    float *out = &mesh.skinned[0];
+    simd4f zero = simd_splat(0.0f);
+    for(uint32_t v=first; v<last; v+=4) {
+        // Weighted joint rows of each vertex, transposed to one vertex per lane
+        simd4f rows[3][4];
+        for(int l=0; l<4; l++) {
+            const uint16_t *j = &mesh.joints[(v + l) * 4];
+            const float *w = &mesh.weights[(v + l) * 4];
+            const float *p = palette + j[0] * PALETTE_STRIDE;
+            simd4f w0 = simd_splat(w[0]);
+            simd4f r0 = simd_mul(simd_load(p), w0), r1 = simd_mul(simd_load(p + 4), w0), r2 = simd_mul(simd_load(p + 8), w0);
+            for(int k=1; k<4; k++) {
+                if(w[k] == 0.0f) continue;
+                p = palette + j[k] * PALETTE_STRIDE;
+                simd4f wk = simd_splat(w[k]);
+                r0 = simd_madd(simd_load(p), wk, r0);
+                r1 = simd_madd(simd_load(p + 4), wk, r1);
+                r2 = simd_madd(simd_load(p + 8), wk, r2);
+            }
+            rows[0][l] = r0;
+            rows[1][l] = r1;
+            rows[2][l] = r2;
+        }
+        simd4f m[12];
+        for(int r=0; r<3; r++) {
+            simd_transpose(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+            for(int c=0; c<4; c++) m[r * 4 + c] = rows[r][c];
+        }
+
+        // Positions and normals come back to one vertex per vector, for the scattered writes
+        simd4f x = simd_load(px + v), y = simd_load(py + v), z = simd_load(pz + v);
+        simd4f sx = simd_madd(m[0], x, simd_madd(m[1], y, simd_madd(m[2], z, m[3])));
+        simd4f sy = simd_madd(m[4], x, simd_madd(m[5], y, simd_madd(m[6], z, m[7])));
+        simd4f sz = simd_madd(m[8], x, simd_madd(m[9], y, simd_madd(m[10], z, m[11])));
+        simd4f sw = zero;
+        simd_transpose(sx, sy, sz, sw);
+        simd_store(out + v * 8, sx);
+        simd_store(out + v * 8 + 8, sy);
+        simd_store(out + v * 8 + 16, sz);
+        simd_store(out + v * 8 + 24, sw);
+        if(!normals) continue;
+
+        x = simd_load(nx0 + v);
+        y = simd_load(nx0 + n + v);
+        z = simd_load(nx0 + 2 * n + v);
+        simd4f nx = simd_madd(m[0], x, simd_madd(m[1], y, simd_mul(m[2], z)));
+        simd4f ny = simd_madd(m[4], x, simd_madd(m[5], y, simd_mul(m[6], z)));
+        simd4f nz = simd_madd(m[8], x, simd_madd(m[9], y, simd_mul(m[10], z)));
+        simd4f len = simd_max(simd_sqrt(simd_madd(nx, nx, simd_madd(ny, ny, simd_mul(nz, nz)))), simd_splat(1e-20f));
+        simd4f inv = simd_div(simd_splat(1.0f), len);
+        nx = simd_mul(nx, inv);
+        ny = simd_mul(ny, inv);
+        nz = simd_mul(nz, inv);
+        simd4f nw = zero;
+        simd_transpose(nx, ny, nz, nw);
+        simd_store(out + v * 8 + 4, nx);
+        simd_store(out + v * 8 + 12, ny);
+        simd_store(out + v * 8 + 20, nz);
+        simd_store(out + v * 8 + 28, nw);
+    }
+}
+
+// Writes mesh buffer vertices [first, last) from the skinned source vertices
+static void WriteSkinned(const SkinMesh &mesh, uint32_t first, uint32_t last, float *position, uint32_t position_stride, float *normal, uint32_t normal_stride)
+{
+    const float *s = mesh.skinned.data();
+    for(uint32_t i=first; i<last; i++) {
+        const float *v = s + mesh.indices[i] * 8;
+        float *p = position + i * position_stride;
+        p[0] = v[0];
+        p[1] = v[1];
+        p[2] = v[2];
+        if(normal == nullptr) continue;
+        float *q = normal + i * normal_stride;
+        q[0] = v[4];
+        q[1] = v[5];
+        q[2] = v[6];
+    }
+}
+
+struct SkinJob
+{
+    SkinMesh *          mesh;
+    const float *       palette;
+    uint32_t            first;
+    uint32_t            last;
+    // Mesh buffer streams, written from first to last by WriteSkinnedJob
+    float *             position;
+    uint32_t            position_stride;
+    float *             normal;
+    uint32_t            normal_stride;
+};
+
+static void SkinVerticesJob(void *ctx)
+{
+    SkinJob *job = (SkinJob *)ctx;
+    SkinVertices(*job->mesh, job->palette, job->first, job->last);
+}
+
+static void WriteSkinnedJob(void *ctx)
+{
+    SkinJob *job = (SkinJob *)ctx;
+    WriteSkinned(*job->mesh, job->first, job->last, job->position, job->position_stride, job->normal, job->normal_stride);
+}
+
+// Skins the mesh into the buffer streams, over the worker threads when threaded and large
+static void SkinMeshToStreams(SkinMesh &mesh, const float *palette, float *position, uint32_t position_stride, float *normal, uint32_t normal_stride, bool threaded)
+{
+    uint32_t outputs = (uint32_t)mesh.indices.size();
+    if(mesh.normal.empty()) normal = nullptr;
+    if(!threaded || mesh.padded <= SKIN_JOB_VERTICES) {
+        SkinVertices(mesh, palette, 0, mesh.padded);
+        WriteSkinned(mesh, 0, outputs, position, position_stride, normal, normal_stride);
+        return;
+    }
+
+    std::vector<SkinJob> jobs;
+    for(uint32_t first=0; first<mesh.padded; first+=SKIN_JOB_VERTICES) {
+        SkinJob job = { &mesh, palette, first, std::min(first + SKIN_JOB_VERTICES, mesh.padded), position, position_stride, normal, normal_stride };
+        jobs.push_back(job);
+    }
+    JobBatch *batch = JobBatchNew();
+    for(size_t j=0; j<jobs.size(); j++) JobBatchAdd(batch, SkinVerticesJob, &jobs[j]);
+    JobBatchWait(batch);
+
+    // The mesh buffer in the same number of pieces
+    uint32_t per_job = (outputs + (uint32_t)jobs.size() - 1) / (uint32_t)jobs.size();
+    for(size_t j=0; j<jobs.size(); j++) {
+        jobs[j].first = std::min((uint32_t)j * per_job, outputs);
+        jobs[j].last = std::min(jobs[j].first + per_job, outputs);
+        JobBatchAdd(batch, WriteSkinnedJob, &jobs[j]);
+    }
+    JobBatchWait(batch);
+    JobBatchDelete(batch);
+}
+
+// Scalar reference for SkinVertices: one vertex at a time, no SIMD. Only used by skin_benchmark.
+static void SkinVerticesScalar(SkinMesh &mesh, const float *palette, uint32_t first, uint32_t last)
+{
+    uint32_t n = mesh.padded;
+    bool normals = !mesh.normal.empty();
+    const float *pos = mesh.source_position, *nrm = mesh.source_normal;
+    float *out = &mesh.skinned[0];
+    for(uint32_t v=first; v<last; v++) {
+        float m[12] = { 0 };
+        for(int k=0; k<4; k++) {
+            float w = mesh.weights[v * 4 + k];
+            if(w == 0.0f) continue;
+            const float *p = palette + mesh.joints[v * 4 + k] * PALETTE_STRIDE;
+            for(int e=0; e<12; e++) m[e] += w * p[e];
+        }
+        float *o = out + v * 8;
+        float x = pos[v], y = pos[n + v], z = pos[2 * n + v];
+        for(int r=0; r<3; r++) o[r] = m[r * 4] * x + m[r * 4 + 1] * y + m[r * 4 + 2] * z + m[r * 4 + 3];
+        o[3] = 0.0f;
+        if(!normals) continue;
+        x = nrm[v]; y = nrm[n + v]; z = nrm[2 * n + v];
+        float len = 0.0f;
+        for(int r=0; r<3; r++) {
+            o[4 + r] = m[r * 4] * x + m[r * 4 + 1] * y + m[r * 4 + 2] * z;
+            len += o[4 + r] * o[4 + r];
+        }
+        float inv = 1.0f / std::max(sqrtf(len), 1e-20f);
+        for(int r=0; r<3; r++) o[4 + r] *= inv;
+        o[7] = 0.0f;
+    }
+}
+
+// Skin by index (a number, 0 based) or cgltf_skin pointer (node.skin)
+static int CheckSkin(lua_State *L, cgltf_data *data, int index)
+{
+    lua_Integer skin = -1;
+    if(lua_islightuserdata(L, index)) {
+        cgltf_skin *ptr = (cgltf_skin *)lua_touserdata(L, index);
+        if(ptr) skin = (lua_Integer)cgltf_skin_index(data, ptr);
+    }
+    else skin = luaL_checkinteger(L, index);
+    if(skin < 0 || skin >= (lua_Integer)data->skins_count) {
+        return luaL_error(L, "skin: no skin %d", (int)skin);
+    }
+    return (int)skin;
+}
+
+// skin_palette(pose, skin [, buffer])
+//   The joint matrices of skin (node.skin, or its 0 based index) for the pose, in a buffer with a
+//   "palette" stream of 12 floats per joint: the top three rows of each matrix. Joints are in the
+//   skin's order, as JOINTS_0 indexes them. Pass the buffer from the last call to refill it.
+//   Returns the buffer and the joint count.
+int lib_skin_palette(lua_State *L)
+{
+    Pose *pose = (Pose *)lua_touserdata(L, 1);
+    if(pose == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    cgltf_data *data = pose->model->data;
+    SkinJoints &skin = GetSkinModel(data)->skins[CheckSkin(L, data, 2)];
+    uint32_t joints = (uint32_t)skin.joints.size();
+
+    dmBuffer::HBuffer buffer = 0;
+    if(!lua_isnoneornil(L, 3)) {
+        buffer = dmScript::CheckBufferUnpack(L, 3);
+        lua_pushvalue(L, 3);
+    }
+    else {
+        dmBuffer::StreamDeclaration decl[] = {
+            { dmHashString64(PALETTE_STREAM), dmBuffer::VALUE_TYPE_FLOAT32, PALETTE_STRIDE }
+        };
+        if(dmBuffer::Create(joints > 0 ? joints : 1, decl, 1, &buffer) != dmBuffer::RESULT_OK) {
+            printf("[Error] skin_palette: could not create buffer (%u joints)\n", joints);
+            lua_pushnil(L);
+            return 1;
+        }
+        dmScript::LuaHBuffer luabuf(buffer, dmScript::OWNER_LUA);
+        dmScript::PushBuffer(L, luabuf);
+    }
+
+    float *out = nullptr;
+    uint32_t count = 0, components = 0, stride = 0;
+    if(dmBuffer::GetStream(buffer, dmHashString64(PALETTE_STREAM), (void **)&out, &count, &components, &stride) != dmBuffer::RESULT_OK
+        || components != PALETTE_STRIDE || stride != PALETTE_STRIDE || count < joints) {
+        return luaL_error(L, "skin_palette: buffer needs a palette stream of %d floats for %u joints", PALETTE_STRIDE, joints);
+    }
+    ComputePalette(skin, pose->trs.data(), out);
+    lua_pushinteger(L, joints);
+    return 2;
+}
+
+// skin_primitive(prim, palette, buffer [, threaded])
+//   Skins the primitive (prim.addr, or its last morph_primitive blend) with a palette from
+//   skin_palette, writing the "position" and (when both have them) "normal" streams of buffer.
+//   The buffer is the primitive's mesh buffer: one vertex per index, or per vertex without
+//   indices. Skinned positions are in the space of the skeleton's root, so the mesh object should
+//   have no transform of its own. threaded splits large meshes over the worker threads. Returns the number of vertices written.
+int lib_skin_primitive(lua_State *L)
+{
+    const cgltf_primitive *prim = (const cgltf_primitive *)lua_touserdata(L, 1);
+    SkinMesh *mesh = prim ? GetSkinMesh(prim) : nullptr;
+    if(mesh == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    dmBuffer::HBuffer palette_buffer = dmScript::CheckBufferUnpack(L, 2);
+    dmBuffer::HBuffer buffer = dmScript::CheckBufferUnpack(L, 3);
+    bool threaded = lua_toboolean(L, 4);
+
+    float *palette = nullptr;
+    uint32_t joints = 0, components = 0, stride = 0;
+    if(dmBuffer::GetStream(palette_buffer, dmHashString64(PALETTE_STREAM), (void **)&palette, &joints, &components, &stride) != dmBuffer::RESULT_OK
+        || components != PALETTE_STRIDE || stride != PALETTE_STRIDE) {
+        return luaL_error(L, "skin_primitive: no palette stream of %d floats", PALETTE_STRIDE);
+    }
+    if(mesh->max_joint >= (int)joints) {
+        return luaL_error(L, "skin_primitive: the palette has %u joints, the primitive uses %d", joints, mesh->max_joint + 1);
+    }
+
+    float *position = nullptr, *normal = nullptr;
+    uint32_t count = 0, position_stride = 0, normal_stride = 0;
+    if(dmBuffer::GetStream(buffer, dmHashString64("position"), (void **)&position, &count, &components, &position_stride) != dmBuffer::RESULT_OK
+        || components != 3 || count != mesh->indices.size()) {
+        return luaL_error(L, "skin_primitive: buffer needs a position stream of %u vertices", (uint32_t)mesh->indices.size());
+    }
+    if(!mesh->normal.empty()) {
+        uint32_t normal_count = 0;
+        if(dmBuffer::GetStream(buffer, dmHashString64("normal"), (void **)&normal, &normal_count, &components, &normal_stride) != dmBuffer::RESULT_OK
+            || components != 3 || normal_count != count) {
+            normal = nullptr;
+        }
+    }
+
+    mesh->source_position = mesh->position.data();
+    mesh->source_normal = mesh->normal.empty() ? nullptr : mesh->normal.data();
+    MorphedVertices(prim, &mesh->source_position, &mesh->source_normal);
+    SkinMeshToStreams(*mesh, palette, position, position_stride, normal, normal_stride, threaded);
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+// skin_benchmark(prim, palette [, iterations])
+//   Times skinning the primitive's vertices with the palette, iterations times (default 1000), with
+//   the SIMD kernel and with a scalar one vertex at a time reference. Only the skinning itself is
+//   timed, not the writes to a mesh buffer. Returns the average microseconds per call of each, and
+//   the largest difference between their positions.
+int lib_skin_benchmark(lua_State *L)
+{
+    const cgltf_primitive *prim = (const cgltf_primitive *)lua_touserdata(L, 1);
+    SkinMesh *mesh = prim ? GetSkinMesh(prim) : nullptr;
+    if(mesh == nullptr) {
+        lua_pushnil(L);
+        return 1;
+    }
+    dmBuffer::HBuffer palette_buffer = dmScript::CheckBufferUnpack(L, 2);
+    int iterations = (int)luaL_optinteger(L, 3, 1000);
+    if(iterations < 1) iterations = 1;
+
+    float *palette = nullptr;
+    uint32_t joints = 0, components = 0, stride = 0;
+    if(dmBuffer::GetStream(palette_buffer, dmHashString64(PALETTE_STREAM), (void **)&palette, &joints, &components, &stride) != dmBuffer::RESULT_OK
+        || components != PALETTE_STRIDE || stride != PALETTE_STRIDE || mesh->max_joint >= (int)joints) {
+        return luaL_error(L, "skin_benchmark: no palette stream of %d floats for %d joints", PALETTE_STRIDE, mesh->max_joint + 1);
+    }
+
+    mesh->source_position = mesh->position.data();
+    mesh->source_normal = mesh->normal.empty() ? nullptr : mesh->normal.data();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i=0; i<iterations; i++) SkinVerticesScalar(*mesh, palette, 0, mesh->vertices);
+    std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+    std::vector<float> reference(mesh->skinned);
+    for(int i=0; i<iterations; i++) SkinVertices(*mesh, palette, 0, mesh->padded);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    float error = 0.0f;
+    for(uint32_t v=0; v<mesh->vertices; v++) {
+        for(int c=0; c<3; c++) error = std::max(error, fabsf(mesh->skinned[v * 8 + c] - reference[v * 8 + c]));
+    }
+    lua_pushnumber(L, std::chrono::duration<double, std::micro>(mid - start).count() / iterations);
+    lua_pushnumber(L, std::chrono::duration<double, std::micro>(end - mid).count() / iterations);
+    lua_pushnumber(L, error);
+    return 3;
+}
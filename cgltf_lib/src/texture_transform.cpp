@@ -0,0 +1,181 @@
+// texture_transform.cpp
+// KHR_texture_transform baked into the TEXCOORD data at load.
+//   A texture view's offset/rotation/scale is a 2x3 affine transform of its UV set. When every
+//   view that reads a TEXCOORD accessor (across all primitives and variant materials using it)
+//   has the same transform, the accessor's UVs are transformed once here and the views lose
+//   their transform, so shaders don't pay for it per fragment. UV sets read with different
+//   transforms are left alone, and their views keep the transform for the material.
+
+#include "cgltf_lib.h"
+#include "simd.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+
+struct UVUse
+{
+    cgltf_accessor *                accessor;
+    std::vector<cgltf_texture_view*> views;
+    bool                            conflict;   // read with more than one transform
+    bool                            baked;
+};
+
+static bool SameTransform(const cgltf_texture_view *a, const cgltf_texture_view *b)
+{
+    static const cgltf_texture_transform identity = { { 0.0f, 0.0f }, 0.0f, { 1.0f, 1.0f }, false, 0 };
+    const cgltf_texture_transform &ta = a->has_transform ? a->transform : identity;
+    const cgltf_texture_transform &tb = b->has_transform ? b->transform : identity;
+    return ta.offset[0] == tb.offset[0] && ta.offset[1] == tb.offset[1] && ta.rotation == tb.rotation
+        && ta.scale[0] == tb.scale[0] && ta.scale[1] == tb.scale[1];
+}
+
+// UV set a view reads, the transform's texCoord overrides the view's
+static int ViewTexcoord(const cgltf_texture_view *view)
+{
+    return view->has_transform && view->transform.has_texcoord ? view->transform.texcoord : view->texcoord;
+}
+
+// Row major 2x3: u' = m[0] u + m[1] v + m[2], v' = m[3] u + m[4] v + m[5]
+//   The spec's order is translation * rotation * scale.
+void TextureTransformMatrix(const cgltf_texture_transform &t, float *m)
+{
+    float c = cosf(t.rotation);
+    float s = sinf(t.rotation);
+    m[0] = c * t.scale[0];  m[1] = s * t.scale[1];  m[2] = t.offset[0];
+    m[3] = -s * t.scale[0]; m[4] = c * t.scale[1];  m[5] = t.offset[1];
+}
+
+// Transforms count interleaved uv pairs in place, two per simd4f
+static void TransformUVs(float *uvs, cgltf_size count, const float *m)
+{
+    simd4f diag = simd_set(m[0], m[4], m[0], m[4]);
+    simd4f cross = simd_set(m[1], m[3], m[1], m[3]);
+    simd4f offset = simd_set(m[2], m[5], m[2], m[5]);
+    cgltf_size i = 0;
+    for(; i + 2 <= count; i += 2) {
+        simd4f uv = simd_load(uvs + i * 2);
+        simd_store(uvs + i * 2, simd_madd(simd_swap_pairs(uv), cross, simd_madd(uv, diag, offset)));
+    }
+    for(; i < count; i++) {
+        float u = uvs[i * 2], v = uvs[i * 2 + 1];
+        uvs[i * 2] = m[0] * u + m[1] * v + m[2];
+        uvs[i * 2 + 1] = m[3] * u + m[4] * v + m[5];
+    }
+}
+
+static void AddMaterialUses(cgltf_primitive *prim, cgltf_material *mat, std::map<cgltf_accessor*, UVUse> &uses)
+{
+    if(mat == nullptr) return;
+    const cgltf_texture_view *views[MATERIAL_TEXTURE_VIEWS];
+    int count = MaterialTextureViews(mat, views);
+    for(int v=0; v<count; v++) {
+        cgltf_texture_view *view = const_cast<cgltf_texture_view *>(views[v]);
+        if(view->texture == nullptr) continue;
+        cgltf_accessor *acc = const_cast<cgltf_accessor *>(cgltf_find_accessor(prim, cgltf_attribute_type_texcoord, ViewTexcoord(view)));
+        if(acc == nullptr) continue;
+        UVUse &use = uses[acc];
+        use.accessor = acc;
+        if(!use.views.empty() && !SameTransform(use.views[0], view)) use.conflict = true;
+        use.views.push_back(view);
+    }
+}
+
+// A view can be baked into only if every accessor it reads (through any primitive) is bakeable
+static bool ViewBakeable(cgltf_texture_view *view, const std::map<cgltf_accessor*, UVUse> &uses)
+{
+    for(std::map<cgltf_accessor*, UVUse>::const_iterator it = uses.begin(); it != uses.end(); ++it) {
+        const UVUse &use = it->second;
+        if(!use.conflict) continue;
+        for(size_t v=0; v<use.views.size(); v++) {
+            if(use.views[v] == view) return false;
+        }
+    }
+    return true;
+}
+
+// Returns the number of accessors baked, remaining is set to the number of texture views that
+// still have a transform
+int BakeTextureTransforms(cgltf_data *data, int *remaining)
+{
+    std::map<cgltf_accessor*, UVUse> uses;
+    for(cgltf_size m=0; m<data->meshes_count; m++) {
+        for(cgltf_size p=0; p<data->meshes[m].primitives_count; p++) {
+            cgltf_primitive *prim = &data->meshes[m].primitives[p];
+            AddMaterialUses(prim, prim->material, uses);
+            for(cgltf_size v=0; v<prim->mappings_count; v++) AddMaterialUses(prim, prim->mappings[v].material, uses);
+        }
+    }
+
+    // Only accessors whose views all agree, and whose views don't also read a conflicting one
+    std::vector<UVUse*> bake;
+    for(std::map<cgltf_accessor*, UVUse>::iterator it = uses.begin(); it != uses.end(); ++it) {
+        UVUse &use = it->second;
+        if(use.conflict || !use.views[0]->has_transform) continue;
+        bool ok = use.accessor->type == cgltf_type_vec2;
+        for(size_t v=0; v<use.views.size() && ok; v++) ok = ViewBakeable(use.views[v], uses);
+        if(ok) bake.push_back(&use);
+    }
+
+    int baked = 0;
+    for(size_t b=0; b<bake.size(); b++) {
+        cgltf_accessor *acc = bake[b]->accessor;
+        cgltf_size floats = acc->count * 2;
+        float *uvs = (float *)malloc(floats * sizeof(float));
+        if(uvs == nullptr || cgltf_accessor_unpack_floats(acc, uvs, floats) != floats) {
+            free(uvs);
+            printf("[Error] Texture transform: cannot read texcoords\n");
+            continue;
+        }
+        float matrix[6];
+        TextureTransformMatrix(bake[b]->views[0]->transform, matrix);
+        TransformUVs(uvs, acc->count, matrix);
+
+        acc->buffer_view = AttachBufferView(data, uvs, floats * sizeof(float), cgltf_buffer_view_type_vertices);
+        acc->offset = 0;
+        acc->stride = 2 * sizeof(float);
+        acc->component_type = cgltf_component_type_r_32f;
+        acc->normalized = false;
+        acc->is_sparse = false;
+        acc->has_min = acc->has_max = false;
+        bake[b]->baked = true;
+        baked++;
+    }
+
+    // The baked views now read plain UVs (a second pass, views can share baked accessors)
+    for(size_t b=0; b<bake.size(); b++) {
+        if(!bake[b]->baked) continue;
+        for(size_t v=0; v<bake[b]->views.size(); v++) {
+            cgltf_texture_view *view = bake[b]->views[v];
+            if(!view->has_transform) continue;
+            view->texcoord = ViewTexcoord(view);
+            view->has_transform = false;
+        }
+    }
+
+    std::vector<cgltf_texture_view*> left;
+    for(std::map<cgltf_accessor*, UVUse>::iterator it = uses.begin(); it != uses.end(); ++it) {
+        for(size_t v=0; v<it->second.views.size(); v++) {
+            if(it->second.views[v]->has_transform) left.push_back(it->second.views[v]);
+        }
+    }
+    std::sort(left.begin(), left.end());
+    *remaining = (int)(std::unique(left.begin(), left.end()) - left.begin());
+    return baked;
+}
+
+// bake_texture_transforms(data)
+//   Bakes KHR_texture_transform into the UV accessors where possible (call once, after the
+//   buffers and any draco data are loaded). Returns the number of accessors baked and the
+//   number of texture views that still have a transform.
+int lib_bake_texture_transforms(lua_State *L)
+{
+    cgltf_data * data = (cgltf_data *)lua_touserdata(L, 1);
+    int remaining = 0;
+    int baked = data ? BakeTextureTransforms(data, &remaining) : 0;
+    lua_pushinteger(L, baked);
+    lua_pushinteger(L, remaining);
+    return 2;
+}
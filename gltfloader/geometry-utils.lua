@@ -57,6 +57,44 @@ function geom:makeGeom(name, prim, mesh)
 	go.set(prim.mesh_uri, "vertices", mesh.vbuf.buffer)
 end
 
+------------------------------------------------------------------------------------------------------------
+-- EXT_mesh_gpu_instancing: mesh components can't draw hardware instances from a buffer, so the set
+--   is baked natively into vertex buffers (the primitive once per instance), each drawn by one 
+--   component. A chunk holds at most MAX_BAKED_VERTICES vertices (at least one instance), so large
+--   sets become a few chunk objects instead of one huge buffer.
+geom.MAX_BAKED_VERTICES = 256 * 1024
+
+function geom:makeInstancedGeom(name, prim, mesh, instances, count)
+
+	local src = resource.get_buffer(mesh.vbuf.label)
+	local per_chunk = math.max(1, math.floor(geom.MAX_BAKED_VERTICES / math.max(mesh.vbuf.size, 1)))
+	prim.instance_geoms = {}
+	prim.instance_buffers = {}
+
+	for first = 1, count, per_chunk do 
+		local batched = cgltf.batch_instances(src, instances, first, per_chunk)
+		if(batched == nil) then break end
+
+		-- Named per node and chunk: nodes sharing a mesh have their own instance sets
+		local batch_name = string.format("/mesh_buffer_%s_inst%d.bufferc", name, #prim.instance_buffers)
+		local success = pcall(resource.get_buffer, batch_name)
+		if(success) then 
+			resource.set_buffer(batch_name, batched)
+		else
+			resource.create_buffer(batch_name, { buffer = batched })
+		end
+
+		-- The instance matrices are relative to the node, so the chunk takes the node's transform
+		local geo = factory.create(FACTORY_URI, prim.pos, prim.rot, nil, prim.scl)
+		go.set(msg.url(nil, geo, "mesh"), "vertices", hash(batch_name))
+		tinsert(prim.instance_buffers, batch_name)
+		tinsert(prim.instance_geoms, geo)
+	end
+
+	prim.geom = prim.instance_geoms[1]
+	if(prim.geom) then prim.mesh_uri = msg.url(nil, prim.geom, "mesh") end
+end
+
 ------------------------------------------------------------------------------------------------------------
 -- AABB param is a table with siz values (min.max) like: { 0, 0, 0, 1, 1, 1 }
 function geom:makeMesh( goname, primdata, pid )
@@ -9,6 +9,7 @@ local gameobject	= require("gltfloader.engine.gameobject")
 local geom 			= require("gltfloader.geometry-utils")
 local meshes 		= require("gltfloader.geometry.meshes")
 local imageutils 	= require("gltfloader.image-utils")
+local texturestreaming = require("gltfloader.texture-streaming")
 
 local b64 			= require("gltfloader.base64")
 local utils			= require("gltfloader.utils")
@@ -51,8 +52,25 @@ local gltfloader = {
 }
 
 ------------------------------------------------------------------------------------------------------------
+-- The mesh objects drawing a node primitive: its instance batches, or its one geom
 
-function gltfloader:processmaterials( model, gochildname, thisnode )
+local function primgeoms( mprim )
+
+	if(mprim == nil) then return {} end
+	return mprim.instance_geoms or { mprim.geom }
+end
+
+-- Material constants are set with go.set, which fails when the material doesn't declare them
+local function setconstant( mesh_uri, name, value )
+
+	return pcall(go.set, mesh_uri, name, value)
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Applies the materials of a node's primitives to their meshes. changed (mesh primitive -> true) 
+--   limits it to those primitives, after a variant switch.
+
+function gltfloader:processmaterials( model, gochildname, thisnode, changed )
 
 	-- Get indices from accessor 
 	local thismesh = thisnode.mesh
@@ -63,9 +81,10 @@ function gltfloader:processmaterials( model, gochildname, thisnode )
 	for k,prim in pairs(prims) do
 
 		-- If it has a material, load it, and set the material 
-		if(prim.material) then 
+		if(prim.material and (changed == nil or changed[prim])) then 
 			local mat = prim.material
-			local mprim = thisnode.prims[k]
+			-- Node primitives are keyed by the 0 based primitive index
+			local mprim = thisnode.prims[k-1]
 			local primmesh = { mesh = prim.primmesh, name = prim.primname }
 
 			if(mat.alpha_mode) then 
@@ -80,15 +99,26 @@ function gltfloader:processmaterials( model, gochildname, thisnode )
 				end
 			end
 			
-			if(mat.base_color_factor) then 
-				local bcolor = mat.base_color_factor
-				local mesh_uri = msg.url(nil, prim.geom, "mesh")
-				model.set_constant(mesh_uri, "tint", vmath.vector4(bcolor[1], bcolor[2], bcolor[3], bcolor[4]) )
+			if(mat.base_color) then 
+				local bcolor = mat.base_color
+				for _, geo in ipairs(primgeoms(mprim)) do
+					local mesh_uri = msg.url(nil, geo, "mesh")
+					setconstant(mesh_uri, "tint", vmath.vector4(bcolor[1], bcolor[2], bcolor[3], bcolor[4]) )
+				end
 			end 
+
+			-- A texture transform that couldn't be baked into the UVs: uv' = uv_transform * uv + uv_offset
+			local uvt = mat.base_color_transform
+			if(uvt) then 
+				for _, geo in ipairs(primgeoms(mprim)) do
+					local mesh_uri = msg.url(nil, geo, "mesh")
+					setconstant(mesh_uri, "uv_transform", vmath.vector4(uvt[1], uvt[2], uvt[4], uvt[5]) )
+					setconstant(mesh_uri, "uv_offset", vmath.vector4(uvt[3], uvt[6], 0, 0) )
+				end
+			end
 			
 			if(mat.base_color_tex) then 
 				local bcolor = mat.base_color_tex
-				bcolor = model.images[1]
 				gltfloader:loadimages( model, mprim, bcolor)
 			end 
 --  
@@ -122,53 +152,18 @@ function gltfloader:processmaterials( model, gochildname, thisnode )
 end 
 
 ------------------------------------------------------------------------------------------------------------
--- Combine AABB's of model with primitives. 
-local function calcAABB( aabb, aabbmin, aabbmax )
-	aabb = aabb or { 
-		min =vmath.vector3(math.huge,math.huge,math.huge), 
-		max =vmath.vector3(-math.huge,-math.huge,-math.huge) 
+-- Native bounds are flat runs of BOUNDS_STRIDE floats: min xyz, max xyz, sphere center xyz, radius
+local BOUNDS_STRIDE = 10
+
+local function makebounds( flat, offset )
+	offset = offset or 0
+	if(flat == nil or flat[offset + 1] > flat[offset + 4]) then return nil end
+	return {
+		min 	= vmath.vector3(flat[offset + 1], flat[offset + 2], flat[offset + 3]),
+		max 	= vmath.vector3(flat[offset + 4], flat[offset + 5], flat[offset + 6]),
+		center 	= vmath.vector3(flat[offset + 7], flat[offset + 8], flat[offset + 9]),
+		radius 	= flat[offset + 10],
 	}
-	aabb.min.x = math.min(aabb.min.x, aabbmin.x)
-	aabb.min.y = math.min(aabb.min.y, aabbmin.y)
-	aabb.min.z = math.min(aabb.min.z, aabbmin.z)
-
-	aabb.max.x = math.max(aabb.max.x, aabbmax.x)
-	aabb.max.y = math.max(aabb.max.y, aabbmax.y)
-	aabb.max.z = math.max(aabb.max.z, aabbmax.z)
-	return aabb
-end
-
-------------------------------------------------------------------------------------------------------------
-
-local function transformAABB(aabb, tform)
-    -- compute 8 corners of the local AABB
-    local corners = {
-       vmath.vector3(aabb.min.x, aabb.min.y, aabb.min.z),
-       vmath.vector3(aabb.max.x, aabb.min.y, aabb.min.z),
-       vmath.vector3(aabb.min.x, aabb.max.y, aabb.min.z),
-       vmath.vector3(aabb.min.x, aabb.min.y, aabb.max.z),
-       vmath.vector3(aabb.min.x, aabb.max.y, aabb.max.z),
-       vmath.vector3(aabb.max.x, aabb.max.y, aabb.min.z),
-       vmath.vector3(aabb.max.x, aabb.min.y, aabb.max.z),
-       vmath.vector3(aabb.max.x, aabb.max.y, aabb.max.z),
-    }
-
-    local newAABB = { 
-        min =vmath.vector3(math.huge, math.huge, math.huge),
-        max =vmath.vector3(-math.huge, -math.huge, -math.huge)
-    }
-
-    for i=1,#corners do
-		local worldCorner = tform * vmath.vector4(corners[i].x, corners[i].y, corners[i].z, 1)
-        newAABB.min.x = math.min(newAABB.min.x, worldCorner.x)
-        newAABB.min.y = math.min(newAABB.min.y, worldCorner.y)
-        newAABB.min.z = math.min(newAABB.min.z, worldCorner.z)
-        newAABB.max.x = math.max(newAABB.max.x, worldCorner.x)
-        newAABB.max.y = math.max(newAABB.max.y, worldCorner.y)
-        newAABB.max.z = math.max(newAABB.max.z, worldCorner.z)
-    end
-
-    return newAABB
 end
 
 ------------------------------------------------------------------------------------------------------------
@@ -189,11 +184,22 @@ function gltfloader:processdata( model, gochildname, thisnode, parent )
 	if(thismesh.primitives == nil) then print("No Primitives?"); return end 
 
 	thisnode.prims = thisnode.prims or {}
+
+	-- Instanced nodes get their instance matrices (relative to the node) in one native buffer
+	if(thisnode.has_instancing and thisnode.instances == nil) then 
+		thisnode.instances, thisnode.instance_count = cgltf.get_node_instances(model.data, thisnode.node_addr)
+		if(thisnode.instances) then 
+			model.stats.instances = model.stats.instances + thisnode.instance_count
+		end
+	end
 	
 	-- collate all primitives (we ignore material separate prims)
-	for pid = 0, thismesh.primitives_count do
+	for pid = 0, thismesh.primitives_count - 1 do
 		local prim = cgltf.get_mesh_primitive(model.data, thismesh.addr, pid)
 
+		-- Primitives are built once per (mesh, primitive) and shared by every node using the mesh
+		local meshkey, cached = cgltf.mesh_cache_get(model.data, thismesh.addr, pid)
+
 		local verts = nil
 		local uvs = nil
 		local normals = nil
@@ -204,109 +210,94 @@ function gltfloader:processdata( model, gochildname, thisnode, parent )
 		local itype = buffer.VALUE_TYPE_UINT16
 		local accessor = nil
 
-		if(acc_idx) then 
-			accessor = cgltf.get_accessor(model.data, acc_idx)
-			local bv = accessor.buffer_view
-			if(bv == nil) then return end 
+		if(cached == nil) then 
+			if(acc_idx) then 
+				accessor = cgltf.get_accessor(model.data, acc_idx)
+				local bv = accessor.buffer_view
+				if(bv == nil) then return end 
 			
-			local bvobj = cgltf.get_buffer_view(bv)
-			print(bvobj.size, bvobj.stride, bvobj.offset, bvobj.type)
-			local ctype = accessor.component_type
-			-- Indices specific - this is default dataset for gltf (I think)
-			if(ctype == cgltf_component_type_r_32u) then 
-				indices = cgltf.get_buffer_view_index_data(bv, 4)
-				itype = buffer.VALUE_TYPE_UINT32
-				print("[Warning] 32 bit index buffer")
-			elseif(ctype == cgltf_component_type_r_32f) then 
-				print("TODO: Support float buffers")
-			elseif(ctype == cgltf_component_type_r_16u or ctype == cgltf_component_type_r_16) then 
-				indices = cgltf.get_buffer_view_index_data(bv, 2)
-				itype = buffer.VALUE_TYPE_UINT16
-			elseif(ctype == cgltf_component_type_r_8u or ctype == cgltf_component_type_r_8) then 
-				indices = cgltf.get_buffer_view_index_data(bv, 1)
-				itype = buffer.VALUE_TYPE_UINT8
-				print("[Warning] 8 bit index buffer")
+				local bvobj = cgltf.get_buffer_view(bv)
+				print(bvobj.size, bvobj.stride, bvobj.offset, bvobj.type)
+				local ctype = accessor.component_type
+				-- Indices specific - this is default dataset for gltf (I think)
+				if(ctype == cgltf_component_type_r_32u) then 
+					indices = cgltf.get_buffer_view_index_data(bv, 4)
+					itype = buffer.VALUE_TYPE_UINT32
+					print("[Warning] 32 bit index buffer")
+				elseif(ctype == cgltf_component_type_r_32f) then 
+					print("TODO: Support float buffers")
+				elseif(ctype == cgltf_component_type_r_16u or ctype == cgltf_component_type_r_16) then 
+					indices = cgltf.get_buffer_view_index_data(bv, 2)
+					itype = buffer.VALUE_TYPE_UINT16
+				elseif(ctype == cgltf_component_type_r_8u or ctype == cgltf_component_type_r_8) then 
+					indices = cgltf.get_buffer_view_index_data(bv, 1)
+					itype = buffer.VALUE_TYPE_UINT8
+					print("[Warning] 8 bit index buffer")
+				else 
+					print("[Error] Unhandled componentType: "..ctype)
+				end
 			else 
-				print("[Error] Unhandled componentType: "..ctype)
-			end
-		else 
-			print("[Error] No indices.")
-			-- No indices generate a tristrip from position count
-			local posidx = prim.attributes[cgltf_attribute_type.position]
-			-- Leave indices nil. The pipeline builder will use triangles by default
+				print("[Error] No indices.")
+				-- No indices generate a tristrip from position count
+				local posidx = prim.attributes[cgltf_attribute_type.position]
+				-- Leave indices nil. The pipeline builder will use triangles by default
 
-			-- geomextension.buildindicestotable( 0, posidx.count, 1, indices)
-		end
+				-- geomextension.buildindicestotable( 0, posidx.count, 1, indices)
+			end
 
-		local aabb = nil
-		for i, attrib in ipairs(prim.attributes) do
-			-- Get position accessor
+			for i, attrib in ipairs(prim.attributes) do
+				-- Get position accessor
 			
-			if(attrib.type == cgltf_attribute_type.position) then 						
-
-				local length = attrib.data.count
-				local float_count = length / 4
-				if(model.counted[attrib] == nil) then
-					model.stats.vertices = model.stats.vertices + float_count / 3
-					model.counted[attrib] = true
-				end
-
-				verts = {}
-				for i = 1, length do 
-					local pos = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 3)
-					tinsert(verts, pos[1])
-					tinsert(verts, pos[2])
-					tinsert(verts, pos[3])
-				end
-
-				-- geomextension.setdataindexfloatstotable( buffer_data, verts, indices, 3)
-				local pos_acc = attrib.data
-				local pmin =vmath.vector3(pos_acc.min[1], pos_acc.min[2], pos_acc.min[3])
-				local pmax =vmath.vector3(pos_acc.max[1], pos_acc.max[2], pos_acc.max[3]) 
-				aabb = calcAABB( aabb, pmin, pmax )
-
-			-- Get uvs accessor
-			elseif(attrib.type == cgltf_attribute_type.texcoord) then 
-
-				local length = attrib.data.count
-				uvs = {}
-				-- uvs = cgltf.cgltf_accessor_read_float_all(attrib.data.addr, 2)
-				for i = 1, length do 
-					local uv = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 2)
-					tinsert(uvs, uv[1])
-					tinsert(uvs, uv[2])
-				end
+				if(attrib.type == cgltf_attribute_type.position) then 						
+
+					local length = attrib.data.count
+					local float_count = length / 4
+					if(model.counted[attrib] == nil) then
+						model.stats.vertices = model.stats.vertices + float_count / 3
+						model.counted[attrib] = true
+					end
+
+					verts = {}
+					for i = 1, length do 
+						local pos = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 3)
+						tinsert(verts, pos[1])
+						tinsert(verts, pos[2])
+						tinsert(verts, pos[3])
+					end
+
+					-- geomextension.setdataindexfloatstotable( buffer_data, verts, indices, 3)
+
+				-- Get uvs accessor
+				elseif(attrib.type == cgltf_attribute_type.texcoord) then 
+
+					local length = attrib.data.count
+					uvs = {}
+					-- uvs = cgltf.cgltf_accessor_read_float_all(attrib.data.addr, 2)
+					for i = 1, length do 
+						local uv = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 2)
+						tinsert(uvs, uv[1])
+						tinsert(uvs, uv[2])
+					end
 								
-				-- geomextension.setdataindexfloatstotable( buffer_data, uvs, indices, 2)
+					-- geomextension.setdataindexfloatstotable( buffer_data, uvs, indices, 2)
 			
-			-- Get normals accessor
-			elseif(attrib.type == cgltf_attribute_type.normal) then 
-
-				local length = attrib.data.count
-				normals = {}
-				for i = 1, length do 
-					local normal = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 3)
-					tinsert(normals, normal[1])
-					tinsert(normals, normal[2])
-					tinsert(normals, normal[3])
-				end
-
-				-- normals = cgltf.get_buffer_view_vertex_data(bv)		
-				-- geomextension.setdataindexfloatstotable( buffer_data, normals, indices, 3)
-			end 
-		end
-
-		if(acc_idx) then 
-			-- Reset indicies, because our buffers are all aligned!
-
-			-- NOTE: Not sure if this is needed. Will need to check
-			-- geomextension.buildindicestotable( 0, acc_idx.count, 1, indices)
+				-- Get normals accessor
+				elseif(attrib.type == cgltf_attribute_type.normal) then 
+
+					local length = attrib.data.count
+					normals = {}
+					for i = 1, length do 
+						local normal = cgltf.cgltf_accessor_read_float(attrib.data.addr, i-1, 3)
+						tinsert(normals, normal[1])
+						tinsert(normals, normal[2])
+						tinsert(normals, normal[3])
+					end
+
+					-- normals = cgltf.get_buffer_view_vertex_data(bv)		
+					-- geomextension.setdataindexfloatstotable( buffer_data, normals, indices, 3)
+				end 
+			end
 		end
-		
-		-- 	local indices	= { 0, 1, 2, 0, 2, 3 }
-		-- 	local verts		= { -sx + offx, 0.0, sy + offy, sx + offx, 0.0, sy + offy, sx + offx, 0.0, -sy + offy, -sx + offx, 0.0, -sy + offy }
-		-- 	local uvs		= { 0.0, 0.0, uvMult, 0.0, uvMult, uvMult, 0.0, uvMult }
-		-- 	local normals	= { 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0, 0.0, 1.0, 0.0 }
 
 		-- Make a submesh for each primitive. This is kinda bad, but.. well.
 		-- print(gochildname)
@@ -321,10 +312,12 @@ function gltfloader:processdata( model, gochildname, thisnode, parent )
 		prim.rot 		= thisnode.rot
 		prim.scl 		= thisnode.scl
 		
-		prim.index_count = accessor.count
-
-		if(indices) then 
+		if(cached) then 
+			prim.index_count = cached.index_count
+			prim.mesh_buffers = geom:GetMesh(meshkey)
+		elseif(indices) then 
 
+			prim.index_count = accessor.count
 			local primdata = {
 				itype = itype, 
 				icount = prim.index_count,
@@ -334,22 +327,38 @@ function gltfloader:processdata( model, gochildname, thisnode, parent )
 				normals = normals, 
 			}
 
-			model.stats.polys = model.stats.polys + primdata.icount / 3
-			prim.mesh_buffers = geom:makeMesh( primmesh, primdata, pid )
+			prim.mesh_buffers = geom:makeMesh( meshkey, primdata, pid )
 			if(prim.mesh_buffers) then 
-
-				geom:makeGeom(primmesh, prim, prim.mesh_buffers)
-				tinsert(model.all_geom, prim.geom)
-				-- print("Added mesh buffer", prim.primmesh)
+				cgltf.mesh_cache_set(model.data, thismesh.addr, pid, prim.mesh_buffers.vbuf.size, prim.index_count)
+				tinsert(model.all_buffers, prim.mesh_buffers.vbuf.label)
 			end
 		else 
 			-- Should habndle vert buffers naively
 			print("Non index buffers?", prim.primmesh)
 		end
 
-		prim.aabb = aabb
-		local tfaabb = transformAABB(prim.aabb, thisnode.transform)
-		model.aabb = calcAABB(model.aabb, tfaabb.min, tfaabb.max)
+		if(prim.mesh_buffers) then 
+			model.stats.polys = model.stats.polys + prim.index_count / 3
+		end
+
+		if(prim.mesh_buffers and thisnode.instances) then 
+
+			geom:makeInstancedGeom(primmesh, prim, prim.mesh_buffers, thisnode.instances, thisnode.instance_count)
+			for _, instgeom in ipairs(prim.instance_geoms) do tinsert(model.all_geom, instgeom) end
+			for _, label in ipairs(prim.instance_buffers) do tinsert(model.all_buffers, label) end
+		elseif(prim.mesh_buffers) then 
+
+			geom:makeGeom(primmesh, prim, prim.mesh_buffers)
+			tinsert(model.all_geom, prim.geom)
+			-- print("Added mesh buffer", prim.primmesh)
+		end
+
+		-- Local bounds from the actual position data (accessor min/max are optional)
+		local bounds = makebounds(cgltf.get_primitive_bounds(prim.addr))
+		if(bounds) then 
+			prim.aabb = { min = bounds.min, max = bounds.max }
+			prim.sphere = { center = bounds.center, radius = bounds.radius }
+		end
 
 		-- go.set_rotation(vmath.quat(), primgo)
 		-- go.set_position(vmath.vector3(0,0,0), primgo)
@@ -409,7 +418,7 @@ function gltfloader:makeNodeMeshes( model, parent, node )
 end	
 
 ------------------------------------------------------------------------------------------------------------
--- Load images: This is horribly slow at the moment. Will improve.
+-- Load images: create the texture resource from the decoded RGBA8 buffer
 
 function gltfloader:loadimages( model, prim, bcolor )
 
@@ -429,44 +438,29 @@ function gltfloader:loadimages( model, prim, bcolor )
 -- 		end
 
 		-- img = model.image_map[bcolor.id+1]
-		local count = 4 
-		if(bcolor.img.type == "rgb") then count = 3 end
-		local imgsize = bcolor.img.width * bcolor.img.height
-		local tbuffer = buffer.create(imgsize, { {name=hash(bcolor.img.type), type=buffer.VALUE_TYPE_FLOAT32, count=count} } )
-		local tstream = buffer.get_stream(tbuffer, hash(bcolor.img.type))
-
-		-- Fill the buffer stream with some float values
-		local imgbuffer = bcolor.img.buffer
-
-		-- pprint("IMAGE BUFFER LEN:", #imgbuffer, bcolor.img.height * bcolor.img.width * count, count)
-		-- TODO: Use Accessor? or 4bytes -> float?
-		local imagesize = bcolor.img.height * bcolor.img.width * count
-		for pos=0, imagesize - 1 do
-			local val = string.byte(imgbuffer,  pos + 1, pos + 2) / 255.0
-			tstream[pos+1] = val 
+		-- Images are decoded natively to RGBA8 (with their mip chain), so upload as is
+		--   Textures are named by content hash, identical images (in any model) share one resource
+		if(model.stream_textures) then 
+			for _, geo in ipairs(primgeoms(prim)) do texturestreaming.bind(bcolor.img, msg.url(nil, geo, "mesh")) end
+			return bcolor.img
 		end
-		
-		local tparams = {
-			width          = bcolor.img.width,
-			height         = bcolor.img.height,
-			type           = graphics.TEXTURE_TYPE_2D,
-			format         = graphics.TEXTURE_FORMAT_RGBA32F,
-		}
-		if(count == 3) then tparams.format = graphics.TEXTURE_FORMAT_RGB32F end
 
-		local texture_name = string.format("/texture_%03d.texturec", bcolor.id)
+		local texture_name = bcolor.img.texture_name or string.format("/texture_%03d.texturec", bcolor.id)
 
 		local success, result = pcall(resource.get_texture, texture_name)
 		local my_texture = hash(texture_name)
 		if not success then
-			my_texture = resource.create_texture(texture_name, tparams, tbuffer)
+			if(bcolor.img.tbuffer == nil) then 
+				print("[Error] Shared texture is not loaded: "..texture_name)
+				return bcolor.img
+			end
+			my_texture = imageutils.createtexture(texture_name, bcolor.img)
 		end   
 		
 		bcolor.img.texture_id = my_texture
-		bcolor.img.tbuffer = tbuffer 
 		-- local temp = hash("/builtins/assets/images/logo/logo_blue_256.texturec")
-		if(prim and prim.geom) then 
-			go.set(prim.mesh_uri, "texture0", bcolor.img.texture_id)
+		for _, geo in ipairs(primgeoms(prim)) do 
+			go.set(msg.url(nil, geo, "mesh"), "texture0", bcolor.img.texture_id)
 		end
 	end
 	return bcolor.img
@@ -482,6 +476,21 @@ function gltf_parse_buffers(model)
 		return nil
 	end
 
+	-- Draco compressed primitives are decoded on worker threads and attached to their accessors,
+	--   so the rest of the loader reads them like any other accessor data.
+	local draco_job = cgltf.draco_decode(model.data)
+	if(draco_job) then 
+		local decoded = cgltf.draco_wait(draco_job)
+		print("[Info] Draco primitives decoded: "..tostring(decoded))
+	end
+
+	-- KHR_texture_transform is baked into the UVs where a UV set is only read with one transform.
+	--   The rest keep it, and the material passes it to the shader (see gltfloader:processmaterials).
+	local baked, remaining = cgltf.bake_texture_transforms(model.data)
+	if(baked > 0 or remaining > 0) then 
+		print("[Info] Texture transforms baked: "..tostring(baked).."  left to the shader: "..tostring(remaining))
+	end
+
 	-- Buffer views and buffers are now loaded ok. Ready for parsing.
 end	
 
@@ -549,6 +558,51 @@ function gltf_parse_images(model)
 
 	local image_map = {}
 	model.images = {}
+
+	-- All images are decoded together on the native worker pool, straight into RGBA8 buffers
+	--   with their full mip chain (sRGB filtered for color maps). Images over max_texture_size or
+	--   the texture budget are downscaled before anything is uploaded.
+	--   KTX2 images (KHR_texture_basisu) stay compressed in a format this platform supports.
+	--   When streaming, the load doesn't wait: records are filled in by texturestreaming.update.
+	--   Only images the scene can reach (with model.variant's materials) are decoded, the rest are
+	--   left for gltfloader:load_variant_images. Separate occlusion and metallic-roughness maps are
+	--   packed into one ORM image unless asset.pack_orm is false. asset.linear_textures converts
+	--   color maps to linear and asset.premultiply_alpha premultiplies blended base color maps.
+	--   asset.pack_normals keeps only x and y of normal maps, in bc5/eac_rg/rg8 (see supportedformats).
+	--   asset.atlas_textures packs small base color maps into one atlas first (see README).
+	--   asset.compress_textures block compresses the rest (bc1/bc3 or etc1/etc2), kept on disk so
+	--   later runs upload the blocks straight away.
+	local decoded = {}
+	local reachable = cgltf.reachable_images(model.data, nil, model.variant)
+	local reached = {}
+	for i, index in ipairs(reachable) do reached[index] = true end
+	local atlased = {}
+	if(model.atlas_textures) then 
+		local options = type(model.atlas_textures) == "table" and model.atlas_textures or {}
+		local atlas = cgltf.atlas_build(model.data, model.basepath, { 
+			images = reachable, mips = true, max_size = model.max_texture_size,
+			max_image_size = options.max_image_size, size = options.size, padding = options.padding,
+		})
+		if(atlas) then 
+			local image = imageutils.makeimage("atlas", atlas.buffer, atlas.width, atlas.height, atlas.images[1], atlas.levels )
+			image.img.bytes = atlas.bytes
+			image.img.texture_name = atlas.texture
+			for i, index in ipairs(atlas.images) do atlased[index] = image end
+			local rest = {}
+			for i, index in ipairs(reachable) do 
+				if(atlased[index] == nil) then tinsert(rest, index) end
+			end
+			reachable = rest
+		end
+	end
+	local formats = model.texture_formats or imageutils.supportedformats()
+	local image_job, orm_pairs = cgltf.images_decode(model.data, model.basepath, { 
+		mips = true, max_size = model.max_texture_size, formats = formats, images = reachable, pack_orm = model.pack_orm ~= false,
+		linearize = model.linear_textures, premultiply = model.premultiply_alpha, pack_normals = model.pack_normals,
+		compress = model.compress_textures, cache_path = model.texture_cache_path,
+	})
+	if(image_job and not model.stream_textures) then decoded = cgltf.images_wait(image_job) end
+
 	local image_count = cgltf.get_images_count(model.data)
 	for i=0, image_count -1 do 
 		local img = cgltf.get_image_index(model.data, i)
@@ -557,35 +611,81 @@ function gltf_parse_images(model)
 		local image = nil
 		local imagename = cgltf.get_image_name(model.data, img)
 		local img_uri = cgltf.get_image_uri(img)
-		if(img_uri) then 
-			local filepath = model.basepath..tostring(img_uri)
-			image = imageutils.loadimage(imagename, filepath, i+1 )
-		else 
-			local bv = cgltf.get_image_buffer_view(img)
-			local bvsize = cgltf.get_buffer_view_size(bv)
-			local bufptr = cgltf.cgltf_buffer_view_data(bv)
-			image = imageutils.loadimagebuffer(imagename, bufptr, bvsize, i+1 )
-			pprint(image)
+		local result = decoded[i+1]
+		if(atlased[i+1]) then 
+			image = atlased[i+1]
+		elseif(not reached[i+1]) then 
+			result = { skipped = true }
+		elseif(image_job and model.stream_textures) then 
+			image = imageutils.makeimage(imagename, nil, 0, 0, i+1 )
+		elseif(result and result.skipped) then 
+			-- fallback of a KTX2 image that decoded fine
+		elseif(result) then 
+			image = imageutils.makeimage(imagename, result.buffer, result.width, result.height, i+1, result.levels, result.format )
+			image.img.bytes = result.bytes
+			image.img.texture_name = result.texture
+			image.img.linear, image.img.premultiplied = result.linear, result.premultiplied
 		end
 		if(image) then 
 			model.images[i+1] = image
-		else
+		elseif(result == nil or not result.skipped) then
 			pprint(string.format("[Error] Failed to add image: %s  uri: %s",imagename, img_uri))
 		end
-		collectgarbage("collect")
 	end
 
-	-- Loade images into texture slots! 
+	-- ORM images follow the model's images, one record per packed pair
+	model.orm_images = {}
+	model.orm_members = {}
+	for i, pair in ipairs(orm_pairs or {}) do 
+		local result = decoded[pair.index]
+		local image = nil
+		if(model.stream_textures) then 
+			image = imageutils.makeimage("orm", nil, 0, 0, pair.index )
+		elseif(result) then 
+			image = imageutils.makeimage("orm", result.buffer, result.width, result.height, pair.index, result.levels, result.format )
+			image.img.bytes = result.bytes
+			image.img.texture_name = result.texture
+			image.img.linear, image.img.premultiplied = result.linear, result.premultiplied
+		end
+		if(image) then 
+			model.images[pair.index] = image
+			model.orm_images[pair.occlusion..":"..pair.metallic_roughness] = image
+			model.orm_members[pair.occlusion] = true
+			model.orm_members[pair.metallic_roughness] = true
+		end
+	end
+
+	model.image_map = image_map
+	gltf_map_textures(model)
+
+	if(image_job and model.stream_textures) then texturestreaming.start(model, image_job) end
+end
+
+-- --------------------------------------------------------------------------------------------------------
+-- Load images into texture slots! 
+function gltf_map_textures(model)
+
+	local image_map = model.image_map
 	model.textures = {}
 	model.textures_map = {}
+	model.texture_images = {}
+	model.stats.textures = 0
 	local textures_count = cgltf.get_textures_count(model.data)
 	for i = 0, textures_count-1 do
 		local tex = cgltf.get_texture_index(model.data, i)
 		local tex_image = cgltf.get_texture_image(tex)
 		local img_id = image_map[get_addr(tex_image)]
+		-- KHR_texture_basisu: use the KTX2 image unless it failed
+		--   When streaming that isn't known yet, a decoded fallback fills in the KTX2 image's record.
+		local basisu_image = cgltf.get_texture_basisu_image(tex)
+		if(basisu_image and model.images[image_map[get_addr(basisu_image)]]) then 
+			img_id = image_map[get_addr(basisu_image)]
+			if(model.stream_textures) then model.image_fallbacks[image_map[get_addr(tex_image)] or -1] = img_id end
+		end
 		local tex_img = model.images[img_id]
 		local texaddr = get_addr(tex)
 		model.textures_map[texaddr] = tex_img
+		model.texture_images[texaddr] = image_map[get_addr(tex_image)]
     	tinsert(model.textures, tex_img)
 		model.stats.textures = model.stats.textures + 1
 	end	
@@ -619,9 +719,18 @@ function gltf_parse_materials(model)
 			}
 
 			scene_mat.base_color_tex = model.textures_map[get_addr(src.base_color_texture)]
+			scene_mat.base_color_transform = src.base_color_transform
 			scene_mat.metallic_roughness_tex = model.textures_map[get_addr(src.metallic_roughness_texture)]
+			-- A packed ORM image stands in for both the occlusion and metallic-roughness maps
+			local occlusion_id = model.texture_images[get_addr(gltf_mat.occlusion_texture)]
+			local mr_id = model.texture_images[get_addr(src.metallic_roughness_texture)]
+			local orm = occlusion_id and mr_id and model.orm_images[occlusion_id..":"..mr_id]
+			if(orm) then 
+				scene_mat.orm_tex = orm
+				scene_mat.metallic_roughness_tex = orm
+			end
 			scene_mat.normal_tex = model.textures_map[get_addr(gltf_mat.normal_texture)]
-			scene_mat.occulusion_tex = model.textures_map[get_addr(gltf_mat.occlusion_texture)]
+			scene_mat.occulusion_tex = scene_mat.orm_tex or model.textures_map[get_addr(gltf_mat.occlusion_texture)]
 			scene_mat.emissive_tex = model.textures_map[get_addr(gltf_mat.emissive_texture)]
 		end 
 		model.materials_map[ get_addr(gltf_mat.addr) ] = scene_mat
@@ -646,10 +755,12 @@ function gltf_parse_meshes(model)
         mesh.num_primitives = gltf_mesh.primitives_count
 		for prim_index = 0,  mesh.num_primitives-1 do
 			local gltf_prim = cgltf.get_mesh_primitive(model.data, gltf_mesh.addr, prim_index)
-			local mat_handle = get_addr(gltf_prim.material)
+			-- KHR_materials_variants: the active variant's material replaces the default one
+			local mat_handle = get_addr(cgltf.get_primitive_material(gltf_prim.addr, model.variant))
             local prim = {
 				prim = gltf_prim,
 				material = model.materials_map[mat_handle],
+				material_handle = mat_handle,
 				indices = gltf_prim.indices,
 				type = gltf_prim.type,
 				attributes = {},
@@ -683,6 +794,10 @@ local function gltf_parse_nodes(model, node)
 		newnode.mesh = model.meshes_map[get_addr(node.mesh)]
 		newnode.transform = build_transform_for_gltf_node(node)
 		newnode.pos, newnode.rot, newnode.scl = get_posrotscl(node)
+		newnode.node_addr = node.addr
+		newnode.node_index = node.index
+		if (get_addr(node.skin)) then newnode.skin = node.skin end
+		newnode.has_instancing = node.has_instancing
 		tinsert(model.scene.nodes, newnode)
 	end
 	model.stats.nodes = model.stats.nodes + 1 
@@ -714,6 +829,18 @@ function gltfloader:load( model, scene, pobj, meshname )
 	return pobj
 end
 
+-- --------------------------------------------------------------------------------------------------------
+-- Where encoded textures are kept between runs: asset.texture_cache is a path prefix, or false to
+--   turn the disk cache off. By default the files go in the app's save directory.
+
+local function texturecachepath( asset )
+
+	if(not asset.compress_textures and not asset.pack_normals) then return nil end
+	if(asset.texture_cache == false) then return nil end
+	if(type(asset.texture_cache) == "string") then return asset.texture_cache end
+	return sys.get_save_file("gltfloader", "texture_")
+end
+
 -- --------------------------------------------------------------------------------------------------------
 -- This is a special version of load that allows the loading of a single mesh into a gameobject manager
 
@@ -741,14 +868,28 @@ function gltfloader:load_gltf( assetfilename, asset, disableaabb )
 	local model = {
 		filename = assetfilename,
 		basepath = basepath,
+		max_texture_size = asset.max_texture_size,
+		texture_formats = asset.texture_formats,
+		stream_textures = asset.stream_textures,
+		variant = asset.variant,
+		pack_orm = asset.pack_orm,
+		linear_textures = asset.linear_textures,
+		premultiply_alpha = asset.premultiply_alpha,
+		pack_normals = asset.pack_normals,
+		atlas_textures = asset.atlas_textures,
+		compress_textures = asset.compress_textures,
+		texture_cache_path = texturecachepath(asset),
+		image_fallbacks = {},
 		data = data,
 		all_geom = {},
+		all_buffers = {},
 		stats = {
 			vertices = 0,
 			polys = 0,
 			textures = 0,
 			nodes = 0,
 			primitives = 0,
+			instances = 0,
 		},
 		counted = {},
 	}
@@ -770,10 +911,13 @@ function gltfloader:load_gltf( assetfilename, asset, disableaabb )
 	-- 	ozzanim.loadgltf( "--file="..assetfilename )
 	-- end
 
-	model.aabb = { 
-		min = vmath.vector3(math.huge,math.huge,math.huge), 
-		max = vmath.vector3(-math.huge,-math.huge,-math.huge) 
-	}
+	-- World bounds for every node subtree and the scene, computed natively
+	model.bounds = cgltf.compute_bounds(model.data)
+	local scene_bounds = makebounds(model.bounds and model.bounds.scene)
+	if(scene_bounds) then 
+		model.aabb = { min = scene_bounds.min, max = scene_bounds.max }
+		model.sphere = { center = scene_bounds.center, radius = scene_bounds.radius }
+	end
 
 	if(asset.format == "gltf" or asset.format == "glb") then 
 		asset.go = gameobject.create( nil, asset.name )
@@ -793,6 +937,260 @@ function gltfloader:load_gltf( assetfilename, asset, disableaabb )
 	return model
 end
 
+------------------------------------------------------------------------------------------------------------
+-- Global texture memory budget in bytes, shared by all loads (0 or nil turns it off). Images that
+--   don't fit are downscaled at decode time. Per load limits use asset.max_texture_size.
+
+function gltfloader:set_texture_budget( bytes )
+
+	cgltf.set_texture_budget(bytes or 0)
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Switch to a KHR_materials_variants variant (0 based, nil for the default materials): decode the
+--   images it needs that the load skipped, refresh the texture and material tables, and rebind the
+--   primitives whose material the switch changed. Returns the number of images decoded.
+
+function gltfloader:load_variant_images( model, variant )
+
+	local missing = {}
+	for i, index in ipairs(cgltf.reachable_images(model.data, nil, variant)) do 
+		if(model.images[index] == nil and not model.orm_members[index]) then tinsert(missing, index) end
+	end
+	model.variant = variant
+
+	local count = 0
+	if(#missing > 0) then 
+		local formats = model.texture_formats or imageutils.supportedformats()
+		local image_job = cgltf.images_decode(model.data, model.basepath, { 
+			mips = true, max_size = model.max_texture_size, formats = formats, images = missing,
+			linearize = model.linear_textures, premultiply = model.premultiply_alpha, pack_normals = model.pack_normals,
+			compress = model.compress_textures, cache_path = model.texture_cache_path,
+		})
+		local decoded = image_job and cgltf.images_wait(image_job) or {}
+		for i, index in ipairs(missing) do 
+			local result = decoded[index]
+			if(result and not result.skipped) then 
+				local img = cgltf.get_image_index(model.data, index - 1)
+				local image = imageutils.makeimage(cgltf.get_image_name(model.data, img), result.buffer, result.width, result.height, index, result.levels, result.format )
+				image.img.bytes = result.bytes
+				image.img.texture_name = result.texture
+				image.img.linear, image.img.premultiplied = result.linear, result.premultiplied
+				model.images[index] = image
+				count = count + 1
+			end
+		end
+	end
+	gltf_map_textures(model)
+	gltf_parse_materials(model)
+
+	-- Primitives take the refreshed material tables, the ones with a new material are rebound
+	local changed = {}
+	for m, mesh in ipairs(model.scene.meshes) do 
+		for k, prim in ipairs(mesh.primitives) do 
+			local mat_handle = get_addr(cgltf.get_primitive_material(prim.prim.addr, variant))
+			if(mat_handle ~= prim.material_handle) then changed[prim] = true end
+			prim.material = model.materials_map[mat_handle]
+			prim.material_handle = mat_handle
+		end
+	end
+	if(next(changed)) then 
+		for n, node in ipairs(model.scene.nodes) do 
+			if(node.mesh and node.prims) then self:processmaterials(model, node.goname, node, changed) end
+		end
+	end
+	return count
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Texture streaming (asset.stream_textures): call once per frame to upload decoded textures,
+--   bytes_per_frame limits how much texture data goes up in one frame.
+
+function gltfloader:update()
+
+	texturestreaming.update()
+end
+
+function gltfloader:set_upload_budget( bytes_per_frame )
+
+	texturestreaming.set_upload_budget(bytes_per_frame)
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Drop the model's references to its (content hashed, shared) textures. A texture resource is only
+--   released once no loaded model uses it.
+
+function gltfloader:release_textures( model )
+
+	if(model.images == nil) then return end
+	for i, image in pairs(model.images) do 
+		local texture_name = image.img.texture_name
+		if(texture_name and cgltf.texture_release(texture_name)) then 
+			pcall(resource.release, texture_name)
+			texturestreaming.released(texture_name)
+		end
+		image.img.texture_name = nil
+	end
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Unload a model: stops its animation and texture streaming, deletes its mesh objects and releases
+--   its vertex buffers and textures, then frees the native data with cgltf.cgltf_free (which also
+--   frees its poses, skins, morph targets and mesh cache). The model can't be used afterwards.
+
+function gltfloader:unload( model )
+
+	if(model.data == nil) then return end
+	self:stop(model)
+
+	local mesh_uris = {}
+	for i, geo in ipairs(model.all_geom) do tinsert(mesh_uris, msg.url(nil, geo, "mesh")) end
+	texturestreaming.stop(model, mesh_uris)
+	self:release_textures(model)
+
+	for i, geo in ipairs(model.all_geom) do go.delete(geo) end
+	for i, label in ipairs(model.all_buffers) do pcall(resource.release, label) end
+	model.all_geom = {}
+	model.all_buffers = {}
+
+	cgltf.cgltf_free(model.data)
+	model.data = nil
+	model.pose = nil
+	model.anim_instance = nil
+end
+
+------------------------------------------------------------------------------------------------------------
+-- World bounds of a node (including its children) from model.bounds. Returns nil for empty nodes.
+--   node is a loader node (model.scene.nodes, carries node_index) or a cgltf node table (index).
+
+function gltfloader:get_node_bounds( model, node )
+
+	local index = node.node_index or node.index
+	if(model.bounds == nil or index == nil) then return nil end
+	return makebounds(model.bounds.nodes, index * BOUNDS_STRIDE)
+end
+
+------------------------------------------------------------------------------------------------------------
+-- Animation: clips are evaluated natively into a pose (local translation, rotation, scale of every 
+--   node). get_animations lists the clips { name, duration, channels }, animate samples clip (1 based) 
+--   at time (seconds, looped) and moves the model's mesh objects to the pose.
+
+function gltfloader:get_animations( model )
+
+	return cgltf.animation_clips(model.data)
+end
+
+local function applypose( model )
+
+	for n, node in ipairs(model.scene.nodes) do
+		local tx, ty, tz, rx, ry, rz, rw, sx, sy, sz = cgltf.pose_get_node(model.pose, node.node_index)
+		-- A skinned mesh follows its joints, not its node
+		for pid, prim in pairs(node.skin == nil and node.prims or {}) do 
+			-- Instanced geometry bakes the node transform into its instances
+			if(prim.geom and prim.instance_geoms == nil) then 
+				go.set_position(vmath.vector3(tx, ty, tz), prim.geom)
+				go.set_rotation(vmath.quat(rx, ry, rz, rw), prim.geom)
+				go.set_scale(vmath.vector3(sx, sy, sz), prim.geom)
+			end
+		end
+	end
+end
+
+function gltfloader:animate( model, clip, time, loop, weight )
+
+	model.pose = model.pose or cgltf.pose_new(model.data)
+	if(model.pose == nil) then return end
+	cgltf.animation_sample(model.pose, clip, time, loop, weight)
+	applypose(model)
+end
+
+-- Joint palette of a skinned mesh node (a model.scene.nodes entry) for the model's pose, in a buffer 
+--   with a "palette" stream of 12 floats per joint (the top three rows of each joint matrix). The 
+--   buffer is kept on the node and refilled by later calls.
+function gltfloader:get_skin_palette( model, node )
+
+	if(node.skin == nil or model.pose == nil) then return nil end
+	node.palette = cgltf.skin_palette(model.pose, node.skin, node.palette)
+	return node.palette
+end
+
+-- CPU skinning, for materials that can't skin in the vertex shader: rewrites the vertex buffer of 
+--   every skinned mesh from the model's pose. Call after animate or update_animations. threaded 
+--   spreads large meshes over the worker threads. Nodes sharing a skinned mesh share its buffer.
+function gltfloader:skin_meshes( model, threaded )
+
+	if(model.pose == nil) then return end
+	for n, node in ipairs(model.scene.nodes) do
+		local palette = node.skin and self:get_skin_palette(model, node)
+		for pid, prim in pairs(palette and node.prims or {}) do 
+			if(prim.mesh_buffers and prim.geom and prim.instance_geoms == nil) then 
+				local label = prim.mesh_buffers.vbuf.label
+				local buf = resource.get_buffer(label)
+				if(cgltf.skin_primitive(prim.addr, palette, buf, threaded)) then 
+					resource.set_buffer(label, buf)
+					-- Skinned positions are already in the model's space
+					go.set_position(vmath.vector3(), prim.geom)
+					go.set_rotation(vmath.quat(), prim.geom)
+					go.set_scale(vmath.vector3(1, 1, 1), prim.geom)
+				end
+			end
+		end
+	end
+end
+
+-- Morph targets: blends every primitive with targets by its node's weights in the model's pose 
+--   (animated weights channels, or the mesh's default weights) and rewrites its vertex buffer. Call 
+--   after animate or update_animations, and before skin_meshes, which skins the blend of skinned 
+--   nodes instead of the buffer being written here.
+function gltfloader:morph_meshes( model )
+
+	if(model.pose == nil) then return end
+	for n, node in ipairs(model.scene.nodes) do
+		for pid, prim in pairs(node.prims or {}) do 
+			if(prim.targets_count and prim.targets_count > 0 and prim.mesh_buffers and prim.instance_geoms == nil) then 
+				if(node.skin) then 
+					cgltf.morph_primitive(prim.addr, model.pose, node.node_index)
+				else
+					local label = prim.mesh_buffers.vbuf.label
+					local buf = resource.get_buffer(label)
+					if(cgltf.morph_primitive(prim.addr, model.pose, node.node_index, buf)) then 
+						resource.set_buffer(label, buf)
+					end
+				end
+			end
+		end
+	end
+end
+
+-- Crowds: play starts a clip on the model (speed 1 = real time, replacing what it played) and 
+--   update_animations(dt) advances every playing model in one native call per frame.
+local playing = {}
+
+function gltfloader:play( model, clip, speed, loop )
+
+	model.pose = model.pose or cgltf.pose_new(model.data)
+	if(model.pose == nil) then return end
+	if(model.anim_instance) then 
+		cgltf.anim_instance_set(model.anim_instance, { clip = clip, time = 0, speed = speed or 1, loop = loop ~= false })
+	else
+		model.anim_instance = cgltf.anim_instance_new(model.pose, clip, speed, 0, loop)
+	end
+	playing[model] = true
+end
+
+function gltfloader:stop( model )
+
+	if(model.anim_instance) then cgltf.anim_instance_free(model.anim_instance) end
+	model.anim_instance = nil
+	playing[model] = nil
+end
+
+function gltfloader:update_animations( dt )
+
+	cgltf.animate_all(dt)
+	for model in pairs(playing) do applypose(model) end
+end
+
 ------------------------------------------------------------------------------------------------------------
 
 function gltfloader:run_node( model, thisnode, node_func)
@@ -33,6 +33,21 @@ local function make_defaults()
 	imageutils.default_white_image = sg.sg_make_image(img_desc)
 end
 
+-------------------------------------------------------------------------------------------------
+-- Wrap an RGBA8 buffer from cgltf.decode_image in the same image record the loaders produce
+--   levels is the mip table when tbuffer holds a whole mip chain (see cgltf.generate_mips)
+
+local function makeimage(imgname, tbuffer, width, height, tid, levels, format )
+
+	local res = {
+		id 		= tid,
+		img 	= { width = width, height = height, type = format or "rgba", tbuffer = tbuffer, levels = levels }, 
+		name 	= imgname,
+	}
+	imageutils.images[tid] = res
+	return res
+end 
+
 -------------------------------------------------------------------------------------------------
 
 local function loadimage(imgname, imagefilepath, tid )
@@ -64,12 +79,28 @@ end
 
 -------------------------------------------------------------------------------------------------
 
-local function loadimagebuffer(imgname, buf, bufsize, tid )
+-- buf is the encoded image as a string, or a cgltf image (cgltf.get_image_index). A cgltf image
+--   is decoded natively straight from its buffer view, the encoded bytes never become a Lua string.
+
+local function loadimagebuffer(imgname, buf, bufsize, tid, basepath )
 
 	if(buf == nil) then 
 		print("[Image Load Error] imagebuffer is nil.") 
 		return nil
 	end
+
+	if(type(buf) == "userdata") then 
+		local tbuffer, width, height, bytes, texture_name = cgltf.decode_image(buf, basepath)
+		if(tbuffer == nil) then 
+			print("[Image Load Error] Cannot decode image: "..tostring(imgname)) 
+			return nil
+		end
+		local res = makeimage(imgname, tbuffer, width, height, tid)
+		res.img.bytes = bytes
+		-- Content named and cached, gltfloader:release_textures gives the memory back
+		res.img.texture_name = texture_name
+		return res
+	end
 	
 	local img = image.load(buf, {})
 	if(img == nil) then 
@@ -87,11 +118,94 @@ local function loadimagebuffer(imgname, buf, bufsize, tid )
 	return res
 end 
 
+-------------------------------------------------------------------------------------------------
+-- Defold texture formats for the native format names (see cgltf.images_decode). Constants that
+--   this engine version doesn't have are left out.
+
+local texture_formats = {
+	rgba 	= graphics.TEXTURE_FORMAT_RGBA,
+	bc1 	= graphics.TEXTURE_FORMAT_RGB_BC1,
+	bc3 	= graphics.TEXTURE_FORMAT_RGBA_BC3,
+	bc7 	= graphics.TEXTURE_FORMAT_RGBA_BC7,
+	etc1 	= graphics.TEXTURE_FORMAT_RGB_ETC1,
+	etc2 	= graphics.TEXTURE_FORMAT_RGBA_ETC2,
+	astc 	= graphics.TEXTURE_FORMAT_RGBA_ASTC_4x4,
+	-- Two channel normal maps. Defold has no RG8, luminance-alpha has the same layout (y in .a).
+	rg8 	= graphics.TEXTURE_FORMAT_LUMINANCE_ALPHA,
+	bc5 	= graphics.TEXTURE_FORMAT_RG_BC5,
+	eac_rg 	= graphics.TEXTURE_FORMAT_RG_ETC2,
+}
+
+-- Compressed formats KTX2 images can be transcoded to (and compress_textures may encode to) on 
+--   this device. The graphics context is asked natively. Engines that don't hand it out get only 
+--   what every GPU of the platform family samples: BCn on desktop, ETC1 on Android, RGBA8 
+--   elsewhere. ASTC and ETC2 are never guessed, GLES2 devices have neither. Normal maps can be 
+--   encoded to the two channel formats in the list (see asset.pack_normals), rg8 works everywhere.
+local function supportedformats()
+
+	local candidates = cgltf.supported_texture_formats()
+	if(candidates == nil) then 
+		local system = sys.get_sys_info().system_name
+		if(system == "Windows" or system == "Linux" or system == "Darwin") then 
+			candidates = { "bc7", "bc3", "bc1", "bc5", "rg8" }
+		elseif(system == "Android") then 
+			candidates = { "etc1", "rg8" }
+		else 
+			candidates = { "rg8" }
+		end
+	end
+
+	local formats = {}
+	for i, name in ipairs(candidates) do 
+		if(texture_formats[name] and name ~= "rgba") then table.insert(formats, name) end
+	end
+	return formats
+end
+
+-------------------------------------------------------------------------------------------------
+-- Create a texture resource from an image record, uploading every mip level it has. The levels
+--   are RGBA8 or, for KTX2 images, already in the GPU format given by img.type.
+
+local function createtexture(texture_name, img )
+
+	local format = texture_formats[img.type] or graphics.TEXTURE_FORMAT_RGBA
+	local tparams = {
+		width          = img.width,
+		height         = img.height,
+		type           = graphics.TEXTURE_TYPE_2D,
+		format         = format,
+	}
+
+	local levels = img.levels
+	if(levels == nil or #levels < 2) then 
+		return resource.create_texture(texture_name, tparams, img.tbuffer)
+	end
+
+	-- The chain is one contiguous buffer, set_texture takes one buffer per level
+	tparams.num_mip_maps = #levels
+	local texture = resource.create_texture(texture_name, tparams, cgltf.mip_level(img.tbuffer, levels[1]))
+	for i = 2, #levels do 
+		local level = levels[i]
+		resource.set_texture(texture_name, {
+			type 	= graphics.TEXTURE_TYPE_2D,
+			width 	= level.width,
+			height 	= level.height,
+			format 	= format,
+			mipmap 	= i - 1,
+		}, cgltf.mip_level(img.tbuffer, level))
+	end
+	return texture
+end 
+
 -------------------------------------------------------------------------------------------------
 
 imageutils.make_defaults 	= make_defaults
 imageutils.loadimage 		= loadimage
 imageutils.loadimagebuffer 	= loadimagebuffer
+imageutils.makeimage 		= makeimage
+imageutils.createtexture 	= createtexture
+imageutils.supportedformats = supportedformats
+imageutils.formats 			= texture_formats
 imageutils.image_id			= image_id
 
 -------------------------------------------------------------------------------------------------
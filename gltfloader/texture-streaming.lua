@@ -0,0 +1,303 @@
+-------------------------------------------------------------------------------------------------
+-- Progressive texture streaming
+--   Materials get a 1x1 placeholder straight away. Images decode on the native worker pool while
+--   the game runs, and each texture is then uploaded smallest mip first: the 1x1 level (the
+--   average color), then one level larger per step until it is full size. Steps are round robin
+--   across textures and limited by a per-frame upload budget, so upgrades don't cause hitches.
+--   Call texturestreaming.update() once per frame (gltfloader:update does).
+
+local imageutils 	= require("gltfloader.image-utils")
+
+local texturestreaming = {
+	upload_budget 	= 1024 * 1024, 	-- bytes per frame, at least one step always runs
+	models 			= {},			-- models whose images are still decoding
+	queue 			= {},			-- textures with upload steps left
+	users 			= {},			-- texture name -> { mesh_uri, .. } waiting for the texture
+	uploaded 		= {},			-- texture name -> true once its first step is on the GPU
+}
+
+local PLACEHOLDER_NAME = "/gltf_placeholder.texturec"
+
+-------------------------------------------------------------------------------------------------
+-- A shared 1x1 white texture for materials whose image isn't on the GPU yet
+
+local function placeholder()
+
+	if(texturestreaming.placeholder) then return texturestreaming.placeholder end
+	local tbuffer = buffer.create(1, { { name = hash("rgba"), type = buffer.VALUE_TYPE_UINT8, count = 4 } })
+	local stream = buffer.get_stream(tbuffer, hash("rgba"))
+	for i = 1, 4 do stream[i] = 255 end
+	texturestreaming.placeholder = resource.create_texture(PLACEHOLDER_NAME, {
+		width 	= 1,
+		height 	= 1,
+		type 	= graphics.TEXTURE_TYPE_2D,
+		format 	= graphics.TEXTURE_FORMAT_RGBA,
+	}, tbuffer)
+	return texturestreaming.placeholder
+end
+
+-------------------------------------------------------------------------------------------------
+-- Bind a texture to every mesh waiting for it
+
+local function bindusers(texture_name)
+
+	local users = texturestreaming.users[texture_name]
+	if(users == nil) then return end
+	local texture_id = hash(texture_name)
+	for i, mesh_uri in ipairs(users) do
+		go.set(mesh_uri, "texture0", texture_id)
+	end
+	texturestreaming.users[texture_name] = nil
+end
+
+-- Is the texture waiting for (more) upload steps?
+local function queued(texture_name)
+
+	for i, entry in ipairs(texturestreaming.queue) do
+		if(entry.name == texture_name) then return true end
+	end
+	return false
+end
+
+local function adduser(texture_name, mesh_uri)
+
+	-- A texture that exists but was never streamed was created by a load without stream_textures,
+	--   so it's ready to use and nothing will upload it again
+	if(texturestreaming.uploaded[texture_name] == nil and not queued(texture_name) and pcall(resource.get_texture, texture_name)) then
+		texturestreaming.uploaded[texture_name] = true
+	end
+	if(texturestreaming.uploaded[texture_name]) then
+		go.set(mesh_uri, "texture0", hash(texture_name))
+		return
+	end
+	local users = texturestreaming.users[texture_name] or {}
+	table.insert(users, mesh_uri)
+	texturestreaming.users[texture_name] = users
+end
+
+-------------------------------------------------------------------------------------------------
+-- Bytes uploaded by the step that makes level 'top' the largest level
+
+local function stepcost(img, top)
+
+	local levels = img.levels
+	local bytes = 0
+	for i = top, #levels do
+		bytes = bytes + (levels[i].size or levels[i].width * levels[i].height * 4)
+	end
+	return bytes
+end
+
+-- Upload levels top..#levels as the whole texture. Setting level 0 at a new size reallocates it.
+local function uploadstep(entry)
+
+	local img = entry.img
+	local levels = img.levels
+	local top = entry.top
+	local format = imageutils.formats[img.type] or graphics.TEXTURE_FORMAT_RGBA
+	local first = levels[top]
+	if(entry.created == nil) then
+		resource.create_texture(entry.name, {
+			width 			= first.width,
+			height 			= first.height,
+			type 			= graphics.TEXTURE_TYPE_2D,
+			format 			= format,
+			num_mip_maps 	= #levels - top + 1,
+		}, cgltf.mip_level(img.tbuffer, first))
+		entry.created = true
+	else
+		resource.set_texture(entry.name, {
+			type 	= graphics.TEXTURE_TYPE_2D,
+			width 	= first.width,
+			height 	= first.height,
+			format 	= format,
+			mipmap 	= 0,
+		}, cgltf.mip_level(img.tbuffer, first))
+	end
+	for i = top + 1, #levels do
+		local level = levels[i]
+		resource.set_texture(entry.name, {
+			type 	= graphics.TEXTURE_TYPE_2D,
+			width 	= level.width,
+			height 	= level.height,
+			format 	= format,
+			mipmap 	= i - top,
+		}, cgltf.mip_level(img.tbuffer, level))
+	end
+end
+
+-------------------------------------------------------------------------------------------------
+-- Queue a decoded texture. Textures without a mip chain go up in one step.
+
+local function enqueue(texture_name, img)
+
+	local success = pcall(resource.get_texture, texture_name)
+	if(success or queued(texture_name)) then
+		-- Another model uploaded (or is uploading) the same content
+		img.tbuffer = nil
+		return
+	end
+	local top = img.levels and #img.levels or 1
+	table.insert(texturestreaming.queue, { name = texture_name, img = img, top = top })
+end
+
+-------------------------------------------------------------------------------------------------
+-- Apply one decoded result to the model's image record (see cgltf.images_poll)
+
+local function applyresult(model, index, result)
+
+	if(result.skipped) then return end
+	-- A KTX2 fallback is only decoded when the KTX2 image failed, it stands in for that image
+	local image = model.images[result.fallback and model.image_fallbacks[index] or index]
+	if(image == nil) then return end
+	local img = image.img
+
+	img.texture_name = result.texture
+	img.width, img.height = result.width, result.height
+	img.bytes = result.bytes
+	img.linear, img.premultiplied = result.linear, result.premultiplied
+	if(result.buffer) then
+		img.tbuffer = result.buffer
+		img.levels = result.levels
+		img.type = result.format or "rgba"
+		enqueue(result.texture, img)
+	end
+
+	-- Meshes bound before the decode finished now wait on the texture itself
+	for i, mesh_uri in ipairs(img.users or {}) do
+		adduser(result.texture, mesh_uri)
+	end
+	img.users = nil
+end
+
+-------------------------------------------------------------------------------------------------
+-- Start streaming a model's images. image_job is from cgltf.images_decode, and image_fallbacks maps
+--   KTX2 fallback image indices to the KTX2 image index their result stands in for.
+
+local function start(model, image_job)
+
+	model.image_job = image_job
+	model.image_fallbacks = model.image_fallbacks or {}
+	table.insert(texturestreaming.models, model)
+end
+
+-------------------------------------------------------------------------------------------------
+-- Bind an image record to a mesh: the texture if it's up, otherwise the placeholder until it is
+
+local function bind(img, mesh_uri)
+
+	if(img.texture_name) then
+		if(texturestreaming.uploaded[img.texture_name] == nil) then
+			go.set(mesh_uri, "texture0", placeholder())
+		end
+		-- Decoded outside the stream (gltfloader:load_variant_images)
+		if(img.tbuffer) then enqueue(img.texture_name, img) end
+		adduser(img.texture_name, mesh_uri)
+		return
+	end
+	go.set(mesh_uri, "texture0", placeholder())
+	img.users = img.users or {}
+	table.insert(img.users, mesh_uri)
+end
+
+-------------------------------------------------------------------------------------------------
+-- Per frame: collect finished decodes, then upload steps within the budget
+
+local function update()
+
+	for m = #texturestreaming.models, 1, -1 do
+		local model = texturestreaming.models[m]
+		local results, all = cgltf.images_poll(model.image_job)
+		for index, result in pairs(results) do
+			applyresult(model, index, result)
+		end
+		if(all) then
+			cgltf.images_wait(model.image_job)
+			model.image_job = nil
+			table.remove(texturestreaming.models, m)
+		end
+	end
+
+	local budget = texturestreaming.upload_budget
+	local steps = 0
+	while(#texturestreaming.queue > 0) do
+		local entry = texturestreaming.queue[1]
+		local cost = entry.img.levels and stepcost(entry.img, entry.top) or entry.img.width * entry.img.height * 4
+		if(steps > 0 and cost > budget) then break end
+		table.remove(texturestreaming.queue, 1)
+
+		if(entry.img.levels and #entry.img.levels > 1) then
+			uploadstep(entry)
+		else
+			imageutils.createtexture(entry.name, entry.img)
+		end
+		budget = budget - cost
+		steps = steps + 1
+
+		if(texturestreaming.uploaded[entry.name] == nil) then
+			texturestreaming.uploaded[entry.name] = true
+			bindusers(entry.name)
+		end
+		if(entry.top > 1) then
+			entry.top = entry.top - 1
+			table.insert(texturestreaming.queue, entry)
+		else
+			entry.img.tbuffer = nil
+		end
+	end
+end
+
+-------------------------------------------------------------------------------------------------
+
+local function set_upload_budget(bytes)
+	texturestreaming.upload_budget = bytes
+end
+
+-- Forget a released texture, so a later load streams it again
+local function released(texture_name)
+	texturestreaming.uploaded[texture_name] = nil
+	texturestreaming.users[texture_name] = nil
+	for i = #texturestreaming.queue, 1, -1 do
+		if(texturestreaming.queue[i].name == texture_name) then table.remove(texturestreaming.queue, i) end
+	end
+end
+
+-------------------------------------------------------------------------------------------------
+-- Stop streaming a model that is being unloaded. Its decode is waited for, and each finished
+--   image gets its texture name, so releasing the model's textures drops it too. Its meshes
+--   (mesh_uris) stop waiting for textures.
+
+local function stop(model, mesh_uris)
+
+	for m = #texturestreaming.models, 1, -1 do
+		if(texturestreaming.models[m] == model) then table.remove(texturestreaming.models, m) end
+	end
+	if(model.image_job) then
+		for index, result in pairs(cgltf.images_wait(model.image_job)) do
+			local image = not result.skipped and model.images[result.fallback and model.image_fallbacks[index] or index]
+			if(image and image.img.texture_name == nil) then image.img.texture_name = result.texture end
+		end
+		model.image_job = nil
+	end
+
+	local removed = {}
+	for i, mesh_uri in ipairs(mesh_uris) do removed[tostring(mesh_uri)] = true end
+	for texture_name, users in pairs(texturestreaming.users) do
+		for i = #users, 1, -1 do
+			if(removed[tostring(users[i])]) then table.remove(users, i) end
+		end
+	end
+end
+
+-------------------------------------------------------------------------------------------------
+
+texturestreaming.start 				= start
+texturestreaming.bind 				= bind
+texturestreaming.update 			= update
+texturestreaming.set_upload_budget 	= set_upload_budget
+texturestreaming.released 			= released
+texturestreaming.stop 				= stop
+
+return texturestreaming
+
+-------------------------------------------------------------------------------------------------